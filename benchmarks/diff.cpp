@@ -0,0 +1,90 @@
+// Buffer diff benchmark
+// Times ZepBufferDiff on two generated files: the first full diff (hashing every line of both), the update after a
+// single edit, and a full diff with changes scattered through the file.
+// Build with CMAKE_BUILD_TYPE=Release; the default build has no optimization.
+//
+// Usage:
+//   diff_benchmark [-lines N] [-changes N]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "src/buffer.h"
+#include "src/buffer_diff.h"
+#include "src/editor.h"
+
+using namespace Zep;
+
+namespace
+{
+
+std::string GenerateText(long lines, long changes, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::ostringstream str;
+    for (long i = 0; i < lines; i++)
+    {
+        if (changes && (rng() % uint32_t(lines)) < uint32_t(changes))
+        {
+            str << "    changed " << rng() << "\n";
+            continue;
+        }
+        str << "    float x" << i << " = pow(sin(y), 2.0) * floor(" << i << ");\n";
+    }
+    return str.str();
+}
+
+double TimeMs(const std::function<void()>& fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    long lines = 1000000;
+    long changes = 1000;
+    for (int i = 1; i < argc - 1; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-lines")
+        {
+            lines = std::atol(argv[++i]);
+        }
+        else if (arg == "-changes")
+        {
+            changes = std::atol(argv[++i]);
+        }
+    }
+
+    ZepEditor editor;
+    auto pOld = editor.AddBuffer("old.txt");
+    auto pNew = editor.AddBuffer("new.txt");
+    pOld->SetText(GenerateText(lines, 0, 1));
+    pNew->SetText(GenerateText(lines, 0, 1));
+
+    std::shared_ptr<ZepBufferDiff> spDiff;
+    auto ms = TimeMs([&]() { spDiff = std::make_shared<ZepBufferDiff>(editor, pOld, pNew); });
+    printf("%-24s %10ld lines %10.2f ms %8zu hunks\n", "initial_identical", lines, ms, spDiff->GetHunks().size());
+
+    pNew->Insert(pNew->GetLinePos(lines / 2, LineLocation::LineBegin), "inserted\n");
+    ms = TimeMs([&]() { spDiff->Update(); });
+    printf("%-24s %10ld lines %10.2f ms %8zu hunks\n", "update_one_edit", lines, ms, spDiff->GetHunks().size());
+
+    pNew->SetText(GenerateText(lines, changes, 2));
+    ms = TimeMs([&]() { spDiff->Update(); });
+    printf("%-24s %10ld lines %10.2f ms %8zu hunks\n", "update_scattered", lines, ms, spDiff->GetHunks().size());
+
+    spDiff.reset();
+    ms = TimeMs([&]() { spDiff = std::make_shared<ZepBufferDiff>(editor, pOld, pNew); });
+    printf("%-24s %10ld lines %10.2f ms %8zu hunks\n", "initial_scattered", lines, ms, spDiff->GetHunks().size());
+    return 0;
+}
@@ -0,0 +1,382 @@
+// GapBuffer microbenchmarks
+// Measures the GapBuffer against a std::vector and a simple chunked rope, so that decisions about
+// the gap size policy and the storage backend can be made with numbers rather than guesses.
+// Build with CMAKE_BUILD_TYPE=Release; the default build has no optimization.
+//
+// Usage:
+//   gapbuffer_benchmark [-min bytes] [-max bytes] [-gap bytes]
+//
+// Sizes run in powers of 4 from min (default 1KB) to max (default 16MB; pass -max 1073741824 for 1GB).
+// Output is CSV on stdout:
+//   container,size_bytes,operation,ops,ns_per_op,mb_per_s,overhead_bytes
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/gap_buffer.h"
+
+namespace
+{
+
+// A minimal rope: text split into leaves of at most LeafSize bytes, found by walking the leaf sizes.
+// Not a balanced tree, but it has the property that matters here; edits never move more than a leaf.
+class SimpleRope
+{
+public:
+    static const size_t LeafSize = 4096;
+
+    void assign(const char* pBegin, const char* pEnd)
+    {
+        m_leaves.clear();
+        m_size = size_t(pEnd - pBegin);
+        while (pBegin < pEnd)
+        {
+            auto count = std::min(size_t(pEnd - pBegin), LeafSize / 2);
+            m_leaves.emplace_back(pBegin, pBegin + count);
+            pBegin += count;
+        }
+        if (m_leaves.empty())
+        {
+            m_leaves.emplace_back();
+        }
+    }
+
+    size_t size() const { return m_size; }
+
+    void insert(size_t pos, char ch)
+    {
+        size_t offset;
+        auto leaf = Locate(pos, offset);
+        auto& str = m_leaves[leaf];
+        str.insert(str.begin() + offset, ch);
+        m_size++;
+        if (str.size() > LeafSize)
+        {
+            std::string tail(str.begin() + LeafSize / 2, str.end());
+            str.resize(LeafSize / 2);
+            m_leaves.insert(m_leaves.begin() + leaf + 1, tail);
+        }
+    }
+
+    void erase(size_t pos)
+    {
+        size_t offset;
+        auto leaf = Locate(pos, offset);
+        auto& str = m_leaves[leaf];
+        if (offset < str.size())
+        {
+            str.erase(str.begin() + offset);
+            m_size--;
+        }
+        if (str.empty() && m_leaves.size() > 1)
+        {
+            m_leaves.erase(m_leaves.begin() + leaf);
+        }
+    }
+
+    template<class F>
+    void for_each(F fn) const
+    {
+        for (auto& leaf : m_leaves)
+        {
+            for (auto ch : leaf)
+            {
+                fn(ch);
+            }
+        }
+    }
+
+    size_t find(char ch) const
+    {
+        size_t base = 0;
+        for (auto& leaf : m_leaves)
+        {
+            auto found = leaf.find(ch);
+            if (found != std::string::npos)
+            {
+                return base + found;
+            }
+            base += leaf.size();
+        }
+        return m_size;
+    }
+
+    size_t capacity_bytes() const
+    {
+        size_t total = m_leaves.capacity() * sizeof(std::string);
+        for (auto& leaf : m_leaves)
+        {
+            total += leaf.capacity();
+        }
+        return total;
+    }
+
+private:
+    size_t Locate(size_t pos, size_t& offset) const
+    {
+        for (size_t i = 0; i < m_leaves.size(); i++)
+        {
+            if (pos <= m_leaves[i].size())
+            {
+                offset = pos;
+                return i;
+            }
+            pos -= m_leaves[i].size();
+        }
+        offset = m_leaves.back().size();
+        return m_leaves.size() - 1;
+    }
+
+    std::vector<std::string> m_leaves;
+    size_t m_size = 0;
+};
+
+// Uniform interface over the three containers
+struct GapAdapter
+{
+    static const char* Name() { return "gapbuffer"; }
+    GapAdapter(size_t gap) : buffer(0, int(gap)) {}
+    void assign(const std::vector<char>& src) { buffer.assign(src.begin(), src.end()); }
+    size_t size() const { return buffer.size(); }
+    void insert(size_t pos, char ch) { buffer.insert(buffer.begin() + pos, &ch, &ch + 1); }
+    void erase(size_t pos) { buffer.erase(buffer.begin() + pos); }
+    uint64_t sum() const
+    {
+        uint64_t total = 0;
+        for (auto itr = buffer.begin(); itr != buffer.end(); itr++)
+        {
+            total += uint8_t(*itr);
+        }
+        return total;
+    }
+    size_t find(char ch) const
+    {
+        return size_t(buffer.find_first_of(buffer.begin(), buffer.end(), &ch, &ch + 1) - buffer.begin());
+    }
+    size_t overhead() const { return size_t(buffer.m_pEnd - buffer.m_pStart) - buffer.size(); }
+
+    GapBuffer<char> buffer;
+};
+
+struct VectorAdapter
+{
+    static const char* Name() { return "vector"; }
+    VectorAdapter(size_t) {}
+    void assign(const std::vector<char>& src) { buffer.assign(src.begin(), src.end()); }
+    size_t size() const { return buffer.size(); }
+    void insert(size_t pos, char ch) { buffer.insert(buffer.begin() + pos, ch); }
+    void erase(size_t pos) { buffer.erase(buffer.begin() + pos); }
+    uint64_t sum() const
+    {
+        uint64_t total = 0;
+        for (auto ch : buffer)
+        {
+            total += uint8_t(ch);
+        }
+        return total;
+    }
+    size_t find(char ch) const { return size_t(std::find(buffer.begin(), buffer.end(), ch) - buffer.begin()); }
+    size_t overhead() const { return buffer.capacity() - buffer.size(); }
+
+    std::vector<char> buffer;
+};
+
+struct RopeAdapter
+{
+    static const char* Name() { return "rope"; }
+    RopeAdapter(size_t) {}
+    void assign(const std::vector<char>& src) { buffer.assign(src.data(), src.data() + src.size()); }
+    size_t size() const { return buffer.size(); }
+    void insert(size_t pos, char ch) { buffer.insert(pos, ch); }
+    void erase(size_t pos) { buffer.erase(pos); }
+    uint64_t sum() const
+    {
+        uint64_t total = 0;
+        buffer.for_each([&](char ch) { total += uint8_t(ch); });
+        return total;
+    }
+    size_t find(char ch) const { return buffer.find(ch); }
+    size_t overhead() const { return buffer.capacity_bytes() - buffer.size(); }
+
+    SimpleRope buffer;
+};
+
+volatile uint64_t g_sink = 0;
+
+void Emit(const char* container, size_t size, const char* op, size_t ops, double seconds, size_t bytesTouched, size_t overhead)
+{
+    auto nsPerOp = ops ? (seconds * 1e9) / double(ops) : 0.0;
+    auto mbPerSec = seconds > 0.0 ? (double(bytesTouched) / (1024.0 * 1024.0)) / seconds : 0.0;
+    printf("%s,%zu,%s,%zu,%.2f,%.2f,%zu\n", container, size, op, ops, nsPerOp, mbPerSec, overhead);
+    fflush(stdout);
+}
+
+double Time(const std::function<void()>& fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+// Enough operations to measure, without spending minutes on O(n) containers at large sizes,
+// or growing small buffers far beyond the size being measured
+size_t EditOps(size_t size)
+{
+    auto ops = size_t((256ull * 1024 * 1024) / std::max(size, size_t(1)));
+    return std::max(size_t(64), std::min(std::min(size_t(20000), size / 4), ops));
+}
+
+template<class Container>
+void RunContainer(const std::vector<char>& source, size_t gap)
+{
+    const auto size = source.size();
+    const auto ops = EditOps(size);
+    std::mt19937 rng(1234);
+
+    Container c(gap);
+    c.assign(source);
+    Emit(Container::Name(), size, "initial", 0, 0.0, 0, c.overhead());
+
+    // Typing: a run of inserts, each one after the last
+    {
+        auto pos = size / 2;
+        auto seconds = Time([&]() { for (size_t i = 0; i < ops; i++) { c.insert(pos++, 'x'); } });
+        Emit(Container::Name(), size, "insert_sequential", ops, seconds, ops, c.overhead());
+    }
+
+    // Local: inserts wandering near a point, as when editing a paragraph
+    {
+        auto base = size / 3;
+        std::uniform_int_distribution<size_t> dist(0, 256);
+        auto seconds = Time([&]() { for (size_t i = 0; i < ops; i++) { c.insert(base + dist(rng), 'y'); } });
+        Emit(Container::Name(), size, "insert_local", ops, seconds, ops, c.overhead());
+    }
+
+    // Random: anywhere in the buffer
+    {
+        auto seconds = Time([&]()
+        {
+            for (size_t i = 0; i < ops; i++)
+            {
+                std::uniform_int_distribution<size_t> dist(0, c.size());
+                c.insert(dist(rng), 'z');
+            }
+        });
+        Emit(Container::Name(), size, "insert_random", ops, seconds, ops, c.overhead());
+    }
+
+    {
+        auto base = size / 3;
+        std::uniform_int_distribution<size_t> dist(0, 256);
+        auto seconds = Time([&]() { for (size_t i = 0; i < ops; i++) { c.erase(std::min(base + dist(rng), c.size() - 1)); } });
+        Emit(Container::Name(), size, "erase_local", ops, seconds, ops, c.overhead());
+    }
+
+    {
+        auto seconds = Time([&]()
+        {
+            for (size_t i = 0; i < ops; i++)
+            {
+                std::uniform_int_distribution<size_t> dist(0, c.size() - 1);
+                c.erase(dist(rng));
+            }
+        });
+        Emit(Container::Name(), size, "erase_random", ops, seconds, ops, c.overhead());
+    }
+
+    // Iteration and find throughput over the whole buffer
+    {
+        uint64_t total = 0;
+        auto seconds = Time([&]() { total = c.sum(); });
+        g_sink = g_sink + total;
+        Emit(Container::Name(), c.size(), "iterate", 1, seconds, c.size(), c.overhead());
+    }
+
+    {
+        size_t found = 0;
+        auto seconds = Time([&]() { found = c.find('\x01'); });
+        g_sink = g_sink + found;
+        Emit(Container::Name(), c.size(), "find", 1, seconds, c.size(), c.overhead());
+    }
+}
+
+// The cost of an edit after the cursor jumps a given distance; this is the MoveGap cost
+void RunMoveGap(const std::vector<char>& source, size_t gap)
+{
+    const auto size = source.size();
+    GapAdapter c(gap);
+    c.assign(source);
+
+    for (size_t distance = 16; distance <= size / 2; distance *= 16)
+    {
+        const size_t ops = std::max(size_t(16), std::min(size_t(10000), size_t((256ull * 1024 * 1024) / distance)));
+        size_t pos = 0;
+        auto seconds = Time([&]()
+        {
+            for (size_t i = 0; i < ops; i++)
+            {
+                pos = (i & 1) ? 0 : distance;
+                c.insert(pos, 'm');
+            }
+        });
+        char name[64];
+        snprintf(name, sizeof(name), "movegap_%zu", distance);
+        Emit(GapAdapter::Name(), size, name, ops, seconds, ops * distance, c.overhead());
+    }
+}
+
+std::vector<char> MakeSource(size_t size)
+{
+    std::vector<char> source(size);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> dist('a', 'z');
+    for (size_t i = 0; i < size; i++)
+    {
+        source[i] = (i % 64 == 63) ? '\n' : char(dist(rng));
+    }
+    return source;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    size_t minSize = 1024;
+    size_t maxSize = 16 * 1024 * 1024;
+    size_t gap = GapBuffer<char>::DEFAULT_GAP;
+
+    for (int i = 1; i < argc - 1; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-min")
+        {
+            minSize = size_t(std::strtoull(argv[++i], nullptr, 10));
+        }
+        else if (arg == "-max")
+        {
+            maxSize = size_t(std::strtoull(argv[++i], nullptr, 10));
+        }
+        else if (arg == "-gap")
+        {
+            gap = size_t(std::strtoull(argv[++i], nullptr, 10));
+        }
+    }
+
+    printf("container,size_bytes,operation,ops,ns_per_op,mb_per_s,overhead_bytes\n");
+    for (auto size = std::max(minSize, size_t(1024)); size <= maxSize; size *= 4)
+    {
+        auto source = MakeSource(size);
+        RunContainer<GapAdapter>(source, gap);
+        RunContainer<VectorAdapter>(source, gap);
+        RunContainer<RopeAdapter>(source, gap);
+        RunMoveGap(source, gap);
+    }
+    return 0;
+}
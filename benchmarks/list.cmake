@@ -0,0 +1,19 @@
+SET(BENCHMARK_REPLAY_SOURCES
+benchmarks/replay.cpp
+benchmarks/list.cmake
+)
+
+SET(BENCHMARK_GAPBUFFER_SOURCES
+benchmarks/gap_buffer.cpp
+benchmarks/list.cmake
+)
+
+SET(BENCHMARK_DIFF_SOURCES
+benchmarks/diff.cpp
+benchmarks/list.cmake
+)
+
+SET(BENCHMARK_REGEX_SOURCES
+benchmarks/regex.cpp
+benchmarks/list.cmake
+)
@@ -0,0 +1,108 @@
+// Regex search benchmark
+// Counts every match of a few patterns in a generated buffer, with ZepRegex over the gap buffer and with std::regex
+// over a copy of the text.  The gap is put in the middle of the buffer, so the search has to cross it.
+// Build with CMAKE_BUILD_TYPE=Release; the default build has no optimization.
+//
+// Usage:
+//   regex_benchmark [-lines N]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <regex>
+#include <sstream>
+#include <string>
+
+#include "src/buffer.h"
+#include "src/buffer_regex.h"
+#include "src/editor.h"
+
+using namespace Zep;
+
+namespace
+{
+
+std::string GenerateText(long lines)
+{
+    std::ostringstream str;
+    for (long i = 0; i < lines; i++)
+    {
+        str << "    float x" << i << " = pow(sin(y), 2.0) * floor(" << i << ");";
+        if (i % 1000 == 0)
+        {
+            str << " // TODO: check " << i;
+        }
+        str << "\n";
+    }
+    return str.str();
+}
+
+double TimeMs(const std::function<void()>& fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    long lines = 200000;
+    for (int i = 1; i < argc - 1; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-lines")
+        {
+            lines = std::atol(argv[++i]);
+        }
+    }
+
+    ZepEditor editor;
+    auto pBuffer = editor.AddBuffer("regex.txt");
+    auto text = GenerateText(lines);
+    pBuffer->SetText(text);
+    pBuffer->Insert(pBuffer->GetLinePos(lines / 2, LineLocation::LineBegin), " ");
+    text = pBuffer->GetText().string();
+    text.pop_back();
+
+    // Vim's pattern, then the same for std::regex; which has no multiline mode before C++17, so finds a line start by
+    // the line end before it
+    struct Pattern
+    {
+        const char* name;
+        const char* vim;
+        const char* ecma;
+    };
+    const Pattern patterns[] = {
+        { "literal", "TODO", "TODO" },
+        { "literal_prefix", "TODO: check \\d\\+", "TODO: check \\d+" },
+        { "anchored", "^    float x1\\d*0 ", "\n    float x1\\d*0 " },
+        { "class_start", "[0-9]\\+\\.[0-9]", "[0-9]+\\.[0-9]" },
+        { "alternation", "sin\\|cos\\|tan", "sin|cos|tan" },
+        { "word", "\\<floor\\>", "\\bfloor\\b" },
+    };
+
+    for (auto& pattern : patterns)
+    {
+        ZepRegex regex(pattern.vim);
+        long zepCount = 0;
+        auto zepMs = TimeMs([&]() {
+            regex.ForEachMatch(pBuffer->GetText(), pBuffer->GetLineEnds(), 0, -1, [&](const RegexMatch&) {
+                zepCount++;
+                return true;
+            });
+        });
+
+        long stdCount = 0;
+        auto stdMs = TimeMs([&]() {
+            std::regex stdRegex(pattern.ecma);
+            stdCount = long(std::distance(std::sregex_iterator(text.begin(), text.end(), stdRegex), std::sregex_iterator()));
+        });
+
+        printf("%-16s %10ld lines  zep %10.2f ms %8ld matches   std::regex %10.2f ms %8ld matches  %6.1fx\n",
+            pattern.name, lines, zepMs, zepCount, stdMs, stdCount, stdMs / std::max(zepMs, 0.001));
+    }
+    return 0;
+}
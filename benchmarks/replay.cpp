@@ -0,0 +1,263 @@
+// Headless keystroke replay benchmark
+// Replays key streams through the vim mode into a ZepDisplayNull, timing each key including the
+// edit, the layout and the draw that follows it.  Reports per-key latency percentiles per workload.
+//
+// Usage:
+//   replay_benchmark [-lines N] [-trace keys.txt] [-file source.txt]
+//
+// With no trace, a set of built in workloads is run against a generated file of N lines.
+// A trace can be recorded from a real session with ZepEditor::SetKeyTrace and ZepKeyTrace::Save.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "src/buffer.h"
+#include "src/display.h"
+#include "src/editor.h"
+#include "src/keytrace.h"
+#include "src/mode_vim.h"
+#include "src/utils/encoding.h"
+
+using namespace Zep;
+
+namespace
+{
+
+std::string GenerateText(long lines)
+{
+    std::ostringstream str;
+    for (long i = 0; i < lines; i++)
+    {
+        switch (i % 4)
+        {
+        case 0:
+            str << "uniform vec4 value" << i << "; // A comment on line " << i << "\n";
+            break;
+        case 1:
+            str << "    float x" << i << " = pow(sin(y), 2.0) * floor(" << i << ");\n";
+            break;
+        case 2:
+            str << "    out vec3 color = vec3(x, y, z) + mul(a, b);\n";
+            break;
+        default:
+            str << "\n";
+            break;
+        }
+    }
+    return str.str();
+}
+
+void AddText(ZepKeyTrace& trace, const std::string& text)
+{
+    // A character per key, as ZepMode::AddCommandText sends them
+    const char* p = text.c_str();
+    const char* pEnd = p + text.size();
+    while (p < pEnd)
+    {
+        uint32_t key;
+        p += EncodingUtils::NextChar(p, pEnd, key);
+        trace.Add(key, 0);
+    }
+}
+
+struct Workload
+{
+    std::string name;
+    ZepKeyTrace keys;
+    std::function<void(ZepEditor&)> setup;
+};
+
+std::vector<Workload> BuiltInWorkloads()
+{
+    std::vector<Workload> workloads;
+
+    // Open a line and type some code, 200 times
+    {
+        Workload work;
+        work.name = "insert_typing";
+        for (int i = 0; i < 200; i++)
+        {
+            AddText(work.keys, "ofloat value = 42.0;");
+            work.keys.Add(ExtKeys::ESCAPE, 0);
+        }
+        workloads.push_back(work);
+    }
+
+    // Plain cursor motion
+    {
+        Workload work;
+        work.name = "motion";
+        for (int i = 0; i < 500; i++)
+        {
+            AddText(work.keys, "jw");
+        }
+        for (int i = 0; i < 500; i++)
+        {
+            AddText(work.keys, "kb");
+        }
+        workloads.push_back(work);
+    }
+
+    // Change a word, move on, repeat
+    {
+        Workload work;
+        work.name = "ciw_storm";
+        for (int i = 0; i < 500; i++)
+        {
+            AddText(work.keys, "ciwabc");
+            work.keys.Add(ExtKeys::ESCAPE, 0);
+            AddText(work.keys, "wj");
+        }
+        workloads.push_back(work);
+    }
+
+    // Paste 10k lines from a register, then undo it
+    {
+        Workload work;
+        work.name = "paste_10k_lines";
+        for (int i = 0; i < 10; i++)
+        {
+            AddText(work.keys, "pu");
+        }
+        work.setup = [](ZepEditor& editor)
+        {
+            editor.SetRegister('"', Register(GenerateText(10000), true));
+        };
+        workloads.push_back(work);
+    }
+
+    return workloads;
+}
+
+void Report(const std::string& name, std::vector<double>& samples)
+{
+    if (samples.empty())
+    {
+        printf("%-20s %8d\n", name.c_str(), 0);
+        return;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&](double p)
+    {
+        auto index = size_t(p * double(samples.size() - 1) + 0.5);
+        return samples[std::min(index, samples.size() - 1)];
+    };
+
+    double total = 0.0;
+    for (auto& s : samples)
+    {
+        total += s;
+    }
+
+    printf("%-20s %8d %12.1f %12.1f %12.1f %12.1f\n", name.c_str(), int(samples.size()),
+        total / samples.size(), percentile(0.5), percentile(0.99), samples.back());
+}
+
+void Run(const std::string& name, const std::string& text, const ZepKeyTrace& keys, const std::function<void(ZepEditor&)>& setup)
+{
+    ZepEditor editor;
+    auto pBuffer = editor.AddBuffer("replay.vert");
+    pBuffer->SetText(text);
+
+    ZepDisplayNull display(editor);
+    display.SetDisplaySize(NVec2f(0.0f, 0.0f), NVec2f(1024.0f, 768.0f));
+
+    auto pWindow = display.AddWindow();
+    pWindow->SetCurrentBuffer(pBuffer);
+    display.SetCurrentWindow(pWindow);
+
+    editor.SetMode(VimMode);
+    auto pMode = editor.GetCurrentMode();
+    pMode->SetCurrentWindow(pWindow);
+
+    if (setup)
+    {
+        setup(editor);
+    }
+
+    display.Display();
+
+    std::vector<double> samples;
+    samples.reserve(keys.GetKeys().size());
+    for (auto& entry : keys.GetKeys())
+    {
+        auto start = std::chrono::steady_clock::now();
+        pMode->AddKeyPress(entry.key, entry.modifiers);
+        display.Display();
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+
+    Report(name, samples);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    long lines = 100000;
+    std::string tracePath;
+    std::string filePath;
+
+    for (int i = 1; i < argc - 1; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-lines")
+        {
+            lines = std::atol(argv[++i]);
+        }
+        else if (arg == "-trace")
+        {
+            tracePath = argv[++i];
+        }
+        else if (arg == "-file")
+        {
+            filePath = argv[++i];
+        }
+    }
+
+    std::string text;
+    if (!filePath.empty())
+    {
+        std::ifstream file(filePath, std::ios::in | std::ios::binary);
+        if (!file)
+        {
+            fprintf(stderr, "Could not read %s\n", filePath.c_str());
+            return 1;
+        }
+        std::ostringstream str;
+        str << file.rdbuf();
+        text = str.str();
+    }
+    else
+    {
+        text = GenerateText(lines);
+    }
+
+    printf("%-20s %8s %12s %12s %12s %12s\n", "workload", "keys", "mean_us", "p50_us", "p99_us", "max_us");
+
+    if (!tracePath.empty())
+    {
+        ZepKeyTrace trace;
+        if (!trace.Load(tracePath))
+        {
+            fprintf(stderr, "Could not load trace %s\n", tracePath.c_str());
+            return 1;
+        }
+        Run(tracePath, text, trace, nullptr);
+        return 0;
+    }
+
+    for (auto& work : BuiltInWorkloads())
+    {
+        Run(work.name, text, work.keys, work.setup);
+    }
+    return 0;
+}
@@ -0,0 +1,373 @@
+#include <cstring>
+
+#include "binary_file.h"
+#include "utils/encoding.h"
+#include "utils/fileutils.h"
+#include "utils/trace.h"
+
+namespace Zep
+{
+
+namespace
+{
+const size_t SniffSize = 64 * 1024;
+const char HexDigits[] = "0123456789abcdef";
+}
+
+ZepBinaryFile::ZepBinaryFile(size_t memoryBudget, size_t pageSize)
+    : m_pageSize(std::max(pageSize, size_t(4096))),
+    m_memoryBudget(memoryBudget)
+{
+    m_maxPages = std::max(size_t(2), m_memoryBudget / m_pageSize);
+}
+
+ZepBinaryFile::~ZepBinaryFile()
+{
+    Close();
+}
+
+void ZepBinaryFile::Close()
+{
+    if (m_pFile)
+    {
+        fclose(m_pFile);
+        m_pFile = nullptr;
+    }
+    m_pages.clear();
+    m_lru.clear();
+    m_edits.clear();
+    m_fileSize = 0;
+}
+
+bool ZepBinaryFile::Open(const std::string& path)
+{
+    ZEP_TRACE_SCOPE("ZepBinaryFile::Open");
+
+    Close();
+
+    m_pFile = fopen(path.c_str(), "r+b");
+    m_readOnly = m_pFile == nullptr;
+    if (!m_pFile)
+    {
+        m_pFile = fopen(path.c_str(), "rb");
+    }
+    if (!m_pFile)
+    {
+        return false;
+    }
+
+    m_fileSize = FileUtils::Size(path);
+
+    // Enough digits for the last offset
+    m_offsetDigits = 8;
+    while (m_offsetDigits < 16 && (m_fileSize >> (m_offsetDigits * 4)) != 0)
+    {
+        m_offsetDigits++;
+    }
+    return true;
+}
+
+bool ZepBinaryFile::IsBinaryFile(const std::string& path)
+{
+    auto pFile = fopen(path.c_str(), "rb");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> sample(SniffSize);
+    auto count = fread(sample.data(), 1, SniffSize, pFile);
+    fclose(pFile);
+
+    size_t bomSize = 0;
+    auto encoding = EncodingUtils::Detect(sample.data(), sample.data() + count, bomSize);
+    if (encoding.type == TextEncoding::Utf16LE || encoding.type == TextEncoding::Utf16BE)
+    {
+        return false;
+    }
+    return memchr(sample.data(), 0, count) != nullptr;
+}
+
+size_t ZepBinaryFile::GetResidentBytes() const
+{
+    return m_pages.size() * m_pageSize + m_edits.size() * (sizeof(uint64_t) * 4);
+}
+
+ZepBinaryFile::Page* ZepBinaryFile::GetPage(uint64_t pageIndex)
+{
+    auto itr = m_pages.find(pageIndex);
+    if (itr != m_pages.end())
+    {
+        m_lru.splice(m_lru.begin(), m_lru, itr->second.itrLRU);
+        return &itr->second;
+    }
+
+    if (!m_pFile || pageIndex * m_pageSize >= m_fileSize)
+    {
+        return nullptr;
+    }
+
+    // Evict, reusing the oldest page's memory
+    Page page;
+    if (m_pages.size() >= m_maxPages)
+    {
+        auto oldest = m_lru.back();
+        m_lru.pop_back();
+        page.data.swap(m_pages[oldest].data);
+        m_pages.erase(oldest);
+    }
+
+    page.data.resize(m_pageSize);
+    auto pageStart = pageIndex * m_pageSize;
+    if (!FileUtils::Seek(m_pFile, pageStart))
+    {
+        return nullptr;
+    }
+    auto count = fread(page.data.data(), 1, m_pageSize, m_pFile);
+    if (ferror(m_pFile))
+    {
+        return nullptr;
+    }
+    page.data.resize(count);
+
+    // Edits that aren't saved yet
+    for (auto itrEdit = m_edits.lower_bound(pageStart); itrEdit != m_edits.end() && itrEdit->first < pageStart + count; itrEdit++)
+    {
+        page.data[size_t(itrEdit->first - pageStart)] = itrEdit->second;
+    }
+
+    m_lru.push_front(pageIndex);
+    page.itrLRU = m_lru.begin();
+    auto& inserted = m_pages[pageIndex];
+    inserted = std::move(page);
+    return &inserted;
+}
+
+size_t ZepBinaryFile::Read(uint64_t offset, uint8_t* pData, size_t size)
+{
+    size_t read = 0;
+    while (read < size && offset < m_fileSize)
+    {
+        auto pPage = GetPage(offset / m_pageSize);
+        if (!pPage)
+        {
+            break;
+        }
+
+        auto pageOffset = size_t(offset % m_pageSize);
+        if (pageOffset >= pPage->data.size())
+        {
+            break;
+        }
+        auto count = std::min(size - read, pPage->data.size() - pageOffset);
+        memcpy(pData + read, pPage->data.data() + pageOffset, count);
+        read += count;
+        offset += count;
+    }
+    return read;
+}
+
+int ZepBinaryFile::ByteAtColumn(int column, bool& ascii, bool& high) const
+{
+    ascii = false;
+    high = false;
+    if (column >= AsciiColumn(0))
+    {
+        auto byte = column - AsciiColumn(0);
+        ascii = true;
+        return byte < BytesPerRow ? byte : -1;
+    }
+
+    for (int byte = 0; byte < BytesPerRow; byte++)
+    {
+        auto hex = HexColumn(byte);
+        if (column == hex || column == hex + 1)
+        {
+            high = column == hex;
+            return byte;
+        }
+    }
+    return -1;
+}
+
+long ZepBinaryFile::FormatRows(long firstRow, long count, std::string& str)
+{
+    if (firstRow < 0 || firstRow >= GetRowCount() || count <= 0)
+    {
+        return 0;
+    }
+    count = std::min(count, GetRowCount() - firstRow);
+
+    ZEP_TRACE_SCOPE("ZepBinaryFile::FormatRows");
+
+    std::vector<uint8_t> bytes(size_t(count) * BytesPerRow);
+    auto read = Read(uint64_t(firstRow) * BytesPerRow, bytes.data(), bytes.size());
+
+    // Write each row straight into place; every row is the same length, apart from the ASCII of a short last one
+    const size_t rowLength = size_t(AsciiColumn(BytesPerRow)) + 1;
+    auto start = str.size();
+    str.resize(start + rowLength * size_t(count));
+    auto pOut = &str[start];
+    for (long row = 0; row < count; row++)
+    {
+        auto offset = uint64_t(firstRow + row) * BytesPerRow;
+        auto pRow = pOut;
+        memset(pRow, ' ', rowLength);
+        for (int digit = 0; digit < m_offsetDigits; digit++)
+        {
+            pRow[m_offsetDigits - 1 - digit] = HexDigits[(offset >> (digit * 4)) & 0xF];
+        }
+
+        auto rowBytes = std::min(size_t(BytesPerRow), read - std::min(read, size_t(row) * BytesPerRow));
+        auto pBytes = bytes.data() + size_t(row) * BytesPerRow;
+        for (size_t byte = 0; byte < rowBytes; byte++)
+        {
+            auto value = pBytes[byte];
+            auto pHex = pRow + HexColumn(int(byte));
+            pHex[0] = HexDigits[value >> 4];
+            pHex[1] = HexDigits[value & 0xF];
+            pRow[AsciiColumn(int(byte))] = (value >= 0x20 && value < 0x7F) ? char(value) : '.';
+        }
+
+        pOut = pRow + (rowBytes == 0 ? m_offsetDigits : AsciiColumn(int(rowBytes)));
+        *pOut++ = '\n';
+    }
+
+    // No line end after the last row
+    str.resize(size_t(pOut - &str[0]) - 1);
+    return count;
+}
+
+bool ZepBinaryFile::Overwrite(uint64_t offset, uint8_t value)
+{
+    if (m_readOnly || offset >= m_fileSize)
+    {
+        return false;
+    }
+
+    m_edits[offset] = value;
+
+    // Keep a cached page up to date; one read later gets the edit when it is loaded
+    auto itr = m_pages.find(offset / m_pageSize);
+    if (itr != m_pages.end() && offset % m_pageSize < itr->second.data.size())
+    {
+        itr->second.data[size_t(offset % m_pageSize)] = value;
+    }
+    return true;
+}
+
+// Runs of neighbouring edits go out in one write
+bool ZepBinaryFile::Save()
+{
+    ZEP_TRACE_SCOPE("ZepBinaryFile::Save");
+
+    if (m_readOnly || !m_pFile)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> run;
+    auto itr = m_edits.begin();
+    while (itr != m_edits.end())
+    {
+        auto runStart = itr->first;
+        run.clear();
+        while (itr != m_edits.end() && itr->first == runStart + run.size())
+        {
+            run.push_back(itr->second);
+            itr++;
+        }
+
+        if (!FileUtils::Seek(m_pFile, runStart) || fwrite(run.data(), 1, run.size(), m_pFile) != run.size())
+        {
+            return false;
+        }
+    }
+
+    if (fflush(m_pFile) != 0)
+    {
+        return false;
+    }
+    m_edits.clear();
+    return true;
+}
+
+int64_t ZepBinaryFile::Find(const std::vector<uint8_t>& bytes, uint64_t start, SearchDirection dir)
+{
+    ZEP_TRACE_SCOPE("ZepBinaryFile::Find");
+
+    if (!m_pFile || bytes.empty() || bytes.size() > m_fileSize)
+    {
+        return -1;
+    }
+
+    // Each block overlaps the next by one less than the pattern, so a match can't fall between them
+    const auto patternSize = bytes.size();
+    const auto overlap = patternSize - 1;
+    std::vector<uint8_t> block(m_pageSize + overlap);
+
+    // The last match starting in [pBegin, pEnd - patternSize], or the first
+    auto search = [&](const uint8_t* pBegin, const uint8_t* pEnd, bool last) -> const uint8_t*
+    {
+        const uint8_t* pFound = nullptr;
+        if (size_t(pEnd - pBegin) < patternSize)
+        {
+            return pFound;
+        }
+        auto pLastStart = pEnd - patternSize;
+        for (auto p = pBegin; p <= pLastStart; p++)
+        {
+            p = (const uint8_t*)memchr(p, bytes[0], size_t(pLastStart - p) + 1);
+            if (!p)
+            {
+                break;
+            }
+            if (memcmp(p + 1, bytes.data() + 1, overlap) == 0)
+            {
+                pFound = p;
+                if (!last)
+                {
+                    break;
+                }
+            }
+        }
+        return pFound;
+    };
+
+    if (dir == SearchDirection::Forward)
+    {
+        for (auto pos = start; pos + patternSize <= m_fileSize; pos += m_pageSize)
+        {
+            auto count = Read(pos, block.data(), block.size());
+            if (count < patternSize)
+            {
+                break;
+            }
+            if (auto pFound = search(block.data(), block.data() + count, false))
+            {
+                return int64_t(pos + uint64_t(pFound - block.data()));
+            }
+        }
+        return -1;
+    }
+
+    // Matches starting at or before start
+    auto blockEnd = std::min(start, m_fileSize - patternSize) + patternSize;
+    for (;;)
+    {
+        auto blockStart = blockEnd > block.size() ? blockEnd - block.size() : 0;
+        auto count = Read(blockStart, block.data(), size_t(blockEnd - blockStart));
+        if (auto pFound = search(block.data(), block.data() + count, true))
+        {
+            return int64_t(blockStart + uint64_t(pFound - block.data()));
+        }
+        if (blockStart == 0)
+        {
+            break;
+        }
+        blockEnd = blockStart + overlap;
+    }
+    return -1;
+}
+
+} // Zep
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "buffer.h"
+
+namespace Zep
+{
+
+// Byte level access to a file of any size, for the hex view.
+// Rows are a fixed number of bytes, so a row's offset, and where each byte sits on it, are simple arithmetic; there is
+// no index to build, and opening is immediate.  Pages are read on demand into an LRU cache that stays inside the
+// memory budget.  Edits overwrite single bytes; they are kept aside (and patched into cached pages) until Save()
+// writes them back in place, so the file never has to be rewritten.
+class ZepBinaryFile
+{
+public:
+    static const size_t DefaultPageSize = 256 * 1024;
+    static const size_t DefaultMemoryBudget = 64 * 1024 * 1024;
+    static const int BytesPerRow = 16;
+
+    ZepBinaryFile(size_t memoryBudget = DefaultMemoryBudget, size_t pageSize = DefaultPageSize);
+    ~ZepBinaryFile();
+
+    // Opened for writing if we can, read only if not
+    bool Open(const std::string& path);
+    void Close();
+
+    // A 0 byte near the start, in a file that isn't UTF-16, means the text views can't show it
+    static bool IsBinaryFile(const std::string& path);
+
+    uint64_t GetSize() const { return m_fileSize; }
+    long GetRowCount() const { return std::max(1l, long((m_fileSize + BytesPerRow - 1) / BytesPerRow)); }
+    bool IsReadOnly() const { return m_readOnly; }
+    size_t GetMemoryBudget() const { return m_memoryBudget; }
+    size_t GetResidentBytes() const;
+
+    // A row is the offset, the bytes in hex (in two groups of 8), then the bytes as ASCII; '.' for anything that
+    // isn't printable
+    int GetOffsetDigits() const { return m_offsetDigits; }
+    int HexColumn(int byte) const { return m_offsetDigits + 2 + byte * 3 + (byte >= BytesPerRow / 2 ? 1 : 0); }
+    int AsciiColumn(int byte) const { return m_offsetDigits + BytesPerRow * 3 + 4 + byte; }
+
+    // The byte shown at a column of a row; -1 for the offset and the spaces.  high is set on the first hex digit
+    int ByteAtColumn(int column, bool& ascii, bool& high) const;
+
+    // Appends rows [firstRow, firstRow + count) to str, one per line, without a line end after the last.
+    // Returns the number of rows appended
+    long FormatRows(long firstRow, long count, std::string& str);
+
+    // With any overwritten bytes; returns the number read, which is short at the end of the file
+    size_t Read(uint64_t offset, uint8_t* pData, size_t size);
+
+    bool Overwrite(uint64_t offset, uint8_t value);
+    bool IsModified(uint64_t offset) const { return m_edits.find(offset) != m_edits.end(); }
+    bool IsDirty() const { return !m_edits.empty(); }
+    bool Save();
+
+    // The offset of the first match at or after start (or the last at or before it, going backwards); -1 if none.
+    // memchr finds candidates for the first byte, a block at a time, so memory stays bounded by the block size
+    int64_t Find(const std::vector<uint8_t>& bytes, uint64_t start, SearchDirection dir = SearchDirection::Forward);
+
+private:
+    struct Page
+    {
+        std::vector<uint8_t> data;
+        std::list<uint64_t>::iterator itrLRU;
+    };
+
+    Page* GetPage(uint64_t pageIndex);
+
+    FILE* m_pFile = nullptr;
+    bool m_readOnly = true;
+    uint64_t m_fileSize = 0;
+    int m_offsetDigits = 8;
+    size_t m_pageSize;
+    size_t m_memoryBudget;
+    size_t m_maxPages;
+
+    std::unordered_map<uint64_t, Page> m_pages;
+    std::list<uint64_t> m_lru;              // Most recently used page first
+    std::map<uint64_t, uint8_t> m_edits;    // Overwritten bytes, not yet saved
+};
+
+} // Zep
@@ -2,30 +2,443 @@
 #include <cstdint>
 #include <cstdlib>
 
+#include "binary_file.h"
 #include "buffer.h"
+#include "buffer_brackets.h"
+#include "buffer_regex.h"
+#include "buffer_search.h"
+#include "buffer_trigram.h"
+#include "commands.h"
+#include "file_pager.h"
+#include "journal.h"
+#include "syntax.h"
+#include "utils/diff.h"
+#include "utils/encoding.h"
+#include "utils/fileutils.h"
 #include "utils/stringutils.h"
+#include "utils/trace.h"
 
 #include <algorithm>
-#include <regex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 namespace
 {
+const size_t LoadFirstChunkSize = 64 * 1024;
+const size_t LoadChunkSize = 1024 * 1024;
+const size_t LoadMaxQueuedChunks = 16;
+
+// The classes of a character, for the word motions
+namespace CharClass
+{
+enum : uint8_t
+{
+    Blank = (1 << 0),           // Space or tab
+    Word = (1 << 1),            // Alphanumeric or underscore
+    NonWord = (1 << 2),         // Anything else that isn't white space
+    WORD = (1 << 3),            // Any printable character
+    NonWORD = (1 << 4)          // Anything else that isn't white space
+};
+}
+
 // A VIM-like definition of a word.  Actually, in Vim this can be changed, but this editor
-// assumes a word is alphanumberic or underscore for consistency
-inline bool IsWordChar(const char ch) { return std::isalnum(ch) || ch == '_'; }
-inline bool IsNonWordChar(const char ch) { return (!IsWordChar(ch) && !std::isspace(ch)); }
-inline bool IsWORDChar(const char ch) { return std::isgraph(ch); }
-inline bool IsNonWORDChar(const char ch) { return !IsWORDChar(ch) && !std::isspace(ch); }
-inline bool IsSpace(const char ch) { return std::isblank(ch); }
+// assumes a word is alphanumberic or underscore for consistency.
+// Worked out once for every byte, in the C locale, instead of asking the locale about every character a motion steps over
+struct CharClassTable
+{
+    uint8_t classes[256];
+
+    CharClassTable()
+    {
+        for (int ch = 0; ch < 256; ch++)
+        {
+            bool word = std::isalnum(ch) || ch == '_';
+            bool graph = std::isgraph(ch) != 0;
+            bool space = std::isspace(ch) != 0;
+            classes[ch] = uint8_t((std::isblank(ch) ? CharClass::Blank : 0) |
+                (word ? CharClass::Word : 0) |
+                (!word && !space ? CharClass::NonWord : 0) |
+                (graph ? CharClass::WORD : 0) |
+                (!graph && !space ? CharClass::NonWORD : 0));
+        }
+    }
+};
+const CharClassTable CharClasses;
+
+// The classes of the character at the location.  Just past the end reads as the terminating 0 again, as the motions
+// have always seen it; there is nothing before the start
+uint8_t ClassAt(const GapBuffer<Zep::utf8>& text, long location)
+{
+    if (location < 0 || location > long(text.size()))
+    {
+        return 0;
+    }
+    return CharClasses.classes[location < long(text.size()) ? text[location] : 0];
+}
+
+// Step from start towards limit (which isn't looked at) while the characters are in one of the classes, and return where
+// it stopped.  Runs are walked straight along either side of the gap, not through an iterator checking for it every step
+long SkipClasses(const GapBuffer<Zep::utf8>& text, long start, long limit, uint8_t classes)
+{
+    auto size = long(text.size());
+    auto before = long(text.m_pGapStart - text.m_pStart);
+    if (start < 0 || start > size || (start == size && (start <= limit || !(ClassAt(text, start) & classes))))
+    {
+        return start;
+    }
+    if (start == size)
+    {
+        start--;
+    }
+
+    if (start < limit)
+    {
+        limit = std::min(limit, size);
+        while (start < limit)
+        {
+            auto front = start < before;
+            auto pSegment = front ? text.m_pStart : text.m_pGapEnd;
+            auto offset = front ? 0 : before;
+            auto segmentEnd = front ? std::min(limit, before) : limit;
+            while (start < segmentEnd && (CharClasses.classes[pSegment[start - offset]] & classes))
+            {
+                start++;
+            }
+            if (start < segmentEnd)
+            {
+                break;
+            }
+        }
+    }
+    else
+    {
+        limit = std::max(limit, -1l);
+        while (start > limit)
+        {
+            auto front = start < before;
+            auto pSegment = front ? text.m_pStart : text.m_pGapEnd;
+            auto offset = front ? 0 : before;
+            auto segmentLow = front ? limit : std::max(limit, before - 1);
+            while (start > segmentLow && (CharClasses.classes[pSegment[start - offset]] & classes))
+            {
+                start--;
+            }
+            if (start > segmentLow)
+            {
+                break;
+            }
+        }
+    }
+    return start;
+}
+
+// Where the count'th ch is, stepping from start towards limit (which isn't looked at); -1 if there aren't that many.
+// Forwards, memchr jumps along each side of the gap; there is no portable memrchr, so backwards is a plain loop
+long FindByte(const GapBuffer<Zep::utf8>& text, long start, long limit, Zep::utf8 ch, long count)
+{
+    auto before = long(text.m_pGapStart - text.m_pStart);
+    if (start < limit)
+    {
+        while (start < limit)
+        {
+            auto front = start < before;
+            auto pSegment = front ? text.m_pStart : text.m_pGapEnd;
+            auto offset = front ? 0 : before;
+            auto segmentEnd = front ? std::min(limit, before) : limit;
+            while (start < segmentEnd)
+            {
+                auto pFound = (const Zep::utf8*)memchr(pSegment + start - offset, ch, size_t(segmentEnd - start));
+                if (!pFound)
+                {
+                    start = segmentEnd;
+                    break;
+                }
+                start = long(pFound - pSegment) + offset;
+                if (--count == 0)
+                {
+                    return start;
+                }
+                start++;
+            }
+        }
+        return -1;
+    }
+
+    while (start > limit)
+    {
+        auto front = start < before;
+        auto pSegment = front ? text.m_pStart : text.m_pGapEnd;
+        auto offset = front ? 0 : before;
+        auto segmentLow = front ? limit : std::max(limit, before - 1);
+        for (; start > segmentLow; start--)
+        {
+            if (pSegment[start - offset] == ch && --count == 0)
+            {
+                return start;
+            }
+        }
+    }
+    return -1;
+}
 }
 
 namespace Zep
 {
 
 const char* Msg_Buffer = "Buffer";
+const long ZepBuffer::PagedWindowLines;
+const long ZepBuffer::BinaryWindowRows;
+
+// A piece of a file, read and prepared on the load thread: line ends found, and their carriage returns stripped while
+// the file is DOS
+struct LoadChunk
+{
+    std::vector<utf8> text;
+    std::vector<long> lineEnds;     // Offsets just after each \n, relative to the start of the chunk
+    LineEndFormat format = LineEndFormat::Unknown;  // Of the file, as far as the end of this chunk
+    bool dropCR = false;            // The chunk starts with the \n of a \r\n; the buffer ends with its \r
+    bool restoreCR = false;         // The file isn't DOS after all; the carriage returns stripped so far go back
+};
+
+// Shared between a buffer and its load thread
+struct BufferLoad
+{
+    FILE* pFile = nullptr;
+    std::thread thread;
+    std::atomic<bool> stop = { false };
+    size_t fileSize = 0;
+    std::atomic<size_t> bytesRead = { 0 };
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<LoadChunk> chunks;   // Waiting for the main thread to append them
+    bool finished = false;
+    bool failed = false;
+
+    EncodingUtils::Utf8Decoder decoder; // Used by the load thread, after the first chunk
+    LineEndState lineEnds;              // So is this
+};
+
+// A save running on a worker; it writes a copy of the text, so the buffer can be edited meanwhile
+struct BufferSave
+{
+    std::thread thread;
+    std::string path;
+    std::vector<utf8> text;         // Without the trailing 0
+    bool restoreCR = false;         // Write \r\n line ends
+    FileEncoding encoding;
+    uint64_t revision = 0;          // Of the text we copied
+    std::atomic<bool> finished = { false };
+    bool success = false;
+    bool converted = true;          // False if the encoding couldn't hold the text, so nothing was written
+    FileUtils::FileStamp stamp;     // Of the file we wrote
+};
+
+// The file as we last loaded or saved it
+struct BufferWatch
+{
+    FileUtils::FileWatcher watcher;
+    FileUtils::FileStamp stamp;
+};
+
+// A file being followed; the buffer has everything up to m_fileOffset
+struct BufferFollow
+{
+    FileUtils::FileWatcher watcher;
+    FILE* pFile = nullptr;
+    bool changed = true;    // Check once the load is done, whatever the watcher says
+    LoadChunk chunk;        // Reused between updates
+    EncodingUtils::Utf8Decoder decoder;
+    LineEndState lineEnds;
+
+    ~BufferFollow()
+    {
+        if (pFile)
+        {
+            fclose(pFile);
+        }
+    }
+};
+
+namespace
+{
+// Returns the number of bytes read from the file; the chunk may be smaller once the \r are gone (or bigger, once
+// converted to UTF-8)
+size_t ReadChunk(FILE* pFile, size_t size, LoadChunk& chunk, bool& failed, EncodingUtils::Utf8Decoder& decoder, LineEndState& lineEnds)
+{
+    size_t count;
+    if (decoder.GetType() == TextEncoding::Utf8)
+    {
+        chunk.text.resize(size);
+        count = fread(chunk.text.data(), 1, size, pFile);
+        chunk.text.resize(count);
+    }
+    else
+    {
+        std::vector<uint8_t> raw(size);
+        count = fread(raw.data(), 1, size, pFile);
+        chunk.text.clear();
+        decoder.Decode(raw.data(), raw.data() + count, chunk.text);
+    }
+    failed = ferror(pFile) != 0;
+
+    auto format = lineEnds.format;
+    auto afterCR = lineEnds.afterCR;
+    chunk.text.resize(EncodingUtils::ReadLineEnds(chunk.text.data(), chunk.text.size(), lineEnds, chunk.lineEnds));
+    chunk.format = lineEnds.format;
+    chunk.dropCR = afterCR && lineEnds.format == LineEndFormat::Dos && !chunk.text.empty() && chunk.text[0] == '\n';
+    chunk.restoreCR = format == LineEndFormat::Dos && lineEnds.format == LineEndFormat::Unix;
+    return count;
+}
+
+// A file in another encoding is converted whole, carriage returns and all, before it is opened; so text the encoding
+// can't hold (we return false) leaves the file as it was
+bool EncodeText(const utf8* pStart, const utf8* pEnd, bool restoreCR, const FileEncoding& encoding, std::string& encoded)
+{
+    static const utf8 CRLF[2] = { '\r', '\n' };
+    bool converted = true;
+    while (restoreCR && pStart < pEnd)
+    {
+        auto pLineEnd = (const utf8*)memchr(pStart, '\n', size_t(pEnd - pStart));
+        if (!pLineEnd)
+        {
+            break;
+        }
+        converted = EncodingUtils::Encode(encoding, pStart, pLineEnd, encoded) && converted;
+        EncodingUtils::Encode(encoding, CRLF, CRLF + 2, encoded);
+        pStart = pLineEnd + 1;
+    }
+    return EncodingUtils::Encode(encoding, pStart, pEnd, encoded) && converted;
+}
+
+// UTF-8 goes out as it is, with \r put back before each \n if restoreCR
+void WriteText(FileUtils::FileWriter& writer, const utf8* pStart, const utf8* pEnd, bool restoreCR)
+{
+    if (!restoreCR)
+    {
+        writer.Write(pStart, size_t(pEnd - pStart));
+        return;
+    }
+
+    static const char* CRLF = "\r\n";
+    while (pStart < pEnd)
+    {
+        auto pLineEnd = (const utf8*)memchr(pStart, '\n', size_t(pEnd - pStart));
+        if (!pLineEnd)
+        {
+            writer.Write(pStart, size_t(pEnd - pStart));
+            break;
+        }
+        writer.Write(pStart, size_t(pLineEnd - pStart));
+        writer.Write(CRLF, 2);
+        pStart = pLineEnd + 1;
+    }
+}
+
+// A whole file's text, as read: UTF-8 stays where it is, less any byte order mark; anything else is converted into
+// decoded, and we return true
+bool DecodeFileText(utf8* pText, size_t& size, FileEncoding& encoding, std::vector<utf8>& decoded)
+{
+    size_t bomSize = 0;
+    encoding = EncodingUtils::Detect(pText, pText + size, bomSize);
+    if (encoding.type == TextEncoding::Utf8)
+    {
+        memmove(pText, pText + bomSize, size - bomSize);
+        size -= bomSize;
+        return false;
+    }
+
+    EncodingUtils::Utf8Decoder decoder(encoding.type);
+    decoder.Decode(pText + bomSize, pText + size, decoded);
+    decoder.Finish(decoded);
+    return true;
+}
+
+// The whole file, converted to UTF-8 and with the carriage returns of a DOS file stripped, as the buffer stores it
+bool ReadFileText(const std::string& path, std::string& text, LineEndFormat& format, FileEncoding& encoding)
+{
+    size_t size = 0;
+    if (!FileUtils::ReadFile(path, [&](size_t fileSize)
+    {
+        text.resize(fileSize);
+        return (uint8_t*)&text[0];
+    }, size))
+    {
+        return false;
+    }
+
+    std::vector<utf8> decoded;
+    if (DecodeFileText((utf8*)&text[0], size, encoding, decoded))
+    {
+        text.assign(decoded.begin(), decoded.end());
+    }
+    else
+    {
+        text.resize(size);
+    }
+
+    LineEndState lineEnds;
+    std::vector<long> lines;
+    text.resize(EncodingUtils::ReadLineEnds((utf8*)&text[0], text.size(), lineEnds, lines));
+    format = lineEnds.format;
+    return true;
+}
+
+// Write next to the file, then swap it in; whatever happens, the file has either the old text or the new.
+// A symlink is followed, so the file it points at gets replaced and the link stays.  A file with other hard links
+// is written in place, as Vim does, since swapping in a new one would leave the other names on the old text
+bool WriteFileAtomic(const std::string& path, const std::vector<utf8>& text, bool restoreCR, const FileEncoding& encoding, bool& converted)
+{
+    std::string encoded;
+    converted = encoding.type == TextEncoding::Utf8 || EncodeText(text.data(), text.data() + text.size(), restoreCR, encoding, encoded);
+    if (!converted)
+    {
+        return false;
+    }
+
+    auto target = FileUtils::Canonical(path);
+    bool inPlace = FileUtils::HasOtherLinks(target);
+    auto tempPath = inPlace ? target : target + ".zepsave";
+    FileUtils::FileWriter writer;
+    if (!writer.Open(tempPath))
+    {
+        return false;
+    }
+
+    auto bom = EncodingUtils::ByteOrderMark(encoding);
+    writer.Write(bom, strlen(bom));
+    if (encoding.type == TextEncoding::Utf8)
+    {
+        WriteText(writer, text.data(), text.data() + text.size(), restoreCR);
+    }
+    else
+    {
+        writer.Write(encoded.data(), encoded.size());
+    }
+    bool success = writer.Sync();
+    success = writer.Close() && success;
+    if (inPlace)
+    {
+        return success;
+    }
+    if (!success || !FileUtils::ReplaceFileAtomic(tempPath, target))
+    {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+}
 ZepBuffer::ZepBuffer(ZepEditor& editor, const std::string& strName)
     : ZepComponent(editor),
     m_threadPool(),
+    m_spSearch(std::make_shared<ZepBufferSearch>(*this)),
+    m_spTrigramIndex(std::make_shared<ZepTrigramIndex>(*this)),
+    m_spBrackets(std::make_shared<ZepBracketIndex>(*this)),
     m_strName(strName)
 {
     SetText("");
@@ -33,6 +446,17 @@ ZepBuffer::ZepBuffer(ZepEditor& editor, const std::string& strName)
 
 ZepBuffer::~ZepBuffer()
 {
+    CancelLoad();
+    StopFollow();
+
+    // Let a save finish; the file would be fine, but the text would be lost
+    if (m_spSave && m_spSave->thread.joinable())
+    {
+        m_spSave->thread.join();
+    }
+
+    // Closing cleanly; the journal is only for crashes
+    CloseJournal();
 }
 
 void ZepBuffer::Notify(std::shared_ptr<ZepMessage> message)
@@ -91,250 +515,1372 @@ long ZepBuffer::LineFromOffset(long offset) const
     return line;
 }
 
-BufferLocation ZepBuffer::LocationFromOffset(long offset) const
-{
-    return BufferLocation{ offset };
-}
+BufferLocation ZepBuffer::LocationFromOffset(long offset) const
+{
+    return BufferLocation{ offset };
+}
+
+BufferLocation ZepBuffer::Search(const std::string& str, BufferLocation start, SearchDirection dir, BufferLocation end) const
+{
+    ZepRegex regex;
+    if (!regex.Compile(str))
+    {
+        return InvalidOffset;
+    }
+
+    RegexMatch match;
+    if (dir == SearchDirection::Forward)
+    {
+        return regex.Find(m_gapBuffer, m_lineEnds, start, end, match) ? match.start : InvalidOffset;
+    }
+    return (start > 0 && regex.FindLast(m_gapBuffer, m_lineEnds, std::max(0l, end), start - 1, match)) ? match.start : InvalidOffset;
+}
+
+bool ZepBuffer::FindMatch(const ZepRegex& regex, BufferLocation start, SearchDirection dir, RegexMatch& match) const
+{
+    if (dir == SearchDirection::Forward)
+    {
+        return regex.Find(m_gapBuffer, m_lineEnds, start, -1, match);
+    }
+    return start > 0 && regex.FindLast(m_gapBuffer, m_lineEnds, 0, start - 1, match);
+}
+
+// Given a stream of ___AAA__BBB
+// We return markers for the start of the first block, beyond the first block, and the second
+// i.e. we 'find' AAA and BBB, and remember if there are spaces between them
+// This enables us to implement various block motions
+BufferBlock ZepBuffer::GetBlock(uint32_t searchType, BufferLocation start, SearchDirection dir) const
+{
+    BufferBlock ret;
+    ret.blockSearchPos = start;
+
+    // Backwards, the search goes from the end of the buffer towards its beginning
+    auto size = long(m_gapBuffer.size());
+    auto inc = (dir == SearchDirection::Forward) ? 1 : -1;
+    BufferLocation begin = 0;
+    BufferLocation end = size;
+    if (inc == -1)
+    {
+        std::swap(begin, end);
+    }
+    ret.direction = inc;
+
+    uint8_t blockClass = CharClass::WORD;
+    uint8_t nonBlockClass = CharClass::NonWORD;
+    if (searchType & SearchType::AlphaNumeric)
+    {
+        blockClass = CharClass::Word;
+        nonBlockClass = CharClass::NonWord;
+    }
+
+    // The blanks before the start
+    auto current = SkipClasses(m_gapBuffer, start, begin, CharClass::Blank);
+    if (current != begin)
+    {
+        current += inc;
+    }
+    ret.spaceBeforeStart = current;
+
+    // Skip the initial spaces; they are not part of the block
+    current = SkipClasses(m_gapBuffer, start, end, CharClass::Blank);
+    ret.spaceBefore = current != start;
+
+    auto GetBlockClass = [&](BufferLocation location)
+    {
+        return (ClassAt(m_gapBuffer, location) & blockClass) ? blockClass : nonBlockClass;
+    };
+
+    // Find the right start block type
+    auto check = GetBlockClass(current);
+    ret.startOnBlock = check == blockClass;
+
+    // Walk backwards to the start of the block
+    current = SkipClasses(m_gapBuffer, current, begin, check);
+    if (current < size &&
+        !(ClassAt(m_gapBuffer, current) & check))  // Note this also handles where we couldn't walk back any further
+    {
+        current += inc;
+    }
+
+    // Record start
+    ret.firstBlock = current;
+
+    // Walk forwards to the end of the block
+    current = SkipClasses(m_gapBuffer, current, end, check);
+    ret.firstNonBlock = current;
+
+    // If we couldn't walk further back, record that the offset was beyond!
+    // This is only for backward motions
+    if (current < size &&
+        (ClassAt(m_gapBuffer, current) & check))
+    {
+        ret.firstNonBlock += inc;
+    }
+
+    // Skip the next spaces; they are not part of the block
+    auto spaceStart = current;
+    current = SkipClasses(m_gapBuffer, current, end, CharClass::Blank);
+    ret.spaceBetween = current != spaceStart;
+    ret.secondBlock = current;
+
+    // Get to the end of the second non block
+    check = GetBlockClass(current);
+    current = SkipClasses(m_gapBuffer, current, end, check);
+    ret.secondNonBlock = current;
+
+    // If we couldn't walk further back, record that the offset was beyond!
+    if (current < size &&
+        (ClassAt(m_gapBuffer, current) & check))
+    {
+        ret.secondNonBlock += inc;
+    }
+
+    return ret;
+}
+
+BufferLocation ZepBuffer::FindOnLine(utf8 ch, BufferLocation start, SearchDirection dir, long count) const
+{
+    long lineStart, lineEnd;
+    if (count < 1 || !GetLineOffsets(LineFromOffset(start), lineStart, lineEnd))
+    {
+        return InvalidOffset;
+    }
+
+    // The line's \n (or the terminating 0 on the last line) is not part of it
+    if (dir == SearchDirection::Forward)
+    {
+        return start + 1 < lineEnd - 1 ? FindByte(m_gapBuffer, start + 1, lineEnd - 1, ch, count) : InvalidOffset;
+    }
+    return FindByte(m_gapBuffer, start - 1, lineStart - 1, ch, count);
+}
+
+// Tell clients the whole buffer is about to be replaced
+void ZepBuffer::BeginReplaceText()
+{
+    if (m_gapBuffer.size() != 0)
+    {
+        GetEditor().Broadcast(MakeMessage(
+            BufferMessageType::TextDeleted,
+            BufferLocation{ 0 },
+            BufferLocation{ long(m_gapBuffer.size()) }));
+    }
+
+    // Inform clients we are about to change the buffer
+    GetEditor().Broadcast(MakeMessage(BufferMessageType::PreBufferChange, 0, BufferLocation(m_gapBuffer.size() - 1)));
+}
+
+// The new text has been placed at the front of the gap buffer; size bytes of it.
+// Without a format, it is a file's text: the \r come off its line ends in place if it is DOS, as the line index is built
+// in the same pass.  With one, it has already been read, and the format is the file's
+void ZepBuffer::EndReplaceText(size_t size, LineEndFormat format)
+{
+    m_lineEnds.clear();
+
+    LineEndState lineEnds;
+    lineEnds.format = format == LineEndFormat::Unknown ? format : LineEndFormat::Unix;
+    m_gapBuffer.resize(EncodingUtils::ReadLineEnds(m_gapBuffer.m_pStart, size, lineEnds, m_lineEnds));
+    m_lineEndFormat = format == LineEndFormat::Unknown ? lineEnds.format : format;
+
+    if (m_gapBuffer.empty() || m_gapBuffer[m_gapBuffer.size() - 1] != 0)
+    {
+        m_gapBuffer.push_back(0);
+    }
+
+    m_lineEnds.push_back(long(m_gapBuffer.size()));
+
+    GetEditor().Broadcast(MakeMessage(
+        BufferMessageType::TextAdded,
+        BufferLocation{ 0 },
+        BufferLocation{ long(m_gapBuffer.size()) }));
+
+    // Doc is not dirty
+    m_dirty = false;
+    m_revision++;
+    CloseJournal();
+}
+
+BufferLocation ZepBuffer::Clamp(BufferLocation in) const
+{
+    in = std::min(in, BufferLocation(m_gapBuffer.size() - 1));
+    in = std::max(in, BufferLocation(0));
+    return in;
+}
+
+// Method for querying the beginning and end of a line
+bool ZepBuffer::GetLineOffsets(const long line, long& lineStart, long& lineEnd) const
+{
+    // Not valid
+    if (m_lineEnds.size() <= line)
+    {
+        lineStart = 0;
+        lineEnd = 0;
+        return false;
+    }
+
+    // Find the line bounds - we know the end, find the start from the previous
+    lineEnd = m_lineEnds[line];
+    lineStart = line == 0 ? 0 : m_lineEnds[line - 1];
+    return true;
+}
+
+/* TODO:
+void ZepBuffer::LockRead()
+{
+    // Wait for line counter
+    if (m_lineCountResult.valid())
+    {
+        m_lineCountResult.get();
+    }
+}*/
+
+
+// Brackets in comments and strings are skipped, so they are paired up again for the new syntax
+void ZepBuffer::SetSyntax(std::shared_ptr<ZepSyntax> spSyntax)
+{
+    m_spBrackets->Reset();
+    m_spSyntax = spSyntax;
+}
+
+// Replace the buffer buffer with the text 
+void ZepBuffer::SetText(const std::string& text)
+{
+    ZEP_TRACE_SCOPE("ZepBuffer::SetText");
+
+    CancelLoad();
+    StopFollow();
+    m_spPager.reset();
+    m_spBinary.reset();
+    m_spWatch.reset();
+    m_changedOnDisk = false;
+    m_encoding = FileEncoding();
+    ReplaceText(text);
+}
+
+void ZepBuffer::ReplaceText(const std::string& text, LineEndFormat format)
+{
+    BeginReplaceText();
+
+    auto pText = m_gapBuffer.assign_uninitialized(text.size());
+    memcpy(pText, text.data(), text.size());
+
+    EndReplaceText(text.size(), format);
+}
+
+// Read the file straight into the gap buffer; there is no intermediate copy
+bool ZepBuffer::Load(const std::string& path)
+{
+    ZEP_TRACE_SCOPE("ZepBuffer::Load");
+
+    CancelLoad();
+    StopFollow();
+    m_spPager.reset();
+    m_spBinary.reset();
+    BeginReplaceText();
+
+    // Before the read; if the file changes while we read it, a journal won't be replayed over it
+    auto stamp = FileUtils::GetStamp(path);
+    size_t size = 0;
+    bool success = FileUtils::ReadFile(path, [&](size_t fileSize)
+    {
+        return m_gapBuffer.assign_uninitialized(fileSize);
+    }, size);
+
+    if (!success)
+    {
+        m_gapBuffer.assign_uninitialized(0);
+        size = 0;
+    }
+
+    auto fileSize = size;
+    std::vector<utf8> decoded;
+    if (DecodeFileText(m_gapBuffer.m_pStart, size, m_encoding, decoded))
+    {
+        size = decoded.size();
+        memcpy(m_gapBuffer.assign_uninitialized(size), decoded.data(), size);
+    }
+
+    EndReplaceText(size);
+    m_filePath = path;
+    m_fileOffset = fileSize;
+    m_fileStamp = stamp;
+    m_changedOnDisk = false;
+    m_journalFound = FileUtils::Exists(ZepJournal::PathFor(path));
+    if (success)
+    {
+        WatchFile();
+    }
+    return success;
+}
+
+bool ZepBuffer::LoadAsync(const std::string& path)
+{
+    ZEP_TRACE_SCOPE("ZepBuffer::LoadAsync");
+
+    if (GetEditor().GetFlags() & ZepEditorFlags::DisableThreads)
+    {
+        return Load(path);
+    }
+
+    CancelLoad();
+    StopFollow();
+    m_spPager.reset();
+    m_spBinary.reset();
+
+    auto stamp = FileUtils::GetStamp(path);
+    auto pFile = fopen(path.c_str(), "rb");
+    if (!pFile)
+    {
+        return Load(path);
+    }
+
+    auto spLoad = std::make_shared<BufferLoad>();
+    spLoad->pFile = pFile;
+    spLoad->fileSize = FileUtils::Size(path);
+
+    // The first screen's worth, now; so there is something to show straight away
+    BeginReplaceText();
+    auto firstSize = std::min(spLoad->fileSize, LoadFirstChunkSize);
+    auto size = fread(m_gapBuffer.assign_uninitialized(firstSize), 1, firstSize, pFile);
+    spLoad->bytesRead = size;
+
+    // The first chunk decides the encoding; the decoder carries on from it, with anything split at its end
+    auto bytesRead = size;
+    size_t bomSize = 0;
+    m_encoding = EncodingUtils::Detect(m_gapBuffer.m_pStart, m_gapBuffer.m_pStart + size, bomSize);
+    spLoad->decoder = EncodingUtils::Utf8Decoder(m_encoding.type);
+    if (m_encoding.type == TextEncoding::Utf8)
+    {
+        memmove(m_gapBuffer.m_pStart, m_gapBuffer.m_pStart + bomSize, size - bomSize);
+        size -= bomSize;
+    }
+    else
+    {
+        std::vector<utf8> decoded;
+        spLoad->decoder.Decode(m_gapBuffer.m_pStart + bomSize, m_gapBuffer.m_pStart + size, decoded);
+        size = decoded.size();
+        memcpy(m_gapBuffer.assign_uninitialized(size), decoded.data(), size);
+    }
+
+    // The load thread reads the line ends on from where the first chunk left off
+    spLoad->lineEnds.afterCR = size > 0 && m_gapBuffer.m_pStart[size - 1] == '\r';
+    EndReplaceText(size);
+    spLoad->lineEnds.format = m_lineEndFormat;
+    m_filePath = path;
+    m_fileOffset = bytesRead;
+    m_fileStamp = stamp;
+    m_changedOnDisk = false;
+    WatchFile();
+
+    // Make room for the rest, so appending doesn't keep growing the buffer
+    m_gapBuffer.resizeGap(spLoad->fileSize - size + GapBuffer<utf8>::DEFAULT_GAP);
+
+    auto pLoad = spLoad.get();
+    spLoad->thread = std::thread([pLoad]()
+    {
+        bool failed = false;
+        while (!pLoad->stop && !failed)
+        {
+            LoadChunk chunk;
+            auto count = ReadChunk(pLoad->pFile, LoadChunkSize, chunk, failed, pLoad->decoder, pLoad->lineEnds);
+            if (count == 0)
+            {
+                break;
+            }
+
+            std::unique_lock<std::mutex> lock(pLoad->mutex);
+            pLoad->condition.wait(lock, [pLoad]() { return pLoad->chunks.size() < LoadMaxQueuedChunks || pLoad->stop; });
+            pLoad->chunks.push_back(std::move(chunk));
+            pLoad->bytesRead += count;
+            pLoad->condition.notify_all();
+        }
+
+        fclose(pLoad->pFile);
+        pLoad->pFile = nullptr;
+
+        std::lock_guard<std::mutex> lock(pLoad->mutex);
+        pLoad->finished = true;
+        pLoad->failed = failed;
+        pLoad->condition.notify_all();
+    });
+
+    m_spLoad = spLoad;
+    return true;
+}
+
+// Append whatever the load thread has read since we last looked
+void ZepBuffer::UpdateLoad()
+{
+    if (!m_spLoad)
+    {
+        return;
+    }
+
+    ZEP_TRACE_SCOPE("ZepBuffer::UpdateLoad");
+
+    std::deque<LoadChunk> chunks;
+    bool finished;
+    bool failed;
+    {
+        std::lock_guard<std::mutex> lock(m_spLoad->mutex);
+        chunks.swap(m_spLoad->chunks);
+        finished = m_spLoad->finished;
+        failed = m_spLoad->failed;
+        m_spLoad->condition.notify_all();
+    }
+
+    for (auto& chunk : chunks)
+    {
+        AppendChunk(chunk);
+    }
+
+    if (finished)
+    {
+        m_fileOffset = m_spLoad->bytesRead;
+        m_spLoad->thread.join();
+
+        // Following carries on where the load stopped, which may be part way through a character
+        if (m_spFollow)
+        {
+            m_spFollow->decoder = m_spLoad->decoder;
+            m_spFollow->lineEnds = m_spLoad->lineEnds;
+        }
+        m_spLoad.reset();
+
+        // Don't let a save overwrite the file with the part we managed to read
+        if (failed)
+        {
+            m_filePath.clear();
+        }
+    }
+}
+
+// Always at the end, just before the trailing 0
+void ZepBuffer::AppendChunk(LoadChunk& chunk)
+{
+    if (chunk.restoreCR)
+    {
+        RestoreCR();
+    }
+    else if (chunk.dropCR)
+    {
+        auto end = long(m_gapBuffer.size() - 1);
+        DeleteText(end - 1, end, BufferLocation{ -1 });
+    }
+
+    // Grow the gap in proportion to the text, so a stream of appends doesn't copy the whole buffer each time
+    if (m_gapBuffer.capacity() - m_gapBuffer.size() < chunk.text.size())
+    {
+        m_gapBuffer.resizeGap(chunk.text.size() + m_gapBuffer.size() / 2);
+    }
+
+    auto start = long(m_gapBuffer.size() - 1);
+    for (auto& lineEnd : chunk.lineEnds)
+    {
+        lineEnd += start;
+    }
+    InsertText(start, chunk.text.data(), chunk.text.data() + chunk.text.size(), chunk.lineEnds, BufferLocation{ -1 });
+    m_lineEndFormat = chunk.format;
+}
+
+// Every line end so far had a \r, but one further on doesn't; so the text goes back to how it is in the file
+void ZepBuffer::RestoreCR()
+{
+    ZEP_TRACE_SCOPE("ZepBuffer::RestoreCR");
+
+    std::string text;
+    text.reserve(m_gapBuffer.size() + m_lineEnds.size());
+    for (auto itr = m_gapBuffer.begin(); itr != m_gapBuffer.end() - 1; itr++)
+    {
+        if (*itr == '\n')
+        {
+            text.push_back('\r');
+        }
+        text.push_back(char(*itr));
+    }
+
+    // Edits made while the load runs are kept, and still need saving
+    auto dirty = m_dirty;
+    ReplaceText(text, LineEndFormat::Unix);
+    m_dirty = dirty;
+}
+
+void ZepBuffer::WaitForLoad()
+{
+    while (m_spLoad)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_spLoad->mutex);
+            m_spLoad->condition.wait(lock, [this]() { return !m_spLoad->chunks.empty() || m_spLoad->finished; });
+        }
+        UpdateLoad();
+    }
+}
+
+void ZepBuffer::CancelLoad()
+{
+    if (!m_spLoad)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_spLoad->mutex);
+        m_spLoad->stop = true;
+        m_spLoad->condition.notify_all();
+    }
+    m_spLoad->thread.join();
+    m_spLoad.reset();
+}
+
+float ZepBuffer::GetLoadProgress() const
+{
+    if (!m_spLoad)
+    {
+        return 1.0f;
+    }
+    if (m_spLoad->fileSize == 0)
+    {
+        return 0.0f;
+    }
+    return std::min(1.0f, float(m_spLoad->bytesRead) / float(m_spLoad->fileSize));
+}
+
+bool ZepBuffer::Follow(const std::string& path)
+{
+    ZEP_TRACE_SCOPE("ZepBuffer::Follow");
+
+    auto spFollow = std::make_shared<BufferFollow>();
+
+    // Watch before loading, so nothing written during the load is missed
+    spFollow->watcher.Watch(path, GetEditor().GetFileNotifier());
+    if (!LoadAsync(path))
+    {
+        return false;
+    }
+
+    spFollow->pFile = fopen(path.c_str(), "rb");
+    if (!spFollow->pFile)
+    {
+        return false;
+    }
+    spFollow->decoder = EncodingUtils::Utf8Decoder(m_encoding.type);
+    spFollow->lineEnds.format = m_lineEndFormat;
+    spFollow->lineEnds.afterCR = m_gapBuffer.size() > 1 && m_gapBuffer[m_gapBuffer.size() - 2] == '\r';
+
+    // Following takes care of the changes
+    m_spWatch.reset();
+    m_spFollow = spFollow;
+    return true;
+}
+
+void ZepBuffer::StopFollow()
+{
+    m_spFollow.reset();
+}
+
+void ZepBuffer::UpdateFollow()
+{
+    if (!m_spFollow || m_spLoad)
+    {
+        return;
+    }
+
+    auto changed = m_spFollow->watcher.Poll() || m_spFollow->changed;
+    m_spFollow->changed = false;
+    if (!changed)
+    {
+        return;
+    }
+
+    ZEP_TRACE_SCOPE("ZepBuffer::UpdateFollow");
+
+    // Truncated, or replaced by something smaller; start again
+    if (FileUtils::Size(m_filePath) < m_fileOffset)
+    {
+        auto path = m_filePath;
+        Follow(path);
+        return;
+    }
+
+    auto spFollow = m_spFollow;
+    if (!FileUtils::Seek(spFollow->pFile, m_fileOffset))
+    {
+        return;
+    }
+
+    for (;;)
+    {
+        auto& chunk = spFollow->chunk;
+        chunk.lineEnds.clear();
+
+        bool failed = false;
+        auto count = ReadChunk(spFollow->pFile, LoadChunkSize, chunk, failed, spFollow->decoder, spFollow->lineEnds);
+        if (count == 0)
+        {
+            break;
+        }
+        m_fileOffset += count;
+        AppendChunk(chunk);
+        if (failed)
+        {
+            break;
+        }
+    }
+}
+
+void ZepBuffer::SetTemporary()
+{
+    WaitForLoad();
+    StopFollow();
+    CloseJournal();
+    m_spWatch.reset();
+    m_filePath.clear();
+    m_journalFound = false;
+    m_changedOnDisk = false;
+    m_temporary = true;
+}
+
+void ZepBuffer::WatchFile()
+{
+    m_spWatch = std::make_shared<BufferWatch>();
+    m_spWatch->watcher.Watch(m_filePath, GetEditor().GetFileNotifier());
+    m_spWatch->stamp = FileUtils::GetStamp(m_filePath);
+}
+
+// Journal the edits to a file from the first one, against the file as the text was read from it; the file may have
+// changed since, before we noticed.  A buffer that already differs from the file starts with its whole text, which
+// replaces the file's as it is now
+void ZepBuffer::StartJournal()
+{
+    if (m_spJournal || m_journalFound || m_filePath.empty() || IsReadOnly() || IsFollowing() || m_spLoad)
+    {
+        return;
+    }
+
+    auto snapshot = m_dirty || m_changedOnDisk;
+    m_spJournal = std::make_shared<ZepJournal>(ZepJournal::PathFor(m_filePath),
+        snapshot ? FileUtils::GetStamp(m_filePath) : m_fileStamp,
+        !(GetEditor().GetFlags() & ZepEditorFlags::DisableThreads));
+
+    if (snapshot)
+    {
+        auto textEnd = m_gapBuffer.size() - 1;
+        auto beforeGap = std::min(size_t(m_gapBuffer.m_pGapStart - m_gapBuffer.m_pStart), textEnd);
+        auto pBefore = (const char*)m_gapBuffer.m_pStart;
+        auto pAfter = (const char*)m_gapBuffer.m_pGapEnd;
+        m_spJournal->Snapshot(pBefore, pBefore + beforeGap);
+        m_spJournal->Insert(long(beforeGap), pAfter, pAfter + (textEnd - beforeGap));
+    }
+}
+
+void ZepBuffer::CloseJournal()
+{
+    if (m_spJournal)
+    {
+        m_spJournal->Discard();
+        m_spJournal.reset();
+    }
+}
+
+void ZepBuffer::FlushJournal()
+{
+    if (m_spJournal)
+    {
+        m_spJournal->Flush();
+    }
+}
+
+bool ZepBuffer::RecoverJournal()
+{
+    ZEP_TRACE_SCOPE("ZepBuffer::RecoverJournal");
+
+    if (!m_journalFound || IsReadOnly() || IsFollowing())
+    {
+        return false;
+    }
+
+    WaitForLoad();
+    WaitForSave();
+
+    auto stamp = FileUtils::GetStamp(m_filePath);
+    std::string text;
+    auto format = LineEndFormat::Unknown;
+    FileEncoding encoding;
+    if (!ReadFileText(m_filePath, text, format, encoding) ||
+        !ZepJournal::Replay(ZepJournal::PathFor(m_filePath), stamp, text))
+    {
+        return false;
+    }
+
+    ReplaceText(text, format == LineEndFormat::Unknown ? LineEndFormat::Unix : format);
+    m_encoding = encoding;
+    m_fileStamp = stamp;
+    m_dirty = true;
+    m_journalFound = false;
+
+    // A new journal, holding the recovered text, replaces the old one
+    StartJournal();
+    return true;
+}
+
+void ZepBuffer::UpdateExternalChange()
+{
+    if (!m_spWatch || m_spLoad || m_spSave || m_changedOnDisk)
+    {
+        return;
+    }
+
+    if (!m_spWatch->watcher.Poll())
+    {
+        return;
+    }
+
+    // Our own saves, and touches that change nothing
+    auto stamp = FileUtils::GetStamp(m_filePath);
+    if (stamp == m_spWatch->stamp)
+    {
+        return;
+    }
+
+    ZEP_TRACE_SCOPE("ZepBuffer::UpdateExternalChange");
+
+    // The file may have been replaced rather than written to; watch whatever is there now
+    m_spWatch->watcher.Watch(m_filePath, GetEditor().GetFileNotifier());
+    m_spWatch->stamp = stamp;
+
+    if (m_dirty || !FileUtils::Exists(m_filePath) || !ReloadChanges())
+    {
+        m_changedOnDisk = true;
+    }
+}
+
+bool ZepBuffer::ReloadChanges()
+{
+    ZEP_TRACE_SCOPE("ZepBuffer::ReloadChanges");
+
+    if (m_filePath.empty() || IsReadOnly() || IsFollowing())
+    {
+        return false;
+    }
+
+    WaitForLoad();
+    WaitForSave();
+
+    auto stamp = FileUtils::GetStamp(m_filePath);
+    std::string newText;
+    auto format = LineEndFormat::Unknown;
+    FileEncoding encoding;
+    if (!ReadFileText(m_filePath, newText, format, encoding))
+    {
+        return false;
+    }
+
+    // Our text, without the trailing 0
+    std::string oldText;
+    auto textEnd = m_gapBuffer.size() - 1;
+    auto beforeGap = std::min(size_t(m_gapBuffer.m_pGapStart - m_gapBuffer.m_pStart), textEnd);
+    oldText.reserve(textEnd);
+    oldText.append((const char*)m_gapBuffer.m_pStart, beforeGap);
+    oldText.append((const char*)m_gapBuffer.m_pGapEnd, textEnd - beforeGap);
+
+    std::vector<uint64_t> oldHashes;
+    std::vector<uint64_t> newHashes;
+    DiffUtils::HashLines(oldText.data(), oldText.data() + oldText.size(), oldHashes);
+    DiffUtils::HashLines(newText.data(), newText.data() + newText.size(), newHashes);
+    auto hunks = DiffUtils::DiffLines(oldHashes, newHashes);
+
+    std::vector<long> newLineStarts(1, 0);
+    for (size_t i = 0; i < newText.size(); i++)
+    {
+        if (newText[i] == '\n')
+        {
+            newLineStarts.push_back(long(i + 1));
+        }
+    }
+    newLineStarts.push_back(long(newText.size()));
+
+    // From the bottom up, so the line ends above each hunk are still right when we get to it
+    auto lineStart = [&](long line)
+    {
+        return line == 0 ? 0 : std::min(m_lineEnds[line - 1], long(m_gapBuffer.size() - 1));
+    };
+
+    std::vector<std::shared_ptr<ZepCommand>> commands;
+    auto pMode = GetEditor().GetCurrentMode();
+    auto apply = [&](std::shared_ptr<ZepCommand> spCommand)
+    {
+        if (pMode)
+        {
+            pMode->AddCommand(spCommand);
+        }
+        else
+        {
+            spCommand->Redo();
+        }
+        commands.push_back(spCommand);
+    };
+
+    for (auto itr = hunks.rbegin(); itr != hunks.rend(); itr++)
+    {
+        auto start = lineStart(itr->oldStart);
+        auto end = lineStart(itr->oldStart + itr->oldCount);
+        if (end > start)
+        {
+            apply(std::make_shared<ZepCommand_DeleteRange>(*this, start, end));
+        }
+        if (itr->newCount > 0)
+        {
+            auto newStart = newLineStarts[itr->newStart];
+            auto newEnd = std::min(newLineStarts[itr->newStart + itr->newCount], long(newText.size()));
+            apply(std::make_shared<ZepCommand_Insert>(*this, start, newText.substr(newStart, newEnd - newStart)));
+        }
+    }
+
+    // One undo step for the whole reload
+    if (commands.size() > 1)
+    {
+        commands.front()->SetFlags(CommandFlags::GroupBoundary);
+        commands.back()->SetFlags(CommandFlags::GroupBoundary);
+    }
+
+    m_lineEndFormat = format;
+    m_encoding = encoding;
+    m_dirty = false;
+    m_changedOnDisk = false;
+    m_fileOffset = stamp.size;
+    m_fileStamp = stamp;
+    CloseJournal();
+    if (m_spWatch)
+    {
+        m_spWatch->stamp = stamp;
+    }
+    return true;
+}
+
+bool ZepBuffer::OpenPaged(const std::string& path, size_t memoryBudget)
+{
+    ZEP_TRACE_SCOPE("ZepBuffer::OpenPaged");
+
+    CancelLoad();
+    StopFollow();
+    m_spWatch.reset();
+    m_spBinary.reset();
+
+    auto spPager = std::make_shared<ZepFilePager>(memoryBudget - memoryBudget / 4);
+    if (!spPager->Open(path))
+    {
+        return false;
+    }
+
+    m_spPager = spPager;
+    m_filePath = path;
+    m_pagedFirstLine = -1;
+    m_pagedWindowBudget = memoryBudget / 4;
+    return SetPagedWindow(0);
+}
+
+bool ZepBuffer::SetPagedWindow(long firstLine)
+{
+    if (!m_spPager)
+    {
+        return false;
+    }
+
+    // Each character of the window costs its byte and its syntax entry, and each line its line end.  At worst every
+    // line is a single \n, so that bounds the line count; the bytes are what's left
+    const size_t charSize = sizeof(utf8) + sizeof(uint32_t);
+    auto maxLines = std::min(PagedWindowLines, long(m_pagedWindowBudget / (charSize + sizeof(long))));
+    maxLines = std::max(maxLines, 1l);
+    auto maxBytes = (m_pagedWindowBudget - std::min(m_pagedWindowBudget, size_t(maxLines) * sizeof(long))) / charSize;
+
+    firstLine = std::min(firstLine, m_spPager->GetLineCount() - maxLines);
+    firstLine = std::max(firstLine, 0l);
+    if (firstLine == m_pagedFirstLine)
+    {
+        return true;
+    }
+
+    ZEP_TRACE_SCOPE("ZepBuffer::SetPagedWindow");
+
+    std::string text;
+    auto lines = m_spPager->ReadLines(firstLine, maxLines, text, maxBytes);
+
+    // Mid file, the last \n would show as an extra empty line that isn't really there
+    if (firstLine + lines < m_spPager->GetLineCount() && !text.empty() && text.back() == '\n')
+    {
+        text.pop_back();
+    }
+
+    m_pagedFirstLine = firstLine;
+    ReplaceText(text);
+    return true;
+}
+
+// The window is searched first; past it, the pager finds the file line with the match, and the window slides there
+bool ZepBuffer::FindPaged(const ZepRegex& regex, BufferLocation from, SearchDirection dir, BufferLocation& location)
+{
+    if (!m_spPager)
+    {
+        return false;
+    }
+
+    RegexMatch match;
+    if (dir == SearchDirection::Forward ? FindMatch(regex, from + 1, dir, match) : FindMatch(regex, from, dir, match))
+    {
+        location = match.start;
+        return true;
+    }
+
+    auto fileLines = m_spPager->GetLineCount();
+    auto windowEnd = m_pagedFirstLine + GetLineCount();
+    long line = -1;
+    if (dir == SearchDirection::Forward)
+    {
+        line = windowEnd < fileLines ? m_spPager->Find(regex, windowEnd, dir) : -1;
+        line = line == -1 ? m_spPager->Find(regex, 0, dir) : line;
+    }
+    else
+    {
+        line = m_pagedFirstLine > 0 ? m_spPager->Find(regex, m_pagedFirstLine - 1, dir) : -1;
+        line = line == -1 ? m_spPager->Find(regex, fileLines - 1, dir) : line;
+    }
+    if (line == -1)
+    {
+        return false;
+    }
+
+    if (line < m_pagedFirstLine || line >= windowEnd)
+    {
+        SetPagedWindow(line - PagedWindowLines / 2);
+    }
+
+    // The first match on the line going forwards, the last going back
+    auto lineStart = GetLinePos(line - m_pagedFirstLine, LineLocation::LineBegin);
+    auto lineEnd = GetLinePos(line - m_pagedFirstLine, LineLocation::LineEnd);
+    if (dir == SearchDirection::Forward ? !FindMatch(regex, lineStart, dir, match) : !FindMatch(regex, lineEnd, dir, match))
+    {
+        return false;
+    }
+    location = match.start;
+    return true;
+}
+
+long ZepBuffer::GetFileLineCount() const
+{
+    if (m_spPager)
+    {
+        return m_spPager->GetLineCount();
+    }
+    if (m_spBinary)
+    {
+        return m_spBinary->GetRowCount();
+    }
+    return GetLineCount();
+}
+
+long ZepBuffer::GetFileFirstLine() const
+{
+    return m_spPager ? m_pagedFirstLine : m_spBinary ? m_binaryFirstRow : 0;
+}
+
+bool ZepBuffer::SetFileWindow(long firstLine)
+{
+    return m_spBinary ? SetBinaryWindow(firstLine) : SetPagedWindow(firstLine);
+}
+
+bool ZepBuffer::OpenBinary(const std::string& path, size_t memoryBudget)
+{
+    ZEP_TRACE_SCOPE("ZepBuffer::OpenBinary");
+
+    CancelLoad();
+    StopFollow();
+    WaitForSave();
+    m_spWatch.reset();
+    m_spPager.reset();
+
+    auto spBinary = std::make_shared<ZepBinaryFile>(memoryBudget);
+    if (!spBinary->Open(path))
+    {
+        return false;
+    }
+
+    m_spBinary = spBinary;
+    m_filePath = path;
+    m_encoding = FileEncoding();
+    m_binaryFirstRow = -1;
+    return SetBinaryWindow(0);
+}
+
+bool ZepBuffer::SetBinaryWindow(long firstRow)
+{
+    if (!m_spBinary)
+    {
+        return false;
+    }
+
+    firstRow = std::min(firstRow, m_spBinary->GetRowCount() - BinaryWindowRows);
+    firstRow = std::max(firstRow, 0l);
+    if (firstRow == m_binaryFirstRow)
+    {
+        return true;
+    }
+
+    ZEP_TRACE_SCOPE("ZepBuffer::SetBinaryWindow");
 
-BufferLocation ZepBuffer::Search(const std::string& str, BufferLocation start, SearchDirection dir, BufferLocation end) const
-{
-    return BufferLocation{ 0 };
+    std::string text;
+    m_spBinary->FormatRows(firstRow, BinaryWindowRows, text);
+    m_binaryFirstRow = firstRow;
+    ReplaceText(text);
+    return true;
 }
 
-// Given a stream of ___AAA__BBB
-// We return markers for the start of the first block, beyond the first block, and the second
-// i.e. we 'find' AAA and BBB, and remember if there are spaces between them
-// This enables us to implement various block motions
-BufferBlock ZepBuffer::GetBlock(uint32_t searchType, BufferLocation start, SearchDirection dir) const
+// Rows are all the same shape, so the file offset comes from the line and column alone
+int64_t ZepBuffer::BinaryOffsetAt(BufferLocation location) const
 {
-    BufferBlock ret;
-    ret.blockSearchPos = start;
+    if (!m_spBinary)
+    {
+        return -1;
+    }
 
-    BufferLocation end;
-    BufferLocation begin;
-    end = BufferLocation{ long(m_gapBuffer.size()) };
-    begin = BufferLocation{ 0 };
+    auto line = LineFromOffset(location);
+    bool ascii;
+    bool high;
+    auto byte = m_spBinary->ByteAtColumn(int(location - GetLinePos(line, LineLocation::LineBegin)), ascii, high);
+    if (byte < 0)
+    {
+        return -1;
+    }
 
-    auto itrBegin = m_gapBuffer.begin() + begin;
-    auto itrEnd = m_gapBuffer.begin() + end;
-    auto itrCurrent = m_gapBuffer.begin() + start;
+    auto offset = uint64_t(m_binaryFirstRow + line) * ZepBinaryFile::BytesPerRow + uint64_t(byte);
+    return offset < m_spBinary->GetSize() ? int64_t(offset) : -1;
+}
 
-    auto pIsBlock = IsWORDChar;
-    auto pIsNotBlock = IsNonWORDChar;
-    if (searchType & SearchType::AlphaNumeric)
+BufferLocation ZepBuffer::OverwriteBinary(BufferLocation location, char ch)
+{
+    auto offset = BinaryOffsetAt(location);
+    if (offset < 0)
     {
-        pIsBlock = IsWordChar;
-        pIsNotBlock = IsNonWordChar;
+        return BufferLocation{ -1 };
     }
 
-    // Set the search pos
-    ret.blockSearchPos = LocationFromOffset(long(itrCurrent - m_gapBuffer.begin()));
+    auto lineStart = GetLinePos(LineFromOffset(location), LineLocation::LineBegin);
+    bool ascii;
+    bool high;
+    auto byte = m_spBinary->ByteAtColumn(int(location - lineStart), ascii, high);
 
-    auto inc = (dir == SearchDirection::Forward) ? 1 : -1;
-    if (inc == -1)
+    uint8_t value;
+    if (!m_spBinary->Read(uint64_t(offset), &value, 1))
     {
-        std::swap(itrBegin, itrEnd);
+        return BufferLocation{ -1 };
     }
-    ret.direction = inc;
 
-    ret.spaceBefore = false;
-    ret.spaceBetween = false;
-
-    while ((itrCurrent != itrBegin) &&
-        IsSpace(*itrCurrent))
+    if (ascii)
     {
-        itrCurrent -= inc;
+        value = uint8_t(ch);
     }
-    if (itrCurrent != itrBegin)
+    else
     {
-        itrCurrent += inc;
+        auto pDigit = std::isxdigit(uint8_t(ch)) ? strchr("0123456789abcdef", std::tolower(uint8_t(ch))) : nullptr;
+        if (!pDigit)
+        {
+            return BufferLocation{ -1 };
+        }
+        auto digit = uint8_t(pDigit - "0123456789abcdef");
+        value = high ? uint8_t((digit << 4) | (value & 0x0F)) : uint8_t((value & 0xF0) | digit);
     }
-    ret.spaceBeforeStart = LocationFromOffset(long(itrCurrent - m_gapBuffer.begin()));
 
-    // Skip the initial spaces; they are not part of the block
-    itrCurrent = m_gapBuffer.begin() + start;
-    while (itrCurrent != itrEnd &&
-        (IsSpace(*itrCurrent)))
+    if (!m_spBinary->Overwrite(uint64_t(offset), value))
     {
-        ret.spaceBefore = true;
-        itrCurrent += inc;
+        return BufferLocation{ -1 };
     }
 
-    auto GetBlockChecker = [&](const char ch) 
+    // Update both sides of the row where they are; nothing moves, but the workers still stop reading first
+    std::string row;
+    m_spBinary->FormatRows(m_binaryFirstRow + LineFromOffset(location), 1, row);
+    auto hex = m_spBinary->HexColumn(byte);
+    auto asciiColumn = m_spBinary->AsciiColumn(byte);
+    GetEditor().Broadcast(MakeMessage(BufferMessageType::PreBufferChange, lineStart + hex, lineStart + asciiColumn + 1));
+    m_gapBuffer[lineStart + hex] = row[hex];
+    m_gapBuffer[lineStart + hex + 1] = row[hex + 1];
+    m_gapBuffer[lineStart + asciiColumn] = row[asciiColumn];
+    m_revision++;
+    GetEditor().Broadcast(MakeMessage(BufferMessageType::TextChanged, lineStart + hex, lineStart + asciiColumn + 1));
+
+    // The next digit, or the next character; on to the next row at the end of this one
+    if (!ascii && high)
     {
-        if (pIsBlock(ch))
-            return pIsBlock;
-        else 
-            return pIsNotBlock;
-    };
+        return location + 1;
+    }
+    auto nextByte = byte + 1;
+    auto nextStart = lineStart;
+    if (nextByte == ZepBinaryFile::BytesPerRow)
+    {
+        nextByte = 0;
+        nextStart = GetLinePos(LineFromOffset(location) + 1, LineLocation::LineBegin);
+        if (nextStart <= lineStart)
+        {
+            return location;
+        }
+    }
+    return nextStart + (ascii ? m_spBinary->AsciiColumn(nextByte) : m_spBinary->HexColumn(nextByte));
+}
 
-    // Find the right start block type
-    auto pCheck = GetBlockChecker(*itrCurrent);
-    ret.startOnBlock = (pCheck == pIsBlock) ? true : false;
+BufferLocation ZepBuffer::FindBinary(const std::vector<uint8_t>& bytes, BufferLocation start, SearchDirection dir)
+{
+    if (!m_spBinary)
+    {
+        return BufferLocation{ -1 };
+    }
 
-    // Walk backwards to the start of the block
-    while (itrCurrent != itrBegin &&
-        (pCheck(*itrCurrent)))
+    // Just past (or before) the byte we are on
+    auto startOffset = BinaryOffsetAt(start);
+    if (startOffset < 0)
     {
-        itrCurrent -= inc;
+        startOffset = int64_t(m_binaryFirstRow + LineFromOffset(start)) * ZepBinaryFile::BytesPerRow;
     }
-    if (itrCurrent < m_gapBuffer.end() &&
-        !pCheck(*itrCurrent))  // Note this also handles where we couldn't walk back any further
+    else if (dir == SearchDirection::Forward)
     {
-        itrCurrent += inc;
+        startOffset++;
     }
-
-    // Record start
-    ret.firstBlock = LocationFromOffset(long(itrCurrent - m_gapBuffer.begin()));
-   
-    // Walk forwards to the end of the block
-    while (itrCurrent != itrEnd &&
-        (pCheck(*itrCurrent)))
+    else if (startOffset-- == 0)
     {
-        itrCurrent += inc;
+        return BufferLocation{ -1 };
     }
 
-    // Record end
-    ret.firstNonBlock = LocationFromOffset(long(itrCurrent - m_gapBuffer.begin()));
+    auto found = m_spBinary->Find(bytes, uint64_t(startOffset), dir);
+    if (found < 0)
+    {
+        return BufferLocation{ -1 };
+    }
 
-    // If we couldn't walk further back, record that the offset was beyond!
-    // This is only for backward motions
-    if (itrCurrent < m_gapBuffer.end() &&
-        pCheck(*itrCurrent))
+    auto row = long(found / ZepBinaryFile::BytesPerRow);
+    if (row < m_binaryFirstRow || row >= m_binaryFirstRow + GetLineCount())
     {
-        ret.firstNonBlock += inc;
+        SetBinaryWindow(row - BinaryWindowRows / 2);
     }
+    return GetLinePos(row - m_binaryFirstRow, LineLocation::LineBegin) + m_spBinary->HexColumn(int(found % ZepBinaryFile::BytesPerRow));
+}
 
-    // Skip the next spaces; they are not part of the block
-    while (itrCurrent != itrEnd &&
-        (IsSpace(*itrCurrent)))
+bool ZepBuffer::SaveBinary()
+{
+    if (!m_spBinary->Save())
     {
-        ret.spaceBetween = true;
-        itrCurrent += inc;
+        GetEditor().Broadcast(MakeMessage(BufferMessageType::SaveFailed, 0, 0));
+        return false;
     }
+    GetEditor().Broadcast(MakeMessage(BufferMessageType::Saved, 0, 0));
+    return true;
+}
+
+bool ZepBuffer::IsDirty() const
+{
+    return m_dirty || (m_spBinary && m_spBinary->IsDirty());
+}
 
-    ret.secondBlock = LocationFromOffset(long(itrCurrent - m_gapBuffer.begin()));
+// Write the two halves of the gap buffer directly.  If we stripped carriage returns on the way in, we put them back
+// by writing the text between each line end, followed by a \r\n; still without copying the text anywhere
+bool ZepBuffer::Save()
+{
+    ZEP_TRACE_SCOPE("ZepBuffer::Save");
 
-    // Get to the end of the second non block
-    pCheck = GetBlockChecker(*itrCurrent);
-    while (itrCurrent != itrEnd &&
-        (pCheck(*itrCurrent)))
+    if (IsBinary())
     {
-        itrCurrent += inc;
+        return SaveBinary();
     }
 
-    ret.secondNonBlock = LocationFromOffset(long(itrCurrent - m_gapBuffer.begin()));
-    
-    // If we couldn't walk further back, record that the offset was beyond!
-    if (itrCurrent < m_gapBuffer.end() &&
-        pCheck(*itrCurrent))
+    if (m_filePath.empty() || IsReadOnly())
     {
-        ret.secondNonBlock += inc;
+        return false;
     }
-    
-    return ret;
-}
 
-void ZepBuffer::ProcessInput(const std::string& text)
-{
-    // Inform clients we are about to change the buffer
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, 0, BufferLocation(m_gapBuffer.size() - 1)));
+    // Only the whole file gets written back; and not before an earlier save that would overwrite it
+    WaitForLoad();
+    WaitForSave();
+    if (m_filePath.empty())
+    {
+        return false;
+    }
 
-    m_gapBuffer.clear();
-    m_lineEnds.clear();
+    // Don't write the trailing 0
+    auto textEnd = m_gapBuffer.size() - 1;
+    auto beforeGap = std::min(size_t(m_gapBuffer.m_pGapStart - m_gapBuffer.m_pStart), textEnd);
+    auto restoreCR = m_lineEndFormat == LineEndFormat::Dos;
+    std::string encoded;
+    if (m_encoding.type != TextEncoding::Utf8)
+    {
+        // A character can't be converted in two halves, so join the text across the gap first
+        std::vector<utf8> text(m_gapBuffer.m_pStart, m_gapBuffer.m_pStart + beforeGap);
+        text.insert(text.end(), m_gapBuffer.m_pGapEnd, m_gapBuffer.m_pGapEnd + (textEnd - beforeGap));
+        if (!EncodeText(text.data(), text.data() + text.size(), restoreCR, m_encoding, encoded))
+        {
+            return false;
+        }
+    }
 
-    m_bStrippedCR = false;
+    FileUtils::FileWriter writer;
+    if (!writer.Open(m_filePath))
+    {
+        return false;
+    }
 
-    if (text.empty())
+    auto bom = EncodingUtils::ByteOrderMark(m_encoding);
+    writer.Write(bom, strlen(bom));
+    if (m_encoding.type == TextEncoding::Utf8)
     {
-        m_gapBuffer.push_back(0);
+        WriteText(writer, m_gapBuffer.m_pStart, m_gapBuffer.m_pStart + beforeGap, restoreCR);
+        WriteText(writer, m_gapBuffer.m_pGapEnd, m_gapBuffer.m_pGapEnd + (textEnd - beforeGap), restoreCR);
     }
     else
     {
-        // Update the gap buffer with the text
-        // We remove \r, we only care about \n
-        for (auto& ch : text)
-        {
-            if (ch == '\r')
-            {
-                m_bStrippedCR = true;
-            }
-            else
-            {
-                m_gapBuffer.push_back(ch);
-                if (ch == '\n')
-                {
-                    m_lineEnds.push_back(long(m_gapBuffer.size()));
-                }
-            }
-        }
+        writer.Write(encoded.data(), encoded.size());
     }
 
-    if (m_gapBuffer[m_gapBuffer.size() - 1] != 0)
+    if (!writer.Close())
     {
-        m_gapBuffer.push_back(0);
+        return false;
     }
 
-    m_lineEnds.push_back(long(m_gapBuffer.size()));
-}
+    m_dirty = false;
+    m_changedOnDisk = false;
+    m_fileStamp = FileUtils::GetStamp(m_filePath);
+    WatchFile();
 
-BufferLocation ZepBuffer::Clamp(BufferLocation in) const
-{
-    in = std::min(in, BufferLocation(m_gapBuffer.size() - 1));
-    in = std::max(in, BufferLocation(0));
-    return in;
+    // The edits are in the file now, and so is whatever an old journal held
+    CloseJournal();
+    if (m_journalFound)
+    {
+        std::remove(ZepJournal::PathFor(m_filePath).c_str());
+        m_journalFound = false;
+    }
+    return true;
 }
 
-// Method for querying the beginning and end of a line
-bool ZepBuffer::GetLineOffsets(const long line, long& lineStart, long& lineEnd) const
+bool ZepBuffer::SaveAsync()
 {
-    // Not valid
-    if (m_lineEnds.size() <= line)
+    ZEP_TRACE_SCOPE("ZepBuffer::SaveAsync");
+
+    // Only the overwritten bytes; a write that small doesn't need a worker
+    if (IsBinary())
+    {
+        return SaveBinary();
+    }
+
+    if (m_filePath.empty() || IsReadOnly())
     {
-        lineStart = 0;
-        lineEnd = 0;
         return false;
     }
 
-    // Find the line bounds - we know the end, find the start from the previous
-    lineEnd = m_lineEnds[line];
-    lineStart = line == 0 ? 0 : m_lineEnds[line - 1];
+    if (m_spSave)
+    {
+        m_savePending = true;
+        return true;
+    }
+
+    // Only the whole file gets written back
+    WaitForLoad();
+    if (m_filePath.empty())
+    {
+        return false;
+    }
+
+    auto spSave = std::make_shared<BufferSave>();
+    spSave->path = m_filePath;
+    spSave->restoreCR = m_lineEndFormat == LineEndFormat::Dos;
+    spSave->encoding = m_encoding;
+    spSave->revision = m_revision;
+
+    // The copy is all that happens on this thread; the text either side of the gap, without the trailing 0
+    auto textEnd = m_gapBuffer.size() - 1;
+    auto beforeGap = std::min(size_t(m_gapBuffer.m_pGapStart - m_gapBuffer.m_pStart), textEnd);
+    spSave->text.reserve(textEnd);
+    spSave->text.assign(m_gapBuffer.m_pStart, m_gapBuffer.m_pStart + beforeGap);
+    spSave->text.insert(spSave->text.end(), m_gapBuffer.m_pGapEnd, m_gapBuffer.m_pGapEnd + (textEnd - beforeGap));
+
+    auto pSave = spSave.get();
+    auto fnWrite = [pSave]()
+    {
+        pSave->success = WriteFileAtomic(pSave->path, pSave->text, pSave->restoreCR, pSave->encoding, pSave->converted);
+        if (pSave->success)
+        {
+            pSave->stamp = FileUtils::GetStamp(pSave->path);
+        }
+        pSave->finished = true;
+    };
+
+    m_spSave = spSave;
+    if (GetEditor().GetFlags() & ZepEditorFlags::DisableThreads)
+    {
+        fnWrite();
+        UpdateSave();
+    }
+    else
+    {
+        spSave->thread = std::thread(fnWrite);
+    }
     return true;
 }
 
-/* TODO:
-void ZepBuffer::LockRead()
+void ZepBuffer::UpdateSave()
 {
-    // Wait for line counter
-    if (m_lineCountResult.valid())
+    if (!m_spSave || !m_spSave->finished)
     {
-        m_lineCountResult.get();
+        return;
     }
-}*/
 
+    ZEP_TRACE_SCOPE("ZepBuffer::UpdateSave");
 
-// Replace the buffer buffer with the text 
-void ZepBuffer::SetText(const std::string& text)
-{
-    if (m_gapBuffer.size() != 0)
+    auto spSave = m_spSave;
+    if (spSave->thread.joinable())
     {
-        GetEditor().Broadcast(std::make_shared<BufferMessage>(this,
-            BufferMessageType::TextDeleted,
-            BufferLocation{ 0 },
-            BufferLocation{ long(m_gapBuffer.size()) }));
+        spSave->thread.join();
+    }
+    m_spSave.reset();
+
+    // Edits made while we were saving keep the buffer dirty
+    if (spSave->success && spSave->revision == m_revision)
+    {
+        m_dirty = false;
     }
 
-    ProcessInput(text);
+    // The rename replaced the file we were watching; and the journal, which now starts from the file we wrote
+    if (spSave->success && spSave->path == m_filePath)
+    {
+        m_changedOnDisk = false;
+        m_fileStamp = spSave->stamp;
+        WatchFile();
 
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this,
-        BufferMessageType::TextAdded,
-        BufferLocation{ 0 },
-        BufferLocation{ long(m_gapBuffer.size()) }));
+        CloseJournal();
+        if (m_journalFound)
+        {
+            std::remove(ZepJournal::PathFor(m_filePath).c_str());
+            m_journalFound = false;
+        }
+        if (m_dirty)
+        {
+            StartJournal();
+        }
+    }
+    auto type = spSave->success ? BufferMessageType::Saved : (spSave->converted ? BufferMessageType::SaveFailed : BufferMessageType::SaveConversionFailed);
+    GetEditor().Broadcast(MakeMessage(type, 0, 0));
 
-    // Doc is not dirty
-    m_dirty = 0;
+    if (m_savePending)
+    {
+        m_savePending = false;
+        SaveAsync();
+    }
 }
 
+void ZepBuffer::WaitForSave()
+{
+    while (m_spSave)
+    {
+        if (m_spSave->thread.joinable())
+        {
+            m_spSave->thread.join();
+        }
+        UpdateSave();
+    }
+}
 
 BufferLocation ZepBuffer::GetLinePos(long line, LineLocation location) const
 {
@@ -438,22 +1984,11 @@ BufferLocation ZepBuffer::GetLinePos(long line, LineLocation location) const
 
 bool ZepBuffer::Insert(const BufferLocation& startOffset, const std::string& str, const BufferLocation& cursorAfter)
 {
-    if (startOffset > m_gapBuffer.size())
-    {
-        return false;
-    }
-
-    BufferLocation changeRange{ long(m_gapBuffer.size()) };
-
-    // We are about to modify this range
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, startOffset, changeRange));
+    ZEP_TRACE_SCOPE("ZepBuffer::Insert");
 
-    // abcdef\r\nabc<insert>dfdf\r\n
-    auto itrLine = std::lower_bound(m_lineEnds.begin(), m_lineEnds.end(), startOffset);;
-    if (itrLine != m_lineEnds.end() &&
-        *itrLine <= startOffset)
+    if (IsReadOnly() || startOffset > m_gapBuffer.size())
     {
-        itrLine++;
+        return false;
     }
 
     auto itrEnd = str.end();
@@ -478,12 +2013,92 @@ bool ZepBuffer::Insert(const BufferLocation& startOffset, const std::string& str
         }
     }
 
+    StartJournal();
+
+    auto pText = (const utf8*)str.c_str();
+    InsertText(startOffset, pText, pText + str.size(), lines, cursorAfter);
+    m_dirty = true;
+    m_revision++;
+
+    if (m_spJournal)
+    {
+        m_spJournal->Insert(startOffset, str.data(), str.data() + str.size());
+    }
+    return true;
+}
+
+bool ZepBuffer::Replace(const BufferLocation& startOffset, const BufferLocation& endOffset, const std::string& str, const BufferLocation& cursorAfter)
+{
+    ZEP_TRACE_SCOPE("ZepBuffer::Replace");
+
+    if (IsReadOnly() || startOffset < 0 || startOffset > endOffset || endOffset > long(m_gapBuffer.size()) - 1)
+    {
+        return false;
+    }
+
+    StartJournal();
+
+    // We are about to modify this range
+    GetEditor().Broadcast(MakeMessage(BufferMessageType::PreBufferChange, startOffset, endOffset));
+
+    // The line ends in the range make way for those of the new text; those after it move by the difference
+    auto length = long(str.size());
+    auto difference = length - (endOffset - startOffset);
+    auto itrFirst = std::upper_bound(m_lineEnds.begin(), m_lineEnds.end(), startOffset);
+    auto itrLast = std::upper_bound(itrFirst, m_lineEnds.end(), endOffset);
+    for (auto itr = itrLast; itr != m_lineEnds.end(); itr++)
+    {
+        *itr += difference;
+    }
+
+    std::vector<long> lines;
+    for (auto pos = str.find('\n'); pos != std::string::npos; pos = str.find('\n', pos + 1))
+    {
+        lines.push_back(startOffset + long(pos) + 1);
+    }
+    auto first = itrFirst - m_lineEnds.begin();
+    m_lineEnds.erase(itrFirst, itrLast);
+    m_lineEnds.insert(m_lineEnds.begin() + first, lines.begin(), lines.end());
+
+    m_gapBuffer.erase(m_gapBuffer.begin() + startOffset, m_gapBuffer.begin() + endOffset);
+    m_gapBuffer.insert(m_gapBuffer.begin() + startOffset, str.begin(), str.end());
+    m_dirty = true;
+    m_revision++;
+
+    if (m_spJournal)
+    {
+        m_spJournal->Delete(startOffset, endOffset - startOffset);
+        m_spJournal->Insert(startOffset, str.data(), str.data() + str.size());
+    }
+
+    GetEditor().Broadcast(MakeMessage(BufferMessageType::TextDeleted, startOffset, endOffset));
+    GetEditor().Broadcast(MakeMessage(BufferMessageType::TextAdded, startOffset, startOffset + length, cursorAfter));
+    return true;
+}
+
+// Insert text for which we already know the line ends (as buffer offsets, after the insert)
+void ZepBuffer::InsertText(const BufferLocation& startOffset, const utf8* pBegin, const utf8* pEnd, const std::vector<long>& lines, const BufferLocation& cursorAfter)
+{
+    BufferLocation changeRange{ long(m_gapBuffer.size()) };
+
+    // We are about to modify this range
+    GetEditor().Broadcast(MakeMessage(BufferMessageType::PreBufferChange, startOffset, changeRange));
+
+    // abcdef\r\nabc<insert>dfdf\r\n
+    auto itrLine = std::lower_bound(m_lineEnds.begin(), m_lineEnds.end(), startOffset);;
+    if (itrLine != m_lineEnds.end() &&
+        *itrLine <= startOffset)
+    {
+        itrLine++;
+    }
+
     // Increment the rest of the line ends
     // We make all the remaning line ends bigger by the size of the insertion
+    auto length = long(pEnd - pBegin);
     auto itrAdd = itrLine;
     while (itrAdd != m_lineEnds.end())
     {
-        *itrAdd += long(str.length());
+        *itrAdd += length;
         itrAdd++;
     }
 
@@ -493,11 +2108,10 @@ bool ZepBuffer::Insert(const BufferLocation& startOffset, const std::string& str
         m_lineEnds.insert(itrLine, lines.begin(), lines.end());
     }
 
-    m_gapBuffer.insert(m_gapBuffer.begin() + startOffset, str.begin(), str.end());
+    m_gapBuffer.insert(m_gapBuffer.begin() + startOffset, pBegin, pEnd);
 
-    // This is the range we added (not valid any more in the buffer)
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextAdded, startOffset, changeRange, cursorAfter));
-    return true;
+    // This is the range we added
+    GetEditor().Broadcast(MakeMessage(BufferMessageType::TextAdded, startOffset, startOffset + length, cursorAfter));
 }
 
 // A fundamental operation - delete a range of characters
@@ -511,10 +2125,35 @@ bool ZepBuffer::Insert(const BufferLocation& startOffset, const std::string& str
 // This makes a few things fall out more easily
 bool ZepBuffer::Delete(const BufferLocation& startOffset, const BufferLocation& endOffset, const BufferLocation& cursorAfter)
 {
+    ZEP_TRACE_SCOPE("ZepBuffer::Delete");
+
+    if (IsReadOnly())
+    {
+        return false;
+    }
+
     assert(startOffset >= 0 && endOffset <= (m_gapBuffer.size() - 1));
 
+    StartJournal();
+    if (!DeleteText(startOffset, endOffset, cursorAfter))
+    {
+        return false;
+    }
+    m_dirty = true;
+    m_revision++;
+
+    if (m_spJournal)
+    {
+        m_spJournal->Delete(startOffset, endOffset - startOffset);
+    }
+    return true;
+}
+
+// Delete text, keeping the line ends up to date
+bool ZepBuffer::DeleteText(const BufferLocation& startOffset, const BufferLocation& endOffset, const BufferLocation& cursorAfter)
+{
     // We are about to modify this range
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, startOffset, endOffset));
+    GetEditor().Broadcast(MakeMessage(BufferMessageType::PreBufferChange, startOffset, endOffset));
 
     auto itrLine = std::lower_bound(m_lineEnds.begin(), m_lineEnds.end(), startOffset);
     if (itrLine == m_lineEnds.end())
@@ -545,11 +2184,47 @@ bool ZepBuffer::Delete(const BufferLocation& startOffset, const BufferLocation&
     assert(m_gapBuffer.size() > 0 && m_gapBuffer[m_gapBuffer.size() - 1] == 0);
 
     // This is the range we deleted (not valid any more in the buffer)
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextDeleted, startOffset, endOffset, cursorAfter));
-
+    GetEditor().Broadcast(MakeMessage(BufferMessageType::TextDeleted, startOffset, endOffset, cursorAfter));
     return true;
 }
 
+BufferMemory ZepBuffer::GetMemoryUsage() const
+{
+    BufferMemory mem;
+    mem.text = m_gapBuffer.size() * sizeof(utf8);
+    mem.gap = (m_gapBuffer.capacity() - m_gapBuffer.size()) * sizeof(utf8);
+    mem.lineEnds = m_lineEnds.capacity() * sizeof(long);
+    if (m_spSyntax)
+    {
+        mem.syntax = m_spSyntax->GetMemoryUsage();
+    }
+    if (m_spPager)
+    {
+        mem.pages = m_spPager->GetResidentBytes();
+    }
+    if (m_spBinary)
+    {
+        mem.pages = m_spBinary->GetResidentBytes();
+    }
+    mem.index = m_spTrigramIndex->GetMemoryUsage();
+    mem.brackets = m_spBrackets->GetMemoryUsage();
+    return mem;
+}
+
+// Every edit broadcasts a couple of messages; reuse the last one if no client kept hold of it
+std::shared_ptr<BufferMessage> ZepBuffer::MakeMessage(BufferMessageType type, const BufferLocation& startLoc, const BufferLocation& endLoc, const BufferLocation& cursor)
+{
+    if (m_spMessage && m_spMessage.use_count() == 1)
+    {
+        *m_spMessage = BufferMessage(this, type, startLoc, endLoc, cursor);
+    }
+    else
+    {
+        m_spMessage = std::make_shared<BufferMessage>(this, type, startLoc, endLoc, cursor);
+    }
+    return m_spMessage;
+}
+
 BufferLocation ZepBuffer::EndLocation() const
 {
     auto end = m_gapBuffer.size() - 1;
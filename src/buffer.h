@@ -6,6 +6,8 @@
 #include <set>
 
 #include "gap_buffer.h"
+#include "utils/encoding.h"
+#include "utils/fileutils.h"
 #if !(TARGET_PC)
 #define shared_mutex shared_timed_mutex
 #endif
@@ -13,6 +15,19 @@ namespace Zep
 {
 
 class ZepSyntax;
+struct BufferLoad;
+struct BufferFollow;
+struct BufferSave;
+struct BufferWatch;
+struct LoadChunk;
+class ZepFilePager;
+class ZepBinaryFile;
+class ZepJournal;
+class ZepRegex;
+struct RegexMatch;
+class ZepBufferSearch;
+class ZepTrigramIndex;
+class ZepBracketIndex;
 
 enum class SearchDirection
 {
@@ -53,6 +68,9 @@ enum class BufferMessageType
     TextChanged,
     TextDeleted,
     TextAdded,
+    Saved,
+    SaveFailed,
+    SaveConversionFailed    // Not saved: the file's encoding can't hold some of the text
 };
 struct BufferMessage : public ZepMessage
 {
@@ -92,6 +110,21 @@ struct BufferBlock
 };
 
 
+// Memory used by a buffer, in bytes, broken down by component
+struct BufferMemory
+{
+    size_t text = 0;        // Characters in the gap buffer
+    size_t gap = 0;         // Allocated but unused gap buffer space
+    size_t lineEnds = 0;    // Line index
+    size_t syntax = 0;      // Syntax highlighting state
+    size_t undo = 0;        // Undo/redo commands that refer to this buffer (filled in by the modes)
+    size_t pages = 0;       // Resident pages and line index of a paged file
+    size_t index = 0;       // Trigram search index
+    size_t brackets = 0;    // Bracket pair index
+
+    size_t Total() const { return text + gap + lineEnds + syntax + undo + pages + index + brackets; }
+};
+
 class ZepBuffer : public ZepComponent
 {
 public:
@@ -99,13 +132,126 @@ public:
     virtual ~ZepBuffer();
     void SetText(const std::string& strText);
 
+    // Load replaces the text with the file; Save writes it back.  When every line of the file ends with \r\n, the
+    // buffer holds them without the \r, and Save puts them back; otherwise any \r is kept as it is, as text.
+    // Text the file's encoding can't hold isn't saved at all, rather than written with something in its place
+    bool Load(const std::string& path);
+    bool Save();
+
+    // Background save: the text is copied, then written on a worker to a temporary file that is synced and renamed
+    // over the file, so the file is never left half written.  UpdateSave() (the display calls it every frame) sends
+    // a Saved, SaveFailed or SaveConversionFailed message when it is done.  Saving while a save is running saves again after it, with the
+    // latest text.  The buffer is only marked clean if it hasn't been edited since its text was copied.
+    bool SaveAsync();
+    void UpdateSave();
+    void WaitForSave();
+    bool IsSaving() const { return bool(m_spSave); }
+    uint64_t GetRevision() const { return m_revision; }
+
+    // A loaded or saved file is watched.  When it changes on disk, UpdateExternalChange() (the display calls it every
+    // frame) diffs the lines against the buffer and applies just the changed hunks, as one undoable edit through the
+    // current mode; so undo history, syntax and the view outside of the hunks survive.  A buffer with unsaved edits
+    // is left alone and marked as changed on disk; ReloadChanges() brings it up to date regardless.
+    void UpdateExternalChange();
+    bool ReloadChanges();
+    bool IsChangedOnDisk() const { return m_changedOnDisk; }
+
+    // Crash recovery.  Edits to a file are journalled (see ZepJournal) from the first one until the buffer matches
+    // the file again, and a clean close removes the journal.  Load finds a journal left behind by a crash;
+    // RecoverJournal() replays it onto the file's text and leaves the buffer dirty.  Until then nothing is journalled.
+    bool HasRecoveryJournal() const { return m_journalFound; }
+    bool RecoverJournal();
+    void FlushJournal();
+
+    // Progressive load: the first screen of text is read before returning, the rest is read on a worker and
+    // appended to the end of the buffer as UpdateLoad() picks it up (the display does this every frame).
+    // The buffer can be edited while loading; text typed at the very end stays ahead of the text still to come.
+    // Queries see only the loaded text; WaitForLoad() blocks until the whole file is in.
+    bool LoadAsync(const std::string& path);
+    void UpdateLoad();
+    void WaitForLoad();
+    bool IsLoading() const { return bool(m_spLoad); }
+    float GetLoadProgress() const;
+
+    // Read only paging, for files bigger than memory.  The buffer holds a window of the file's lines, which
+    // SetPagedWindow slides around.  A quarter of the budget is the window's: its text, syntax and line ends; the
+    // pager behind it keeps its cache and index inside the rest.  FindPaged searches the whole file for the next
+    // match after from (or the one before it), wrapping around, and slides the window to it
+    static const long PagedWindowLines = 4096;
+    bool OpenPaged(const std::string& path, size_t memoryBudget);
+    bool SetPagedWindow(long firstLine);
+    bool FindPaged(const ZepRegex& regex, BufferLocation from, SearchDirection dir, BufferLocation& location);
+    bool IsPaged() const { return bool(m_spPager); }
+    bool IsReadOnly() const { return IsPaged() || IsBinary(); }
+    long GetPagedFirstLine() const { return m_pagedFirstLine; }
+    ZepFilePager* GetPager() const { return m_spPager.get(); }
+
+    // Hex view of a binary file (see ZepBinaryFile).  Like paging, the buffer holds a window of formatted rows that
+    // SetBinaryWindow slides around; the text can't be edited, but bytes can be overwritten in place through it.
+    // OverwriteBinary takes a hex digit on the hex side, or any character on the ASCII side, and returns where the
+    // next one goes (-1 if nothing changed).  FindBinary returns the location of the match's first hex digit,
+    // sliding the window to it.  Saving writes just the overwritten bytes back.
+    static const long BinaryWindowRows = 4096;
+    bool OpenBinary(const std::string& path, size_t memoryBudget);
+    bool SetBinaryWindow(long firstRow);
+    bool IsBinary() const { return bool(m_spBinary); }
+    long GetBinaryFirstRow() const { return m_binaryFirstRow; }
+    ZepBinaryFile* GetBinaryFile() const { return m_spBinary.get(); }
+    int64_t BinaryOffsetAt(BufferLocation location) const;
+    BufferLocation OverwriteBinary(BufferLocation location, char ch);
+    BufferLocation FindBinary(const std::vector<uint8_t>& bytes, BufferLocation start, SearchDirection dir = SearchDirection::Forward);
+
+    // Lines of the whole file, and the one at the top of the buffer; only a window of them is held when paged or in
+    // the hex view (where they are rows), otherwise these are the buffer's own
+    long GetFileLineCount() const;
+    long GetFileFirstLine() const;
+    bool SetFileWindow(long firstLine);
+
+    // Tail follow, for logs: loads the file, then appends whatever is written to the end of it.  UpdateFollow()
+    // (the display calls it every frame) reads only the new bytes; a file that shrinks is loaded again
+    bool Follow(const std::string& path);
+    void StopFollow();
+    void UpdateFollow();
+    bool IsFollowing() const { return bool(m_spFollow); }
+
+    const std::string& GetFilePath() const { return m_filePath; }
+    void SetFilePath(const std::string& path) { m_filePath = path; }
+
+    // A copy the editor keeps for itself, such as the file's side of a diff.  It stops being the file: OpenFile won't
+    // return it, it isn't watched or journaled, and :vimgrep leaves it out
+    void SetTemporary();
+    bool IsTemporary() const { return m_temporary; }
+
+    // The text is always UTF-8.  Loading detects the file's encoding and converts from it as the file is read;
+    // saving converts back, so a UTF-16 or Latin-1 file stays one.  SetEncoding changes what the next save writes.
+    const FileEncoding& GetEncoding() const { return m_encoding; }
+    void SetEncoding(const FileEncoding& encoding) { m_encoding = encoding; }
+
     BufferBlock GetBlock(uint32_t searchType, BufferLocation start, SearchDirection dir) const;
 
+    // The count'th ch after start, or before it, without leaving start's line; InvalidOffset if the line doesn't have
+    // that many.  One pass however big the count, for f/t and friends
+    BufferLocation FindOnLine(utf8 ch, BufferLocation start, SearchDirection dir, long count = 1) const;
+
+    // The start of the first match of a Vim pattern in [start, end] (an end of -1 is the end of the buffer), or going
+    // backwards the last match before start, back as far as end; InvalidOffset if there isn't one
     BufferLocation Search(const std::string& str,
         BufferLocation start,
         SearchDirection dir = SearchDirection::Forward,
         BufferLocation end = BufferLocation{ -1l }) const;
 
+    // The first match starting at or after start, or the last one starting before it; no wrapping
+    bool FindMatch(const ZepRegex& regex, BufferLocation start, SearchDirection dir, RegexMatch& match) const;
+
+    // Matches of the highlighted search pattern, kept up to date as the buffer is edited
+    ZepBufferSearch& GetSearch() const { return *m_spSearch; }
+
+    // Narrows down where searches of big buffers look
+    ZepTrigramIndex& GetTrigramIndex() const { return *m_spTrigramIndex; }
+
+    // Pairs up the brackets, for % and the bracket motions and text objects
+    ZepBracketIndex& GetBrackets() const { return *m_spBrackets; }
+
     BufferLocation GetLinePos(long line, LineLocation location) const;
     bool GetLineOffsets(const long line, long& charStart, long& charEnd) const;
     BufferLocation Clamp(BufferLocation location) const;
@@ -115,6 +261,10 @@ public:
     bool Delete(const BufferLocation& startOffset, const BufferLocation& endOffset, const BufferLocation& cursorAfter = BufferLocation{ -1 });
     bool Insert(const BufferLocation& startOffset, const std::string& str, const BufferLocation& cursorAfter = BufferLocation{ -1 });
 
+    // The range's text swapped for str in one change: the line index is patched once, and clients are told of one
+    // delete and one insert, however much of the text it is
+    bool Replace(const BufferLocation& startOffset, const BufferLocation& endOffset, const std::string& str, const BufferLocation& cursorAfter = BufferLocation{ -1 });
+
     long GetLineCount() const { return long(m_lineEnds.size()); }
     long LineFromOffset(long offset) const;
     BufferLocation LocationFromOffset(const BufferLocation& location, long offset) const;
@@ -123,31 +273,68 @@ public:
     BufferLocation EndLocation() const;
 
     const GapBuffer<utf8>& GetText() const { return m_gapBuffer; }
-    const std::vector<long> GetLineEnds() const { return m_lineEnds; }
-    bool IsDirty() const { return m_dirty; }
+    const std::vector<long>& GetLineEnds() const { return m_lineEnds; }
+    bool IsDirty() const;
 
-    void SetSyntax(std::shared_ptr<ZepSyntax> spSyntax) { m_spSyntax = spSyntax; }
+    void SetSyntax(std::shared_ptr<ZepSyntax> spSyntax);
     ZepSyntax* GetSyntax() const { return m_spSyntax.get(); }
 
     const std::string& GetName() const { return m_strName; }
 
+    BufferMemory GetMemoryUsage() const;
+
     virtual void Notify(std::shared_ptr<ZepMessage> message) override;
 
 private:
     // Internal
     GapBuffer<utf8>::const_iterator SearchWord(uint32_t searchType, GapBuffer<utf8>::const_iterator itrBegin, GapBuffer<utf8>::const_iterator itrEnd, SearchDirection dir) const;
 
-    void ProcessInput(const std::string& str);
+    void ReplaceText(const std::string& text, LineEndFormat format = LineEndFormat::Unknown);
+    void BeginReplaceText();
+    void EndReplaceText(size_t size, LineEndFormat format = LineEndFormat::Unknown);
+    void InsertText(const BufferLocation& startOffset, const utf8* pBegin, const utf8* pEnd, const std::vector<long>& lines, const BufferLocation& cursorAfter);
+    bool DeleteText(const BufferLocation& startOffset, const BufferLocation& endOffset, const BufferLocation& cursorAfter);
+    void AppendChunk(LoadChunk& chunk);
+    void RestoreCR();
+    void WatchFile();
+    void StartJournal();
+    void CloseJournal();
+    void CancelLoad();
+    bool SaveBinary();
+    std::shared_ptr<BufferMessage> MakeMessage(BufferMessageType type, const BufferLocation& startLoc, const BufferLocation& endLoc, const BufferLocation& cursor = BufferLocation{ -1 });
 
 private:
     bool m_dirty;                              // Is the text modified?
     GapBuffer<utf8> m_gapBuffer;                  // Storage for the text - a gap buffer for efficiency
     std::vector<long> m_lineEnds;              // End of each line
     ThreadPool m_threadPool;
+    std::shared_ptr<ZepBufferSearch> m_spSearch; // Searches on the thread pool, so is destroyed before it
+    std::shared_ptr<ZepTrigramIndex> m_spTrigramIndex; // Indexes on the thread pool too
     uint32_t m_flags;
     std::shared_ptr<ZepSyntax> m_spSyntax;
+    std::shared_ptr<ZepBracketIndex> m_spBrackets; // Reads the syntax, so is destroyed before it
     std::string m_strName;
-    bool m_bStrippedCR;
+    std::string m_filePath;
+    LineEndFormat m_lineEndFormat = LineEndFormat::Unknown; // Of the file; DOS files are written back with \r\n
+    std::shared_ptr<BufferMessage> m_spMessage;  // Recycled between edits
+    std::shared_ptr<BufferLoad> m_spLoad;        // Background load in progress
+    std::shared_ptr<ZepFilePager> m_spPager;     // Source of the text when paged
+    long m_pagedFirstLine = 0;                   // File line at the top of the buffer when paged
+    size_t m_pagedWindowBudget = 0;              // Bytes the window's text, syntax and line ends can use
+    std::shared_ptr<ZepBinaryFile> m_spBinary;   // Source of the hex view
+    long m_binaryFirstRow = 0;                   // Row at the top of the buffer in the hex view
+    std::shared_ptr<BufferFollow> m_spFollow;    // File we are appending from
+    uint64_t m_fileOffset = 0;                   // Bytes of the file that have been read into the buffer
+    std::shared_ptr<BufferSave> m_spSave;        // Background save in progress
+    bool m_savePending = false;                  // Save again when it finishes
+    uint64_t m_revision = 0;                     // Incremented by every change to the text
+    std::shared_ptr<BufferWatch> m_spWatch;      // Watching the file for changes made outside
+    bool m_changedOnDisk = false;                // Changed outside, while we had unsaved edits
+    std::shared_ptr<ZepJournal> m_spJournal;     // Edits since the text last matched the file
+    FileUtils::FileStamp m_fileStamp;            // The file as the text was last read from it or written to it
+    bool m_journalFound = false;                 // A journal from an earlier session is waiting to be recovered
+    bool m_temporary = false;                    // Not the file it was read from
+    FileEncoding m_encoding;                     // Of the file; the buffer holds UTF-8
 };
 
 } // Zep
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "buffer.h"
+
+namespace Zep
+{
+
+// A buffer's text cut into blocks of whole lines, for the indexes that keep something per block (the trigram and
+// bracket indexes).  The blocks follow the edits: Update() resizes, joins and marks out of date the blocks an edit
+// touches, calling back for each so the index can drop what it had for it.  Each block is the index's payload and
+// its size.
+template<class TPayload>
+class ZepLineBlocks
+{
+public:
+    struct Block : public TPayload
+    {
+        long size = 0;          // Bytes, ending at a line end (or the end of the buffer)
+    };
+
+    using iterator = typename std::vector<Block>::iterator;
+    using const_iterator = typename std::vector<Block>::const_iterator;
+
+    bool empty() const { return m_blocks.empty(); }
+    size_t size() const { return m_blocks.size(); }
+    Block& operator[](size_t block) { return m_blocks[block]; }
+    const Block& operator[](size_t block) const { return m_blocks[block]; }
+    iterator begin() { return m_blocks.begin(); }
+    iterator end() { return m_blocks.end(); }
+    const_iterator begin() const { return m_blocks.begin(); }
+    const_iterator end() const { return m_blocks.end(); }
+
+    // All the text in one block, to be split
+    void Reset(long textSize)
+    {
+        m_blocks.assign(1, Block());
+        m_blocks.back().size = textSize;
+    }
+
+    void Clear()
+    {
+        std::vector<Block>().swap(m_blocks);
+    }
+
+    long GetTextSize() const
+    {
+        return std::accumulate(m_blocks.begin(), m_blocks.end(), 0l, [](long size, const Block& block) { return size + block.size; });
+    }
+
+    size_t GetMemoryUsage() const
+    {
+        return m_blocks.capacity() * sizeof(Block);
+    }
+
+    // The block with the location in it; the last one for the end of the buffer
+    size_t Find(BufferLocation location, BufferLocation& blockStart) const
+    {
+        blockStart = 0;
+        for (size_t block = 0; block < m_blocks.size() - 1; block++)
+        {
+            if (location < blockStart + m_blocks[block].size)
+            {
+                return block;
+            }
+            blockStart += m_blocks[block].size;
+        }
+        return m_blocks.size() - 1;
+    }
+
+    // Cut big blocks that are out of date (after a load, or a big paste) at the first line ends past each block's
+    // worth; new blocks get a default payload
+    template<class FnOutOfDate>
+    void Split(const std::vector<long>& lineEnds, long blockSize, FnOutOfDate fnOutOfDate)
+    {
+        if (std::none_of(m_blocks.begin(), m_blocks.end(), [&](const Block& block) { return fnOutOfDate(block) && block.size > blockSize * 2; }))
+        {
+            return;
+        }
+
+        std::vector<Block> blocks;
+        long start = 0;
+        for (auto& block : m_blocks)
+        {
+            auto end = start + block.size;
+            if (fnOutOfDate(block) && block.size > blockSize * 2)
+            {
+                for (auto pos = start; pos < end;)
+                {
+                    auto cut = end;
+                    if (end - pos > blockSize * 2)
+                    {
+                        cut = std::min(end, *std::lower_bound(lineEnds.begin(), lineEnds.end(), pos + blockSize));
+                    }
+                    blocks.emplace_back();
+                    blocks.back().size = cut - pos;
+                    pos = cut;
+                }
+            }
+            else
+            {
+                blocks.push_back(std::move(block));
+            }
+            start = end;
+        }
+        m_blocks.swap(blocks);
+    }
+
+    // Follow an edit; fnInvalidate(block) is called for each block whose text it changed, before any are joined
+    template<class FnInvalidate>
+    void Update(const BufferMessage& message, FnInvalidate fnInvalidate)
+    {
+        if (m_blocks.empty())
+        {
+            return;
+        }
+
+        auto start = message.startLocation;
+        auto end = message.endLocation;
+        BufferLocation blockStart = 0;
+        if (message.type == BufferMessageType::TextAdded)
+        {
+            auto block = Find(start, blockStart);
+            m_blocks[block].size += end - start;
+            fnInvalidate(block);
+        }
+        else if (message.type == BufferMessageType::TextDeleted)
+        {
+            // The blocks the deleted text was in become one; and so does the block after, if its line was joined onto them
+            auto first = Find(start, blockStart);
+            auto last = first;
+            auto blockEnd = blockStart + m_blocks[first].size;
+            while (last + 1 < m_blocks.size() && blockEnd <= end)
+            {
+                blockEnd += m_blocks[++last].size;
+            }
+
+            for (auto block = first; block <= last; block++)
+            {
+                fnInvalidate(block);
+            }
+            m_blocks[first].size = (blockEnd - blockStart) - (end - start);
+            m_blocks.erase(m_blocks.begin() + first + 1, m_blocks.begin() + last + 1);
+        }
+        else if (message.type == BufferMessageType::TextChanged)
+        {
+            auto first = Find(start, blockStart);
+            for (auto block = first; block < m_blocks.size() && blockStart <= end; blockStart += m_blocks[block++].size)
+            {
+                fnInvalidate(block);
+            }
+        }
+    }
+
+private:
+    std::vector<Block> m_blocks;    // In text order
+};
+
+} // Zep
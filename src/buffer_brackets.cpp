@@ -0,0 +1,569 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+#include "buffer_brackets.h"
+#include "syntax.h"
+#include "utils/trace.h"
+
+namespace Zep
+{
+
+namespace
+{
+// kind << 1 | open for each bracket character: ( ) are kind 0, [ ] 1 and { } 2
+struct BracketTable
+{
+    static const uint8_t None = 0xff;
+    uint8_t codes[256];
+
+    BracketTable()
+    {
+        std::memset(codes, None, sizeof(codes));
+        codes[uint8_t('(')] = 1;
+        codes[uint8_t(')')] = 0;
+        codes[uint8_t('[')] = 3;
+        codes[uint8_t(']')] = 2;
+        codes[uint8_t('{')] = 5;
+        codes[uint8_t('}')] = 4;
+    }
+};
+const BracketTable Brackets;
+
+long Offset(uint32_t bracket)
+{
+    return long(bracket >> 3);
+}
+
+int Kind(uint32_t bracket)
+{
+    return int(bracket >> 1) & 3;
+}
+
+bool IsOpen(uint32_t bracket)
+{
+    return (bracket & 1) != 0;
+}
+
+// The brackets in [start, end), with their offsets from start
+void GetBrackets(const GapBuffer<utf8>& text, long start, long end, std::vector<uint32_t>& brackets)
+{
+    auto add = [&](const utf8* pBegin, const utf8* pEnd, long offset)
+    {
+        for (auto p = pBegin; p < pEnd; p++)
+        {
+            auto code = Brackets.codes[*p];
+            if (code != BracketTable::None)
+            {
+                brackets.push_back(uint32_t(offset + (p - pBegin)) << 3 | code);
+            }
+        }
+    };
+
+    // Either side of the gap
+    auto before = long(text.m_pGapStart - text.m_pStart);
+    if (start < before)
+    {
+        add(text.m_pStart + start, text.m_pStart + std::min(end, before), 0);
+    }
+    if (end > before)
+    {
+        auto from = std::max(start, before);
+        add(text.m_pGapEnd + (from - before), text.m_pGapEnd + (end - before), from - start);
+    }
+}
+}
+
+ZepBracketIndex::ZepBracketIndex(ZepBuffer& buffer)
+    : ZepComponent(buffer.GetEditor()),
+    m_buffer(buffer),
+    m_stop(false)
+{
+}
+
+ZepBracketIndex::~ZepBracketIndex()
+{
+    Interrupt();
+}
+
+void ZepBracketIndex::Reset()
+{
+    Interrupt();
+    Clear();
+}
+
+// Stop scanning, and keep the blocks that were finished; true if it was running.
+// An edit passes where it starts: the syntax may have been moved on past it already, so it can't be read there
+bool ZepBracketIndex::Interrupt(BufferLocation classifyLimit)
+{
+    if (m_results.empty())
+    {
+        return false;
+    }
+
+    m_stop = true;
+    for (auto& result : m_results)
+    {
+        auto found = result.get();
+        Merge(found, classifyLimit);
+    }
+    m_results.clear();
+    m_stop = false;
+    return true;
+}
+
+void ZepBracketIndex::Clear()
+{
+    m_blocks.Clear();
+}
+
+// Scanning text the syntax hasn't got to would only have to be done again, so it waits for it
+bool ZepBracketIndex::IsSyntaxComplete() const
+{
+    auto pSyntax = m_buffer.GetSyntax();
+    return !pSyntax || pSyntax->GetSettledChar() >= long(m_buffer.GetText().size()) - 1;
+}
+
+bool ZepBracketIndex::Update()
+{
+    if (m_buffer.IsPaged() || m_buffer.IsBinary())
+    {
+        Interrupt();
+        Clear();
+        return false;
+    }
+
+    // Take the results once they are all in
+    bool changed = false;
+    if (std::all_of(m_results.begin(), m_results.end(), [](std::future<BlockBrackets>& result)
+    {
+        return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }))
+    {
+        changed = Interrupt();
+    }
+
+    if (m_blocks.empty())
+    {
+        m_blocks.Reset(long(m_buffer.GetText().size()));
+    }
+
+    assert(m_blocks.GetTextSize() == long(m_buffer.GetText().size()));
+
+    if (m_results.empty() && IsSyntaxComplete())
+    {
+        for (size_t block = 0; block < m_blocks.size(); block++)
+        {
+            if (m_blocks[block].scanned && !m_blocks[block].classified)
+            {
+                Invalidate(block);
+            }
+        }
+        Split();
+        Scan();
+    }
+    return changed;
+}
+
+// Finish scanning, whether the syntax has caught up or not
+void ZepBracketIndex::Wait()
+{
+    Update();
+    if (m_blocks.empty())
+    {
+        return;
+    }
+
+    if (m_results.empty())
+    {
+        Split();
+        Scan();
+    }
+    for (auto& result : m_results)
+    {
+        result.wait();
+    }
+    Interrupt();
+}
+
+bool ZepBracketIndex::IsComplete() const
+{
+    return !m_blocks.empty() && m_results.empty() && std::all_of(m_blocks.begin(), m_blocks.end(), [](const Block& block)
+    {
+        return block.scanned && block.classified;
+    });
+}
+
+// Each task takes a share of the blocks
+void ZepBracketIndex::Scan()
+{
+    // Without threads, the brackets go straight into the blocks, which keep their storage from the last scan
+    if (GetEditor().GetFlags() & ZepEditorFlags::DisableThreads)
+    {
+        long start = 0;
+        for (auto& block : m_blocks)
+        {
+            if (!block.scanned)
+            {
+                GetBrackets(m_buffer.GetText(), start, start + block.size, block.brackets);
+                Classify(block, start, std::numeric_limits<BufferLocation>::max());
+            }
+            start += block.size;
+        }
+        return;
+    }
+
+    std::vector<std::pair<size_t, long>> jobs;
+    long start = 0;
+    for (size_t block = 0; block < m_blocks.size(); block++)
+    {
+        if (!m_blocks[block].scanned)
+        {
+            jobs.push_back(std::make_pair(block, start));
+        }
+        start += m_blocks[block].size;
+    }
+    if (jobs.empty())
+    {
+        return;
+    }
+
+    auto runJobs = [this](std::vector<std::pair<size_t, long>> jobs, std::vector<long> sizes)
+    {
+        ZEP_TRACE_SCOPE("ZepBracketIndex::Scan");
+
+        BlockBrackets found;
+        for (size_t job = 0; job < jobs.size() && !m_stop; job++)
+        {
+            std::vector<uint32_t> brackets;
+            GetBrackets(m_buffer.GetText(), jobs[job].second, jobs[job].second + sizes[job], brackets);
+            found.push_back(std::make_pair(jobs[job], std::move(brackets)));
+        }
+        return found;
+    };
+
+    auto tasks = std::min(std::max(1u, std::thread::hardware_concurrency()), unsigned(jobs.size()));
+    for (unsigned task = 0; task < tasks; task++)
+    {
+        std::vector<std::pair<size_t, long>> taskJobs;
+        std::vector<long> sizes;
+        for (size_t job = task; job < jobs.size(); job += tasks)
+        {
+            taskJobs.push_back(jobs[job]);
+            sizes.push_back(m_blocks[jobs[job].first].size);
+        }
+        m_results.push_back(m_buffer.GetThreadPool().enqueue(runJobs, taskJobs, sizes));
+    }
+}
+
+// Brackets of blocks scanned on the thread pool
+void ZepBracketIndex::Merge(BlockBrackets& found, BufferLocation classifyLimit)
+{
+    for (auto& blockBrackets : found)
+    {
+        auto& block = m_blocks[blockBrackets.first.first];
+        blockBrackets.second.shrink_to_fit();
+        block.brackets.swap(blockBrackets.second);
+        Classify(block, blockBrackets.first.second, classifyLimit);
+    }
+}
+
+// Drop the brackets the syntax puts in comments and strings, and count what the block leaves unpaired.  The syntax
+// is only read here, on the editor's thread, and only where an update that may be running won't write
+void ZepBracketIndex::Classify(Block& block, BufferLocation blockStart, BufferLocation classifyLimit)
+{
+    auto pSyntax = m_buffer.GetSyntax();
+    auto& brackets = block.brackets;
+    block.classified = true;
+    if (pSyntax)
+    {
+        auto& syntax = pSyntax->GetText();
+        auto processed = std::min({ pSyntax->GetSettledChar(), long(syntax.size()), classifyLimit });
+        brackets.erase(std::remove_if(brackets.begin(), brackets.end(), [&](uint32_t bracket)
+        {
+            auto location = blockStart + Offset(bracket);
+            if (location >= processed)
+            {
+                block.classified = false;
+                return false;
+            }
+            return (syntax[location] & (SyntaxType::Comment | SyntaxType::String)) != 0;
+        }), brackets.end());
+    }
+
+    uint32_t depth[3] = {};
+    for (auto bracket : brackets)
+    {
+        auto kind = Kind(bracket);
+        if (IsOpen(bracket))
+        {
+            depth[kind]++;
+        }
+        else if (depth[kind] > 0)
+        {
+            depth[kind]--;
+        }
+        else
+        {
+            block.closes[kind]++;
+        }
+    }
+    std::copy(depth, depth + 3, block.opens);
+    block.scanned = true;
+}
+
+// Cut big blocks that need scanning (after a load, or a big paste)
+void ZepBracketIndex::Split()
+{
+    m_blocks.Split(m_buffer.GetLineEnds(), BlockSize, [](const Block& block) { return !block.scanned; });
+}
+
+// The block keeps its storage for the next scan
+void ZepBracketIndex::Invalidate(size_t block)
+{
+    auto& invalid = m_blocks[block];
+    invalid.scanned = false;
+    invalid.classified = false;
+    invalid.brackets.clear();
+    std::fill(invalid.opens, invalid.opens + 3, 0);
+    std::fill(invalid.closes, invalid.closes + 3, 0);
+}
+
+// The bracket at the location, once the index is up to date
+bool ZepBracketIndex::FindBracket(BufferLocation location, size_t& block, BufferLocation& blockStart, size_t& index)
+{
+    Wait();
+    if (m_blocks.empty())
+    {
+        return false;
+    }
+
+    block = m_blocks.Find(location, blockStart);
+    auto& brackets = m_blocks[block].brackets;
+    auto offset = uint32_t(location - blockStart);
+    auto itr = std::lower_bound(brackets.begin(), brackets.end(), offset << 3);
+    index = size_t(itr - brackets.begin());
+    return itr != brackets.end() && Offset(*itr) == offset;
+}
+
+// The first close bracket of the kind from the index on that isn't paired with an open one after the index; the
+// blocks after this one are stepped over by their counts until the one it's in
+BufferLocation ZepBracketIndex::FindClose(size_t block, BufferLocation blockStart, size_t index, int kind) const
+{
+    uint32_t need = 1;
+    auto& brackets = m_blocks[block].brackets;
+    for (auto i = index; i < brackets.size(); i++)
+    {
+        if (Kind(brackets[i]) == kind && (IsOpen(brackets[i]) ? need++ : --need) == 0)
+        {
+            return blockStart + Offset(brackets[i]);
+        }
+    }
+
+    for (blockStart += m_blocks[block].size, block++; block < m_blocks.size(); blockStart += m_blocks[block++].size)
+    {
+        auto& next = m_blocks[block];
+        if (next.closes[kind] >= need)
+        {
+            uint32_t depth = 0;
+            for (auto bracket : next.brackets)
+            {
+                if (Kind(bracket) != kind)
+                {
+                    continue;
+                }
+                if (IsOpen(bracket))
+                {
+                    depth++;
+                }
+                else if (depth > 0)
+                {
+                    depth--;
+                }
+                else if (--need == 0)
+                {
+                    return blockStart + Offset(bracket);
+                }
+            }
+        }
+        need += next.opens[kind] - next.closes[kind];
+    }
+    return -1;
+}
+
+// The same, back from the bracket before the index
+BufferLocation ZepBracketIndex::FindOpen(size_t block, BufferLocation blockStart, size_t index, int kind) const
+{
+    uint32_t need = 1;
+    auto& brackets = m_blocks[block].brackets;
+    for (auto i = index; i-- > 0;)
+    {
+        if (Kind(brackets[i]) == kind && (IsOpen(brackets[i]) ? --need : need++) == 0)
+        {
+            return blockStart + Offset(brackets[i]);
+        }
+    }
+
+    while (block-- > 0)
+    {
+        auto& previous = m_blocks[block];
+        blockStart -= previous.size;
+        if (previous.opens[kind] >= need)
+        {
+            uint32_t depth = 0;
+            for (auto i = previous.brackets.size(); i-- > 0;)
+            {
+                auto bracket = previous.brackets[i];
+                if (Kind(bracket) != kind)
+                {
+                    continue;
+                }
+                if (!IsOpen(bracket))
+                {
+                    depth++;
+                }
+                else if (depth > 0)
+                {
+                    depth--;
+                }
+                else if (--need == 0)
+                {
+                    return blockStart + Offset(bracket);
+                }
+            }
+        }
+        need += previous.closes[kind] - previous.opens[kind];
+    }
+    return -1;
+}
+
+// Open brackets of the kind before the index that aren't closed before it
+long ZepBracketIndex::GetDepthAt(size_t block, size_t index, int kind) const
+{
+    uint32_t depth = 0;
+    for (size_t previous = 0; previous < block; previous++)
+    {
+        auto& counts = m_blocks[previous];
+        depth = (depth > counts.closes[kind] ? depth - counts.closes[kind] : 0) + counts.opens[kind];
+    }
+
+    auto& brackets = m_blocks[block].brackets;
+    for (size_t i = 0; i < index; i++)
+    {
+        if (Kind(brackets[i]) == kind)
+        {
+            depth = IsOpen(brackets[i]) ? depth + 1 : (depth > 0 ? depth - 1 : 0);
+        }
+    }
+    return long(depth);
+}
+
+BufferLocation ZepBracketIndex::FindMatch(BufferLocation location)
+{
+    ZEP_TRACE_SCOPE("ZepBracketIndex::FindMatch");
+
+    size_t block;
+    size_t index;
+    BufferLocation blockStart;
+    if (!FindBracket(location, block, blockStart, index))
+    {
+        return -1;
+    }
+
+    auto bracket = m_blocks[block].brackets[index];
+    return IsOpen(bracket) ? FindClose(block, blockStart, index + 1, Kind(bracket)) : FindOpen(block, blockStart, index, Kind(bracket));
+}
+
+BufferLocation ZepBracketIndex::FindEnclosing(BufferLocation location, utf8 open)
+{
+    ZEP_TRACE_SCOPE("ZepBracketIndex::FindEnclosing");
+
+    auto code = Brackets.codes[open];
+    size_t block;
+    size_t index;
+    BufferLocation blockStart;
+    if (code == BracketTable::None || !IsOpen(code))
+    {
+        return -1;
+    }
+    FindBracket(location, block, blockStart, index);
+    return m_blocks.empty() ? -1 : FindOpen(block, blockStart, index, Kind(code));
+}
+
+BufferLocation ZepBracketIndex::FindNext(BufferLocation start, BufferLocation end)
+{
+    Wait();
+    if (m_blocks.empty())
+    {
+        return -1;
+    }
+
+    BufferLocation blockStart;
+    for (auto block = m_blocks.Find(start, blockStart); block < m_blocks.size() && blockStart < end; blockStart += m_blocks[block++].size)
+    {
+        auto& brackets = m_blocks[block].brackets;
+        auto offset = uint32_t(std::max(start - blockStart, 0l));
+        auto itr = std::lower_bound(brackets.begin(), brackets.end(), offset << 3);
+        if (itr != brackets.end())
+        {
+            auto location = blockStart + Offset(*itr);
+            return location < end ? location : -1;
+        }
+    }
+    return -1;
+}
+
+long ZepBracketIndex::GetDepth(BufferLocation location)
+{
+    size_t block;
+    size_t index;
+    BufferLocation blockStart;
+    if (!FindBracket(location, block, blockStart, index))
+    {
+        return -1;
+    }
+
+    // A close bracket is as deep as its open one; after it, its pair is closed
+    auto bracket = m_blocks[block].brackets[index];
+    return GetDepthAt(block, IsOpen(bracket) ? index : index + 1, Kind(bracket));
+}
+
+size_t ZepBracketIndex::GetMemoryUsage() const
+{
+    size_t size = m_blocks.GetMemoryUsage();
+    for (auto& block : m_blocks)
+    {
+        size += block.brackets.capacity() * sizeof(uint32_t);
+    }
+    return size;
+}
+
+void ZepBracketIndex::Notify(std::shared_ptr<ZepMessage> spMsg)
+{
+    if (spMsg->messageId != Msg_Buffer || m_blocks.empty())
+    {
+        return;
+    }
+
+    auto spBufferMsg = std::static_pointer_cast<BufferMessage>(spMsg);
+    if (spBufferMsg->pBuffer != &m_buffer)
+    {
+        return;
+    }
+
+    // Replacing the text says it was deleted before saying it will change; so stop on either
+    if (spBufferMsg->type == BufferMessageType::PreBufferChange)
+    {
+        Interrupt();
+    }
+    else
+    {
+        Interrupt(spBufferMsg->startLocation);
+    }
+    m_blocks.Update(*spBufferMsg, [this](size_t block) { Invalidate(block); });
+}
+
+} // Zep
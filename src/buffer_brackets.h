@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <limits>
+
+#include "buffer.h"
+#include "buffer_blocks.h"
+
+namespace Zep
+{
+
+// The brackets of a buffer, for % and the bracket motions and text objects.
+// The text is cut into blocks of whole lines, like the trigram index, and each block keeps the ( ) [ ] { } in it that
+// the syntax doesn't put in a comment or a string, along with how many of each kind it leaves open and closes that it
+// didn't open.  A bracket's partner is found by pairing up the rest of its block, then stepping over whole blocks by
+// those counts until the one it is in; so a query reads a block or two, not the text between the brackets.
+// Blocks are scanned on the thread pool; an edit marks the blocks it touches to be scanned again.  Update() (the
+// display calls it every frame) starts the scans, once the syntax has caught up with the text; a query finishes them
+// first, whatever the syntax is doing, and scans again later what the syntax hadn't got to.
+class ZepBracketIndex : public ZepComponent
+{
+public:
+    static const long BlockSize = 256 * 1024;
+
+    ZepBracketIndex(ZepBuffer& buffer);
+    virtual ~ZepBracketIndex();
+
+    virtual void Notify(std::shared_ptr<ZepMessage> message) override;
+
+    // Pick up the blocks scanned so far, and scan any that need it; true if the index changed
+    bool Update();
+    void Wait();
+    bool IsComplete() const;
+
+    // Scan everything again; the syntax has changed
+    void Reset();
+
+    // The other bracket of the pair the one at location is in; -1 if there's no bracket there, or it has no partner
+    BufferLocation FindMatch(BufferLocation location);
+
+    // The open bracket (one of "([{") of the innermost pair of its kind around location; -1 if there isn't one
+    BufferLocation FindEnclosing(BufferLocation location, utf8 open);
+
+    // The first bracket in [start, end); -1 if there isn't one
+    BufferLocation FindNext(BufferLocation start, BufferLocation end);
+
+    // Pairs of its kind around the bracket at location; -1 if there's no bracket there
+    long GetDepth(BufferLocation location);
+
+    size_t GetMemoryUsage() const;
+
+private:
+    struct BlockScan
+    {
+        bool scanned = false;               // False until the brackets are found, and again after an edit
+        bool classified = false;            // The syntax had got to all of its brackets
+        std::vector<uint32_t> brackets;     // Offset in the block << 3 | kind << 1 | open, in order
+        uint32_t opens[3] = {};             // Of each kind, open brackets the block doesn't close
+        uint32_t closes[3] = {};            // ... and close brackets it didn't open
+    };
+    using Block = ZepLineBlocks<BlockScan>::Block;
+
+    // Brackets of blocks (and where each block starts), from the thread pool; the syntax is checked when they are merged
+    using BlockBrackets = std::vector<std::pair<std::pair<size_t, BufferLocation>, std::vector<uint32_t>>>;
+
+    bool Interrupt(BufferLocation classifyLimit = std::numeric_limits<BufferLocation>::max());
+    void Clear();
+    void Scan();
+    void Merge(BlockBrackets& found, BufferLocation classifyLimit);
+    void Classify(Block& block, BufferLocation blockStart, BufferLocation classifyLimit);
+    void Split();
+    void Invalidate(size_t block);
+    bool IsSyntaxComplete() const;
+    bool FindBracket(BufferLocation location, size_t& block, BufferLocation& blockStart, size_t& index);
+    BufferLocation FindClose(size_t block, BufferLocation blockStart, size_t index, int kind) const;
+    BufferLocation FindOpen(size_t block, BufferLocation blockStart, size_t index, int kind) const;
+    long GetDepthAt(size_t block, size_t index, int kind) const;
+
+private:
+    ZepBuffer& m_buffer;
+    ZepLineBlocks<BlockScan> m_blocks;
+    std::vector<std::future<BlockBrackets>> m_results;              // Blocks being scanned on the thread pool
+    std::atomic<bool> m_stop;
+};
+
+} // Zep
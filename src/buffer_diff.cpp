@@ -0,0 +1,249 @@
+#include "buffer_diff.h"
+#include "buffer.h"
+
+#include "utils/trace.h"
+
+#include <algorithm>
+#include <future>
+#include <limits>
+
+namespace Zep
+{
+
+namespace
+{
+// Below this many lines to hash, handing them out to the pool costs more than it saves
+const long ParallelHashLines = 64 * 1024;
+
+long HunkStart(const DiffHunk& hunk, DiffSide side)
+{
+    return side == DiffSide::Old ? hunk.oldStart : hunk.newStart;
+}
+
+long HunkCount(const DiffHunk& hunk, DiffSide side)
+{
+    return side == DiffSide::Old ? hunk.oldCount : hunk.newCount;
+}
+
+DiffSide OtherSide(DiffSide side)
+{
+    return side == DiffSide::Old ? DiffSide::New : DiffSide::Old;
+}
+
+// Hash lines [first, last) of the buffer into pOut.  The text is read in place; only a line that straddles
+// the gap is copied out.  The terminating 0 is not part of the last line.
+void HashBufferLines(const ZepBuffer& buffer, long first, long last, uint64_t* pOut)
+{
+    auto& text = buffer.GetText();
+    auto& lineEnds = buffer.GetLineEnds();
+    const auto gapOffset = long(text.m_pGapStart - text.m_pStart);
+    const auto textEnd = long(text.size()) - 1;
+
+    std::string scratch;
+    for (auto line = first; line < last; line++)
+    {
+        auto start = line == 0 ? 0 : lineEnds[line - 1];
+        auto end = std::min(lineEnds[line], textEnd);
+        if (end <= gapOffset)
+        {
+            pOut[line - first] = DiffUtils::HashLine((const char*)text.m_pStart + start, (const char*)text.m_pStart + end);
+        }
+        else if (start >= gapOffset)
+        {
+            auto pLine = (const char*)text.m_pGapEnd + (start - gapOffset);
+            pOut[line - first] = DiffUtils::HashLine(pLine, pLine + (end - start));
+        }
+        else
+        {
+            scratch.assign((const char*)text.m_pStart + start, (const char*)text.m_pGapStart);
+            scratch.append((const char*)text.m_pGapEnd, (const char*)text.m_pGapEnd + (end - gapOffset));
+            pOut[line - first] = DiffUtils::HashLine(scratch.data(), scratch.data() + scratch.size());
+        }
+    }
+}
+}
+
+ZepBufferDiff::ZepBufferDiff(ZepEditor& editor, ZepBuffer* pOld, ZepBuffer* pNew)
+    : ZepComponent(editor)
+{
+    m_sides[int(DiffSide::Old)].pBuffer = pOld;
+    m_sides[int(DiffSide::New)].pBuffer = pNew;
+    Update();
+}
+
+void ZepBufferDiff::Notify(std::shared_ptr<ZepMessage> payload)
+{
+    if (payload->messageId != Msg_Buffer)
+    {
+        return;
+    }
+
+    auto pMsg = std::static_pointer_cast<BufferMessage>(payload);
+    for (auto& side : m_sides)
+    {
+        if (pMsg->pBuffer != side.pBuffer)
+        {
+            continue;
+        }
+
+        // Both arrive after the edit; an insert ends on the line holding the rest of the line it split,
+        // and a delete leaves a single joined line
+        auto pBuffer = side.pBuffer;
+        switch (pMsg->type)
+        {
+        case BufferMessageType::TextAdded:
+            MarkChanged(side, pBuffer->LineFromOffset(pMsg->startLocation), pBuffer->LineFromOffset(pMsg->endLocation));
+            break;
+        case BufferMessageType::TextDeleted:
+            MarkChanged(side, pBuffer->LineFromOffset(pMsg->startLocation), pBuffer->LineFromOffset(pMsg->startLocation));
+            break;
+        case BufferMessageType::TextChanged:
+            MarkChanged(side, 0, pBuffer->GetLineCount());
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void ZepBufferDiff::MarkChanged(DiffBuffer& side, long firstLine, long lastLine)
+{
+    if (!side.dirty)
+    {
+        side.dirty = true;
+        side.cleanHead = std::numeric_limits<long>::max();
+        side.cleanTail = std::numeric_limits<long>::max();
+    }
+    side.cleanHead = std::min(side.cleanHead, firstLine);
+    side.cleanTail = std::min(side.cleanTail, std::max(0l, side.pBuffer->GetLineCount() - lastLine - 1));
+}
+
+void ZepBufferDiff::Update()
+{
+    if (!m_sides[0].dirty && !m_sides[1].dirty)
+    {
+        return;
+    }
+
+    ZEP_TRACE_SCOPE("ZepBufferDiff::Update");
+    for (auto& side : m_sides)
+    {
+        if (side.dirty)
+        {
+            Rehash(side);
+        }
+    }
+    m_hunks = DiffUtils::DiffLines(m_sides[0].hashes, m_sides[1].hashes);
+}
+
+// Keep the hashes of the untouched head and tail, moving the tail to where its lines are now, and hash the rest
+void ZepBufferDiff::Rehash(DiffBuffer& side)
+{
+    auto& hashes = side.hashes;
+    const auto oldCount = long(hashes.size());
+    const auto newCount = side.pBuffer->GetLineCount();
+    const auto head = std::min(side.cleanHead, std::min(oldCount, newCount));
+    const auto tail = std::min(side.cleanTail, std::min(oldCount, newCount) - head);
+
+    if (newCount > oldCount)
+    {
+        hashes.resize(size_t(newCount));
+        std::move_backward(hashes.begin() + (oldCount - tail), hashes.begin() + oldCount, hashes.end());
+    }
+    else if (newCount < oldCount)
+    {
+        std::move(hashes.begin() + (oldCount - tail), hashes.end(), hashes.begin() + (newCount - tail));
+        hashes.resize(size_t(newCount));
+    }
+
+    HashLines(side, head, newCount - tail);
+
+    side.dirty = false;
+    side.cleanHead = 0;
+    side.cleanTail = 0;
+}
+
+void ZepBufferDiff::HashLines(DiffBuffer& side, long first, long last)
+{
+    auto& buffer = *side.pBuffer;
+    auto pOut = side.hashes.data();
+    const auto count = last - first;
+    if (count < ParallelHashLines || (GetEditor().GetFlags() & ZepEditorFlags::DisableThreads))
+    {
+        HashBufferLines(buffer, first, last, pOut + first);
+        return;
+    }
+
+    // The buffer can't change until we return, so the workers read it directly
+    const long tasks = std::max(1l, long(std::thread::hardware_concurrency()));
+    const long step = (count + tasks - 1) / tasks;
+    std::vector<std::future<void>> results;
+    for (auto start = first; start < last; start += step)
+    {
+        auto end = std::min(last, start + step);
+        results.push_back(buffer.GetThreadPool().enqueue([&buffer, start, end, pOut]()
+        {
+            HashBufferLines(buffer, start, end, pOut + start);
+        }));
+    }
+    for (auto& result : results)
+    {
+        result.get();
+    }
+}
+
+DiffLineType ZepBufferDiff::GetLineType(DiffSide side, long line) const
+{
+    // The first hunk that ends after the line
+    auto itr = std::upper_bound(m_hunks.begin(), m_hunks.end(), line, [side](long l, const DiffHunk& hunk)
+    {
+        return l < HunkStart(hunk, side) + HunkCount(hunk, side);
+    });
+    if (itr == m_hunks.end() || HunkStart(*itr, side) > line)
+    {
+        return DiffLineType::Same;
+    }
+
+    if (HunkCount(*itr, OtherSide(side)) != 0)
+    {
+        return DiffLineType::Changed;
+    }
+    return side == DiffSide::Old ? DiffLineType::Removed : DiffLineType::Added;
+}
+
+bool ZepBufferDiff::IsGapBefore(DiffSide side, long line) const
+{
+    // Hunks are separated by at least one common line, so only one can start here
+    auto itr = std::lower_bound(m_hunks.begin(), m_hunks.end(), line, [side](const DiffHunk& hunk, long l)
+    {
+        return HunkStart(hunk, side) < l;
+    });
+    return itr != m_hunks.end() &&
+        HunkStart(*itr, side) == line &&
+        HunkCount(*itr, side) == 0;
+}
+
+long ZepBufferDiff::MapLine(DiffSide side, long line) const
+{
+    // The last hunk starting at or before the line
+    auto itr = std::upper_bound(m_hunks.begin(), m_hunks.end(), line, [side](long l, const DiffHunk& hunk)
+    {
+        return l < HunkStart(hunk, side);
+    });
+    if (itr == m_hunks.begin())
+    {
+        return line;
+    }
+    --itr;
+
+    auto other = OtherSide(side);
+    auto start = HunkStart(*itr, side);
+    auto count = HunkCount(*itr, side);
+    if (line < start + count)
+    {
+        return HunkStart(*itr, other) + std::min(line - start, std::max(0l, HunkCount(*itr, other) - 1));
+    }
+    return line - (start + count) + HunkStart(*itr, other) + HunkCount(*itr, other);
+}
+
+} // Zep
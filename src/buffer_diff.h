@@ -0,0 +1,66 @@
+#pragma once
+
+#include "editor.h"
+#include "utils/diff.h"
+
+namespace Zep
+{
+
+class ZepBuffer;
+
+enum class DiffSide
+{
+    Old,
+    New
+};
+
+enum class DiffLineType
+{
+    Same,
+    Added,      // Only in the new buffer
+    Removed,    // Only in the old buffer
+    Changed     // Replaced by different lines on the other side
+};
+
+// A live line diff between two buffers.
+// Each side keeps a hash per line; an edit only marks the lines it touched, and Update() rehashes those (across the
+// thread pool when there are a lot of them) before diffing the hashes again.  The diff trims the common head and tail
+// with a compare, so a small edit in a 1M line file costs a few milliseconds.
+class ZepBufferDiff : public ZepComponent
+{
+public:
+    ZepBufferDiff(ZepEditor& editor, ZepBuffer* pOld, ZepBuffer* pNew);
+
+    virtual void Notify(std::shared_ptr<ZepMessage> message) override;
+
+    // Bring the hunks up to date with the buffers; nothing to do if neither has changed
+    void Update();
+
+    ZepBuffer* GetBuffer(DiffSide side) const { return m_sides[int(side)].pBuffer; }
+    const std::vector<DiffHunk>& GetHunks() const { return m_hunks; }
+
+    // Per line information for the gutters, from the hunks of the last Update()
+    DiffLineType GetLineType(DiffSide side, long line) const;
+    bool IsGapBefore(DiffSide side, long line) const;      // Lines on the other side are missing just above this one
+    long MapLine(DiffSide side, long line) const;          // The matching line on the other side
+
+private:
+    struct DiffBuffer
+    {
+        ZepBuffer* pBuffer = nullptr;
+        std::vector<uint64_t> hashes;       // One per line, as of the last update
+        long cleanHead = 0;                 // Lines at the start and the end that no edit has touched since then
+        long cleanTail = 0;
+        bool dirty = true;
+    };
+
+    void MarkChanged(DiffBuffer& side, long firstLine, long lastLine);
+    void Rehash(DiffBuffer& side);
+    void HashLines(DiffBuffer& side, long first, long last);
+
+private:
+    DiffBuffer m_sides[2];
+    std::vector<DiffHunk> m_hunks;
+};
+
+} // Zep
@@ -0,0 +1,2332 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#include "buffer_regex.h"
+#include "utils/trace.h"
+
+namespace Zep
+{
+
+namespace
+{
+const uint32_t EndOfText = 0xFFFFFFFF;
+const int Unbounded = -1;
+const size_t MaxProgramSize = 64 * 1024;
+
+// Bytes that aren't valid UTF-8 stand for themselves, out of the way of real characters
+uint32_t InvalidByte(uint8_t c)
+{
+    return 0xDC00 | c;
+}
+
+// Lower case.  Past ASCII, the letters of Latin-1, Latin Extended-A, Greek and Cyrillic are folded too: where most
+// text has its cased letters.  Each lower case letter has just the one upper case one
+uint32_t FoldCase(uint32_t cp)
+{
+    if (cp < 0x80)
+    {
+        return (cp >= 'A' && cp <= 'Z') ? cp + ('a' - 'A') : cp;
+    }
+    if ((cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) ||
+        (cp >= 0x391 && cp <= 0x3AB && cp != 0x3A2) ||
+        (cp >= 0x410 && cp <= 0x42F))
+    {
+        return cp + 0x20;
+    }
+    if (cp >= 0x400 && cp <= 0x40F)
+    {
+        return cp + 0x50;
+    }
+    if (cp >= 0x386 && cp <= 0x38F)
+    {
+        // The Greek vowels with accents
+        switch (cp)
+        {
+        case 0x386: return 0x3AC;
+        case 0x388: case 0x389: case 0x38A: return cp + 0x25;
+        case 0x38C: return 0x3CC;
+        case 0x38E: case 0x38F: return cp + 0x3F;
+        default: return cp;
+        }
+    }
+    if (cp == 0x178)
+    {
+        return 0xFF;
+    }
+    if (cp >= 0x100 && cp <= 0x17E && cp != 0x130 && cp != 0x131 && cp != 0x138 && cp != 0x149)
+    {
+        // Pairs, upper case first; between the odd ones out at 0x138 and 0x178 they start on odd code points
+        auto evenUpper = cp < 0x138 || (cp > 0x149 && cp < 0x178);
+        return (cp & 1) == (evenUpper ? 0u : 1u) ? cp + 1 : cp;
+    }
+    return cp;
+}
+
+// The other way, for a lower case letter
+uint32_t UpperCase(uint32_t cp)
+{
+    if (cp < 0x80)
+    {
+        return (cp >= 'a' && cp <= 'z') ? cp - ('a' - 'A') : cp;
+    }
+    if ((cp >= 0xE0 && cp <= 0xFE && cp != 0xF7) ||
+        (cp >= 0x3B1 && cp <= 0x3CB && cp != 0x3C2) ||
+        (cp >= 0x430 && cp <= 0x44F))
+    {
+        return cp - 0x20;
+    }
+    if (cp >= 0x450 && cp <= 0x45F)
+    {
+        return cp - 0x50;
+    }
+    if ((cp >= 0x3AC && cp <= 0x3AF) || (cp >= 0x3CC && cp <= 0x3CE))
+    {
+        for (uint32_t upper = 0x386; upper <= 0x38F; upper++)
+        {
+            if (FoldCase(upper) == cp)
+            {
+                return upper;
+            }
+        }
+    }
+    if (cp == 0xFF)
+    {
+        return 0x178;
+    }
+    if (cp > 0x100 && cp <= 0x17E && FoldCase(cp - 1) == cp)
+    {
+        return cp - 1;
+    }
+    return cp;
+}
+
+bool HasCase(uint32_t cp)
+{
+    return FoldCase(cp) != cp || UpperCase(cp) != cp;
+}
+
+// ASCII letters to lower case, eight bytes at a time.  A byte gets 0x20 if it is at least 'A' and not past 'Z'; the
+// sums can't carry into the next byte, with the top bits cleared first
+uint64_t FoldWord(uint64_t word)
+{
+    const uint64_t high = 0x8080808080808080ull;
+    const uint64_t ones = 0x0101010101010101ull;
+    auto low = word & ~high;
+    auto upper = (low + ones * (0x80 - 'A')) & ~(low + ones * (0x80 - 'Z' - 1)) & ~word & high;
+    return word | (upper >> 2);
+}
+
+// The top bit of each byte of the word that is 0, and only those
+uint64_t ZeroBytes(uint64_t word)
+{
+    const uint64_t high = 0x8080808080808080ull;
+    return ~(((word & ~high) + ~high) | word | ~high);
+}
+
+uint8_t FoldByte(uint8_t c)
+{
+    return (c >= 'A' && c <= 'Z') ? uint8_t(c + ('a' - 'A')) : c;
+}
+
+// As Vim's default 'iskeyword'; anything past ASCII counts
+bool IsWordByte(uint8_t c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+uint32_t DecodeUtf8(const uint8_t* p, const uint8_t* pEnd, int& length)
+{
+    auto c = p[0];
+    length = 1;
+    if (c < 0x80)
+    {
+        return c;
+    }
+
+    int count;
+    uint32_t cp;
+    if (c >= 0xC2 && c <= 0xDF)
+    {
+        count = 2;
+        cp = c & 0x1F;
+    }
+    else if (c >= 0xE0 && c <= 0xEF)
+    {
+        count = 3;
+        cp = c & 0x0F;
+    }
+    else if (c >= 0xF0 && c <= 0xF4)
+    {
+        count = 4;
+        cp = c & 0x07;
+    }
+    else
+    {
+        return InvalidByte(c);
+    }
+
+    if (pEnd - p < count)
+    {
+        return InvalidByte(c);
+    }
+    for (int i = 1; i < count; i++)
+    {
+        if ((p[i] & 0xC0) != 0x80)
+        {
+            return InvalidByte(c);
+        }
+        cp = (cp << 6) | (p[i] & 0x3F);
+    }
+    length = count;
+    return cp;
+}
+
+// Whether a pattern has an upper case letter in it, for smartcase.  As in Vim, what follows a backslash doesn't count:
+// \S is a class, not an S
+bool HasUpperCase(const std::string& pattern)
+{
+    auto p = (const uint8_t*)pattern.data();
+    auto pEnd = p + pattern.size();
+    while (p < pEnd)
+    {
+        if (*p == '\\')
+        {
+            p++;
+            if (p < pEnd && (*p == '_' || *p == '%'))
+            {
+                p++;
+            }
+            p += p < pEnd ? 1 : 0;
+            continue;
+        }
+
+        int length;
+        auto cp = DecodeUtf8(p, pEnd, length);
+        if (FoldCase(cp) != cp)
+        {
+            return true;
+        }
+        p += length;
+    }
+    return false;
+}
+
+void AppendUtf8(uint32_t cp, std::string& str)
+{
+    if (cp >= InvalidByte(0x80) && cp <= InvalidByte(0xFF))
+    {
+        str.push_back(char(cp & 0xFF));
+    }
+    else if (cp < 0x80)
+    {
+        str.push_back(char(cp));
+    }
+    else if (cp < 0x800)
+    {
+        str.push_back(char(0xC0 | (cp >> 6)));
+        str.push_back(char(0x80 | (cp & 0x3F)));
+    }
+    else if (cp < 0x10000)
+    {
+        str.push_back(char(0xE0 | (cp >> 12)));
+        str.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+        str.push_back(char(0x80 | (cp & 0x3F)));
+    }
+    else
+    {
+        str.push_back(char(0xF0 | (cp >> 18)));
+        str.push_back(char(0x80 | ((cp >> 12) & 0x3F)));
+        str.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+        str.push_back(char(0x80 | (cp & 0x3F)));
+    }
+}
+
+enum class Op : uint8_t
+{
+    Char,
+    CharFold,       // arg is lower case
+    Class,
+    Any,            // Anything but a line end
+    AnyNewline,
+    Split,          // x is tried before y
+    Jump,
+    Save,           // y is the slot
+    LineStart,
+    LineEnd,
+    WordStart,
+    WordEnd,
+    Match
+};
+
+struct Inst
+{
+    Op op;
+    uint32_t arg = 0;
+    int x = 0;
+    int y = 0;
+};
+
+struct CharClass
+{
+    uint64_t ascii[2] = { 0, 0 };
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;     // Past ASCII, inclusive
+    bool negated = false;
+
+    void Add(uint32_t low, uint32_t high)
+    {
+        for (auto cp = low; cp <= high && cp < 0x80; cp++)
+        {
+            ascii[cp >> 6] |= 1ull << (cp & 63);
+        }
+        if (high >= 0x80)
+        {
+            ranges.emplace_back(std::max(low, 0x80u), high);
+        }
+    }
+
+    bool Contains(uint32_t cp) const
+    {
+        if (cp < 0x80)
+        {
+            return (ascii[cp >> 6] >> (cp & 63)) & 1;
+        }
+        for (auto& range : ranges)
+        {
+            if (cp >= range.first && cp <= range.second)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Matches(uint32_t cp) const
+    {
+        return cp != EndOfText && Contains(cp) != negated;
+    }
+
+    void FoldCase()
+    {
+        for (uint32_t cp = 0; cp < 0x460; cp++)
+        {
+            auto lower = Zep::FoldCase(cp);
+            if (lower != cp && Contains(cp) != Contains(lower))
+            {
+                auto missing = Contains(cp) ? lower : cp;
+                Add(missing, missing);
+            }
+        }
+    }
+};
+
+enum class NodeType
+{
+    Empty,
+    Char,
+    Class,
+    Any,
+    AnyNewline,
+    Assert,
+    Save,
+    Group,
+    Concat,
+    Alternate,
+    Repeat
+};
+
+struct Node
+{
+    NodeType type;
+    uint32_t value = 0;     // Char: the code point; Class: its index; Assert: the Op; Save: 0 for \zs, 1 for \ze; Group: the capture, or -1
+    int min = 0;
+    int max = 0;
+    bool greedy = true;
+    std::vector<int> children;
+};
+
+} // namespace
+
+struct RegexProgram
+{
+    std::vector<Inst> insts;
+    std::vector<CharClass> classes;
+    int groupCount = 0;
+    int slotCount = 0;          // Capture slots: the pattern and each group, then \zs and \ze
+    int zsSlot = 0;
+    bool ignoreCase = false;
+
+    // What can start a match
+    std::string prefix;
+    std::string foldedPrefix;   // Ignoring case, a longer one: ASCII letters of either case, in lower case here
+    bool startBytes[256];
+    int startByte = -1;         // When only one byte can
+    bool lineAnchored = false;  // Every match starts with ^
+    bool matchesEmpty = false;
+    bool literal = false;       // Matches nothing but the prefix
+};
+
+namespace
+{
+
+// Recursive descent over the pattern, into a tree of nodes.  The magic level only changes which characters need a
+// backslash; the lexer hands the parser the same 'special' token either way.
+class RegexParser
+{
+public:
+    RegexParser(const std::string& pattern, RegexProgram& program)
+        : m_pattern(pattern),
+        m_program(program)
+    {
+    }
+
+    int Parse()
+    {
+        auto root = ParseAlternation();
+        if (root >= 0 && !Peek().end)
+        {
+            return Fail("Unmatched \\)");
+        }
+        return root;
+    }
+
+    std::vector<Node> nodes;
+    std::string error;
+
+private:
+    enum class Magic
+    {
+        VeryMagic,
+        Magic,
+        NoMagic,
+        VeryNoMagic
+    };
+
+    struct Token
+    {
+        uint32_t ch = 0;
+        bool special = false;
+        bool end = true;
+        size_t length = 0;
+    };
+
+    int Fail(const std::string& message)
+    {
+        if (error.empty())
+        {
+            error = message;
+        }
+        return -1;
+    }
+
+    int AddNode(NodeType type, uint32_t value = 0)
+    {
+        Node node;
+        node.type = type;
+        node.value = value;
+        nodes.push_back(node);
+        return int(nodes.size() - 1);
+    }
+
+    bool IsSpecialBare(char c) const
+    {
+        if (c == 0)
+        {
+            return false;
+        }
+        switch (m_magic)
+        {
+        case Magic::VeryMagic:
+            return strchr("()|+?={@%<>*.[~^$", c) != nullptr;
+        case Magic::Magic:
+            return strchr("^$.*[~", c) != nullptr;
+        default:
+            return c == '^' || c == '$';
+        }
+    }
+
+    bool IsSpecialEscaped(char c) const
+    {
+        if (c == 0)
+        {
+            return false;
+        }
+        switch (m_magic)
+        {
+        case Magic::VeryMagic:
+            return false;
+        case Magic::Magic:
+            return strchr("()|+?={<>%@", c) != nullptr;
+        default:
+            return strchr("()|+?={<>%@.*[~", c) != nullptr;
+        }
+    }
+
+    const Token& Peek()
+    {
+        if (m_tokenValid)
+        {
+            return m_token;
+        }
+
+        // Modifiers can be anywhere; the case ones were looked for before parsing
+        while (m_pos + 1 < m_pattern.size() && m_pattern[m_pos] == '\\' && strchr("vmMVcC", m_pattern[m_pos + 1]) && m_pattern[m_pos + 1] != 0)
+        {
+            switch (m_pattern[m_pos + 1])
+            {
+            case 'v':
+                m_magic = Magic::VeryMagic;
+                break;
+            case 'm':
+                m_magic = Magic::Magic;
+                break;
+            case 'M':
+                m_magic = Magic::NoMagic;
+                break;
+            case 'V':
+                m_magic = Magic::VeryNoMagic;
+                break;
+            default:
+                break;
+            }
+            m_pos += 2;
+        }
+
+        m_token = Token();
+        m_tokenValid = true;
+        if (m_pos >= m_pattern.size())
+        {
+            return m_token;
+        }
+
+        m_token.end = false;
+        auto p = (const uint8_t*)m_pattern.data() + m_pos;
+        auto pEnd = (const uint8_t*)m_pattern.data() + m_pattern.size();
+        if (*p == '\\' && p + 1 < pEnd)
+        {
+            auto c = p[1];
+            int length = 1;
+            if (isalnum(c) || c == '_')
+            {
+                m_token.ch = c;
+                m_token.special = true;
+            }
+            else
+            {
+                m_token.ch = DecodeUtf8(p + 1, pEnd, length);
+                m_token.special = IsSpecialEscaped(char(c));
+            }
+            m_token.length = size_t(length) + 1;
+            return m_token;
+        }
+
+        int length;
+        m_token.ch = DecodeUtf8(p, pEnd, length);
+        m_token.special = m_token.ch < 0x80 && IsSpecialBare(char(m_token.ch));
+        m_token.length = size_t(length);
+        return m_token;
+    }
+
+    void Advance()
+    {
+        Peek();
+        m_pos += m_token.length;
+        m_tokenValid = false;
+    }
+
+    bool PeekSpecial(char c)
+    {
+        auto& token = Peek();
+        return !token.end && token.special && token.ch == uint32_t(c);
+    }
+
+    int ParseAlternation()
+    {
+        std::vector<int> branches;
+        for (;;)
+        {
+            auto branch = ParseConcat();
+            if (branch < 0)
+            {
+                return -1;
+            }
+            branches.push_back(branch);
+            if (!PeekSpecial('|'))
+            {
+                break;
+            }
+            Advance();
+        }
+
+        if (branches.size() == 1)
+        {
+            return branches[0];
+        }
+        auto node = AddNode(NodeType::Alternate);
+        nodes[node].children = branches;
+        return node;
+    }
+
+    int ParseConcat()
+    {
+        std::vector<int> items;
+
+        // Until something that can be repeated; a * before then is literal, as in Vim
+        bool atStart = true;
+        for (;;)
+        {
+            auto token = Peek();
+            if (token.end || (token.special && (token.ch == '|' || token.ch == ')')))
+            {
+                break;
+            }
+            Advance();
+
+            bool repeatable = true;
+            auto atom = ParseAtom(token, atStart, repeatable);
+            if (atom < 0)
+            {
+                return -1;
+            }
+
+            if (repeatable)
+            {
+                int min, max;
+                bool greedy;
+                auto multi = ParseMulti(min, max, greedy);
+                if (multi < 0)
+                {
+                    return -1;
+                }
+                if (multi > 0)
+                {
+                    auto repeat = AddNode(NodeType::Repeat);
+                    nodes[repeat].children.push_back(atom);
+                    nodes[repeat].min = min;
+                    nodes[repeat].max = max;
+                    nodes[repeat].greedy = greedy;
+                    atom = repeat;
+
+                    if (ParseMulti(min, max, greedy) != 0)
+                    {
+                        return Fail("Nested repeat");
+                    }
+                }
+                atStart = false;
+            }
+            items.push_back(atom);
+        }
+
+        if (items.size() == 1)
+        {
+            return items[0];
+        }
+        auto node = AddNode(items.empty() ? NodeType::Empty : NodeType::Concat);
+        nodes[node].children = items;
+        return node;
+    }
+
+    // 1 if there was one, 0 if not, -1 for a bad one
+    int ParseMulti(int& min, int& max, bool& greedy)
+    {
+        auto& token = Peek();
+        if (token.end || !token.special)
+        {
+            return 0;
+        }
+
+        greedy = true;
+        switch (token.ch)
+        {
+        case '*':
+            min = 0;
+            max = Unbounded;
+            break;
+        case '+':
+            min = 1;
+            max = Unbounded;
+            break;
+        case '=':
+        case '?':
+            min = 0;
+            max = 1;
+            break;
+        case '{':
+            Advance();
+            return ParseBraces(min, max, greedy) ? 1 : -1;
+        default:
+            return 0;
+        }
+        Advance();
+        return 1;
+    }
+
+    // \{n,m} and friends, with a - for the least instead of the most; the closing brace can have a backslash
+    bool ParseBraces(int& min, int& max, bool& greedy)
+    {
+        auto readNumber = [&](int& value)
+        {
+            bool any = false;
+            value = 0;
+            while (m_pos < m_pattern.size() && isdigit(uint8_t(m_pattern[m_pos])))
+            {
+                value = std::min(value * 10 + (m_pattern[m_pos++] - '0'), 100000);
+                any = true;
+            }
+            return any;
+        };
+
+        if (m_pos < m_pattern.size() && m_pattern[m_pos] == '-')
+        {
+            greedy = false;
+            m_pos++;
+        }
+
+        int first = 0;
+        bool hasFirst = readNumber(first);
+        min = hasFirst ? first : 0;
+        max = hasFirst ? first : Unbounded;
+        if (m_pos < m_pattern.size() && m_pattern[m_pos] == ',')
+        {
+            m_pos++;
+            int second;
+            max = readNumber(second) ? second : Unbounded;
+        }
+
+        if (m_pos < m_pattern.size() && m_pattern[m_pos] == '\\')
+        {
+            m_pos++;
+        }
+        if (m_pos >= m_pattern.size() || m_pattern[m_pos] != '}')
+        {
+            Fail("Missing } in \\{");
+            return false;
+        }
+        m_pos++;
+
+        if (max != Unbounded && min > max)
+        {
+            std::swap(min, max);
+        }
+        return true;
+    }
+
+    int AddClass(const CharClass& charClass)
+    {
+        m_program.classes.push_back(charClass);
+        return AddNode(NodeType::Class, uint32_t(m_program.classes.size() - 1));
+    }
+
+    // \s \d \w and the rest; upper case is the opposite.  None match a line end without the \_
+    bool NamedClass(uint32_t ch, bool newline, CharClass& charClass)
+    {
+        switch (FoldCase(ch))
+        {
+        case 's':
+            charClass.Add(' ', ' ');
+            charClass.Add('\t', '\t');
+            break;
+        case 'd':
+            charClass.Add('0', '9');
+            break;
+        case 'w':
+            charClass.Add('0', '9');
+            charClass.Add('a', 'z');
+            charClass.Add('A', 'Z');
+            charClass.Add('_', '_');
+            break;
+        case 'a':
+            charClass.Add('a', 'z');
+            charClass.Add('A', 'Z');
+            break;
+        case 'l':
+            charClass.Add('a', 'z');
+            break;
+        case 'u':
+            charClass.Add('A', 'Z');
+            break;
+        case 'x':
+            charClass.Add('0', '9');
+            charClass.Add('a', 'f');
+            charClass.Add('A', 'F');
+            break;
+        case 'o':
+            charClass.Add('0', '7');
+            break;
+        case 'h':
+            charClass.Add('a', 'z');
+            charClass.Add('A', 'Z');
+            charClass.Add('_', '_');
+            break;
+        default:
+            return false;
+        }
+
+        charClass.negated = ch >= 'A' && ch <= 'Z';
+        if (charClass.negated != newline)
+        {
+            // Left out of an opposite, added to a \_ class
+            charClass.Add('\n', '\n');
+        }
+        return true;
+    }
+
+    int ParseAtom(const Token& token, bool atStart, bool& repeatable)
+    {
+        if (!token.special)
+        {
+            return AddNode(NodeType::Char, token.ch);
+        }
+
+        switch (token.ch)
+        {
+        case '^':
+            if (atStart)
+            {
+                repeatable = false;
+                return AddNode(NodeType::Assert, uint32_t(Op::LineStart));
+            }
+            return AddNode(NodeType::Char, '^');
+        case '$':
+            if (Peek().end || PeekSpecial('|') || PeekSpecial(')'))
+            {
+                repeatable = false;
+                return AddNode(NodeType::Assert, uint32_t(Op::LineEnd));
+            }
+            return AddNode(NodeType::Char, '$');
+        case '*':
+        case '~':
+            return AddNode(NodeType::Char, token.ch);
+        case '+':
+        case '=':
+        case '?':
+        case '{':
+            return Fail("Nothing to repeat");
+        case '.':
+            return AddNode(NodeType::Any);
+        case '[':
+            return ParseBracket(false);
+        case '(':
+        {
+            if (m_groupCount + 1 >= RegexMatch::MaxGroups)
+            {
+                return Fail("Too many \\(");
+            }
+            return ParseGroup(int(++m_groupCount));
+        }
+        case '%':
+            if (!Peek().end && Peek().ch == '(')
+            {
+                Advance();
+                return ParseGroup(-1);
+            }
+            return Fail("Unsupported \\%");
+        case '<':
+            repeatable = false;
+            return AddNode(NodeType::Assert, uint32_t(Op::WordStart));
+        case '>':
+            repeatable = false;
+            return AddNode(NodeType::Assert, uint32_t(Op::WordEnd));
+        case '@':
+            return Fail("Look around isn't supported");
+        case 'n':
+            return AddNode(NodeType::Char, '\n');
+        case 't':
+            return AddNode(NodeType::Char, '\t');
+        case 'e':
+            return AddNode(NodeType::Char, 27);
+        case 'r':
+            return AddNode(NodeType::Char, '\r');
+        case 'z':
+        {
+            auto next = Peek();
+            if (!next.end && (next.ch == 's' || next.ch == 'e'))
+            {
+                Advance();
+                repeatable = false;
+                return AddNode(NodeType::Save, next.ch == 's' ? 0 : 1);
+            }
+            return Fail("Unsupported \\z");
+        }
+        case '_':
+        {
+            auto next = Peek();
+            if (next.end)
+            {
+                return Fail("Missing character after \\_");
+            }
+            Advance();
+            CharClass charClass;
+            switch (next.ch)
+            {
+            case '.':
+                return AddNode(NodeType::AnyNewline);
+            case '[':
+                return ParseBracket(true);
+            case '^':
+                repeatable = false;
+                return AddNode(NodeType::Assert, uint32_t(Op::LineStart));
+            case '$':
+                repeatable = false;
+                return AddNode(NodeType::Assert, uint32_t(Op::LineEnd));
+            default:
+                if (NamedClass(next.ch, true, charClass))
+                {
+                    return AddClass(charClass);
+                }
+                return Fail("Unsupported \\_");
+            }
+        }
+        default:
+            break;
+        }
+
+        CharClass charClass;
+        if (NamedClass(token.ch, false, charClass))
+        {
+            return AddClass(charClass);
+        }
+        if (token.ch >= '1' && token.ch <= '9')
+        {
+            return Fail("Back references aren't supported");
+        }
+        return Fail(std::string("Unsupported \\") + char(token.ch));
+    }
+
+    int ParseGroup(int capture)
+    {
+        auto inner = ParseAlternation();
+        if (inner < 0)
+        {
+            return -1;
+        }
+        if (!PeekSpecial(')'))
+        {
+            return Fail("Unmatched \\(");
+        }
+        Advance();
+
+        auto group = AddNode(NodeType::Group, uint32_t(capture));
+        nodes[group].children.push_back(inner);
+        return group;
+    }
+
+    // Read from the pattern itself; inside [] only a few backslash codes mean anything.  A [ without its ] is a literal
+    int ParseBracket(bool newline)
+    {
+        auto p = (const uint8_t*)m_pattern.data() + m_pos;
+        auto pEnd = (const uint8_t*)m_pattern.data() + m_pattern.size();
+
+        CharClass charClass;
+        if (p < pEnd && *p == '^')
+        {
+            charClass.negated = true;
+            p++;
+        }
+
+        auto readChar = [&](uint32_t& cp)
+        {
+            if (*p == '\\' && p + 1 < pEnd)
+            {
+                const char* pFrom = "etrnb\\]^-";
+                const char* pTo = "\x1b\t\r\n\b\\]^-";
+                auto pCode = p[1] ? strchr(pFrom, p[1]) : nullptr;
+                if (pCode)
+                {
+                    cp = uint8_t(pTo[pCode - pFrom]);
+                    p += 2;
+                    return;
+                }
+            }
+            int length;
+            cp = DecodeUtf8(p, pEnd, length);
+            p += length;
+        };
+
+        bool first = true;
+        for (;;)
+        {
+            if (p >= pEnd)
+            {
+                return AddNode(NodeType::Char, '[');
+            }
+            if (*p == ']' && !first)
+            {
+                p++;
+                break;
+            }
+            first = false;
+
+            if (*p == '[' && p + 1 < pEnd && p[1] == ':')
+            {
+                static const char* Names[] = { "alpha", "digit", "alnum", "lower", "upper", "space", "blank", "punct", "xdigit" };
+                auto pClose = std::search(p + 2, pEnd, (const uint8_t*)":]", (const uint8_t*)":]" + 2);
+                if (pClose != pEnd)
+                {
+                    std::string name(p + 2, pClose);
+                    auto itr = std::find_if(std::begin(Names), std::end(Names), [&](const char* n) { return name == n; });
+                    if (itr == std::end(Names))
+                    {
+                        return Fail("Unknown class [:" + name + ":]");
+                    }
+                    for (uint32_t cp = 0; cp < 0x80; cp++)
+                    {
+                        bool in = false;
+                        switch (itr - std::begin(Names))
+                        {
+                        case 0: in = isalpha(int(cp)) != 0; break;
+                        case 1: in = isdigit(int(cp)) != 0; break;
+                        case 2: in = isalnum(int(cp)) != 0; break;
+                        case 3: in = islower(int(cp)) != 0; break;
+                        case 4: in = isupper(int(cp)) != 0; break;
+                        case 5: in = isspace(int(cp)) != 0; break;
+                        case 6: in = cp == ' ' || cp == '\t'; break;
+                        case 7: in = ispunct(int(cp)) != 0; break;
+                        default: in = isxdigit(int(cp)) != 0; break;
+                        }
+                        if (in)
+                        {
+                            charClass.Add(cp, cp);
+                        }
+                    }
+                    p = pClose + 2;
+                    continue;
+                }
+            }
+
+            uint32_t low;
+            readChar(low);
+            auto high = low;
+            if (p + 1 < pEnd && *p == '-' && p[1] != ']')
+            {
+                p++;
+                readChar(high);
+                if (high < low)
+                {
+                    return Fail("Reverse range in []");
+                }
+            }
+            charClass.Add(low, high);
+        }
+
+        m_pos = size_t(p - (const uint8_t*)m_pattern.data());
+        m_tokenValid = false;
+
+        if (m_program.ignoreCase)
+        {
+            charClass.FoldCase();
+        }
+        if (charClass.negated != newline)
+        {
+            charClass.Add('\n', '\n');
+        }
+        return AddClass(charClass);
+    }
+
+private:
+    const std::string& m_pattern;
+    RegexProgram& m_program;
+    size_t m_pos = 0;
+    Magic m_magic = Magic::Magic;
+    Token m_token;
+    bool m_tokenValid = false;
+    uint32_t m_groupCount = 0;
+};
+
+// Thompson's construction, into the program
+class RegexEmitter
+{
+public:
+    RegexEmitter(const std::vector<Node>& nodes, RegexProgram& program)
+        : m_nodes(nodes),
+        m_program(program)
+    {
+    }
+
+    bool Emit(int index)
+    {
+        if (m_program.insts.size() > MaxProgramSize)
+        {
+            return false;
+        }
+
+        const auto& node = m_nodes[index];
+        switch (node.type)
+        {
+        case NodeType::Empty:
+            break;
+        case NodeType::Char:
+            if (m_program.ignoreCase && HasCase(node.value))
+            {
+                Add(Op::CharFold, FoldCase(node.value));
+            }
+            else
+            {
+                Add(Op::Char, node.value);
+            }
+            break;
+        case NodeType::Class:
+            Add(Op::Class, node.value);
+            break;
+        case NodeType::Any:
+            Add(Op::Any);
+            break;
+        case NodeType::AnyNewline:
+            Add(Op::AnyNewline);
+            break;
+        case NodeType::Assert:
+            Add(Op(node.value));
+            break;
+        case NodeType::Save:
+            m_program.insts[Add(Op::Save)].y = m_program.zsSlot + int(node.value);
+            break;
+        case NodeType::Group:
+            if (int(node.value) >= 0)
+            {
+                m_program.insts[Add(Op::Save)].y = int(node.value) * 2;
+            }
+            if (!Emit(node.children[0]))
+            {
+                return false;
+            }
+            if (int(node.value) >= 0)
+            {
+                m_program.insts[Add(Op::Save)].y = int(node.value) * 2 + 1;
+            }
+            break;
+        case NodeType::Concat:
+            for (auto child : node.children)
+            {
+                if (!Emit(child))
+                {
+                    return false;
+                }
+            }
+            break;
+        case NodeType::Alternate:
+        {
+            std::vector<int> jumps;
+            for (size_t i = 0; i + 1 < node.children.size(); i++)
+            {
+                auto split = Add(Op::Split);
+                m_program.insts[split].x = split + 1;
+                if (!Emit(node.children[i]))
+                {
+                    return false;
+                }
+                jumps.push_back(Add(Op::Jump));
+                m_program.insts[split].y = Next();
+            }
+            if (!Emit(node.children.back()))
+            {
+                return false;
+            }
+            for (auto jump : jumps)
+            {
+                m_program.insts[jump].x = Next();
+            }
+            break;
+        }
+        case NodeType::Repeat:
+            return EmitRepeat(node);
+        }
+        return m_program.insts.size() <= MaxProgramSize;
+    }
+
+private:
+    int Add(Op op, uint32_t arg = 0)
+    {
+        Inst inst;
+        inst.op = op;
+        inst.arg = arg;
+        m_program.insts.push_back(inst);
+        return int(m_program.insts.size() - 1);
+    }
+
+    int Next() const
+    {
+        return int(m_program.insts.size());
+    }
+
+    void SetSplit(int split, int taken, int skipped, bool greedy)
+    {
+        m_program.insts[split].x = greedy ? taken : skipped;
+        m_program.insts[split].y = greedy ? skipped : taken;
+    }
+
+    bool EmitRepeat(const Node& node)
+    {
+        auto child = node.children[0];
+        if (node.max == Unbounded)
+        {
+            // The required copies, the last one looping
+            if (node.min > 0)
+            {
+                for (int i = 0; i < node.min - 1; i++)
+                {
+                    if (!Emit(child))
+                    {
+                        return false;
+                    }
+                }
+                auto loop = Next();
+                if (!Emit(child))
+                {
+                    return false;
+                }
+                auto split = Add(Op::Split);
+                SetSplit(split, loop, split + 1, node.greedy);
+                return true;
+            }
+
+            auto split = Add(Op::Split);
+            if (!Emit(child))
+            {
+                return false;
+            }
+            m_program.insts[Add(Op::Jump)].x = split;
+            SetSplit(split, split + 1, Next(), node.greedy);
+            return true;
+        }
+
+        for (int i = 0; i < node.min; i++)
+        {
+            if (!Emit(child))
+            {
+                return false;
+            }
+        }
+
+        // Each optional copy can stop the lot
+        std::vector<int> splits;
+        for (int i = node.min; i < node.max; i++)
+        {
+            splits.push_back(Add(Op::Split));
+            if (!Emit(child))
+            {
+                return false;
+            }
+        }
+        for (auto split : splits)
+        {
+            SetSplit(split, split + 1, Next(), node.greedy);
+        }
+        return true;
+    }
+
+private:
+    const std::vector<Node>& m_nodes;
+    RegexProgram& m_program;
+};
+
+// Walks the program from the start, without consuming anything, to see what can begin a match
+void AnalyzeStart(RegexProgram& program)
+{
+    auto& insts = program.insts;
+    std::fill(std::begin(program.startBytes), std::end(program.startBytes), false);
+    program.lineAnchored = true;
+    program.matchesEmpty = false;
+
+    auto addByte = [&](uint32_t cp)
+    {
+        std::string bytes;
+        AppendUtf8(cp, bytes);
+        program.startBytes[uint8_t(bytes[0])] = true;
+    };
+    auto addRange = [&](int low, int high)
+    {
+        for (int c = low; c <= high; c++)
+        {
+            program.startBytes[c] = true;
+        }
+    };
+
+    std::vector<uint8_t> visited(insts.size() * 2, 0);
+    std::vector<std::pair<int, bool>> stack;
+    stack.emplace_back(0, false);
+    while (!stack.empty())
+    {
+        auto pc = stack.back().first;
+        auto anchored = stack.back().second;
+        stack.pop_back();
+
+        auto& seen = visited[size_t(pc) * 2 + (anchored ? 1 : 0)];
+        if (seen)
+        {
+            continue;
+        }
+        seen = 1;
+
+        const auto& inst = insts[pc];
+        switch (inst.op)
+        {
+        case Op::Split:
+            stack.emplace_back(inst.y, anchored);
+            stack.emplace_back(inst.x, anchored);
+            continue;
+        case Op::Jump:
+            stack.emplace_back(inst.x, anchored);
+            continue;
+        case Op::LineStart:
+            stack.emplace_back(pc + 1, true);
+            continue;
+        case Op::Save:
+        case Op::LineEnd:
+        case Op::WordStart:
+        case Op::WordEnd:
+            stack.emplace_back(pc + 1, anchored);
+            continue;
+        case Op::Match:
+            program.matchesEmpty = true;
+            addRange(0, 255);
+            break;
+        case Op::Char:
+            addByte(inst.arg);
+            break;
+        case Op::CharFold:
+            addByte(inst.arg);
+            addByte(UpperCase(inst.arg));
+            break;
+        case Op::Class:
+        {
+            const auto& charClass = program.classes[inst.arg];
+            for (uint32_t c = 0; c < 0x80; c++)
+            {
+                if (charClass.Matches(c))
+                {
+                    program.startBytes[c] = true;
+                }
+            }
+            if (charClass.negated || !charClass.ranges.empty())
+            {
+                addRange(0x80, 0xFF);
+            }
+            break;
+        }
+        case Op::Any:
+            addRange(0, '\n' - 1);
+            addRange('\n' + 1, 255);
+            break;
+        case Op::AnyNewline:
+            addRange(0, 255);
+            break;
+        }
+
+        if (!anchored)
+        {
+            program.lineAnchored = false;
+        }
+    }
+
+    auto count = std::count(std::begin(program.startBytes), std::end(program.startBytes), true);
+    program.startByte = count == 1 ? int(std::find(std::begin(program.startBytes), std::end(program.startBytes), true) - std::begin(program.startBytes)) : -1;
+
+    // Characters before anything that branches (or consumes anything else) must start every match
+    program.prefix.clear();
+    for (size_t pc = 0; pc < insts.size(); pc++)
+    {
+        if (insts[pc].op == Op::Char)
+        {
+            AppendUtf8(insts[pc].arg, program.prefix);
+        }
+        else if (insts[pc].op != Op::Save && insts[pc].op != Op::LineStart && insts[pc].op != Op::WordStart && insts[pc].op != Op::WordEnd)
+        {
+            break;
+        }
+    }
+
+    // Ignoring case, the prefix can go on through the ASCII letters; it is looked for with them folded
+    program.foldedPrefix.clear();
+    for (size_t pc = 0; pc < insts.size() && program.ignoreCase; pc++)
+    {
+        if (insts[pc].op == Op::Char || (insts[pc].op == Op::CharFold && insts[pc].arg < 0x80))
+        {
+            AppendUtf8(insts[pc].arg, program.foldedPrefix);
+        }
+        else if (insts[pc].op != Op::Save && insts[pc].op != Op::LineStart && insts[pc].op != Op::WordStart && insts[pc].op != Op::WordEnd)
+        {
+            break;
+        }
+    }
+    if (program.foldedPrefix.size() <= program.prefix.size())
+    {
+        program.foldedPrefix.clear();
+    }
+
+    // Nothing but characters and the groups around them: a match is just the prefix, wherever it is
+    program.literal = !program.prefix.empty() && std::all_of(insts.begin(), insts.end(), [&](const Inst& inst)
+    {
+        return inst.op == Op::Char || inst.op == Op::Match || (inst.op == Op::Save && inst.y < program.zsSlot);
+    });
+}
+
+// The per search state: the thread lists, and a view of the text on both sides of the gap
+class RegexRunner
+{
+public:
+    RegexRunner(const RegexProgram& program, const GapBuffer<utf8>& text, const std::vector<long>& lineEnds)
+        : m_program(program),
+        m_lineEnds(lineEnds),
+        m_pStart(text.m_pStart),
+        m_pGapEnd(text.m_pGapEnd),
+        m_gapOffset(long(text.m_pGapStart - text.m_pStart)),
+        m_textEnd(long(text.size())),
+        m_slots(size_t(program.slotCount))
+    {
+        if (m_textEnd > 0 && At(m_textEnd - 1) == 0)
+        {
+            m_textEnd--;
+        }
+        for (auto pList : { &m_current, &m_next, &m_closure })
+        {
+            pList->sparse.resize(program.insts.size());
+            pList->dense.resize(program.insts.size());
+            pList->caps.resize(program.insts.size() * m_slots);
+        }
+        m_caps.resize(m_slots);
+    }
+
+    long TextEnd() const
+    {
+        return m_textEnd;
+    }
+
+    // The DFA finds where the first match ends, and the last place before it with no thread running; the leftmost
+    // match can't start before that, so the VM only has to run from there
+    bool Find(long start, long end, RegexMatch& match)
+    {
+        auto from = start;
+        if (!m_dfaFailed)
+        {
+            switch (ScanDfa(start, end, from))
+            {
+            case DfaResult::NoMatch:
+                return false;
+            case DfaResult::Failed:
+                m_dfaFailed = true;
+                from = start;
+                break;
+            default:
+                break;
+            }
+        }
+        return FindWithVM(from, end, match);
+    }
+
+    bool FindWithVM(long start, long end, RegexMatch& match)
+    {
+        m_current.count = 0;
+        bool matched = false;
+        long pos = start;
+        for (;;)
+        {
+            if (m_current.count == 0)
+            {
+                if (matched)
+                {
+                    break;
+                }
+                pos = NextCandidate(pos, end);
+                if (pos < 0)
+                {
+                    break;
+                }
+            }
+
+            int length = 1;
+            auto cp = pos < m_textEnd ? Decode(pos, length) : EndOfText;
+            if (!matched && pos <= end && CanStartAt(pos))
+            {
+                std::fill(m_caps.begin(), m_caps.end(), -1l);
+                AddThread(m_current, 0, pos);
+            }
+
+            auto next = pos + length;
+            m_next.count = 0;
+            for (int i = 0; i < m_current.count; i++)
+            {
+                auto pc = m_current.dense[i];
+                const auto& inst = m_program.insts[pc];
+                const long* pCaps = &m_current.caps[size_t(i) * m_slots];
+                bool step = false;
+                switch (inst.op)
+                {
+                case Op::Match:
+                    Record(pCaps, match);
+                    matched = true;
+                    // Threads after this one have lower priority
+                    i = m_current.count;
+                    break;
+                case Op::Char:
+                    step = cp == inst.arg;
+                    break;
+                case Op::CharFold:
+                    step = FoldCase(cp) == inst.arg;
+                    break;
+                case Op::Class:
+                    step = m_program.classes[inst.arg].Matches(cp);
+                    break;
+                case Op::Any:
+                    step = cp != '\n' && cp != EndOfText;
+                    break;
+                case Op::AnyNewline:
+                    step = cp != EndOfText;
+                    break;
+                default:
+                    break;
+                }
+                if (step)
+                {
+                    std::copy(pCaps, pCaps + m_slots, m_caps.begin());
+                    AddThread(m_next, pc + 1, next);
+                }
+            }
+
+            if (pos >= m_textEnd)
+            {
+                break;
+            }
+            std::swap(m_current, m_next);
+            pos = next;
+        }
+        return matched;
+    }
+
+    // The line index limits the search to a line at a time
+    bool FindLast(long start, long end, RegexMatch& match)
+    {
+        long blockEnd = end;
+        for (;;)
+        {
+            long blockStart = start;
+            if (!m_lineEnds.empty())
+            {
+                auto itr = std::upper_bound(m_lineEnds.begin(), m_lineEnds.end(), blockEnd);
+                blockStart = std::max(start, itr == m_lineEnds.begin() ? 0 : *(itr - 1));
+            }
+
+            bool found = false;
+            RegexMatch candidate;
+            long pos = blockStart;
+            while (pos <= blockEnd && Find(pos, blockEnd, candidate))
+            {
+                match = candidate;
+                found = true;
+                pos = candidate.groups[0] + 1;
+            }
+            if (found)
+            {
+                return true;
+            }
+            if (blockStart <= start)
+            {
+                return false;
+            }
+            blockEnd = blockStart - 1;
+        }
+    }
+
+private:
+    enum class DfaResult
+    {
+        Match,
+        NoMatch,
+        Failed      // Too many states; the VM does it all
+    };
+
+    // The threads waiting at a position, before anything that doesn't consume is followed, as a set; the order only
+    // matters to which match wins, and the VM decides that.  The flags describe the character before, which the
+    // assertions need, and whether new threads still start here.
+    struct DfaState
+    {
+        std::vector<int> roots;
+        uint8_t flags;
+        int next[128];          // For each ASCII character: the next state * 2, plus 1 if a match ended before it; -1 until needed
+    };
+
+    enum : uint8_t
+    {
+        PrevWord = (1 << 0),
+        PrevNewline = (1 << 1),
+        Starting = (1 << 2)
+    };
+
+    static const size_t MaxDfaStates = 4096;
+
+    uint8_t FlagsAt(long pos, long end) const
+    {
+        uint8_t flags = pos <= end ? Starting : 0;
+        if (pos == 0 || At(pos - 1) == '\n')
+        {
+            flags |= PrevNewline;
+        }
+        else if (IsWordByte(At(pos - 1)))
+        {
+            flags |= PrevWord;
+        }
+        return flags;
+    }
+
+    int DfaStateFor(std::vector<int>& roots, uint8_t flags)
+    {
+        auto key = std::make_pair(flags, roots);
+        auto itr = m_dfaLookup.find(key);
+        if (itr != m_dfaLookup.end())
+        {
+            return itr->second;
+        }
+        if (m_dfaStates.size() >= MaxDfaStates)
+        {
+            return -1;
+        }
+
+        m_dfaStates.emplace_back();
+        auto& state = m_dfaStates.back();
+        state.roots = roots;
+        state.flags = flags;
+        std::fill(std::begin(state.next), std::end(state.next), -1);
+        auto index = int(m_dfaStates.size() - 1);
+        m_dfaLookup[key] = index;
+        return index;
+    }
+
+    // Steps a state over a character (or the end of the text), as the VM would; -1 if out of states
+    int DfaTransition(int index, uint32_t cp)
+    {
+        m_closure.count = 0;
+        m_dfaStack.assign(m_dfaStates[index].roots.rbegin(), m_dfaStates[index].roots.rend());
+        const auto flags = m_dfaStates[index].flags;
+        if (flags & Starting)
+        {
+            m_dfaStack.insert(m_dfaStack.begin(), 0);
+        }
+
+        const bool word = cp != EndOfText && (cp >= 0x80 || IsWordByte(uint8_t(cp)));
+        const bool prevWord = (flags & PrevWord) != 0;
+        bool matched = false;
+        m_dfaRoots.clear();
+        while (!m_dfaStack.empty())
+        {
+            auto pc = m_dfaStack.back();
+            m_dfaStack.pop_back();
+            auto seen = m_closure.sparse[size_t(pc)];
+            if (seen < m_closure.count && m_closure.dense[size_t(seen)] == pc)
+            {
+                continue;
+            }
+            m_closure.sparse[size_t(pc)] = m_closure.count;
+            m_closure.dense[size_t(m_closure.count++)] = pc;
+
+            const auto& inst = m_program.insts[size_t(pc)];
+            bool step = false;
+            switch (inst.op)
+            {
+            case Op::Jump:
+                m_dfaStack.push_back(inst.x);
+                continue;
+            case Op::Split:
+                m_dfaStack.push_back(inst.y);
+                m_dfaStack.push_back(inst.x);
+                continue;
+            case Op::Save:
+                m_dfaStack.push_back(pc + 1);
+                continue;
+            case Op::LineStart:
+                if (flags & PrevNewline)
+                {
+                    m_dfaStack.push_back(pc + 1);
+                }
+                continue;
+            case Op::LineEnd:
+                if (cp == '\n' || cp == EndOfText)
+                {
+                    m_dfaStack.push_back(pc + 1);
+                }
+                continue;
+            case Op::WordStart:
+                if (!prevWord && word)
+                {
+                    m_dfaStack.push_back(pc + 1);
+                }
+                continue;
+            case Op::WordEnd:
+                if (prevWord && !word)
+                {
+                    m_dfaStack.push_back(pc + 1);
+                }
+                continue;
+            case Op::Match:
+                matched = true;
+                continue;
+            case Op::Char:
+                step = cp == inst.arg;
+                break;
+            case Op::CharFold:
+                step = FoldCase(cp) == inst.arg;
+                break;
+            case Op::Class:
+                step = m_program.classes[inst.arg].Matches(cp);
+                break;
+            case Op::Any:
+                step = cp != '\n' && cp != EndOfText;
+                break;
+            case Op::AnyNewline:
+                step = cp != EndOfText;
+                break;
+            }
+            if (step)
+            {
+                m_dfaRoots.push_back(pc + 1);
+            }
+        }
+
+        std::sort(m_dfaRoots.begin(), m_dfaRoots.end());
+        m_dfaRoots.erase(std::unique(m_dfaRoots.begin(), m_dfaRoots.end()), m_dfaRoots.end());
+        uint8_t nextFlags = flags & Starting;
+        if (cp == '\n')
+        {
+            nextFlags |= PrevNewline;
+        }
+        else if (word)
+        {
+            nextFlags |= PrevWord;
+        }
+        auto next = DfaStateFor(m_dfaRoots, nextFlags);
+        return next < 0 ? -1 : next * 2 + (matched ? 1 : 0);
+    }
+
+    // With no threads waiting; one for each set of flags
+    int IdleDfaState(uint8_t flags)
+    {
+        auto& index = m_dfaIdle[flags];
+        if (index < 0)
+        {
+            std::vector<int> none;
+            index = DfaStateFor(none, flags);
+        }
+        return index;
+    }
+
+    DfaResult ScanDfa(long start, long end, long& from)
+    {
+        long pos = start;
+        auto index = IdleDfaState(FlagsAt(pos, end));
+        if (index < 0)
+        {
+            return DfaResult::Failed;
+        }
+
+        from = pos;
+        for (;;)
+        {
+            if (m_dfaStates[index].roots.empty())
+            {
+                // Nothing running; skip to where something could start
+                if (!(m_dfaStates[index].flags & Starting))
+                {
+                    return DfaResult::NoMatch;
+                }
+                auto candidate = NextCandidate(pos, end);
+                if (candidate < 0)
+                {
+                    return DfaResult::NoMatch;
+                }
+                if (candidate != pos)
+                {
+                    pos = candidate;
+                    index = IdleDfaState(FlagsAt(pos, end));
+                    if (index < 0)
+                    {
+                        return DfaResult::Failed;
+                    }
+                }
+                from = pos;
+            }
+
+            int length = 1;
+            int transition;
+            if (pos >= m_textEnd)
+            {
+                transition = DfaTransition(index, EndOfText);
+            }
+            else
+            {
+                auto c = At(pos);
+                if (c < 0x80)
+                {
+                    transition = m_dfaStates[index].next[c];
+                    if (transition < 0)
+                    {
+                        transition = DfaTransition(index, c);
+                        if (transition >= 0)
+                        {
+                            m_dfaStates[index].next[c] = transition;
+                        }
+                    }
+                }
+                else
+                {
+                    transition = DfaTransition(index, Decode(pos, length));
+                }
+            }
+
+            if (transition < 0)
+            {
+                return DfaResult::Failed;
+            }
+            if (transition & 1)
+            {
+                return DfaResult::Match;
+            }
+            if (pos >= m_textEnd)
+            {
+                return DfaResult::NoMatch;
+            }
+
+            index = transition / 2;
+            pos += length;
+            if (pos > end && (m_dfaStates[index].flags & Starting))
+            {
+                // Past the last place a match can start
+                auto roots = m_dfaStates[index].roots;
+                index = DfaStateFor(roots, uint8_t(m_dfaStates[index].flags & ~Starting));
+                if (index < 0)
+                {
+                    return DfaResult::Failed;
+                }
+            }
+        }
+    }
+
+    struct StackEntry
+    {
+        int pc;
+        int slot;       // A slot to put back, instead of a pc to follow
+        long value;
+    };
+
+    struct ThreadList
+    {
+        std::vector<int> sparse;
+        std::vector<int> dense;
+        std::vector<long> caps;
+        int count = 0;
+    };
+
+    utf8 At(long pos) const
+    {
+        return pos < m_gapOffset ? m_pStart[pos] : m_pGapEnd[pos - m_gapOffset];
+    }
+
+    uint32_t Decode(long pos, int& length) const
+    {
+        auto c = At(pos);
+        length = 1;
+        if (c < 0x80)
+        {
+            return c;
+        }
+
+        // Copied out, in case it straddles the gap
+        uint8_t bytes[4];
+        auto count = std::min(4l, m_textEnd - pos);
+        for (long i = 0; i < count; i++)
+        {
+            bytes[i] = At(pos + i);
+        }
+        return DecodeUtf8(bytes, bytes + count, length);
+    }
+
+    bool IsLineStart(long pos) const
+    {
+        return pos == 0 || At(pos - 1) == '\n';
+    }
+
+    bool CanStartAt(long pos) const
+    {
+        if (m_program.lineAnchored && !IsLineStart(pos))
+        {
+            return false;
+        }
+        return pos >= m_textEnd ? m_program.matchesEmpty : m_program.startBytes[At(pos)];
+    }
+
+    bool HasPrefixAt(long pos) const
+    {
+        const auto& prefix = m_program.prefix;
+        if (pos + long(prefix.size()) > m_textEnd)
+        {
+            return prefix.empty();
+        }
+        for (size_t i = 0; i < prefix.size(); i++)
+        {
+            if (At(pos + long(i)) != uint8_t(prefix[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Calls fn on the contiguous pieces of [from, to), until it returns the offset of what it was looking for
+    template <class F>
+    long ScanPieces(long from, long to, F fn) const
+    {
+        if (from < m_gapOffset)
+        {
+            auto found = fn(m_pStart, from, std::min(to, m_gapOffset));
+            if (found >= 0)
+            {
+                return found;
+            }
+            from = m_gapOffset;
+        }
+        if (from < to)
+        {
+            return fn(m_pGapEnd - m_gapOffset, from, to);
+        }
+        return -1;
+    }
+
+    long NextLineStart(long pos) const
+    {
+        if (IsLineStart(pos))
+        {
+            return pos;
+        }
+        if (!m_lineEnds.empty())
+        {
+            auto itr = std::lower_bound(m_lineEnds.begin(), m_lineEnds.end(), pos);
+            if (itr != m_lineEnds.end() && *itr <= m_textEnd && IsLineStart(*itr))
+            {
+                return *itr;
+            }
+            if (itr == m_lineEnds.end() || *itr > m_textEnd)
+            {
+                return -1;
+            }
+        }
+
+        // No index (or a stale one); look for the line end
+        auto found = ScanPieces(pos - 1, m_textEnd, [](const utf8* pBase, long from, long to) {
+            auto p = (const utf8*)memchr(pBase + from, '\n', size_t(to - from));
+            return p ? long(p - pBase) : -1l;
+        });
+        return found < 0 ? -1 : found + 1;
+    }
+
+    bool HasFoldedPrefixAt(long pos) const
+    {
+        const auto& prefix = m_program.foldedPrefix;
+        for (size_t i = 1; i < prefix.size(); i++)
+        {
+            if (FoldByte(At(pos + long(i))) != uint8_t(prefix[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The next place in [pos, last] the folded prefix is, ignoring the case of the ASCII letters.  A word of text at a
+    // time is folded and compared with the first byte in every lane; only a word with that byte in it is looked into
+    long NextFolded(long pos, long last) const
+    {
+        const auto& prefix = m_program.foldedPrefix;
+        auto size = long(prefix.size());
+        auto first = uint8_t(prefix[0]);
+        auto firsts = 0x0101010101010101ull * first;
+        return ScanPieces(pos, std::min(last, m_textEnd - size) + 1, [&](const utf8* pBase, long from, long to) {
+            while (from < to)
+            {
+                if (to - from >= 8)
+                {
+                    uint64_t word;
+                    memcpy(&word, pBase + from, sizeof(word));
+                    if (!ZeroBytes(FoldWord(word) ^ firsts))
+                    {
+                        from += 8;
+                        continue;
+                    }
+                }
+
+                for (auto stop = std::min(to, from + 8); from < stop; from++)
+                {
+                    if (FoldByte(pBase[from]) == first && HasFoldedPrefixAt(from))
+                    {
+                        return from;
+                    }
+                }
+            }
+            return -1l;
+        });
+    }
+
+    // Where, at or after pos, a match could next start; -1 if nowhere before end
+    long NextCandidate(long pos, long end) const
+    {
+        if (m_program.lineAnchored)
+        {
+            while (pos <= end)
+            {
+                pos = NextLineStart(pos);
+                if (pos < 0 || pos > end)
+                {
+                    return -1;
+                }
+                if (CanStartAt(pos) && HasPrefixAt(pos))
+                {
+                    return pos;
+                }
+                pos++;
+            }
+            return -1;
+        }
+
+        long found = -1;
+        auto last = std::min(end, m_textEnd - 1);
+        if (!m_program.foldedPrefix.empty())
+        {
+            return NextFolded(pos, last);
+        }
+
+        const auto& prefix = m_program.prefix;
+        if (!prefix.empty())
+        {
+            auto size = long(prefix.size());
+            found = ScanPieces(pos, std::min(last, m_textEnd - size) + 1, [&](const utf8* pBase, long from, long to) {
+                auto first = uint8_t(prefix[0]);
+                while (from < to)
+                {
+                    auto p = (const utf8*)memchr(pBase + from, first, size_t(to - from));
+                    if (!p)
+                    {
+                        break;
+                    }
+                    from = long(p - pBase);
+                    long i = 1;
+                    while (i < size && At(from + i) == uint8_t(prefix[i]))
+                    {
+                        i++;
+                    }
+                    if (i == size)
+                    {
+                        return from;
+                    }
+                    from++;
+                }
+                return -1l;
+            });
+            return found;
+        }
+
+        if (m_program.startByte >= 0)
+        {
+            found = ScanPieces(pos, last + 1, [&](const utf8* pBase, long from, long to) {
+                auto p = (const utf8*)memchr(pBase + from, m_program.startByte, size_t(to - from));
+                return p ? long(p - pBase) : -1l;
+            });
+        }
+        else
+        {
+            found = ScanPieces(pos, last + 1, [&](const utf8* pBase, long from, long to) {
+                for (auto p = pBase + from; p < pBase + to; p++)
+                {
+                    if (m_program.startBytes[*p])
+                    {
+                        return long(p - pBase);
+                    }
+                }
+                return -1l;
+            });
+        }
+
+        if (found < 0 && m_program.matchesEmpty && pos <= m_textEnd && end >= m_textEnd)
+        {
+            return m_textEnd;
+        }
+        return found;
+    }
+
+    // Follows everything that doesn't consume a character, leaving the threads that do in the list, in priority order.
+    // An explicit stack, so that long chains of optional pieces can't overflow the real one
+    void AddThread(ThreadList& list, int pc, long pos)
+    {
+        m_stack.clear();
+        m_stack.push_back(StackEntry{ pc, -1, 0 });
+
+        while (!m_stack.empty())
+        {
+            auto entry = m_stack.back();
+            m_stack.pop_back();
+            if (entry.slot >= 0)
+            {
+                m_caps[size_t(entry.slot)] = entry.value;
+                continue;
+            }
+
+            pc = entry.pc;
+            for (;;)
+            {
+                auto index = list.sparse[size_t(pc)];
+                if (index < list.count && list.dense[size_t(index)] == pc)
+                {
+                    break;
+                }
+                index = list.count++;
+                list.sparse[size_t(pc)] = index;
+                list.dense[size_t(index)] = pc;
+
+                const auto& inst = m_program.insts[size_t(pc)];
+                bool follow = true;
+                switch (inst.op)
+                {
+                case Op::Jump:
+                    pc = inst.x;
+                    continue;
+                case Op::Split:
+                    m_stack.push_back(StackEntry{ inst.y, -1, 0 });
+                    pc = inst.x;
+                    continue;
+                case Op::Save:
+                    m_stack.push_back(StackEntry{ 0, inst.y, m_caps[size_t(inst.y)] });
+                    m_caps[size_t(inst.y)] = pos;
+                    break;
+                case Op::LineStart:
+                    follow = IsLineStart(pos);
+                    break;
+                case Op::LineEnd:
+                    follow = pos >= m_textEnd || At(pos) == '\n';
+                    break;
+                case Op::WordStart:
+                    follow = (pos == 0 || !IsWordByte(At(pos - 1))) && pos < m_textEnd && IsWordByte(At(pos));
+                    break;
+                case Op::WordEnd:
+                    follow = pos > 0 && IsWordByte(At(pos - 1)) && (pos >= m_textEnd || !IsWordByte(At(pos)));
+                    break;
+                default:
+                    std::copy(m_caps.begin(), m_caps.end(), list.caps.begin() + size_t(index) * m_slots);
+                    follow = false;
+                    break;
+                }
+                if (!follow)
+                {
+                    break;
+                }
+                pc++;
+            }
+        }
+    }
+
+    void Record(const long* pCaps, RegexMatch& match) const
+    {
+        auto groupSlots = std::min(size_t(m_program.zsSlot), size_t(RegexMatch::MaxGroups * 2));
+        std::fill(std::begin(match.groups), std::end(match.groups), -1l);
+        std::copy(pCaps, pCaps + groupSlots, std::begin(match.groups));
+        match.start = pCaps[m_program.zsSlot] >= 0 ? pCaps[m_program.zsSlot] : pCaps[0];
+        match.end = pCaps[m_program.zsSlot + 1] >= 0 ? pCaps[m_program.zsSlot + 1] : pCaps[1];
+        match.end = std::max(match.start, match.end);
+    }
+
+private:
+    const RegexProgram& m_program;
+    const std::vector<long>& m_lineEnds;
+    const utf8* m_pStart;
+    const utf8* m_pGapEnd;
+    long m_gapOffset;
+    long m_textEnd;
+    size_t m_slots;
+    ThreadList m_current;
+    ThreadList m_next;
+    std::vector<long> m_caps;
+    std::vector<StackEntry> m_stack;
+
+    // Built as the search needs it, and kept for the next search with this runner
+    std::vector<DfaState> m_dfaStates;
+    std::map<std::pair<uint8_t, std::vector<int>>, int> m_dfaLookup;
+    std::vector<int> m_dfaStack;
+    std::vector<int> m_dfaRoots;
+    ThreadList m_closure;
+    int m_dfaIdle[8] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+    bool m_dfaFailed = false;
+};
+
+} // namespace
+
+bool RegexMatch::GetGroup(int group, long& groupStart, long& groupEnd) const
+{
+    if (group < 0 || group >= MaxGroups || groups[group * 2] < 0 || groups[group * 2 + 1] < 0)
+    {
+        return false;
+    }
+    groupStart = groups[group * 2];
+    groupEnd = groups[group * 2 + 1];
+    return true;
+}
+
+ZepRegex::ZepRegex(const std::string& pattern, uint32_t flags)
+{
+    Compile(pattern, flags);
+}
+
+bool ZepRegex::Compile(const std::string& pattern, uint32_t flags)
+{
+    ZEP_TRACE_SCOPE("ZepRegex::Compile");
+
+    m_spProgram.reset();
+    m_pattern = pattern;
+    m_flags = flags;
+    m_error.clear();
+
+    auto spProgram = std::make_shared<RegexProgram>();
+    spProgram->ignoreCase = (flags & RegexFlags::IgnoreCase) != 0 && !((flags & RegexFlags::SmartCase) && HasUpperCase(pattern));
+
+    // \c and \C apply to the whole pattern, wherever they are
+    for (size_t i = 0; i + 1 < pattern.size(); i++)
+    {
+        if (pattern[i] == '\\')
+        {
+            if (pattern[i + 1] == 'c')
+            {
+                spProgram->ignoreCase = true;
+            }
+            else if (pattern[i + 1] == 'C')
+            {
+                spProgram->ignoreCase = false;
+            }
+            i++;
+        }
+    }
+
+    RegexParser parser(pattern, *spProgram);
+    auto root = parser.Parse();
+    if (root < 0)
+    {
+        m_error = parser.error;
+        return false;
+    }
+
+    spProgram->groupCount = 0;
+    for (auto& node : parser.nodes)
+    {
+        if (node.type == NodeType::Group)
+        {
+            spProgram->groupCount = std::max(spProgram->groupCount, int(node.value));
+        }
+    }
+    spProgram->zsSlot = (spProgram->groupCount + 1) * 2;
+    spProgram->slotCount = spProgram->zsSlot + 2;
+
+    RegexEmitter emitter(parser.nodes, *spProgram);
+    Inst save;
+    save.op = Op::Save;
+    save.y = 0;
+    spProgram->insts.push_back(save);
+    if (!emitter.Emit(root))
+    {
+        m_error = "Pattern is too large";
+        return false;
+    }
+    save.y = 1;
+    spProgram->insts.push_back(save);
+    Inst match;
+    match.op = Op::Match;
+    spProgram->insts.push_back(match);
+
+    AnalyzeStart(*spProgram);
+    m_spProgram = spProgram;
+    return true;
+}
+
+bool ZepRegex::IgnoresCase() const
+{
+    return m_spProgram && m_spProgram->ignoreCase;
+}
+
+int ZepRegex::GetGroupCount() const
+{
+    return m_spProgram ? m_spProgram->groupCount : 0;
+}
+
+const std::string& ZepRegex::GetLiteralPrefix() const
+{
+    static const std::string empty;
+    return m_spProgram ? m_spProgram->prefix : empty;
+}
+
+const std::string& ZepRegex::GetFoldedPrefix() const
+{
+    static const std::string empty;
+    return m_spProgram ? m_spProgram->foldedPrefix : empty;
+}
+
+bool ZepRegex::IsLiteral() const
+{
+    return m_spProgram && m_spProgram->literal;
+}
+
+bool ZepRegex::Find(const GapBuffer<utf8>& text, const std::vector<long>& lineEnds, long start, long end, RegexMatch& match) const
+{
+    if (!m_spProgram)
+    {
+        return false;
+    }
+
+    RegexRunner runner(*m_spProgram, text, lineEnds);
+    end = end < 0 ? runner.TextEnd() : std::min(end, runner.TextEnd());
+    start = std::max(0l, start);
+    return start <= end && runner.Find(start, end, match);
+}
+
+void ZepRegex::ForEachMatch(const GapBuffer<utf8>& text, const std::vector<long>& lineEnds, long start, long end, const std::function<bool(const RegexMatch&)>& fn) const
+{
+    if (!m_spProgram)
+    {
+        return;
+    }
+
+    RegexRunner runner(*m_spProgram, text, lineEnds);
+    end = end < 0 ? runner.TextEnd() : std::min(end, runner.TextEnd());
+    RegexMatch match;
+    for (auto pos = std::max(0l, start); pos <= end && runner.Find(pos, end, match);)
+    {
+        if (!fn(match))
+        {
+            break;
+        }
+        pos = std::max(match.groups[1], match.groups[0] + 1);
+    }
+}
+
+void ZepRegex::ForEachMatchAt(const GapBuffer<utf8>& text, const std::vector<long>& lineEnds, const std::vector<long>& starts, const std::function<bool(const RegexMatch&)>& fn) const
+{
+    if (!m_spProgram)
+    {
+        return;
+    }
+
+    RegexRunner runner(*m_spProgram, text, lineEnds);
+    RegexMatch match;
+    for (auto start : starts)
+    {
+        if (start >= 0 && start <= runner.TextEnd() && runner.Find(start, start, match) && !fn(match))
+        {
+            break;
+        }
+    }
+}
+
+bool ZepRegex::FindLast(const GapBuffer<utf8>& text, const std::vector<long>& lineEnds, long start, long end, RegexMatch& match) const
+{
+    if (!m_spProgram)
+    {
+        return false;
+    }
+
+    RegexRunner runner(*m_spProgram, text, lineEnds);
+    end = end < 0 ? runner.TextEnd() : std::min(end, runner.TextEnd());
+    start = std::max(0l, start);
+    return start <= end && runner.FindLast(start, end, match);
+}
+
+} // Zep
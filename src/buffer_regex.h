@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "editor.h"
+#include "gap_buffer.h"
+
+namespace Zep
+{
+
+namespace RegexFlags
+{
+enum : uint32_t
+{
+    None = 0,
+    IgnoreCase = (1 << 0),      // \c and \C in the pattern win over this
+    SmartCase = (1 << 1)        // With IgnoreCase: unless the pattern has an upper case letter in it
+};
+}
+
+// Where a pattern matched, as offsets into the text; ends are exclusive
+struct RegexMatch
+{
+    static const int MaxGroups = 10;    // The whole pattern, then \1 to \9
+
+    long start = -1;                    // Moved by \zs and \ze, if the pattern has them
+    long end = -1;
+    long groups[MaxGroups * 2];         // Start and end of the whole pattern, then of each \( \); -1 if a group took no part
+
+    bool GetGroup(int group, long& groupStart, long& groupEnd) const;
+};
+
+struct RegexProgram;
+
+// Searches with Vim's pattern dialect, straight over the gap buffer.
+// The pattern is compiled to bytecode for a Pike VM: every thread steps over a character together, so the search is
+// linear in the text however the pattern is written, and leftmost-first like Vim's own matcher.  The text is read in
+// place on both sides of the gap; nothing is copied.
+// Most of the text can't start a match, and is skipped: memchr for a literal prefix, a byte table otherwise, and the
+// line index for patterns that start with ^.  Ignoring case, a prefix is looked for with the text folded a word at a
+// time, rather than in a lower cased copy.  The rest is scanned by a DFA, built from the program as it is needed,
+// which finds where the first match ends; the VM then only runs over the stretch just before it, for the start and
+// the groups.  Case is ignored for ASCII, and past it for the Latin, Greek and Cyrillic letters.
+//
+// Supported: literals, . [] [^] [[:alpha:]], * \+ \= \? \{n,m} \{-n,m}, \( \) \%( \) \|, ^ $ \< \>, \zs \ze,
+// \s \d \w \a \l \u \x \o \h (and their upper case opposites), \_x \_. \_[] \_^ \_$, \n \t \e \r, and the
+// \v \m \M \V and \c \C modifiers.  Back references and look around aren't; they fail to compile.
+//
+// Compiled patterns are immutable and shared by copies, so a copy can be searched with on another thread.
+class ZepRegex
+{
+public:
+    ZepRegex() {}
+    explicit ZepRegex(const std::string& pattern, uint32_t flags = RegexFlags::None);
+
+    // False if the pattern is bad; GetError() says why
+    bool Compile(const std::string& pattern, uint32_t flags = RegexFlags::None);
+
+    bool IsValid() const { return bool(m_spProgram); }
+    const std::string& GetPattern() const { return m_pattern; }
+    uint32_t GetFlags() const { return m_flags; }
+    const std::string& GetError() const { return m_error; }
+    bool IgnoresCase() const;
+    int GetGroupCount() const;
+
+    // Text every match starts with; empty if there isn't any
+    const std::string& GetLiteralPrefix() const;
+
+    // Ignoring case, a longer prefix if there is one: every match starts with it, whatever the case of its ASCII
+    // letters.  They are lower case here
+    const std::string& GetFoldedPrefix() const;
+
+    // The pattern matches its literal prefix and nothing else
+    bool IsLiteral() const;
+
+    // The first match starting in [start, end]; it may carry on past end.  An end of -1 is the end of the text, and a
+    // 0 at the end of the text (as the buffer has) isn't searched.  lineEnds is the text's line index, as the buffer
+    // keeps it; it may be empty.
+    bool Find(const GapBuffer<utf8>& text, const std::vector<long>& lineEnds, long start, long end, RegexMatch& match) const;
+
+    // Each match starting in [start, end], in order, until fn returns false.  Matches don't overlap; after an empty one
+    // the search goes on from the next character
+    void ForEachMatch(const GapBuffer<utf8>& text, const std::vector<long>& lineEnds, long start, long end, const std::function<bool(const RegexMatch&)>& fn) const;
+
+    // The match starting at each of starts, for those that have one, until fn returns false
+    void ForEachMatchAt(const GapBuffer<utf8>& text, const std::vector<long>& lineEnds, const std::vector<long>& starts, const std::function<bool(const RegexMatch&)>& fn) const;
+
+    // The last match starting in [start, end], searching back a line at a time
+    bool FindLast(const GapBuffer<utf8>& text, const std::vector<long>& lineEnds, long start, long end, RegexMatch& match) const;
+
+private:
+    std::shared_ptr<const RegexProgram> m_spProgram;
+    std::string m_pattern;
+    uint32_t m_flags = RegexFlags::None;
+    std::string m_error;
+};
+
+} // Zep
@@ -0,0 +1,511 @@
+#include <algorithm>
+#include <chrono>
+
+#include "buffer_search.h"
+#include "utils/trace.h"
+
+namespace Zep
+{
+
+namespace
+{
+// The background search looks to see if it has been stopped between chunks this big
+const long SearchChunkSize = 1 << 20;
+
+// Edited regions bigger than this are searched on the thread pool, with the rest of the buffer
+const long EditedSearchSize = 1 << 16;
+
+// A literal that can't overlap itself has a match everywhere it occurs
+bool CanOverlap(const std::string& literal)
+{
+    for (size_t size = 1; size < literal.size(); size++)
+    {
+        if (literal.compare(0, size, literal, literal.size() - size, size) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+}
+
+ZepBufferSearch::ZepBufferSearch(ZepBuffer& buffer)
+    : ZepComponent(buffer.GetEditor()),
+    m_buffer(buffer),
+    m_stop(false)
+{
+}
+
+ZepBufferSearch::~ZepBufferSearch()
+{
+    Interrupt();
+}
+
+template<class FnBefore>
+size_t ZepBufferSearch::FindIndex(size_t first, FnBefore fnBefore) const
+{
+    auto count = m_matches.size() - first;
+    while (count > 0)
+    {
+        auto step = count / 2;
+        if (fnBefore(GetMatch(first + step)))
+        {
+            first += step + 1;
+            count -= step + 1;
+        }
+        else
+        {
+            count = step;
+        }
+    }
+    return first;
+}
+
+void ZepBufferSearch::SetMatches(std::vector<SearchMatch>& matches)
+{
+    m_matches.swap(matches);
+    m_shift = 0;
+}
+
+void ZepBufferSearch::EraseMatches(size_t first, size_t last)
+{
+    m_matches.erase(m_matches.begin() + first, m_matches.begin() + last);
+    if (m_shiftFrom >= last)
+    {
+        m_shiftFrom -= last - first;
+    }
+    else if (m_shiftFrom > first)
+    {
+        m_shiftFrom = first;
+    }
+}
+
+// The matches are where they are now; so any that go after the shift have it taken off
+void ZepBufferSearch::InsertMatches(size_t index, const std::vector<SearchMatch>& matches)
+{
+    m_matches.insert(m_matches.begin() + index, matches.begin(), matches.end());
+    if (index <= m_shiftFrom)
+    {
+        m_shiftFrom += matches.size();
+    }
+    else
+    {
+        ApplyShift(index, index + matches.size(), -m_shift);
+    }
+}
+
+// Move the matches from first on.  Only those between first and where the last shift started are touched; typing
+// in one place touches none
+void ZepBufferSearch::ShiftMatches(size_t first, long shift)
+{
+    if (m_shift == 0)
+    {
+        m_shiftFrom = first;
+    }
+    else if (first < m_shiftFrom)
+    {
+        ApplyShift(first, m_shiftFrom, shift);
+    }
+    else
+    {
+        ApplyShift(m_shiftFrom, first, m_shift);
+        m_shiftFrom = first;
+    }
+    m_shift += shift;
+}
+
+void ZepBufferSearch::ApplyShift(size_t first, size_t last, long shift)
+{
+    if (shift == 0)
+    {
+        return;
+    }
+    for (auto index = first; index < last; index++)
+    {
+        m_matches[index].start += shift;
+        m_matches[index].end += shift;
+    }
+}
+
+// Stop the background search, and wait for it; true if it hadn't finished
+bool ZepBufferSearch::Interrupt()
+{
+    if (!m_result.valid())
+    {
+        return false;
+    }
+
+    m_stop = true;
+    m_result.get();
+    m_stop = false;
+    return true;
+}
+
+void ZepBufferSearch::SetPattern(const std::string& pattern, BufferLocation visibleStart, BufferLocation visibleEnd)
+{
+    auto flags = GetEditor().GetSearchFlags();
+    if (pattern == m_regex.GetPattern() && flags == m_regex.GetFlags())
+    {
+        return;
+    }
+
+    ZEP_TRACE_SCOPE("ZepBufferSearch::SetPattern");
+
+    // Pick up the edits first, so that the matches are complete if they are to be refined
+    SearchEdited();
+    auto complete = !Interrupt();
+
+    auto previous = m_regex;
+    m_regex.Compile(pattern, flags);
+    m_restart = false;
+    if (!m_regex.IsValid())
+    {
+        m_matches.clear();
+        m_shift = 0;
+        return;
+    }
+
+    if (complete && Refine(previous))
+    {
+        return;
+    }
+
+    m_matches.clear();
+    m_shift = 0;
+    if (visibleEnd < 0 || (GetEditor().GetFlags() & ZepEditorFlags::DisableThreads))
+    {
+        auto matches = FindMatches(m_regex, GetSearchRanges());
+        SetMatches(matches);
+        return;
+    }
+
+    SearchRange(visibleStart, visibleEnd, m_matches);
+    SearchAll();
+}
+
+void ZepBufferSearch::Clear()
+{
+    if (m_regex.GetPattern().empty())
+    {
+        return;
+    }
+
+    Interrupt();
+    m_regex = ZepRegex();
+    std::vector<SearchMatch> none;
+    SetMatches(none);
+    m_restart = false;
+    m_editedStart = m_editedEnd = -1;
+}
+
+bool ZepBufferSearch::Update()
+{
+    if (m_result.valid() &&
+        m_result.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        auto matches = m_result.get();
+        SetMatches(matches);
+        return true;
+    }
+
+    if (m_editedStart >= 0)
+    {
+        SearchEdited();
+        return true;
+    }
+    return false;
+}
+
+void ZepBufferSearch::Wait()
+{
+    SearchEdited();
+    if (m_result.valid())
+    {
+        auto matches = m_result.get();
+        SetMatches(matches);
+    }
+}
+
+SearchMatch ZepBufferSearch::GetMatch(size_t index) const
+{
+    auto match = m_matches[index];
+    if (index >= m_shiftFrom)
+    {
+        match.start += m_shift;
+        match.end += m_shift;
+    }
+    return match;
+}
+
+const std::vector<SearchMatch>& ZepBufferSearch::GetMatches()
+{
+    ApplyShift(m_shiftFrom, m_matches.size(), m_shift);
+    m_shift = 0;
+    return m_matches;
+}
+
+size_t ZepBufferSearch::MatchesFrom(BufferLocation location) const
+{
+    return FindIndex(0, [location](const SearchMatch& match)
+    {
+        return match.end <= location;
+    });
+}
+
+bool ZepBufferSearch::FindNext(BufferLocation location, SearchDirection dir, SearchMatch& match) const
+{
+    if (m_matches.empty())
+    {
+        return false;
+    }
+
+    auto count = CountTo(location);
+    if (dir == SearchDirection::Forward)
+    {
+        match = GetMatch(size_t(count) % m_matches.size());
+        return true;
+    }
+
+    // Back past a match that starts right at location
+    if (count > 0 && GetMatch(count - 1).start == location)
+    {
+        count--;
+    }
+    match = GetMatch(count > 0 ? count - 1 : m_matches.size() - 1);
+    return true;
+}
+
+long ZepBufferSearch::CountTo(BufferLocation location) const
+{
+    return long(FindIndex(0, [location](const SearchMatch& match)
+    {
+        return match.start <= location;
+    }));
+}
+
+void ZepBufferSearch::SearchRange(BufferLocation start, BufferLocation end, std::vector<SearchMatch>& matches) const
+{
+    m_regex.ForEachMatch(m_buffer.GetText(), m_buffer.GetLineEnds(), start, end, [&](const RegexMatch& match)
+    {
+        matches.push_back(SearchMatch{ match.start, match.end });
+        return true;
+    });
+}
+
+// The whole buffer, on the thread pool
+void ZepBufferSearch::SearchAll()
+{
+    auto regex = m_regex;
+    auto ranges = GetSearchRanges();
+    m_result = m_buffer.GetThreadPool().enqueue([this, regex, ranges]()
+    {
+        ZEP_TRACE_SCOPE("ZepBufferSearch::SearchAll");
+        return FindMatches(regex, ranges);
+    });
+}
+
+// Where a match could start: the blocks the trigram index has the literal prefix in (folded, when ignoring case), or
+// everywhere
+SearchRanges ZepBufferSearch::GetSearchRanges() const
+{
+    SearchRanges ranges;
+    const auto& folded = m_regex.GetFoldedPrefix();
+    if (!m_buffer.GetTrigramIndex().FindCandidates(folded.empty() ? m_regex.GetLiteralPrefix() : folded, ranges))
+    {
+        ranges.assign(1, std::make_pair(0l, long(m_buffer.GetText().size())));
+    }
+    return ranges;
+}
+
+// The matches in the ranges, as a search from the start finds them; a chunk at a time, so an edit can stop it quickly
+std::vector<SearchMatch> ZepBufferSearch::FindMatches(const ZepRegex& regex, const SearchRanges& ranges) const
+{
+    std::vector<SearchMatch> matches;
+    auto& text = m_buffer.GetText();
+    BufferLocation next = 0;
+    for (auto& range : ranges)
+    {
+        for (long chunk = range.first; chunk < range.second && !m_stop; chunk += SearchChunkSize)
+        {
+            regex.ForEachMatch(text, m_buffer.GetLineEnds(), std::max(chunk, next), std::min(chunk + SearchChunkSize, range.second) - 1, [&](const RegexMatch& match)
+            {
+                matches.push_back(SearchMatch{ match.start, match.end });
+                next = std::max(match.groups[1], match.groups[0] + 1);
+                return !m_stop;
+            });
+        }
+    }
+    return matches;
+}
+
+// Every match of the new pattern starts with the old literal.  If the literal can't overlap itself, the old matches are
+// all the places it occurs, and the only ones to check
+bool ZepBufferSearch::Refine(const ZepRegex& previous)
+{
+    const auto& literal = previous.GetLiteralPrefix();
+    if (!previous.IsLiteral() ||
+        CanOverlap(literal) ||
+        m_regex.GetLiteralPrefix().compare(0, literal.size(), literal) != 0)
+    {
+        return false;
+    }
+
+    ZEP_TRACE_SCOPE("ZepBufferSearch::Refine");
+
+    std::vector<long> starts;
+    starts.reserve(m_matches.size());
+    for (size_t index = 0; index < m_matches.size(); index++)
+    {
+        starts.push_back(GetMatch(index).start);
+    }
+
+    // Matches don't overlap, as when searching from the start
+    std::vector<SearchMatch> matches;
+    BufferLocation next = 0;
+    m_regex.ForEachMatchAt(m_buffer.GetText(), m_buffer.GetLineEnds(), starts, [&](const RegexMatch& match)
+    {
+        if (match.groups[0] >= next)
+        {
+            matches.push_back(SearchMatch{ match.start, match.end });
+            next = std::max(match.groups[1], match.groups[0] + 1);
+        }
+        return true;
+    });
+    SetMatches(matches);
+    return true;
+}
+
+// Grow the edited range to whole lines, with one either side for patterns that match across them, and search it again
+void ZepBufferSearch::SearchEdited()
+{
+    if (m_editedStart < 0)
+    {
+        return;
+    }
+
+    ZEP_TRACE_SCOPE("ZepBufferSearch::SearchEdited");
+
+    auto& lineEnds = m_buffer.GetLineEnds();
+    auto firstLine = std::max(0l, m_buffer.LineFromOffset(m_editedStart) - 1);
+    auto lastLine = std::min(long(lineEnds.size()) - 1, m_buffer.LineFromOffset(m_editedEnd) + 1);
+    BufferLocation start = firstLine == 0 ? 0 : lineEnds[firstLine - 1];
+    BufferLocation end = lastLine < 0 ? 0 : lineEnds[lastLine];
+    m_editedStart = m_editedEnd = -1;
+
+    if (!m_regex.IsValid())
+    {
+        return;
+    }
+
+    // A large edit (or a load) is left to a search of the whole buffer
+    if (m_restart || (end - start > EditedSearchSize && !(GetEditor().GetFlags() & ZepEditorFlags::DisableThreads)))
+    {
+        m_restart = false;
+        SearchAll();
+        return;
+    }
+
+    // Take out the matches in the range, and any running into it
+    auto first = MatchesFrom(start);
+    if (first < m_matches.size())
+    {
+        start = std::min(start, GetMatch(first).start);
+    }
+    auto last = FindIndex(first, [end](const SearchMatch& match)
+    {
+        return match.start < end;
+    });
+
+    std::vector<SearchMatch> found;
+    BufferLocation from = first == 0 ? start : std::max(start, GetMatch(first - 1).end);
+    SearchRange(from, end - 1, found);
+
+    // A match found at the end can run over those after it
+    if (!found.empty())
+    {
+        while (last < m_matches.size() && GetMatch(last).start < found.back().end)
+        {
+            last++;
+        }
+    }
+
+    EraseMatches(first, last);
+    InsertMatches(first, found);
+}
+
+void ZepBufferSearch::MarkEdited(BufferLocation start, BufferLocation end)
+{
+    m_editedStart = m_editedStart < 0 ? start : std::min(m_editedStart, start);
+    m_editedEnd = std::max(m_editedEnd, end);
+}
+
+void ZepBufferSearch::Notify(std::shared_ptr<ZepMessage> spMsg)
+{
+    if (spMsg->messageId != Msg_Buffer)
+    {
+        return;
+    }
+
+    auto spBufferMsg = std::static_pointer_cast<BufferMessage>(spMsg);
+    if (spBufferMsg->pBuffer != &m_buffer || !m_regex.IsValid())
+    {
+        return;
+    }
+
+    auto start = spBufferMsg->startLocation;
+    auto end = spBufferMsg->endLocation;
+    if (spBufferMsg->type == BufferMessageType::PreBufferChange)
+    {
+        m_restart = Interrupt() || m_restart;
+    }
+    else if (spBufferMsg->type == BufferMessageType::TextDeleted)
+    {
+        // Matches in the deleted text go; those after it move back
+        auto length = end - start;
+        auto first = MatchesFrom(start);
+        EraseMatches(first, FindIndex(first, [end](const SearchMatch& match)
+        {
+            return match.start < end;
+        }));
+        ShiftMatches(first, -length);
+
+        auto shift = [=](BufferLocation location)
+        {
+            return location >= end ? location - length : std::min(location, start);
+        };
+        if (m_editedStart >= 0)
+        {
+            m_editedStart = shift(m_editedStart);
+            m_editedEnd = shift(m_editedEnd);
+        }
+        MarkEdited(start, start);
+    }
+    else if (spBufferMsg->type == BufferMessageType::TextAdded)
+    {
+        // A match the text went into the middle of goes; those after it move on
+        auto length = end - start;
+        auto first = FindIndex(0, [start](const SearchMatch& match)
+        {
+            return match.start < start;
+        });
+        if (first > 0 && GetMatch(first - 1).end > start)
+        {
+            EraseMatches(first - 1, first);
+            first--;
+        }
+        ShiftMatches(first, length);
+
+        if (m_editedStart >= 0)
+        {
+            m_editedStart = m_editedStart > start ? m_editedStart + length : m_editedStart;
+            m_editedEnd = m_editedEnd > start ? m_editedEnd + length : m_editedEnd;
+        }
+        MarkEdited(start, end);
+    }
+    else if (spBufferMsg->type == BufferMessageType::TextChanged)
+    {
+        MarkEdited(start, end);
+    }
+}
+
+} // Zep
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+
+#include "buffer.h"
+#include "buffer_regex.h"
+#include "buffer_trigram.h"
+
+namespace Zep
+{
+
+// Where the search pattern matched; the end is exclusive
+struct SearchMatch
+{
+    BufferLocation start;
+    BufferLocation end;
+};
+
+// The matches of a search pattern in one buffer, sorted, for highlighting.
+// SetPattern searches the range it is given (the visible lines) straight away, and the whole buffer on the thread
+// pool; Update() picks up the result.  Typing a search mostly adds to a literal pattern, and then the old matches are
+// the only places a new one can start, so just those are checked.  In a big buffer, the trigram index narrows down
+// where the rest are searched for.  Edits shift the matches after them lazily, by an offset kept for all the matches
+// from one on, so typing in a buffer with many matches doesn't touch them all each key; Update() searches the lines
+// the edits touched again.
+class ZepBufferSearch : public ZepComponent
+{
+public:
+    ZepBufferSearch(ZepBuffer& buffer);
+    virtual ~ZepBufferSearch();
+
+    virtual void Notify(std::shared_ptr<ZepMessage> message) override;
+
+    // Nothing to do if the pattern hasn't changed.  A bad pattern matches nothing
+    void SetPattern(const std::string& pattern, BufferLocation visibleStart = 0, BufferLocation visibleEnd = -1);
+    void Clear();
+
+    // Search the edited lines, and take the matches from a finished background search; true if they changed
+    bool Update();
+    void Wait();
+
+    const ZepRegex& GetRegex() const { return m_regex; }
+    bool IsComplete() const { return !m_result.valid(); }
+
+    // The matches in order, where they are now
+    size_t GetMatchCount() const { return m_matches.size(); }
+    SearchMatch GetMatch(size_t index) const;
+
+    // All of them, with the shift from the edits since applied to them first
+    const std::vector<SearchMatch>& GetMatches();
+
+    // The index of the first match that ends after location
+    size_t MatchesFrom(BufferLocation location) const;
+
+    // For n/N and the status bar, once complete: the first match starting after location, or going back the last one
+    // starting before it, wrapping around (false if there are none); and how many start at or before location
+    bool FindNext(BufferLocation location, SearchDirection dir, SearchMatch& match) const;
+    long CountTo(BufferLocation location) const;
+
+private:
+    bool Interrupt();
+    void SearchAll();
+    SearchRanges GetSearchRanges() const;
+    std::vector<SearchMatch> FindMatches(const ZepRegex& regex, const SearchRanges& ranges) const;
+    void SearchRange(BufferLocation start, BufferLocation end, std::vector<SearchMatch>& matches) const;
+    bool Refine(const ZepRegex& previous);
+    void SearchEdited();
+    void MarkEdited(BufferLocation start, BufferLocation end);
+
+    // The first index from first on whose match fnBefore is false for; the matches are sorted, so it is true up to there
+    template<class FnBefore>
+    size_t FindIndex(size_t first, FnBefore fnBefore) const;
+    void SetMatches(std::vector<SearchMatch>& matches);
+    void EraseMatches(size_t first, size_t last);
+    void InsertMatches(size_t index, const std::vector<SearchMatch>& matches);
+    void ShiftMatches(size_t first, long shift);
+    void ApplyShift(size_t first, size_t last, long shift);
+
+private:
+    ZepBuffer& m_buffer;
+    ZepRegex m_regex;
+    std::vector<SearchMatch> m_matches;
+    size_t m_shiftFrom = 0;                          // The matches from here on are m_shift further on than stored
+    long m_shift = 0;
+    std::future<std::vector<SearchMatch>> m_result;  // Matches in the whole buffer, from the thread pool
+    std::atomic<bool> m_stop;
+    bool m_restart = false;                          // An edit stopped the background search
+    BufferLocation m_editedStart = -1;               // Range the edits since the last Update() touched
+    BufferLocation m_editedEnd = -1;
+};
+
+} // Zep
@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <cctype>
+
+#include "buffer_substitute.h"
+#include "utils/trace.h"
+
+namespace Zep
+{
+
+namespace
+{
+// The replacement for one match, on the end of the new text
+void AppendReplacement(const GapBuffer<utf8>& text, const RegexMatch& match, const std::string& replacement, std::string& out)
+{
+    char caseNext = 0;          // \u or \l: the next character
+    char caseRest = 0;          // \U or \L: until \E or \e
+    auto put = [&](char ch)
+    {
+        auto mode = caseNext ? caseNext : caseRest;
+        caseNext = 0;
+        if (mode)
+        {
+            ch = char(std::tolower(mode) == 'u' ? std::toupper(uint8_t(ch)) : std::tolower(uint8_t(ch)));
+        }
+        out.push_back(ch);
+    };
+    auto putText = [&](long start, long end)
+    {
+        if (!caseNext && !caseRest)
+        {
+            text.append_to(out, start, end);
+            return;
+        }
+        for (auto i = start; i < end; i++)
+        {
+            put(char(text[i]));
+        }
+    };
+
+    for (size_t i = 0; i < replacement.size(); i++)
+    {
+        auto ch = replacement[i];
+        if (ch == '&')
+        {
+            putText(match.start, match.end);
+            continue;
+        }
+        if (ch != '\\' || i + 1 == replacement.size())
+        {
+            put(ch);
+            continue;
+        }
+
+        ch = replacement[++i];
+        long groupStart;
+        long groupEnd;
+        if (ch == '0')
+        {
+            putText(match.start, match.end);
+        }
+        else if (ch >= '1' && ch <= '9')
+        {
+            if (match.GetGroup(ch - '0', groupStart, groupEnd))
+            {
+                putText(groupStart, groupEnd);
+            }
+        }
+        else if (ch == 'r' || ch == 'n')
+        {
+            // Vim puts a NUL for \n; the buffer can't hold one, so it is a line break too
+            out.push_back('\n');
+        }
+        else if (ch == 't')
+        {
+            put('\t');
+        }
+        else if (ch == 'u' || ch == 'l')
+        {
+            caseNext = ch;
+        }
+        else if (ch == 'U' || ch == 'L')
+        {
+            caseRest = ch;
+        }
+        else if (ch == 'E' || ch == 'e')
+        {
+            caseRest = 0;
+        }
+        else
+        {
+            put(ch);
+        }
+    }
+}
+}
+
+bool BuildSubstitution(const ZepRegex& regex, const GapBuffer<utf8>& text, const std::vector<long>& lineEnds, long firstLine, long lastLine, const std::string& replacement, uint32_t flags, Substitution& result)
+{
+    ZEP_TRACE_SCOPE("BuildSubstitution");
+
+    result = Substitution();
+    lastLine = std::min(lastLine, long(lineEnds.size()) - 1);
+    if (!regex.IsValid() || firstLine < 0 || firstLine > lastLine)
+    {
+        return false;
+    }
+
+    auto rangeStart = firstLine == 0 ? 0 : lineEnds[firstLine - 1];
+    auto rangeEnd = lineEnds[lastLine] - 1;
+    auto& out = result.text;
+    long copied = -1;           // The end of the last match; the text is copied from here up to the next
+    long line = firstLine;
+    long lineMatched = -1;
+    auto onMatch = [&](const RegexMatch& match)
+    {
+        while (lineEnds[line] <= match.start)
+        {
+            line++;
+        }
+
+        // Like Vim, an empty match straight after the last one isn't replaced
+        if (match.start == match.end && match.start == copied)
+        {
+            return;
+        }
+        if (line != lineMatched)
+        {
+            lineMatched = line;
+            result.lines++;
+        }
+        if (result.count++ == 0)
+        {
+            result.start = match.start;
+        }
+        else if (!(flags & SubstituteFlags::CountOnly))
+        {
+            text.append_to(out, copied, match.start);
+        }
+        copied = match.end;
+
+        if (!(flags & SubstituteFlags::CountOnly))
+        {
+            result.last = long(out.size());
+            AppendReplacement(text, match, replacement, out);
+        }
+    };
+
+    if (flags & SubstituteFlags::Global)
+    {
+        regex.ForEachMatch(text, lineEnds, rangeStart, rangeEnd, [&](const RegexMatch& match)
+        {
+            onMatch(match);
+            return true;
+        });
+    }
+    else
+    {
+        // The first match on each line; the search goes on from the next line, or the end of a match that ran past it
+        RegexMatch match;
+        for (auto pos = rangeStart; pos <= rangeEnd && regex.Find(text, lineEnds, pos, rangeEnd, match);)
+        {
+            onMatch(match);
+            pos = std::max(lineEnds[line], match.end);
+        }
+    }
+
+    if (result.count == 0)
+    {
+        return false;
+    }
+    result.end = copied;
+    if (result.last != -1)
+    {
+        result.last += result.start;
+    }
+    return true;
+}
+
+} // Zep
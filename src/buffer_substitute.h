@@ -0,0 +1,38 @@
+#pragma once
+
+#include "buffer.h"
+#include "buffer_regex.h"
+
+namespace Zep
+{
+
+namespace SubstituteFlags
+{
+enum : uint32_t
+{
+    None = 0,
+    Global = (1 << 0),          // Every match on a line, not just the first
+    CountOnly = (1 << 1)        // Count the matches; no text is built
+};
+}
+
+// The text a :s command puts in place of [start, end): from the start of the first match to the end of the last
+struct Substitution
+{
+    BufferLocation start = 0;
+    BufferLocation end = 0;
+    std::string text;
+    long count = 0;             // Matches replaced
+    long lines = 0;             // Lines they were on
+    BufferLocation last = -1;   // Where the last replacement starts, once the text is in the buffer
+};
+
+// Replace the pattern's matches on lines [firstLine, lastLine] of the text.
+// The matches are found and the new text built in one pass; the text between them is copied straight from either
+// side of the gap, so the whole range goes into the buffer as one change however many matches there are.
+// The replacement is Vim's: & and \0 are the match, \1 to \9 its groups, \r and \n a line break, \t a tab, \u \l the
+// next character and \U \L \E \e the rest in upper/lower case; any other escaped character is just the character.
+// False if nothing matched.
+bool BuildSubstitution(const ZepRegex& regex, const GapBuffer<utf8>& text, const std::vector<long>& lineEnds, long firstLine, long lastLine, const std::string& replacement, uint32_t flags, Substitution& result);
+
+} // Zep
@@ -0,0 +1,423 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <thread>
+
+#include "buffer_trigram.h"
+#include "utils/trace.h"
+
+namespace Zep
+{
+
+namespace
+{
+// Postings of blocks since edited are only cleared out once there are more of them than of the indexed ones
+const size_t MinimumStaleEntries = 1 << 20;
+
+// A bit for every trigram, for finding the distinct ones in a block
+using TrigramSet = std::vector<uint64_t>;
+const size_t TrigramCount = 1 << 24;
+
+uint32_t Fold(uint8_t ch)
+{
+    return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+}
+
+// The distinct trigrams of the lines in [start, end), sorted; none span a line end
+void GetTrigrams(const GapBuffer<utf8>& text, long start, long end, TrigramSet& seen, std::vector<uint32_t>& trigrams)
+{
+    uint32_t key = 0;
+    int count = 0;
+    auto add = [&](const utf8* pBegin, const utf8* pEnd)
+    {
+        for (auto p = pBegin; p < pEnd; p++)
+        {
+            if (*p == '\n' || *p == 0)
+            {
+                count = 0;
+                continue;
+            }
+
+            key = ((key << 8) | Fold(*p)) & (TrigramCount - 1);
+            if (++count >= 3)
+            {
+                auto bit = uint64_t(1) << (key & 63);
+                if (!(seen[key >> 6] & bit))
+                {
+                    seen[key >> 6] |= bit;
+                    trigrams.push_back(key);
+                }
+            }
+        }
+    };
+
+    // Either side of the gap
+    auto before = long(text.m_pGapStart - text.m_pStart);
+    if (start < before)
+    {
+        add(text.m_pStart + start, text.m_pStart + std::min(end, before));
+    }
+    if (end > before)
+    {
+        add(text.m_pGapEnd + std::max(start - before, 0l), text.m_pGapEnd + (end - before));
+    }
+
+    for (auto trigram : trigrams)
+    {
+        seen[trigram >> 6] = 0;
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+}
+}
+
+ZepTrigramIndex::ZepTrigramIndex(ZepBuffer& buffer)
+    : ZepComponent(buffer.GetEditor()),
+    m_buffer(buffer),
+    m_stop(false)
+{
+}
+
+ZepTrigramIndex::~ZepTrigramIndex()
+{
+    Interrupt();
+}
+
+void ZepTrigramIndex::SetEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    if (!enabled)
+    {
+        Interrupt();
+        Clear();
+    }
+}
+
+void ZepTrigramIndex::SetMemoryBudget(size_t budget)
+{
+    m_memoryBudget = budget;
+    m_overBudget = false;
+}
+
+// Stop indexing, and keep the blocks that were finished; true if it was running
+bool ZepTrigramIndex::Interrupt()
+{
+    if (m_results.empty())
+    {
+        return false;
+    }
+
+    m_stop = true;
+    for (auto& result : m_results)
+    {
+        auto found = result.get();
+        Merge(found);
+    }
+    m_results.clear();
+    m_stop = false;
+    return true;
+}
+
+void ZepTrigramIndex::Clear()
+{
+    m_blocks.Clear();
+    std::unordered_map<uint32_t, std::vector<uint32_t>>().swap(m_postings);
+    m_liveEntries = m_staleEntries = 0;
+}
+
+bool ZepTrigramIndex::Update()
+{
+    if (!m_enabled || m_overBudget)
+    {
+        return false;
+    }
+
+    if (m_buffer.IsPaged() || m_buffer.IsBinary())
+    {
+        Interrupt();
+        Clear();
+        return false;
+    }
+
+    // Take the results once they are all in
+    bool changed = false;
+    if (std::all_of(m_results.begin(), m_results.end(), [](std::future<BlockTrigrams>& result)
+    {
+        return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }))
+    {
+        changed = Interrupt();
+    }
+
+    if (!IsActive())
+    {
+        auto size = long(m_buffer.GetText().size());
+        if (m_overBudget || size < m_minimumSize)
+        {
+            return changed;
+        }
+        m_blocks.Reset(size);
+    }
+
+    assert(m_blocks.GetTextSize() == long(m_buffer.GetText().size()));
+
+    if (m_results.empty())
+    {
+        Compact();
+        m_blocks.Split(m_buffer.GetLineEnds(), BlockSize, [](const Block& block) { return block.id == 0; });
+        Index();
+    }
+    return changed;
+}
+
+void ZepTrigramIndex::Wait()
+{
+    Update();
+    while (!m_results.empty())
+    {
+        for (auto& result : m_results)
+        {
+            result.wait();
+        }
+        Update();
+    }
+}
+
+bool ZepTrigramIndex::IsComplete() const
+{
+    return m_results.empty() && std::none_of(m_blocks.begin(), m_blocks.end(), [](const Block& block)
+    {
+        return block.id == 0;
+    });
+}
+
+// The distinct trigrams are found with a bitset of them all, so each task takes a share of the blocks
+void ZepTrigramIndex::Index()
+{
+    std::vector<std::pair<long, long>> jobs;
+    long start = 0;
+    for (size_t block = 0; block < m_blocks.size(); block++)
+    {
+        if (m_blocks[block].id == 0)
+        {
+            jobs.push_back(std::make_pair(long(block), start));
+        }
+        start += m_blocks[block].size;
+    }
+    if (jobs.empty())
+    {
+        return;
+    }
+
+    auto runJobs = [this](std::vector<std::pair<long, long>> jobs, std::vector<long> sizes)
+    {
+        ZEP_TRACE_SCOPE("ZepTrigramIndex::Index");
+
+        BlockTrigrams found;
+        TrigramSet seen(TrigramCount / 64, 0);
+        for (size_t job = 0; job < jobs.size() && !m_stop; job++)
+        {
+            std::vector<uint32_t> trigrams;
+            GetTrigrams(m_buffer.GetText(), jobs[job].second, jobs[job].second + sizes[job], seen, trigrams);
+            found.push_back(std::make_pair(jobs[job].first, std::move(trigrams)));
+        }
+        return found;
+    };
+
+    auto tasks = (GetEditor().GetFlags() & ZepEditorFlags::DisableThreads) ? 1 : std::max(1u, std::thread::hardware_concurrency());
+    tasks = std::min(tasks, unsigned(jobs.size()));
+    for (unsigned task = 0; task < tasks; task++)
+    {
+        std::vector<std::pair<long, long>> taskJobs;
+        std::vector<long> sizes;
+        for (size_t job = task; job < jobs.size(); job += tasks)
+        {
+            taskJobs.push_back(jobs[job]);
+            sizes.push_back(m_blocks[jobs[job].first].size);
+        }
+
+        if (GetEditor().GetFlags() & ZepEditorFlags::DisableThreads)
+        {
+            auto found = runJobs(taskJobs, sizes);
+            Merge(found);
+        }
+        else
+        {
+            m_results.push_back(m_buffer.GetThreadPool().enqueue(runJobs, taskJobs, sizes));
+        }
+    }
+}
+
+// Give each newly indexed block an id, bigger than any before it, so the postings stay sorted
+void ZepTrigramIndex::Merge(BlockTrigrams& found)
+{
+    for (auto& blockTrigrams : found)
+    {
+        if (!IsActive())
+        {
+            return;
+        }
+
+        auto& block = m_blocks[blockTrigrams.first];
+        block.id = m_nextId++;
+        block.trigrams = uint32_t(blockTrigrams.second.size());
+        for (auto trigram : blockTrigrams.second)
+        {
+            m_postings[trigram].push_back(block.id);
+        }
+        m_liveEntries += block.trigrams;
+
+        if (GetMemoryUsage() > m_memoryBudget)
+        {
+            Clear();
+            m_overBudget = true;
+        }
+    }
+}
+
+// Take the ids of edited blocks out of the postings, once there are enough of them to be worth it
+void ZepTrigramIndex::Compact()
+{
+    if (m_staleEntries < MinimumStaleEntries || m_staleEntries < m_liveEntries)
+    {
+        return;
+    }
+
+    ZEP_TRACE_SCOPE("ZepTrigramIndex::Compact");
+
+    std::vector<uint32_t> ids;
+    for (auto& block : m_blocks)
+    {
+        if (block.id != 0)
+        {
+            ids.push_back(block.id);
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+
+    for (auto itr = m_postings.begin(); itr != m_postings.end();)
+    {
+        auto& posting = itr->second;
+        posting.erase(std::remove_if(posting.begin(), posting.end(), [&](uint32_t id)
+        {
+            return !std::binary_search(ids.begin(), ids.end(), id);
+        }), posting.end());
+        itr = posting.empty() ? m_postings.erase(itr) : std::next(itr);
+    }
+    m_staleEntries = 0;
+}
+
+void ZepTrigramIndex::Invalidate(size_t block)
+{
+    if (m_blocks[block].id != 0)
+    {
+        m_staleEntries += m_blocks[block].trigrams;
+        m_liveEntries -= m_blocks[block].trigrams;
+        m_blocks[block].id = 0;
+        m_blocks[block].trigrams = 0;
+    }
+}
+
+bool ZepTrigramIndex::FindCandidates(const std::string& literal, SearchRanges& ranges) const
+{
+    ranges.clear();
+    auto line = literal.substr(0, literal.find('\n'));
+    if (line.size() < 3 || std::none_of(m_blocks.begin(), m_blocks.end(), [](const Block& block) { return block.id != 0; }))
+    {
+        return false;
+    }
+
+    ZEP_TRACE_SCOPE("ZepTrigramIndex::FindCandidates");
+
+    std::vector<uint32_t> trigrams;
+    uint32_t key = 0;
+    for (size_t i = 0; i < line.size(); i++)
+    {
+        key = ((key << 8) | Fold(uint8_t(line[i]))) & (TrigramCount - 1);
+        if (i >= 2)
+        {
+            trigrams.push_back(key);
+        }
+    }
+
+    // Intersect the postings, shortest first
+    std::vector<const std::vector<uint32_t>*> postings;
+    for (auto trigram : trigrams)
+    {
+        auto itr = m_postings.find(trigram);
+        if (itr == m_postings.end())
+        {
+            postings.clear();
+            break;
+        }
+        postings.push_back(&itr->second);
+    }
+    std::sort(postings.begin(), postings.end(), [](const std::vector<uint32_t>* a, const std::vector<uint32_t>* b)
+    {
+        return a->size() < b->size();
+    });
+
+    std::vector<uint32_t> ids;
+    if (!postings.empty())
+    {
+        ids = *postings[0];
+        for (size_t i = 1; i < postings.size() && !ids.empty(); i++)
+        {
+            std::vector<uint32_t> both;
+            std::set_intersection(ids.begin(), ids.end(), postings[i]->begin(), postings[i]->end(), std::back_inserter(both));
+            ids.swap(both);
+        }
+    }
+
+    // Blocks with them all, and those not indexed yet; next to each other, they make one range
+    long start = 0;
+    for (auto& block : m_blocks)
+    {
+        if (block.id == 0 || std::binary_search(ids.begin(), ids.end(), block.id))
+        {
+            if (!ranges.empty() && ranges.back().second == start)
+            {
+                ranges.back().second += block.size;
+            }
+            else
+            {
+                ranges.push_back(std::make_pair(start, start + block.size));
+            }
+        }
+        start += block.size;
+    }
+    return true;
+}
+
+size_t ZepTrigramIndex::GetMemoryUsage() const
+{
+    if (!IsActive())
+    {
+        return 0;
+    }
+
+    // Each posting is a map node and a vector
+    return (m_liveEntries + m_staleEntries) * sizeof(uint32_t) +
+        m_postings.size() * (sizeof(std::pair<uint32_t, std::vector<uint32_t>>) + sizeof(void*) * 2) +
+        m_postings.bucket_count() * sizeof(void*) +
+        m_blocks.GetMemoryUsage();
+}
+
+void ZepTrigramIndex::Notify(std::shared_ptr<ZepMessage> spMsg)
+{
+    if (spMsg->messageId != Msg_Buffer || !IsActive())
+    {
+        return;
+    }
+
+    auto spBufferMsg = std::static_pointer_cast<BufferMessage>(spMsg);
+    if (spBufferMsg->pBuffer != &m_buffer)
+    {
+        return;
+    }
+
+    // Replacing the text says it was deleted before saying it will change; so stop on either
+    Interrupt();
+    m_blocks.Update(*spBufferMsg, [this](size_t block) { Invalidate(block); });
+}
+
+} // Zep
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <unordered_map>
+
+#include "buffer.h"
+#include "buffer_blocks.h"
+
+namespace Zep
+{
+
+// Where a search has to look: a list of [start, end) ranges of whole lines
+using SearchRanges = std::vector<std::pair<BufferLocation, BufferLocation>>;
+
+// For searching big buffers without reading all of them.
+// The text is cut into blocks of whole lines, and each trigram (three bytes, with ASCII letters in lower case) maps to
+// the blocks it is in.  A match has to be in a block with every trigram of the first line of its literal prefix, so a
+// search only has to look at those.  Blocks are indexed on the thread pool; an edit marks the blocks it touches as
+// needing it again, and until they have been they are always searched.  Update() (the display calls it every frame)
+// starts indexing them.
+// Only buffers of at least the minimum size are indexed.  An index that grows past its memory budget is dropped, and
+// isn't built again until the budget is changed.
+class ZepTrigramIndex : public ZepComponent
+{
+public:
+    static const long DefaultMinimumSize = 16 * 1024 * 1024;
+    static const size_t DefaultMemoryBudget = 128 * 1024 * 1024;
+    static const long BlockSize = 256 * 1024;
+
+    ZepTrigramIndex(ZepBuffer& buffer);
+    virtual ~ZepTrigramIndex();
+
+    virtual void Notify(std::shared_ptr<ZepMessage> message) override;
+
+    void SetEnabled(bool enabled);
+    bool IsEnabled() const { return m_enabled; }
+    void SetMinimumSize(long size) { m_minimumSize = size; }
+    void SetMemoryBudget(size_t budget);
+    bool IsOverBudget() const { return m_overBudget; }
+
+    // Pick up the blocks indexed so far, and index any that need it; true if the index changed
+    bool Update();
+    void Wait();
+
+    // True (and the ranges) if the index can narrow down where the literal is; false if the whole buffer must be searched
+    bool FindCandidates(const std::string& literal, SearchRanges& ranges) const;
+
+    bool IsActive() const { return !m_blocks.empty(); }
+    bool IsComplete() const;
+    size_t GetMemoryUsage() const;
+
+private:
+    struct BlockIndex
+    {
+        uint32_t id = 0;        // In the postings; 0 until indexed
+        uint32_t trigrams = 0;  // How many postings have the id
+    };
+    using Block = ZepLineBlocks<BlockIndex>::Block;
+
+    // Trigrams of a block, from the thread pool
+    using BlockTrigrams = std::vector<std::pair<long, std::vector<uint32_t>>>;
+
+    bool Interrupt();
+    void Clear();
+    void Index();
+    void Merge(BlockTrigrams& found);
+    void Compact();
+    void Invalidate(size_t block);
+
+private:
+    ZepBuffer& m_buffer;
+    bool m_enabled = true;
+    bool m_overBudget = false;
+    long m_minimumSize = DefaultMinimumSize;
+    size_t m_memoryBudget = DefaultMemoryBudget;
+
+    ZepLineBlocks<BlockIndex> m_blocks;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_postings; // Trigram to the ids of blocks with it, sorted
+    uint32_t m_nextId = 1;
+    size_t m_liveEntries = 0;                                       // Postings of indexed blocks
+    size_t m_staleEntries = 0;                                      // Postings of blocks since edited
+
+    std::vector<std::future<BlockTrigrams>> m_results;              // Blocks being indexed on the thread pool
+    std::atomic<bool> m_stop;
+};
+
+} // Zep
@@ -70,4 +70,36 @@ void ZepCommand_Insert::Undo()
         m_buffer.Delete(m_startOffset, m_endOffsetInserted, m_startOffset);
     }
 }
-}
\ No newline at end of file
+
+// Replace a range
+ZepCommand_ReplaceRange::ZepCommand_ReplaceRange(ZepBuffer& buffer, const BufferLocation& start, const BufferLocation& end, std::string str, const BufferLocation& cursorAfter)
+    : ZepCommand(buffer),
+    m_startOffset(start),
+    m_endOffset(end),
+    m_cursorAfter(cursorAfter),
+    m_text(std::move(str))
+{
+}
+
+void ZepCommand_ReplaceRange::Swap(const BufferLocation& cursorAfter)
+{
+    std::string replaced;
+    replaced.reserve(m_endOffset - m_startOffset);
+    m_buffer.GetText().append_to(replaced, m_startOffset, m_endOffset);
+    if (m_buffer.Replace(m_startOffset, m_endOffset, m_text, cursorAfter))
+    {
+        m_endOffset = m_startOffset + long(m_text.size());
+        m_text.swap(replaced);
+    }
+}
+
+void ZepCommand_ReplaceRange::Redo()
+{
+    Swap(m_cursorAfter);
+}
+
+void ZepCommand_ReplaceRange::Undo()
+{
+    Swap(m_startOffset);
+}
+}
@@ -29,6 +29,9 @@ public:
     virtual void SetFlags(uint32_t flags) { m_flags = flags; }
     virtual uint32_t GetFlags() const { return m_flags; }
 
+    ZepBuffer& GetBuffer() const { return m_buffer; }
+    virtual size_t GetMemoryUsage() const { return sizeof(ZepCommand); }
+
 protected:
     ZepBuffer& m_buffer;
     uint32_t m_flags = 0;
@@ -42,6 +45,7 @@ public:
 
     virtual void Redo() override;
     virtual void Undo() override;
+    virtual size_t GetMemoryUsage() const override { return sizeof(ZepCommand_DeleteRange) + m_deleted.capacity(); }
 
     BufferLocation m_startOffset;
     BufferLocation m_endOffset;
@@ -58,6 +62,7 @@ public:
 
     virtual void Redo() override;
     virtual void Undo() override;
+    virtual size_t GetMemoryUsage() const override { return sizeof(ZepCommand_Insert) + m_strInsert.capacity(); }
 
     BufferLocation m_startOffset;
     std::string m_strInsert;
@@ -66,4 +71,25 @@ public:
     BufferLocation m_cursorAfter;
 };
 
+// Swaps a range's text for new text, and back again; it only keeps whichever text isn't in the buffer
+class ZepCommand_ReplaceRange : public ZepCommand
+{
+public:
+    ZepCommand_ReplaceRange(ZepBuffer& buffer, const BufferLocation& startOffset, const BufferLocation& endOffset, std::string str, const BufferLocation& cursorAfter = BufferLocation{ -1 });
+    virtual ~ZepCommand_ReplaceRange() {};
+
+    virtual void Redo() override;
+    virtual void Undo() override;
+    virtual size_t GetMemoryUsage() const override { return sizeof(ZepCommand_ReplaceRange) + m_text.capacity(); }
+
+    BufferLocation m_startOffset;
+    BufferLocation m_endOffset;
+    BufferLocation m_cursorAfter;
+
+    std::string m_text;
+
+private:
+    void Swap(const BufferLocation& cursorAfter);
+};
+
 } // Zep
\ No newline at end of file
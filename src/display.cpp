@@ -1,9 +1,14 @@
 #include "display.h"
 #include "syntax.h"
 #include "buffer.h"
+#include "buffer_brackets.h"
+#include "buffer_search.h"
+#include "buffer_trigram.h"
+#include "grep.h"
 
 #include "utils/stringutils.h"
 #include "utils/timer.h"
+#include "utils/trace.h"
 
 namespace Zep
 {
@@ -43,7 +48,7 @@ ZepWindow* ZepDisplay::GetCurrentWindow() const
 ZepWindow* ZepDisplay::AddWindow()
 {
     auto spWindow = std::make_shared<ZepWindow>(*this);
-    m_windows.insert(spWindow);
+    m_windows.push_back(spWindow);
 
     if (m_pCurrentWindow == nullptr)
     {
@@ -55,15 +60,20 @@ ZepWindow* ZepDisplay::AddWindow()
 
 void ZepDisplay::RemoveWindow(ZepWindow* pWindow)
 {
-    for (auto& pWin : m_windows)
+    if (pWindow == m_pDiffWindows[0] || pWindow == m_pDiffWindows[1])
     {
-        if (pWin.get() == pWindow)
+        CloseDiff();
+    }
+
+    for (auto itr = m_windows.begin(); itr != m_windows.end(); itr++)
+    {
+        if (itr->get() == pWindow)
         {
-            if (m_pCurrentWindow == pWin.get())
+            if (m_pCurrentWindow == pWindow)
             {
                 m_pCurrentWindow = nullptr;
             }
-            m_windows.erase(pWin);
+            m_windows.erase(itr);
             break;
         }
     }
@@ -83,6 +93,78 @@ const ZepDisplay::tWindows& ZepDisplay::GetWindows() const
     return m_windows;
 }
 
+void ZepDisplay::ShowDiff(ZepBuffer* pOld, ZepBuffer* pNew, ZepBuffer* pTemporary)
+{
+    CloseDiff();
+    m_pDiffTemporary = pTemporary;
+    while (m_windows.size() < 2)
+    {
+        AddWindow();
+    }
+
+    m_spDiff = std::make_shared<ZepBufferDiff>(GetEditor(), pOld, pNew);
+    for (int i = 0; i < 2; i++)
+    {
+        auto side = i == 0 ? DiffSide::Old : DiffSide::New;
+        m_pDiffWindows[i] = m_windows[i].get();
+        m_pDiffWindows[i]->SetCurrentBuffer(m_spDiff->GetBuffer(side));
+        m_pDiffWindows[i]->SetDiff(m_spDiff, side);
+        m_diffTopLines[i] = -1;
+    }
+    PreDisplay();
+}
+
+void ZepDisplay::CloseDiff()
+{
+    auto pTemporary = m_pDiffTemporary;
+    ZepBuffer* pKept = nullptr;
+    if (m_spDiff && pTemporary)
+    {
+        pKept = m_spDiff->GetBuffer(m_spDiff->GetBuffer(DiffSide::Old) == pTemporary ? DiffSide::New : DiffSide::Old);
+    }
+
+    for (auto& pWindow : m_pDiffWindows)
+    {
+        if (pWindow)
+        {
+            pWindow->SetDiff(nullptr, DiffSide::Old);
+        }
+        pWindow = nullptr;
+    }
+    m_spDiff.reset();
+    m_pDiffTemporary = nullptr;
+
+    if (pTemporary)
+    {
+        // A window left with nothing else to show gets the other side
+        for (auto& spWindow : m_windows)
+        {
+            spWindow->RemoveBuffer(pTemporary);
+            if (!spWindow->GetCurrentBuffer())
+            {
+                spWindow->SetCurrentBuffer(pKept);
+            }
+        }
+        GetEditor().RemoveBuffer(pTemporary);
+    }
+}
+
+// The window being worked in leads; when it has scrolled, bring the matching line to the top of the other one
+void ZepDisplay::SyncDiffScroll()
+{
+    auto leader = m_pCurrentWindow == m_pDiffWindows[1] ? 1 : 0;
+    auto pLeader = m_pDiffWindows[leader];
+    auto pFollower = m_pDiffWindows[1 - leader];
+    if (pLeader->bufferCL.y == m_diffTopLines[leader])
+    {
+        return;
+    }
+
+    pFollower->ScrollToLine(m_spDiff->MapLine(pLeader->GetDiffSide(), pLeader->bufferCL.y));
+    m_diffTopLines[leader] = pLeader->bufferCL.y;
+    m_diffTopLines[1 - leader] = pFollower->bufferCL.y;
+}
+
 void ZepDisplay::Notify(std::shared_ptr<ZepMessage> spMsg)
 {
 }
@@ -152,6 +234,29 @@ struct LineData
 
 void ZepDisplay::Display()
 {
+    ZEP_TRACE_SCOPE("ZepDisplay::Display");
+
+    // Pick up any text that background loads have read, or followed files have had appended, since the last frame;
+    // finish any saves that have been written, and bring in changes made to files outside.  Then bring the search
+    // index, matches and bracket pairs up to date with it all, and add the :vimgrep results found since
+    for (auto& spBuffer : GetEditor().GetBuffers())
+    {
+        spBuffer->UpdateLoad();
+        spBuffer->UpdateFollow();
+        spBuffer->UpdateSave();
+        spBuffer->UpdateExternalChange();
+        spBuffer->GetTrigramIndex().Update();
+        spBuffer->GetSearch().Update();
+        spBuffer->GetBrackets().Update();
+    }
+    GetEditor().GetGrep().Update();
+
+    if (m_spDiff)
+    {
+        m_spDiff->Update();
+        SyncDiffScroll();
+    }
+
     PreDisplay();
 
     // Always 1 command line
@@ -193,7 +298,7 @@ void ZepDisplay::Display()
 
 void ZepDisplay::SetCommandText(const std::string& strCommand)
 {
-    m_commandLines = StringUtils::SplitLines(strCommand);
+    StringUtils::SplitLines(strCommand, m_commandLines);
     if (m_commandLines.empty())
     {
         m_commandLines.push_back("");
@@ -15,7 +15,7 @@ const float leftBorder = 30.0f;
 class ZepDisplay : public ZepComponent
 {
 public:
-    using tWindows = std::set<std::shared_ptr<ZepWindow>>;
+    using tWindows = std::vector<std::shared_ptr<ZepWindow>>;
 
     ZepDisplay(ZepEditor& editor);
     virtual ~ZepDisplay();
@@ -47,6 +47,12 @@ public:
     void RemoveWindow(ZepWindow* pWindow);
     const tWindows& GetWindows() const;
 
+    // Side by side diff in the first two windows, old on the left; they scroll together.  A temporary buffer (one of
+    // the two, read just for the diff) is removed from the editor when the diff closes
+    void ShowDiff(ZepBuffer* pOld, ZepBuffer* pNew, ZepBuffer* pTemporary = nullptr);
+    void CloseDiff();
+    ZepBufferDiff* GetDiff() const { return m_spDiff.get(); }
+
     void RequestRefresh();
     bool RefreshRequired() const;
 
@@ -55,6 +61,7 @@ public:
 
 protected:
     void DrawRegion(const Region& region);
+    void SyncDiffScroll();
 
 protected:
     // TODO: A splitter manager
@@ -69,10 +76,15 @@ protected:
     mutable bool m_bPendingRefresh = true;
     mutable bool m_lastCursorBlink = false;
 
-    // One window for now
+    // Left to right, in the order they were added
     tWindows m_windows;
     ZepWindow* m_pCurrentWindow = nullptr;
 
+    std::shared_ptr<ZepBufferDiff> m_spDiff;
+    ZepWindow* m_pDiffWindows[2] = { nullptr, nullptr };
+    ZepBuffer* m_pDiffTemporary = nullptr;
+    long m_diffTopLines[2] = { -1, -1 };            // Top line of each diff window when they were last lined up
+
     std::vector<std::string> m_commandLines;        // Command information, shown under the buffer
 };
 
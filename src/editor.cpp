@@ -1,10 +1,16 @@
+#include <algorithm>
+
 #include "editor.h"
+#include "binary_file.h"
 #include "buffer.h"
 #include "display.h"
+#include "grep.h"
 #include "mode_vim.h"
 #include "mode_standard.h"
 #include "syntax_glsl.h"
 #include "syntax.h"
+#include "utils/fileutils.h"
+#include "utils/trace.h"
 
 namespace Zep
 {
@@ -26,7 +32,9 @@ ZepComponent::~ZepComponent()
 
 
 ZepEditor::ZepEditor(uint32_t flags)
-    : m_flags(flags)
+    : m_spFileNotifier(std::make_shared<FileUtils::FileNotifier>()),
+    m_flags(flags),
+    m_spGrep(std::make_shared<ZepGrep>(*this))
 {
     RegisterMode(VimMode, std::make_shared<ZepMode_Vim>(*this));
     RegisterMode(StandardMode, std::make_shared<ZepMode_Standard>(*this));
@@ -78,6 +86,8 @@ void ZepEditor::RegisterSyntaxFactory(const std::string& extension, tSyntaxFacto
 // Inform clients of an event in the buffer
 bool ZepEditor::Broadcast(std::shared_ptr<ZepMessage> message)
 {
+    ZEP_TRACE_SCOPE("ZepEditor::Broadcast");
+
     Notify(message);
     if (message->handled)
         return true;
@@ -113,6 +123,52 @@ ZepBuffer* ZepEditor::AddBuffer(const std::string& str)
     return spBuffer.get();
 }
 
+void ZepEditor::RemoveBuffer(ZepBuffer* pBuffer)
+{
+    for (auto& mode : m_mapModes)
+    {
+        mode.second->ForgetBuffer(*pBuffer);
+    }
+
+    auto itr = std::find_if(m_buffers.begin(), m_buffers.end(), [&](const std::shared_ptr<ZepBuffer>& spBuffer) { return spBuffer.get() == pBuffer; });
+    if (itr != m_buffers.end())
+    {
+        m_buffers.erase(itr);
+    }
+}
+
+// However the path is written, the same file gets the same buffer
+ZepBuffer* ZepEditor::OpenFile(const std::string& path)
+{
+    auto canonical = FileUtils::Canonical(path);
+    for (auto& spBuffer : m_buffers)
+    {
+        auto& bufferPath = spBuffer->GetFilePath();
+        if (!bufferPath.empty() && (bufferPath == path || FileUtils::Canonical(bufferPath) == canonical))
+        {
+            return spBuffer.get();
+        }
+    }
+
+    auto pBuffer = AddBuffer(path);
+    if (!FileUtils::Exists(path))
+    {
+        pBuffer->SetFilePath(path);
+        return pBuffer;
+    }
+
+    // Binary files get the hex view; the gap buffer can't hold a 0
+    bool loaded = ZepBinaryFile::IsBinaryFile(path) ?
+        pBuffer->OpenBinary(path, ZepBinaryFile::DefaultMemoryBudget) :
+        pBuffer->LoadAsync(path);
+    if (!loaded)
+    {
+        m_buffers.pop_front();
+        return nullptr;
+    }
+    return pBuffer;
+}
+
 ZepBuffer* ZepEditor::GetMRUBuffer() const
 {
     return m_buffers.front().get();
@@ -155,6 +211,26 @@ const tRegisters& ZepEditor::GetRegisters() const
     return m_registers;
 }
 
+BufferMemory ZepEditor::GetMemoryUsage(const ZepBuffer& buffer) const
+{
+    auto mem = buffer.GetMemoryUsage();
+    for (auto& mode : m_mapModes)
+    {
+        mem.undo += mode.second->GetUndoMemoryUsage(buffer);
+    }
+    return mem;
+}
+
+size_t ZepEditor::GetRegisterMemoryUsage() const
+{
+    size_t size = 0;
+    for (auto& reg : m_registers)
+    {
+        size += sizeof(tRegisters::value_type) + reg.first.capacity() + reg.second.text.capacity();
+    }
+    return size;
+}
+
 void ZepEditor::Notify(std::shared_ptr<ZepMessage> message)
 {
 }
@@ -37,6 +37,13 @@ class ZepMode_Standard;
 class ZepEditor;
 class ZepDisplay;
 class ZepSyntax;
+class ZepKeyTrace;
+class ZepGrep;
+
+namespace FileUtils
+{
+class FileNotifier;
+}
 
 // Helper for 2D operations
 template<class T>
@@ -118,6 +125,8 @@ struct Register
 };
 
 using tRegisters = std::map<std::string, Register>;
+
+struct BufferMemory;
 using tBuffers = std::deque<std::shared_ptr<ZepBuffer>>;
 using tSyntaxFactory = std::function<std::shared_ptr<ZepSyntax>(ZepBuffer*)>;
 
@@ -153,6 +162,12 @@ public:
 
     const tBuffers& GetBuffers() const;
     ZepBuffer* AddBuffer(const std::string& str);
+    // The windows must have let go of it first; the modes forget its undo steps
+    void RemoveBuffer(ZepBuffer* pBuffer);
+
+    // Returns the buffer already editing this file, or a new one (loading in the background).  A file that doesn't
+    // exist gives an empty buffer which will create it on save; nullptr means the file exists but couldn't be read
+    ZepBuffer* OpenFile(const std::string& path);
     ZepBuffer* GetMRUBuffer() const;
 
     void SetRegister(const std::string& reg, const Register& val);
@@ -163,9 +178,30 @@ public:
     Register& GetRegister(const char reg);
     const tRegisters& GetRegisters() const;
 
+    // Memory accounting; the buffer figures include the undo state held by all registered modes
+    BufferMemory GetMemoryUsage(const ZepBuffer& buffer) const;
+    size_t GetRegisterMemoryUsage() const;
+
     void Notify(std::shared_ptr<ZepMessage> message);
     uint32_t GetFlags() const { return m_flags; }
 
+    // Windows highlight the matches of this search pattern, in whichever buffer they show; empty for none
+    void SetHighlightPattern(const std::string& pattern) { m_highlightPattern = pattern; }
+    const std::string& GetHighlightPattern() const { return m_highlightPattern; }
+
+    // RegexFlags for searching, and for highlighting the matches: :set ignorecase and smartcase
+    void SetSearchFlags(uint32_t flags) { m_searchFlags = flags; }
+    uint32_t GetSearchFlags() const { return m_searchFlags; }
+
+    // Optional recording of all keys sent to the modes
+    void SetKeyTrace(ZepKeyTrace* pKeyTrace) { m_pKeyTrace = pKeyTrace; }
+    ZepKeyTrace* GetKeyTrace() const { return m_pKeyTrace; }
+
+    // For work across buffers; each buffer has its own pool for its own
+    ThreadPool& GetThreadPool() { return m_threadPool; }
+    ZepGrep& GetGrep() const { return *m_spGrep; }
+    std::shared_ptr<FileUtils::FileNotifier> GetFileNotifier() const { return m_spFileNotifier; }
+
 private:
     std::set<IZepClient*> m_notifyClients;
     mutable tRegisters m_registers;
@@ -178,10 +214,20 @@ private:
     // Active mode
     ZepMode* m_pCurrentMode = nullptr;
 
+    // Shared by the buffers' file watchers, which keep it alive
+    std::shared_ptr<FileUtils::FileNotifier> m_spFileNotifier;
+
     // List of buffers that the editor is managing
     // May or may not be visible
     tBuffers m_buffers;
     uint32_t m_flags = 0;
+
+    ZepKeyTrace* m_pKeyTrace = nullptr;
+    std::string m_highlightPattern;
+    uint32_t m_searchFlags = 0;
+
+    ThreadPool m_threadPool;
+    std::shared_ptr<ZepGrep> m_spGrep;      // Searches on the thread pool, so is destroyed before it
 };
 
 } // Zep
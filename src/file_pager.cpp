@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <cstring>
+
+#include "file_pager.h"
+#include "buffer_regex.h"
+#include "utils/fileutils.h"
+#include "utils/trace.h"
+
+namespace Zep
+{
+
+ZepFilePager::ZepFilePager(size_t memoryBudget, size_t pageSize)
+    : m_pageSize(std::max(pageSize, size_t(4096))),
+    m_memoryBudget(memoryBudget)
+{
+    // Need at least a couple of pages; a line can straddle two
+    m_maxPages = std::max(size_t(2), m_memoryBudget / m_pageSize);
+}
+
+ZepFilePager::~ZepFilePager()
+{
+    Close();
+}
+
+void ZepFilePager::Close()
+{
+    if (m_pFile)
+    {
+        fclose(m_pFile);
+        m_pFile = nullptr;
+    }
+    m_pages.clear();
+    m_lru.clear();
+    m_lineIndex.clear();
+    m_fileSize = 0;
+    m_lineCount = 0;
+}
+
+bool ZepFilePager::Open(const std::string& path)
+{
+    ZEP_TRACE_SCOPE("ZepFilePager::Open");
+
+    Close();
+
+    m_pFile = fopen(path.c_str(), "rb");
+    if (!m_pFile)
+    {
+        return false;
+    }
+
+    // Stream through once to count lines and build the index; only one page is held while we do it
+    std::vector<uint8_t> page(m_pageSize);
+    uint64_t offset = 0;
+    long line = 0;
+    m_lineIndex.push_back(0);
+    for (;;)
+    {
+        auto count = fread(page.data(), 1, m_pageSize, m_pFile);
+        if (count == 0)
+        {
+            break;
+        }
+
+        auto pStart = page.data();
+        auto pEnd = pStart + count;
+        for (auto p = pStart; (p = (uint8_t*)memchr(p, '\n', size_t(pEnd - p))) != nullptr; p++)
+        {
+            line++;
+            if ((line % IndexStride) == 0)
+            {
+                m_lineIndex.push_back(offset + uint64_t(p - pStart) + 1);
+            }
+        }
+        offset += count;
+    }
+
+    if (ferror(m_pFile))
+    {
+        Close();
+        return false;
+    }
+
+    m_fileSize = offset;
+    m_lineCount = line + 1;
+    return true;
+}
+
+size_t ZepFilePager::GetResidentBytes() const
+{
+    return m_pages.size() * m_pageSize + m_lineIndex.capacity() * sizeof(uint64_t);
+}
+
+bool ZepFilePager::ReadAt(uint64_t offset, uint8_t* pData, size_t size, size_t& bytesRead)
+{
+    bytesRead = 0;
+    if (!FileUtils::Seek(m_pFile, offset))
+    {
+        return false;
+    }
+    bytesRead = fread(pData, 1, size, m_pFile);
+    return !ferror(m_pFile);
+}
+
+const ZepFilePager::Page* ZepFilePager::GetPage(uint64_t pageIndex)
+{
+    auto itr = m_pages.find(pageIndex);
+    if (itr != m_pages.end())
+    {
+        m_lru.splice(m_lru.begin(), m_lru, itr->second.itrLRU);
+        return &itr->second;
+    }
+
+    if (!m_pFile || pageIndex * m_pageSize >= m_fileSize)
+    {
+        return nullptr;
+    }
+
+    // Evict, reusing the oldest page's memory
+    Page page;
+    if (m_pages.size() >= m_maxPages)
+    {
+        auto oldest = m_lru.back();
+        m_lru.pop_back();
+        page.data.swap(m_pages[oldest].data);
+        m_pages.erase(oldest);
+    }
+
+    page.data.resize(m_pageSize);
+    size_t count = 0;
+    if (!ReadAt(pageIndex * m_pageSize, page.data.data(), m_pageSize, count))
+    {
+        return nullptr;
+    }
+    page.data.resize(count);
+
+    m_lru.push_front(pageIndex);
+    page.itrLRU = m_lru.begin();
+    auto& inserted = m_pages[pageIndex];
+    inserted = std::move(page);
+    return &inserted;
+}
+
+// Jump to the nearest indexed line, then count line ends through the pages
+uint64_t ZepFilePager::LineOffset(long line)
+{
+    line = std::max(0l, std::min(line, m_lineCount - 1));
+
+    auto offset = m_lineIndex[size_t(line / IndexStride)];
+    auto remaining = line % IndexStride;
+    while (remaining > 0)
+    {
+        auto pPage = GetPage(offset / m_pageSize);
+        if (!pPage)
+        {
+            break;
+        }
+
+        auto pStart = pPage->data.data();
+        auto pEnd = pStart + pPage->data.size();
+        auto p = pStart + (offset % m_pageSize);
+        while (remaining > 0 && (p = (const uint8_t*)memchr(p, '\n', size_t(pEnd - p))) != nullptr)
+        {
+            p++;
+            remaining--;
+        }
+
+        if (remaining == 0)
+        {
+            offset = (offset / m_pageSize) * m_pageSize + uint64_t(p - pStart);
+            break;
+        }
+        offset = (offset / m_pageSize + 1) * m_pageSize;
+    }
+    return offset;
+}
+
+long ZepFilePager::ReadLines(long firstLine, long count, std::string& str, size_t maxBytes)
+{
+    if (!m_pFile || count <= 0 || firstLine < 0 || firstLine >= m_lineCount)
+    {
+        return 0;
+    }
+
+    auto offset = LineOffset(firstLine);
+    auto startSize = str.size();
+    auto lastLineEnd = startSize;
+    long lines = 0;
+
+    // Always at least one line, however long
+    while (lines < count && offset < m_fileSize && (lines == 0 || str.size() - startSize < maxBytes))
+    {
+        auto pPage = GetPage(offset / m_pageSize);
+        if (!pPage)
+        {
+            break;
+        }
+
+        auto pStart = pPage->data.data() + (offset % m_pageSize);
+        auto pEnd = pPage->data.data() + pPage->data.size();
+        auto p = pStart;
+        while (p < pEnd && lines < count && (lines == 0 || str.size() - startSize + size_t(p - pStart) < maxBytes))
+        {
+            auto pLineEnd = (const uint8_t*)memchr(p, '\n', size_t(pEnd - p));
+            if (!pLineEnd)
+            {
+                p = pEnd;
+                break;
+            }
+            p = pLineEnd + 1;
+            lines++;
+            lastLineEnd = str.size() + size_t(p - pStart);
+        }
+
+        str.append((const char*)pStart, size_t(p - pStart));
+        offset += uint64_t(p - pStart);
+    }
+
+    // The last line of the file has no line end
+    if (lines < count && offset >= m_fileSize && firstLine + lines == m_lineCount - 1)
+    {
+        lines++;
+        lastLineEnd = str.size();
+    }
+
+    // Don't hand back part of a line
+    str.resize(lastLineEnd);
+    return lines;
+}
+
+// Reads a page of text at a time, so a block of very long lines is never all in memory at once
+long ZepFilePager::FindInLines(const ZepRegex& regex, long firstLine, long endLine, SearchDirection dir)
+{
+    long found = -1;
+    auto line = firstLine;
+    std::string chunk;
+    GapBuffer<utf8> text;
+    std::vector<long> lineEnds;
+    while (line < endLine)
+    {
+        chunk.clear();
+        auto lines = ReadLines(line, endLine - line, chunk, m_pageSize);
+        if (lines == 0)
+        {
+            break;
+        }
+
+        // Searched the way the buffer is: with a 0 on the end, and the line index
+        text.assign(chunk.begin(), chunk.end());
+        text.push_back(0);
+        lineEnds.clear();
+        for (auto pos = chunk.find('\n'); pos != std::string::npos; pos = chunk.find('\n', pos + 1))
+        {
+            lineEnds.push_back(long(pos + 1));
+        }
+        lineEnds.push_back(long(text.size()));
+
+        RegexMatch match;
+        if (dir == SearchDirection::Forward ? regex.Find(text, lineEnds, 0, -1, match) :
+            regex.FindLast(text, lineEnds, 0, long(chunk.size()), match))
+        {
+            auto matchLine = long(std::upper_bound(lineEnds.begin(), lineEnds.end(), match.start) - lineEnds.begin());
+            found = line + std::min(matchLine, lines - 1);
+            if (dir == SearchDirection::Forward)
+            {
+                return found;
+            }
+        }
+        line += lines;
+    }
+    return found;
+}
+
+long ZepFilePager::Find(const ZepRegex& regex, long startLine, SearchDirection dir)
+{
+    ZEP_TRACE_SCOPE("ZepFilePager::Find");
+
+    if (!m_pFile || !regex.IsValid())
+    {
+        return -1;
+    }
+
+    startLine = std::max(0l, std::min(startLine, m_lineCount - 1));
+    if (dir == SearchDirection::Forward)
+    {
+        return FindInLines(regex, startLine, m_lineCount, dir);
+    }
+
+    // Backwards a block of indexed lines at a time; the last match in the nearest block that has one
+    for (auto block = startLine / IndexStride; block >= 0; block--)
+    {
+        auto found = FindInLines(regex, block * IndexStride, std::min((block + 1) * IndexStride, startLine + 1), dir);
+        if (found != -1)
+        {
+            return found;
+        }
+    }
+    return -1;
+}
+
+} // Zep
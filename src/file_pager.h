@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "buffer.h"
+
+namespace Zep
+{
+
+// Read only access to files far bigger than memory.
+// Open() streams through the file once, recording the offset of every IndexStride'th line.  After that, lines are
+// found by jumping to the nearest indexed line and scanning forward through fixed size pages, which are read on
+// demand and kept in an LRU cache.  The cache and the index are what stay resident; the cache never grows past
+// the memory budget.
+class ZepFilePager
+{
+public:
+    static const size_t DefaultPageSize = 1024 * 1024;
+    static const size_t DefaultMemoryBudget = 64 * 1024 * 1024;
+    static const long IndexStride = 1024;
+
+    ZepFilePager(size_t memoryBudget = DefaultMemoryBudget, size_t pageSize = DefaultPageSize);
+    ~ZepFilePager();
+
+    bool Open(const std::string& path);
+    void Close();
+
+    // A file always has at least one line; the one after the last \n
+    long GetLineCount() const { return m_lineCount; }
+    uint64_t GetFileSize() const { return m_fileSize; }
+    size_t GetMemoryBudget() const { return m_memoryBudget; }
+    size_t GetResidentBytes() const;
+
+    // Appends lines [firstLine, firstLine + count) to str, with their line ends, stopping early at maxBytes.
+    // Returns the number of whole lines appended
+    long ReadLines(long firstLine, long count, std::string& str, size_t maxBytes = SIZE_MAX);
+
+    // The first line at or after startLine (or before it, going backwards) with a match of the pattern; -1 if none.
+    // Text is read a page at a time; a match that spans lines can be missed where two reads meet
+    long Find(const ZepRegex& regex, long startLine, SearchDirection dir = SearchDirection::Forward);
+
+private:
+    struct Page
+    {
+        std::vector<uint8_t> data;
+        std::list<uint64_t>::iterator itrLRU;
+    };
+
+    const Page* GetPage(uint64_t pageIndex);
+    bool ReadAt(uint64_t offset, uint8_t* pData, size_t size, size_t& bytesRead);
+    uint64_t LineOffset(long line);
+    long FindInLines(const ZepRegex& regex, long firstLine, long endLine, SearchDirection dir);
+
+    FILE* m_pFile = nullptr;
+    uint64_t m_fileSize = 0;
+    long m_lineCount = 0;
+    size_t m_pageSize;
+    size_t m_memoryBudget;
+    size_t m_maxPages;
+
+    std::vector<uint64_t> m_lineIndex;      // Offset of line i * IndexStride
+    std::unordered_map<uint64_t, Page> m_pages;
+    std::list<uint64_t> m_lru;              // Most recently used page first
+};
+
+} // Zep
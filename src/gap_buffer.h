@@ -175,6 +175,9 @@ public:
     // Size is size of buffer - the gap size
     inline size_type size() const { return (m_pEnd - m_pStart) - (m_pGapEnd - m_pGapStart); }
 
+    // Size of the allocation, including the gap
+    inline size_type capacity() const { return m_pEnd - m_pStart; }
+
     // No current limit ; not sure how to calculate the ram max size here
     size_type max_size() const { return std::numeric_limits<size_t>::max(); }
 
@@ -337,6 +340,21 @@ public:
         return str;
     }
 
+    // Append the values in [start, end) to str, copied from either side of the gap
+    void append_to(std::string& str, size_type start, size_type end) const
+    {
+        auto before = size_type(m_pGapStart - m_pStart);
+        if (start < before)
+        {
+            str.append((const char*)m_pStart + start, std::min(end, before) - start);
+        }
+        if (end > before)
+        {
+            auto from = std::max(start, before) - before;
+            str.append((const char*)m_pGapEnd + from, end - before - from);
+        }
+    }
+
     // Assign the whole buffer to this range of values
     template<class iter>
     void assign(iter srcBegin, iter srcEnd)
@@ -361,6 +379,22 @@ public:
         DEBUG_FILL_GAP;
     }
 
+    // Replace the contents with count uninitialized entries and the gap at the end.
+    // Returns the entries, so they can be filled in place; for example by reading a file straight into them
+    T* assign_uninitialized(size_type count)
+    {
+        Free();
+
+        auto bufferSize = count + m_defaultGap;
+        m_pStart = get_allocator().allocate(bufferSize);
+        m_pGapStart = m_pStart + count;
+        m_pEnd = m_pStart + bufferSize;
+        m_pGapEnd = m_pEnd;
+
+        DEBUG_FILL_GAP;
+        return m_pStart;
+    }
+
     void assign(std::initializer_list<T> list)
     {
         assign(list.begin(), list.end());
@@ -0,0 +1,426 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <sstream>
+
+#include "grep.h"
+#include "buffer.h"
+#include "buffer_regex.h"
+#include "utils/fileutils.h"
+#include "utils/trace.h"
+
+namespace Zep
+{
+
+// What a search's tasks share with the editor
+struct GrepState
+{
+    ZepRegex regex;                     // Compiled patterns are shared by copies, and can be searched on any thread
+    std::mutex mutex;
+    std::condition_variable done;
+    std::vector<GrepResult> results;    // Finished, but not in the buffer yet
+    long pending = 0;                   // Tasks queued or running
+    std::atomic<bool> stop = { false };
+};
+
+// Text to search: copied from a buffer, or read from a file
+struct GrepText
+{
+    std::string path;
+    GapBuffer<utf8> text;
+    std::vector<long> lineEnds;
+};
+
+namespace
+{
+// A file with a 0 near the start is taken to be binary, and skipped
+const size_t BinaryCheckSize = 8192;
+
+// How much of the buffers Update() copies a frame
+const long CopyBudget = 4 * 1024 * 1024;
+
+// Read the file the way a buffer loads it: the carriage returns of a DOS file stripped and a 0 on the end, with its
+// line index
+bool ReadText(const std::string& path, GrepText& source)
+{
+    auto& text = source.text;
+    size_t size = 0;
+    if (!FileUtils::ReadFile(path, [&](size_t fileSize)
+    {
+        return text.assign_uninitialized(fileSize);
+    }, size))
+    {
+        return false;
+    }
+
+    auto pStart = text.m_pStart;
+    if (std::memchr(pStart, 0, std::min(size, BinaryCheckSize)))
+    {
+        return false;
+    }
+
+    LineEndState lineEnds;
+    text.resize(EncodingUtils::ReadLineEnds(pStart, size, lineEnds, source.lineEnds));
+    text.push_back(0);
+    source.lineEnds.push_back(long(text.size()));
+    return true;
+}
+
+// The line index of copied text; built by the task, so the editor only copies the text
+void IndexLines(GrepText& source)
+{
+    auto& text = source.text;
+    for (auto pLine = text.m_pStart; pLine < text.m_pGapStart;)
+    {
+        auto pEnd = (utf8*)std::memchr(pLine, '\n', size_t(text.m_pGapStart - pLine));
+        if (!pEnd)
+        {
+            break;
+        }
+        pLine = pEnd + 1;
+        source.lineEnds.push_back(long(pLine - text.m_pStart));
+    }
+    source.lineEnds.push_back(long(text.size()));
+}
+
+// A result for each line with a match on it
+void SearchText(const ZepRegex& regex, const GrepText& source, GrepState& state)
+{
+    ZEP_TRACE_SCOPE("ZepGrep::SearchText");
+
+    std::vector<GrepResult> results;
+    auto& text = source.text;
+    auto& lineEnds = source.lineEnds;
+    RegexMatch match;
+    for (long pos = 0; !state.stop && regex.Find(text, lineEnds, pos, -1, match);)
+    {
+        auto line = long(std::upper_bound(lineEnds.begin(), lineEnds.end(), match.start) - lineEnds.begin());
+        line = std::min(line, long(lineEnds.size()) - 1);
+        auto lineStart = line == 0 ? 0 : lineEnds[line - 1];
+        auto lineEnd = lineEnds[line];
+        auto textEnd = lineEnd;
+        while (textEnd > lineStart && (text[textEnd - 1] == '\n' || text[textEnd - 1] == 0))
+        {
+            textEnd--;
+        }
+
+        GrepResult result;
+        result.path = source.path;
+        result.line = line;
+        result.column = match.start - lineStart;
+        result.text.assign(text.begin() + lineStart, text.begin() + textEnd);
+        results.push_back(std::move(result));
+        pos = lineEnd;
+    }
+
+    if (!results.empty())
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.results.insert(state.results.end(), std::make_move_iterator(results.begin()), std::make_move_iterator(results.end()));
+    }
+}
+
+// Count the task in before it is queued, so that waiting for the count to drop waits for all of them; without a pool,
+// the task just runs
+void Enqueue(ThreadPool* pPool, std::shared_ptr<GrepState> spState, std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(spState->mutex);
+        spState->pending++;
+    }
+
+    auto run = [spState, task]()
+    {
+        task();
+        std::lock_guard<std::mutex> lock(spState->mutex);
+        if (--spState->pending == 0)
+        {
+            spState->done.notify_all();
+        }
+    };
+
+    if (pPool)
+    {
+        pPool->enqueue(run);
+    }
+    else
+    {
+        run();
+    }
+}
+}
+
+ZepGrep::ZepGrep(ZepEditor& editor)
+    : ZepComponent(editor)
+{
+}
+
+ZepGrep::~ZepGrep()
+{
+    Stop();
+}
+
+bool ZepGrep::Start(const std::string& pattern, const std::string& directory)
+{
+    ZEP_TRACE_SCOPE("ZepGrep::Start");
+
+    // As in Vim, ignorecase applies and smartcase doesn't
+    ZepRegex regex;
+    if (!regex.Compile(pattern, GetEditor().GetSearchFlags() & ~RegexFlags::SmartCase))
+    {
+        return false;
+    }
+
+    Stop();
+    m_spState = std::make_shared<GrepState>();
+    m_spState->regex = regex;
+    m_results.clear();
+    m_current = -1;
+    if (!m_pResults)
+    {
+        m_pResults = GetEditor().AddBuffer("[Quickfix]");
+    }
+    m_pResults->SetText("");
+
+    auto pPool = (GetEditor().GetFlags() & ZepEditorFlags::DisableThreads) ? nullptr : &GetEditor().GetThreadPool();
+    auto spState = m_spState;
+
+    // A file is read and searched by its task
+    auto searchFile = [spState](ThreadPool* pPool, const std::string& path)
+    {
+        Enqueue(pPool, spState, [spState, path]()
+        {
+            GrepText source;
+            source.path = path;
+            if (!spState->stop && ReadText(path, source))
+            {
+                SearchText(spState->regex, source, *spState);
+            }
+        });
+    };
+
+    // The buffers are copied by Update(), a few at a time.  A buffer still loading is searched in its file instead;
+    // a paged or binary one isn't searched, nor is a temporary copy of a file
+    std::set<std::string> openFiles;
+    for (auto& spBuffer : GetEditor().GetBuffers())
+    {
+        if (spBuffer.get() == m_pResults || spBuffer->IsTemporary())
+        {
+            continue;
+        }
+
+        auto& path = spBuffer->GetFilePath();
+        if (!path.empty())
+        {
+            openFiles.insert(FileUtils::Canonical(path));
+        }
+
+        if (spBuffer->IsPaged() || spBuffer->IsBinary())
+        {
+            continue;
+        }
+        if (spBuffer->IsLoading())
+        {
+            searchFile(pPool, path);
+            continue;
+        }
+
+        Copy copy;
+        copy.wpBuffer = spBuffer;
+        m_copies.push_back(copy);
+    }
+
+    // Files are listed on the pool too; a big tree can take a while
+    if (!directory.empty())
+    {
+        Enqueue(pPool, spState, [pPool, spState, searchFile, directory, openFiles]()
+        {
+            std::vector<std::string> files;
+            FileUtils::ListFiles(directory, files);
+            for (auto& path : files)
+            {
+                if (spState->stop)
+                {
+                    break;
+                }
+                if (openFiles.find(FileUtils::Canonical(path)) == openFiles.end())
+                {
+                    searchFile(pPool, path);
+                }
+            }
+        });
+    }
+    return true;
+}
+
+void ZepGrep::Stop()
+{
+    m_copies.clear();
+    if (m_spState)
+    {
+        m_spState->stop = true;
+        m_spState.reset();
+    }
+}
+
+// Copy up to the budget of the buffer, a memcpy either side of the buffer's gap; and once it is all copied, queue the
+// task to search it.  Returns how much was copied
+long ZepGrep::CopyBuffer(Copy& copy, long budget)
+{
+    auto spBuffer = copy.wpBuffer.lock();
+    if (!spBuffer)
+    {
+        return 0;
+    }
+
+    auto& text = spBuffer->GetText();
+    if (!copy.spSource)
+    {
+        auto& path = spBuffer->GetFilePath();
+        copy.spSource = std::make_shared<GrepText>();
+        copy.spSource->path = path.empty() ? spBuffer->GetName() : path;
+        copy.spSource->text.assign_uninitialized(text.size());
+    }
+
+    auto size = long(copy.spSource->text.size());
+    auto end = std::min(size, copy.copied + budget);
+    auto gapStart = long(text.m_pGapStart - text.m_pStart);
+    auto gapSize = long(text.m_pGapEnd - text.m_pGapStart);
+    auto pDest = copy.spSource->text.m_pStart;
+    if (copy.copied < gapStart)
+    {
+        auto before = std::min(end, gapStart);
+        std::memcpy(pDest + copy.copied, text.m_pStart + copy.copied, size_t(before - copy.copied));
+    }
+    if (end > gapStart)
+    {
+        auto from = std::max(copy.copied, gapStart);
+        std::memcpy(pDest + from, text.m_pStart + from + gapSize, size_t(end - from));
+    }
+    auto copied = end - copy.copied;
+    copy.copied = end;
+
+    if (copy.copied == size)
+    {
+        auto spState = m_spState;
+        auto spSource = copy.spSource;
+        Enqueue((GetEditor().GetFlags() & ZepEditorFlags::DisableThreads) ? nullptr : &GetEditor().GetThreadPool(), spState, [spSource, spState]()
+        {
+            IndexLines(*spSource);
+            SearchText(spState->regex, *spSource, *spState);
+        });
+    }
+    return copied;
+}
+
+void ZepGrep::CopyBuffers(long budget)
+{
+    while (!m_copies.empty() && budget > 0)
+    {
+        auto& copy = m_copies.front();
+        budget -= CopyBuffer(copy, budget);
+        if (copy.wpBuffer.expired() || (copy.spSource && copy.copied == long(copy.spSource->text.size())))
+        {
+            m_copies.pop_front();
+        }
+    }
+}
+
+// A buffer part copied has the rest copied before it changes; one not started yet is copied as it is after
+void ZepGrep::Notify(std::shared_ptr<ZepMessage> message)
+{
+    if (message->messageId != Msg_Buffer || m_copies.empty() || !m_copies.front().spSource)
+    {
+        return;
+    }
+
+    auto spBufferMsg = std::static_pointer_cast<BufferMessage>(message);
+    if (spBufferMsg->type == BufferMessageType::PreBufferChange && spBufferMsg->pBuffer == m_copies.front().wpBuffer.lock().get())
+    {
+        auto& copy = m_copies.front();
+        CopyBuffer(copy, long(copy.spSource->text.size()));
+        m_copies.pop_front();
+    }
+}
+
+void ZepGrep::Wait()
+{
+    if (!m_spState)
+    {
+        return;
+    }
+
+    CopyBuffers(std::numeric_limits<long>::max());
+    {
+        std::unique_lock<std::mutex> lock(m_spState->mutex);
+        m_spState->done.wait(lock, [this]() { return m_spState->pending == 0; });
+    }
+    Update();
+}
+
+bool ZepGrep::IsRunning() const
+{
+    if (!m_spState)
+    {
+        return false;
+    }
+    if (!m_copies.empty())
+    {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(m_spState->mutex);
+    return m_spState->pending != 0 || !m_spState->results.empty();
+}
+
+bool ZepGrep::Update()
+{
+    if (!m_spState)
+    {
+        return false;
+    }
+
+    CopyBuffers(CopyBudget);
+
+    std::vector<GrepResult> results;
+    {
+        std::lock_guard<std::mutex> lock(m_spState->mutex);
+        results.swap(m_spState->results);
+    }
+    if (results.empty())
+    {
+        return false;
+    }
+
+    ZEP_TRACE_SCOPE("ZepGrep::Update");
+
+    std::ostringstream str;
+    for (auto& result : results)
+    {
+        str << result.path << ":" << result.line + 1 << ":" << result.column + 1 << ": " << result.text << "\n";
+    }
+    m_pResults->Insert(m_pResults->EndLocation(), str.str());
+    m_results.insert(m_results.end(), std::make_move_iterator(results.begin()), std::make_move_iterator(results.end()));
+    return true;
+}
+
+const GrepResult* ZepGrep::Step(long step)
+{
+    return Select(m_current < 0 && step > 0 ? 0 : m_current + step);
+}
+
+const GrepResult* ZepGrep::Select(long index)
+{
+    if (m_results.empty())
+    {
+        return nullptr;
+    }
+    m_current = std::min(std::max(index, 0l), long(m_results.size()) - 1);
+    return &m_results[m_current];
+}
+
+} // Zep
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "editor.h"
+
+namespace Zep
+{
+
+class ZepBuffer;
+struct GrepState;
+struct GrepText;
+
+// A line with a match on it
+struct GrepResult
+{
+    std::string path;       // The file; or the buffer's name, if it has no file
+    long line = 0;          // From 0
+    long column = 0;        // Byte offset into the line
+    std::string text;       // The line, without its line end
+};
+
+// :vimgrep.  Searches every buffer, and the files under a directory that aren't open, on the editor's thread pool; a
+// task for each.  Buffers are copied before their tasks start, so no task ever reads a buffer that is being edited;
+// Update() copies a few MB of them each frame, and a buffer that is edited before its copy is done has the rest
+// copied before the edit.  Files are listed and read by the tasks themselves.  Each task hands over its results as it
+// finishes, and Update() (the display calls it every frame) appends them to the results buffer, a
+// "path:line:column: text" line for each, as quickfix does.
+class ZepGrep : public ZepComponent
+{
+public:
+    ZepGrep(ZepEditor& editor);
+    ~ZepGrep();
+
+    // Stops any search still running; false if the pattern is bad
+    bool Start(const std::string& pattern, const std::string& directory = std::string());
+
+    // Tasks already running see the stop and finish on their own; this doesn't wait for them
+    void Stop();
+
+    // Copy more of the buffers, and move finished results into the buffer; true if there were any
+    bool Update();
+    void Wait();
+    bool IsRunning() const;
+
+    ZepBuffer* GetResultsBuffer() const { return m_pResults; }
+    const std::vector<GrepResult>& GetResults() const { return m_results; }
+
+    // Step through the results, as :cn and :cp do; nullptr if there aren't any
+    const GrepResult* Step(long step);
+    const GrepResult* Select(long index);
+    long GetCurrent() const { return m_current; }
+
+    virtual void Notify(std::shared_ptr<ZepMessage> message) override;
+
+private:
+    // A buffer still to be copied for its task
+    struct Copy
+    {
+        std::weak_ptr<ZepBuffer> wpBuffer;
+        std::shared_ptr<GrepText> spSource;     // Once started
+        long copied = 0;
+    };
+
+    void CopyBuffers(long budget);
+    long CopyBuffer(Copy& copy, long budget);
+
+private:
+    ZepBuffer* m_pResults = nullptr;
+    std::shared_ptr<GrepState> m_spState;       // Shared with the tasks, which may outlive a search
+    std::deque<Copy> m_copies;                  // In buffer order; the front one may be part copied
+    std::vector<GrepResult> m_results;
+    long m_current = -1;
+};
+
+} // Zep
@@ -0,0 +1,295 @@
+#include "journal.h"
+#include "gap_buffer.h"
+
+#include "utils/stringutils.h"
+#include "utils/trace.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace Zep
+{
+
+namespace
+{
+const char JournalMagic[8] = { 'Z', 'E', 'P', 'J', 'R', 'N', 'L', '1' };
+const uint64_t JournalSeed = 0x4a524e4c;
+
+// Magic, base size, base modified time, checksum
+const size_t HeaderSize = 32;
+
+// Type, offset, length; then the payload, then a checksum of all of it
+const size_t RecordHeaderSize = 17;
+const size_t ChecksumSize = 8;
+
+enum RecordType : uint8_t
+{
+    Record_Insert = 1,
+    Record_Delete = 2,
+    Record_Snapshot = 3
+};
+
+// A group commit waits this long for more edits to join it, unless the batch fills first
+const auto GroupCommitDelay = std::chrono::milliseconds(100);
+const size_t GroupCommitBytes = 64 * 1024;
+
+uint64_t Checksum(const char* pHeader, size_t headerSize, const char* pBegin, const char* pEnd)
+{
+    auto seed = StringUtils::murmur_hash_64(pHeader, uint32_t(headerSize), JournalSeed);
+    return StringUtils::murmur_hash_64(pBegin, uint32_t(pEnd - pBegin), seed);
+}
+
+template<class T>
+T Read(const char* p)
+{
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+}
+
+ZepJournal::ZepJournal(const std::string& path, const FileUtils::FileStamp& base, bool threaded)
+    : m_path(path)
+{
+    char header[HeaderSize];
+    memcpy(header, JournalMagic, sizeof(JournalMagic));
+    memcpy(header + 8, &base.size, 8);
+    memcpy(header + 16, &base.modified, 8);
+    auto checksum = Checksum(header, 24, nullptr, nullptr);
+    memcpy(header + 24, &checksum, 8);
+    m_pending.assign(header, HeaderSize);
+    m_appendedBytes = HeaderSize;
+
+    if (threaded)
+    {
+        m_thread = std::thread([this]() { WriterThread(); });
+    }
+}
+
+ZepJournal::~ZepJournal()
+{
+    if (m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+    }
+    else if (!m_stop)
+    {
+        Flush();
+    }
+    m_writer.Close();
+}
+
+void ZepJournal::Insert(long offset, const char* pBegin, const char* pEnd)
+{
+    Append(Record_Insert, uint64_t(offset), uint64_t(pEnd - pBegin), pBegin, pEnd);
+}
+
+void ZepJournal::Delete(long offset, long length)
+{
+    Append(Record_Delete, uint64_t(offset), uint64_t(length), nullptr, nullptr);
+}
+
+void ZepJournal::Snapshot(const char* pBegin, const char* pEnd)
+{
+    Append(Record_Snapshot, 0, uint64_t(pEnd - pBegin), pBegin, pEnd);
+}
+
+void ZepJournal::Append(uint8_t type, uint64_t offset, uint64_t length, const char* pBegin, const char* pEnd)
+{
+    char header[RecordHeaderSize];
+    header[0] = char(type);
+    memcpy(header + 1, &offset, 8);
+    memcpy(header + 9, &length, 8);
+    auto checksum = Checksum(header, RecordHeaderSize, pBegin, pEnd);
+
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto wasEmpty = m_pending.empty();
+        m_pending.append(header, RecordHeaderSize);
+        m_pending.append(pBegin, pEnd);
+        m_pending.append((const char*)&checksum, ChecksumSize);
+        m_appendedBytes += RecordHeaderSize + (pEnd - pBegin) + ChecksumSize;
+        wake = wasEmpty || m_pending.size() >= GroupCommitBytes;
+    }
+    if (wake && m_thread.joinable())
+    {
+        m_wake.notify_one();
+    }
+}
+
+void ZepJournal::Flush()
+{
+    if (!m_thread.joinable())
+    {
+        WriteBatch(m_pending);
+        m_pending.clear();
+        m_syncedBytes = m_appendedBytes;
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto target = m_appendedBytes;
+    m_flushRequested = true;
+    m_wake.notify_one();
+    m_written.wait(lock, [&]() { return m_syncedBytes >= target; });
+}
+
+void ZepJournal::Discard()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.clear();
+        m_stop = true;
+    }
+    if (m_thread.joinable())
+    {
+        m_wake.notify_one();
+        m_thread.join();
+    }
+    m_writer.Close();
+    if (m_open)
+    {
+        std::remove(m_path.c_str());
+        m_open = false;
+    }
+}
+
+// Sleeps until there is something to write, then gives more edits a moment to join the batch; one sync covers them all
+void ZepJournal::WriterThread()
+{
+    std::string batch;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_wake.wait(lock, [this]() { return m_stop || m_flushRequested || !m_pending.empty(); });
+        if (!m_stop && !m_flushRequested)
+        {
+            m_wake.wait_for(lock, GroupCommitDelay, [this]()
+            {
+                return m_stop || m_flushRequested || m_pending.size() >= GroupCommitBytes;
+            });
+        }
+
+        if (m_pending.empty() && m_stop)
+        {
+            break;
+        }
+
+        batch.swap(m_pending);
+        auto batchEnd = m_appendedBytes;
+        m_flushRequested = false;
+        lock.unlock();
+
+        WriteBatch(batch);
+        batch.clear();
+
+        lock.lock();
+        m_syncedBytes = batchEnd;
+        m_written.notify_all();
+    }
+}
+
+void ZepJournal::WriteBatch(std::string& batch)
+{
+    if (batch.empty() || m_failed)
+    {
+        return;
+    }
+
+    ZEP_TRACE_SCOPE("ZepJournal::WriteBatch");
+    if (!m_open)
+    {
+        m_open = m_writer.Open(m_path);
+        m_failed = !m_open;
+    }
+    if (m_open)
+    {
+        m_writer.Write(batch.data(), batch.size());
+        m_failed = !m_writer.Sync();
+    }
+}
+
+bool ZepJournal::Replay(const std::string& path, const FileUtils::FileStamp& base, std::string& text)
+{
+    ZEP_TRACE_SCOPE("ZepJournal::Replay");
+
+    std::string journal;
+    size_t size = 0;
+    if (!FileUtils::ReadFile(path, [&](size_t fileSize)
+    {
+        journal.resize(fileSize);
+        return (uint8_t*)&journal[0];
+    }, size))
+    {
+        return false;
+    }
+
+    const char* p = journal.data();
+    if (size < HeaderSize ||
+        memcmp(p, JournalMagic, sizeof(JournalMagic)) != 0 ||
+        Read<uint64_t>(p + 24) != Checksum(p, 24, nullptr, nullptr))
+    {
+        return false;
+    }
+
+    FileUtils::FileStamp stamp;
+    stamp.size = Read<uint64_t>(p + 8);
+    stamp.modified = Read<int64_t>(p + 16);
+    if (stamp != base)
+    {
+        return false;
+    }
+
+    // Edits are mostly near each other, which a gap buffer handles without moving the rest of the text
+    GapBuffer<char> buffer;
+    buffer.assign(text.begin(), text.end());
+
+    size_t pos = HeaderSize;
+    while (size - pos >= RecordHeaderSize + ChecksumSize)
+    {
+        auto pRecord = p + pos;
+        auto type = uint8_t(pRecord[0]);
+        auto offset = Read<uint64_t>(pRecord + 1);
+        auto length = Read<uint64_t>(pRecord + 9);
+        auto payload = type == Record_Delete ? 0 : length;
+        if (payload > size - pos - RecordHeaderSize - ChecksumSize)
+        {
+            break;
+        }
+
+        auto pPayload = pRecord + RecordHeaderSize;
+        if (Read<uint64_t>(pPayload + payload) != Checksum(pRecord, RecordHeaderSize, pPayload, pPayload + payload))
+        {
+            break;
+        }
+
+        if (type == Record_Insert && offset <= buffer.size())
+        {
+            buffer.insert(buffer.begin() + offset, pPayload, pPayload + payload);
+        }
+        else if (type == Record_Delete && offset <= buffer.size() && length <= buffer.size() - offset)
+        {
+            buffer.erase(buffer.begin() + offset, buffer.begin() + (offset + length));
+        }
+        else if (type == Record_Snapshot)
+        {
+            buffer.assign(pPayload, pPayload + payload);
+        }
+        else
+        {
+            break;
+        }
+        pos += RecordHeaderSize + payload + ChecksumSize;
+    }
+
+    text.assign(buffer.begin(), buffer.end());
+    return true;
+}
+
+} // Zep
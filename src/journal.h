@@ -0,0 +1,67 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "utils/fileutils.h"
+
+namespace Zep
+{
+
+// Write-ahead journal of the edits made to a buffer since it matched its file, so they can be recovered after a crash.
+// Append only and binary: a header holding the stamp of the file the edits apply to, then a checksummed record per
+// edit.  Records are encoded into memory on the caller's thread; a writer thread takes them in batches, writes them
+// and syncs once per batch, so an edit never waits for the disk.  A record torn by a crash fails its checksum, and
+// replay stops there.
+class ZepJournal
+{
+public:
+    ZepJournal(const std::string& path, const FileUtils::FileStamp& base, bool threaded);
+    ~ZepJournal();
+
+    static std::string PathFor(const std::string& filePath) { return filePath + ".zepjournal"; }
+
+    // Offsets are into the buffer text, with carriage returns stripped
+    void Insert(long offset, const char* pBegin, const char* pEnd);
+    void Delete(long offset, long length);
+
+    // The whole text, for when the buffer already differs from the file as the journal starts
+    void Snapshot(const char* pBegin, const char* pEnd);
+
+    // Block until everything recorded so far is on the disk
+    void Flush();
+
+    // Stop, and remove the file; the edits are saved, or abandoned
+    void Discard();
+
+    const std::string& GetPath() const { return m_path; }
+
+    // Apply the journal at path to the text of the file it was started against (carriage returns stripped).
+    // False if there is no journal, or the file has changed since; a damaged tail is dropped
+    static bool Replay(const std::string& path, const FileUtils::FileStamp& base, std::string& text);
+
+private:
+    void Append(uint8_t type, uint64_t offset, uint64_t length, const char* pBegin, const char* pEnd);
+    void WriterThread();
+    void WriteBatch(std::string& batch);
+
+private:
+    std::string m_path;
+    FileUtils::FileWriter m_writer;     // Only touched by the writer (or by Flush, with no thread)
+    bool m_open = false;
+    bool m_failed = false;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_written;
+    std::string m_pending;              // Encoded records the writer hasn't taken yet
+    uint64_t m_appendedBytes = 0;       // Bytes recorded, and bytes synced to disk
+    uint64_t m_syncedBytes = 0;
+    bool m_flushRequested = false;
+    bool m_stop = false;
+};
+
+} // Zep
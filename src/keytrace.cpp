@@ -0,0 +1,67 @@
+#include <fstream>
+#include <sstream>
+
+#include "editor.h"
+#include "keytrace.h"
+
+namespace Zep
+{
+
+std::string ZepKeyTrace::ToString() const
+{
+    std::ostringstream str;
+    for (auto& entry : m_keys)
+    {
+        str << entry.key << " " << entry.modifiers << '\n';
+    }
+    return str.str();
+}
+
+bool ZepKeyTrace::FromString(const std::string& text)
+{
+    std::vector<KeyTraceEntry> keys;
+    std::istringstream str(text);
+
+    KeyTraceEntry entry;
+    while (str >> entry.key)
+    {
+        if (!(str >> entry.modifiers))
+        {
+            return false;
+        }
+        keys.push_back(entry);
+    }
+
+    if (!str.eof())
+    {
+        return false;
+    }
+
+    m_keys.swap(keys);
+    return true;
+}
+
+bool ZepKeyTrace::Save(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::out | std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    file << ToString();
+    return bool(file);
+}
+
+bool ZepKeyTrace::Load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    std::ostringstream str;
+    str << file.rdbuf();
+    return FromString(str.str());
+}
+
+} // Zep
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Zep
+{
+
+struct KeyTraceEntry
+{
+    uint32_t key;
+    uint32_t modifiers;
+};
+
+// A recording of the keys sent to a mode via AddKeyPress.
+// Attach one to the editor to capture an editing session, save it, and replay it later; 
+// the replay benchmark uses this to measure real editing workflows instead of micro-operations.
+class ZepKeyTrace
+{
+public:
+    void Add(uint32_t key, uint32_t modifiers) { m_keys.push_back(KeyTraceEntry{ key, modifiers }); }
+    void Clear() { m_keys.clear(); }
+    const std::vector<KeyTraceEntry>& GetKeys() const { return m_keys; }
+
+    // Text format: one "key modifiers" pair per line, in decimal
+    std::string ToString() const;
+    bool FromString(const std::string& text);
+
+    bool Save(const std::string& path) const;
+    bool Load(const std::string& path);
+
+private:
+    std::vector<KeyTraceEntry> m_keys;
+};
+
+} // Zep
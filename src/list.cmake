@@ -4,13 +4,44 @@ src/utils/timer.cpp
 src/utils/timer.h
 src/utils/stringutils.cpp
 src/utils/stringutils.h
+src/utils/fileutils.cpp
+src/utils/fileutils.h
+src/utils/diff.cpp
+src/utils/diff.h
+src/utils/encoding.cpp
+src/utils/encoding.h
 src/utils/threadutils.h
+src/utils/trace.cpp
+src/utils/trace.h
 src/editor.cpp
 src/editor.h
 src/buffer.cpp
 src/buffer.h
+src/buffer_diff.cpp
+src/buffer_diff.h
+src/buffer_regex.cpp
+src/buffer_regex.h
+src/buffer_search.cpp
+src/buffer_search.h
+src/buffer_substitute.cpp
+src/buffer_substitute.h
+src/buffer_blocks.h
+src/buffer_brackets.cpp
+src/buffer_brackets.h
+src/buffer_trigram.cpp
+src/buffer_trigram.h
+src/binary_file.cpp
+src/binary_file.h
+src/file_pager.cpp
+src/file_pager.h
+src/grep.cpp
+src/grep.h
 src/commands.cpp
 src/commands.h
+src/journal.cpp
+src/journal.h
+src/keytrace.cpp
+src/keytrace.h
 src/display.cpp
 src/display.h
 src/window.cpp
@@ -1,7 +1,11 @@
+#include <algorithm>
+
 #include "buffer.h"
 #include "mode.h"
 #include "editor.h"
 #include "commands.h"
+#include "keytrace.h"
+#include "utils/encoding.h"
 
 namespace Zep
 {
@@ -24,9 +28,23 @@ void ZepMode::SetCurrentWindow(ZepWindow* pDisplay)
 
 void ZepMode::AddCommandText(std::string strText)
 {
-    for (auto& ch : strText)
+    // A key is a character, as the front ends send it, not a byte of one
+    const char* p = strText.c_str();
+    const char* pEnd = p + strText.size();
+    while (p < pEnd)
     {
-        AddKeyPress(ch);
+        uint32_t key;
+        p += EncodingUtils::NextChar(p, pEnd, key);
+        AddKeyPress(key);
+    }
+}
+
+void ZepMode::RecordKey(uint32_t key, uint32_t modifierKeys)
+{
+    auto pKeyTrace = GetEditor().GetKeyTrace();
+    if (pKeyTrace)
+    {
+        pKeyTrace->Add(key, modifierKeys);
     }
 }
 
@@ -91,6 +109,49 @@ void ZepMode::Undo()
     while (inGroup);
 }
 
+namespace
+{
+// std::stack hides its container; this is the standard way to get at it without copying
+template<class T>
+const typename T::container_type& GetStackContainer(const T& stack)
+{
+    struct Access : T
+    {
+        static const typename T::container_type& Get(const T& s) { return s.*(&Access::c); }
+    };
+    return Access::Get(stack);
+}
+}
+
+size_t ZepMode::GetUndoMemoryUsage(const ZepBuffer& buffer) const
+{
+    size_t size = 0;
+    for (auto pStack : { &m_undoStack, &m_redoStack })
+    {
+        for (auto& spCommand : GetStackContainer(*pStack))
+        {
+            if (&spCommand->GetBuffer() == &buffer)
+            {
+                size += spCommand->GetMemoryUsage();
+            }
+        }
+    }
+    return size;
+}
+
+void ZepMode::ForgetBuffer(const ZepBuffer& buffer)
+{
+    for (auto pStack : { &m_undoStack, &m_redoStack })
+    {
+        auto commands = GetStackContainer(*pStack);
+        commands.erase(std::remove_if(commands.begin(), commands.end(), [&](const std::shared_ptr<ZepCommand>& spCommand)
+        {
+            return &spCommand->GetBuffer() == &buffer;
+        }), commands.end());
+        *pStack = std::stack<std::shared_ptr<ZepCommand>>(commands);
+    }
+}
+
 void ZepMode::UpdateVisualSelection()
 {
     // Visual mode update - after a command
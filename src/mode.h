@@ -66,7 +66,14 @@ public:
 
     virtual void Undo();
     virtual void Redo();
+
+    // Memory held by the undo/redo stacks for commands on this buffer
+    size_t GetUndoMemoryUsage(const ZepBuffer& buffer) const;
+    // Drops the undo/redo steps of a buffer that is going away
+    void ForgetBuffer(const ZepBuffer& buffer);
 protected:
+    void RecordKey(uint32_t key, uint32_t modifierKeys);
+
     std::stack<std::shared_ptr<ZepCommand>> m_undoStack;
     std::stack<std::shared_ptr<ZepCommand>> m_redoStack;
     ZepWindow* m_pCurrentWindow = nullptr;
@@ -1,6 +1,7 @@
 #include "utils/stringutils.h"
 #include "mode_standard.h"
 #include "commands.h"
+#include "utils/encoding.h"
 
 // Note:
 // This is a version of the buffer that behaves like notepad.
@@ -84,14 +85,17 @@ void ZepMode_Standard::SwitchMode(EditorMode mode)
 
 void ZepMode_Standard::AddKeyPress(uint32_t key, uint32_t modifierKeys)
 {
-    std::string ch((char*)&key);
+    RecordKey(key, modifierKeys);
+
+    std::string ch;
+    EncodingUtils::AppendUtf8(key, ch);
 
     bool copyRegion = false;
     bool pasteText = false;
     bool lineWise = false;
     auto pBuffer = m_pCurrentWindow->GetCurrentBuffer();
     BufferLocation startOffset = m_pCurrentWindow->DisplayToBuffer();
-    BufferLocation endOffset = pBuffer->LocationFromOffsetByChars(startOffset, long(ch.length()));
+    BufferLocation endOffset = pBuffer->LocationFromOffsetByChars(startOffset, 1);
     BufferLocation cursorAfter = endOffset;
 
     const auto cursor = m_pCurrentWindow->GetCursor();
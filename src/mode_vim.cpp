@@ -1,8 +1,18 @@
 #include <cctype>
+#include <cstdlib>
+#include <cstring>
 #include <sstream>
 
 #include "mode_vim.h"
+#include "binary_file.h"
+#include "buffer_brackets.h"
+#include "buffer_regex.h"
+#include "buffer_search.h"
+#include "buffer_substitute.h"
 #include "commands.h"
+#include "grep.h"
+#include "utils/encoding.h"
+#include "utils/fileutils.h"
 #include "utils/stringutils.h"
 #include "utils/timer.h"
 
@@ -48,13 +58,83 @@
 // 'V' (linewise v)
 // Y, D, linewise yank/paste
 // d[a]<count>w/e  Delete words
-// di})]"'
+// di[a]w, da[i]({[b, B and their closes  Delete word, bracket blocks
 // c[a]<count>w/e  Change word
-// ci})]"'
+// c[a]i({[b, B and their closes  Change bracket blocks
+// f,F,t,T,;,, d[c]<count>f/F/t/T  Find a character on the line, and repeat the find
+// % [( [{ ]) ]} d% c%  Matching and enclosing brackets, skipping those in comments and strings
+// /,? Incremental search, highlighting the matches; :noh
+// :set [no]ignorecase, [no]smartcase (ic, scs) and \c, \C in patterns
+// n,N Next/previous match
+// :[range]s/pattern/replacement/[gineI] Substitute, as one undo
+// :vimgrep, :cn, :cp, :cc, :copen Search every buffer, and the files under a directory
 
 namespace Zep
 {
 
+// A :[range]s/pattern/replacement/flags command, split up as far as it has been typed
+struct SubstituteCommand
+{
+    std::string range;
+    std::string pattern;
+    std::string replacement;
+    std::string flags;
+};
+
+// The delimiter is the character after the s; escaped, it is just the character.  Other escapes are left for the
+// pattern and the replacement to deal with
+static bool ParseSubstitute(const std::string& command, SubstituteCommand& substitute)
+{
+    if (command.empty() || command[0] != ':')
+    {
+        return false;
+    }
+
+    size_t pos = 1;
+    while (pos < command.size() && std::strchr("0123456789.$%,;'<>+-", command[pos]))
+    {
+        pos++;
+    }
+    if (command.size() < pos + 2 || command[pos] != 's')
+    {
+        return false;
+    }
+
+    auto delimiter = command[pos + 1];
+    if (std::isalnum(uint8_t(delimiter)) || delimiter == '\\' || delimiter == '"' || delimiter == '|' || delimiter == ' ')
+    {
+        return false;
+    }
+
+    substitute = SubstituteCommand();
+    substitute.range = command.substr(1, pos - 1);
+    pos += 2;
+
+    auto getField = [&](std::string& field)
+    {
+        for (; pos < command.size() && command[pos] != delimiter; pos++)
+        {
+            if (command[pos] == '\\' && pos + 1 < command.size())
+            {
+                if (command[pos + 1] != delimiter)
+                {
+                    field += '\\';
+                }
+                pos++;
+            }
+            field += command[pos];
+        }
+        pos++;
+    };
+    getField(substitute.pattern);
+    getField(substitute.replacement);
+    if (pos < command.size())
+    {
+        substitute.flags = command.substr(pos);
+    }
+    return true;
+}
+
 // Given a searched block, find the next word 
 static BufferLocation WordMotion(const BufferBlock& block)
 {
@@ -120,6 +200,23 @@ BufferLocation WordEndMotion(const BufferBlock& block)
     }
 }
 
+// The motion, count times over from start.  Each block search starts where the last motion landed, so this is one walk
+// along the text; and the cursor, or the edit, only moves once
+static BufferLocation CountedMotion(const ZepBuffer& buffer, uint32_t searchType, SearchDirection dir, BufferLocation start, int count, BufferLocation(*pMotion)(const BufferBlock&))
+{
+    auto location = start;
+    for (int i = 0; i < count; i++)
+    {
+        auto next = buffer.Clamp(pMotion(buffer.GetBlock(searchType, location, dir)));
+        if (next == location)
+        {
+            break;
+        }
+        location = next;
+    }
+    return location;
+}
+
 std::pair<BufferLocation, BufferLocation> Word(const BufferBlock& block)
 {
     if (block.spaceBefore)
@@ -165,6 +262,244 @@ void ZepMode_Vim::Init()
 void ZepMode_Vim::ResetCommand()
 {
     m_currentCommand.clear();
+    if (m_previewing)
+    {
+        GetEditor().SetHighlightPattern(m_highlightBefore);
+        m_previewing = false;
+    }
+}
+
+// Highlight what a :s command will replace, as its pattern is typed
+void ZepMode_Vim::PreviewSubstitute(const std::string& command)
+{
+    SubstituteCommand substitute;
+    if (ParseSubstitute(command, substitute))
+    {
+        auto& pattern = substitute.pattern;
+        if (!m_previewing)
+        {
+            m_highlightBefore = GetEditor().GetHighlightPattern();
+            m_previewing = true;
+        }
+        GetEditor().SetHighlightPattern(pattern.empty() ? m_highlightBefore : pattern);
+    }
+    else if (m_previewing)
+    {
+        GetEditor().SetHighlightPattern(m_highlightBefore);
+        m_previewing = false;
+    }
+}
+
+// The lines of a :range, from 0: %, or one or two (between a comma) of ., $, a number, '< or '>, each with any +N
+// or -N after it.  The cursor line if there's no range
+bool ZepMode_Vim::GetLineRange(const std::string& range, long& firstLine, long& lastLine) const
+{
+    auto pBuffer = m_pCurrentWindow->GetCurrentBuffer();
+    auto current = pBuffer->LineFromOffset(m_pCurrentWindow->DisplayToBuffer());
+
+    // The buffer ends in an empty line when its text ends in a line break; $ is the one before it
+    auto& lineEnds = pBuffer->GetLineEnds();
+    auto lastBufferLine = long(lineEnds.size()) - 1;
+    if (lastBufferLine > 0 && lineEnds[lastBufferLine - 1] == lineEnds[lastBufferLine] - 1)
+    {
+        lastBufferLine--;
+    }
+
+    if (range == "%")
+    {
+        firstLine = 0;
+        lastLine = lastBufferLine;
+        return true;
+    }
+
+    auto getNumber = [&](size_t& pos)
+    {
+        long number = 0;
+        for (; pos < range.size() && std::isdigit(uint8_t(range[pos])); pos++)
+        {
+            number = std::min(number * 10 + (range[pos] - '0'), long(INT32_MAX));
+        }
+        return number;
+    };
+
+    long lines[2] = { current, current };
+    size_t pos = 0;
+    for (auto& line : lines)
+    {
+        line = current;
+        if (pos < range.size())
+        {
+            auto ch = range[pos];
+            if (ch == '.')
+            {
+                pos++;
+            }
+            else if (ch == '$')
+            {
+                line = lastBufferLine;
+                pos++;
+            }
+            else if (std::isdigit(uint8_t(ch)))
+            {
+                line = getNumber(pos) - 1;
+            }
+            else if (ch == '\'' && pos + 1 < range.size() && (range[pos + 1] == '<' || range[pos + 1] == '>'))
+            {
+                line = pBuffer->LineFromOffset(range[pos + 1] == '<' ? m_visualBegin : m_visualEnd);
+                pos += 2;
+            }
+        }
+
+        while (pos < range.size() && (range[pos] == '+' || range[pos] == '-'))
+        {
+            auto sign = range[pos++] == '+' ? 1 : -1;
+            auto start = pos;
+            auto number = getNumber(pos);
+            line += sign * (pos == start ? 1 : number);
+        }
+
+        // After a ; the second line is from the first, not the cursor
+        if (&line == &lines[0])
+        {
+            lines[1] = line;
+            if (pos == range.size() || (range[pos] != ',' && range[pos] != ';'))
+            {
+                break;
+            }
+            if (range[pos++] == ';')
+            {
+                current = line;
+            }
+        }
+    }
+
+    if (pos != range.size())
+    {
+        return false;
+    }
+    firstLine = std::min(lines[0], lines[1]);
+    lastLine = std::max(lines[0], lines[1]);
+    return firstLine >= 0 && lastLine <= lastBufferLine;
+}
+
+// :[range]s/pattern/replacement/flags.  The lines' new text is built with every replacement made, then swapped in as
+// one command: one undo, and one change for the line index, the syntax and the search to catch up with
+bool ZepMode_Vim::Substitute(const std::string& command)
+{
+    SubstituteCommand substitute;
+    if (!ParseSubstitute(command, substitute))
+    {
+        return false;
+    }
+
+    auto& display = m_pCurrentWindow->GetDisplay();
+    auto pBuffer = m_pCurrentWindow->GetCurrentBuffer();
+    long firstLine;
+    long lastLine;
+    if (!GetLineRange(substitute.range, firstLine, lastLine))
+    {
+        display.SetCommandText("Invalid range");
+        return true;
+    }
+
+    // g: every match on a line; n: just count them; i, I: ignore case, or don't, whatever the options say; e: no error
+    // if nothing matches
+    uint32_t flags = SubstituteFlags::None;
+    uint32_t regexFlags = GetEditor().GetSearchFlags();
+    bool reportNotFound = true;
+    for (auto ch : substitute.flags)
+    {
+        switch (ch)
+        {
+        case 'g':
+            flags |= SubstituteFlags::Global;
+            break;
+        case 'n':
+            flags |= SubstituteFlags::CountOnly;
+            break;
+        case 'i':
+            regexFlags = RegexFlags::IgnoreCase;
+            break;
+        case 'I':
+            regexFlags = RegexFlags::None;
+            break;
+        case 'e':
+            reportNotFound = false;
+            break;
+        default:
+            display.SetCommandText("Trailing characters");
+            return true;
+        }
+    }
+
+    // An empty pattern is the last one searched for
+    auto pattern = substitute.pattern.empty() ? m_lastSearch : substitute.pattern;
+    ZepRegex regex;
+    if (pattern.empty() || !regex.Compile(pattern, regexFlags))
+    {
+        display.SetCommandText(pattern.empty() ? "No previous regular expression" : regex.GetError());
+        return true;
+    }
+    if (pBuffer->IsReadOnly() && !(flags & SubstituteFlags::CountOnly))
+    {
+        display.SetCommandText("Buffer is read only");
+        return true;
+    }
+
+    // ~ is the last replacement
+    std::string replacement;
+    auto& typed = substitute.replacement;
+    for (size_t i = 0; i < typed.size(); i++)
+    {
+        if (typed[i] == '~')
+        {
+            replacement += m_lastReplacement;
+            continue;
+        }
+        if (typed[i] == '\\' && i + 1 < typed.size())
+        {
+            replacement += typed[i++];
+        }
+        replacement += typed[i];
+    }
+
+    // The pattern stays highlighted, as a search's would
+    m_lastSearch = pattern;
+    m_highlightBefore = pattern;
+    GetEditor().SetHighlightPattern(pattern);
+
+    Substitution result;
+    if (!BuildSubstitution(regex, pBuffer->GetText(), pBuffer->GetLineEnds(), firstLine, lastLine, replacement, flags, result))
+    {
+        if (reportNotFound)
+        {
+            display.SetCommandText("Pattern not found: " + pattern);
+        }
+        return true;
+    }
+
+    std::ostringstream str;
+    if (flags & SubstituteFlags::CountOnly)
+    {
+        str << result.count << (result.count == 1 ? " match" : " matches") << " on " << result.lines << (result.lines == 1 ? " line" : " lines");
+        display.SetCommandText(str.str());
+        return true;
+    }
+    m_lastReplacement = replacement;
+
+    // The cursor goes to the last line with a replacement on it, and goes back there for a redo
+    auto spCommand = std::make_shared<ZepCommand_ReplaceRange>(*pBuffer, result.start, result.end, std::move(result.text));
+    AddCommand(spCommand);
+    auto cursor = pBuffer->GetLinePos(pBuffer->LineFromOffset(result.last), LineLocation::LineFirstGraphChar);
+    spCommand->m_cursorAfter = cursor;
+    m_pCurrentWindow->MoveCursorTo(cursor);
+
+    if (result.lines > 2)
+    {
+        str << result.count << (result.count == 1 ? " substitution" : " substitutions") << " on " << result.lines << " lines";
+        display.SetCommandText(str.str());
+    }
+    return true;
 }
 
 void ZepMode_Vim::SwitchMode(EditorMode mode)
@@ -197,7 +532,60 @@ void ZepMode_Vim::SwitchMode(EditorMode mode)
     }
 }
 
-bool ZepMode_Vim::GetBlockOpRange(const std::string& op, EditorMode mode, BufferLocation& beginRange, BufferLocation& endRange, BufferLocation& cursorAfter) const
+// The open bracket of the kind a text object names: ( ) b, [ ], { } B; 0 for any other
+static utf8 BlockOpen(char ch)
+{
+    switch (ch)
+    {
+    case '(':
+    case ')':
+    case 'b':
+        return '(';
+    case '[':
+    case ']':
+        return '[';
+    case '{':
+    case '}':
+    case 'B':
+        return '{';
+    default:
+        return 0;
+    }
+}
+
+// f, F, t and T, which find a character on the line
+static bool IsFind(char ch)
+{
+    return ch == 'f' || ch == 'F' || ch == 't' || ch == 'T';
+}
+
+// Where a find ("tx" and so on) lands from the location, count times over; InvalidOffset if the line runs out first.
+// Repeated by ; or , a t or T doesn't stick against the character it stopped in front of last time
+BufferLocation ZepMode_Vim::FindChar(const std::string& find, BufferLocation from, int count, bool repeat) const
+{
+    auto pBuffer = m_pCurrentWindow->m_pCurrentBuffer;
+    auto& text = pBuffer->GetText();
+    auto forward = find[0] == 'f' || find[0] == 't';
+    auto till = find[0] == 't' || find[0] == 'T';
+    auto step = forward ? 1 : -1;
+    auto ch = utf8(find[1]);
+
+    auto start = from;
+    auto next = from + step;
+    if (till && repeat && ch != '\n' && next >= 0 && next < long(text.size()) && text[next] == ch)
+    {
+        start = next;
+    }
+
+    auto found = pBuffer->FindOnLine(ch, start, forward ? SearchDirection::Forward : SearchDirection::Backward, count);
+    if (found == InvalidOffset)
+    {
+        return InvalidOffset;
+    }
+    return till ? found - step : found;
+}
+
+bool ZepMode_Vim::GetBlockOpRange(const std::string& op, EditorMode mode, BufferLocation& beginRange, BufferLocation& endRange, BufferLocation& cursorAfter, int count) const
 {
     auto pBuffer = m_pCurrentWindow->m_pCurrentBuffer;
     const auto cursor = m_pCurrentWindow->GetCursor();
@@ -237,34 +625,21 @@ bool ZepMode_Vim::GetBlockOpRange(const std::string& op, EditorMode mode, Buffer
             cursorAfter = beginRange;
         }
     }
-    else if (op == "w")
-    {
-        auto block = pBuffer->GetBlock(SearchType::AlphaNumeric | SearchType::Word, bufferCursor, SearchDirection::Forward);
-        beginRange = block.blockSearchPos;
-        endRange = WordMotion(block);
-        cursorAfter = beginRange;
-    }
-    else if (op == "cw")
+    else if (op == "w" || op == "W")
     {
-        // Change word doesn't extend over the next space
-        auto block = pBuffer->GetBlock(SearchType::AlphaNumeric | SearchType::Word, bufferCursor, SearchDirection::Forward);
-        beginRange = block.blockSearchPos;
-        endRange = ToEndOfFirstWordOrSpace(block);
+        // To the start of the count'th word on
+        auto searchType = op == "w" ? SearchType::AlphaNumeric | SearchType::Word : SearchType::Word;
+        beginRange = bufferCursor;
+        endRange = CountedMotion(*pBuffer, searchType, SearchDirection::Forward, bufferCursor, count, WordMotion);
         cursorAfter = beginRange;
     }
-    else if (op == "cW")
+    else if (op == "cw" || op == "cW")
     {
         // Change word doesn't extend over the next space
-        auto block = pBuffer->GetBlock(SearchType::Word, bufferCursor, SearchDirection::Forward);
-        beginRange = block.blockSearchPos;
-        endRange = ToEndOfFirstWordOrSpace(block);
-        cursorAfter = beginRange;
-    }
-    else if (op == "W")
-    {
-        auto block = pBuffer->GetBlock(SearchType::Word, bufferCursor, SearchDirection::Forward);
-        beginRange = block.blockSearchPos;
-        endRange = WordMotion(block);
+        auto searchType = op == "cw" ? SearchType::AlphaNumeric | SearchType::Word : SearchType::Word;
+        auto lastWord = CountedMotion(*pBuffer, searchType, SearchDirection::Forward, bufferCursor, count - 1, WordMotion);
+        beginRange = bufferCursor;
+        endRange = CountedMotion(*pBuffer, searchType, SearchDirection::Forward, lastWord, 1, ToEndOfFirstWordOrSpace);
         cursorAfter = beginRange;
     }
     else if (op == "aw")
@@ -295,6 +670,78 @@ bool ZepMode_Vim::GetBlockOpRange(const std::string& op, EditorMode mode, Buffer
         endRange = InnerWord(block).second;
         cursorAfter = beginRange;
     }
+    else if (op == "%")
+    {
+        // To the partner of the bracket under the cursor (or the next one on the line), both ends included
+        if (pLineInfo)
+        {
+            auto& brackets = pBuffer->GetBrackets();
+            auto bracket = brackets.FindNext(bufferCursor, pBuffer->GetLinePos(pLineInfo->lineNumber, LineLocation::LineCRBegin));
+            auto match = bracket == -1 ? -1 : brackets.FindMatch(bracket);
+            if (match != -1)
+            {
+                beginRange = std::min(bufferCursor, match);
+                endRange = std::max(bufferCursor, match) + 1;
+                cursorAfter = beginRange;
+            }
+        }
+    }
+    else if (op.size() == 2 && (op[0] == 'i' || op[0] == 'a') && BlockOpen(op[1]))
+    {
+        // The pair the cursor is on, or else the innermost one around it
+        auto open = BlockOpen(op[1]);
+        auto& brackets = pBuffer->GetBrackets();
+        auto& text = pBuffer->GetText();
+        auto close = open == '(' ? ')' : (open == '[' ? ']' : '}');
+        auto begin = (text[bufferCursor] == open || text[bufferCursor] == close) ? brackets.FindMatch(bufferCursor) : -1;
+        auto end = bufferCursor;
+        if (begin == -1)
+        {
+            begin = brackets.FindEnclosing(bufferCursor, open);
+            end = begin == -1 ? -1 : brackets.FindMatch(begin);
+        }
+        if (begin > end)
+        {
+            std::swap(begin, end);
+        }
+
+        if (begin != -1)
+        {
+            if (op[0] == 'a')
+            {
+                beginRange = begin;
+                endRange = end + 1;
+            }
+            else
+            {
+                // Like Vim, the lines inside a block that spans them keep the line breaks around them
+                beginRange = begin + 1;
+                endRange = end;
+                if (text[beginRange] == '\n' && beginRange < endRange)
+                {
+                    beginRange++;
+                }
+                auto lineBegin = pBuffer->GetLinePos(pBuffer->LineFromOffset(end), LineLocation::LineBegin);
+                if (lineBegin > beginRange && std::all_of(text.begin() + lineBegin, text.begin() + end, [](utf8 c) { return c == ' ' || c == '\t'; }))
+                {
+                    endRange = lineBegin;
+                }
+            }
+            cursorAfter = beginRange;
+        }
+    }
+    else if (op.size() == 2 && IsFind(op[0]))
+    {
+        // f and t take in the character they land on; F and T leave out the one under the cursor
+        auto location = FindChar(op, bufferCursor, count, false);
+        auto forward = op[0] == 'f' || op[0] == 't';
+        if (location != InvalidOffset && (forward || location < bufferCursor))
+        {
+            beginRange = forward ? bufferCursor : location;
+            endRange = forward ? location + 1 : bufferCursor;
+            cursorAfter = beginRange;
+        }
+    }
     else if (op == "cursor")
     {
         beginRange = bufferCursor;
@@ -326,7 +773,8 @@ bool ZepMode_Vim::GetCommand(std::string command, uint32_t lastKey, uint32_t mod
     BufferLocation beginRange{ -1 };
     BufferLocation endRange{ -1 };
     BufferLocation cursorAfter{ -1 };
-    std::stack<char> registers;
+    // A string is the stack storage, so the handful of registers never leave the small string buffer
+    std::stack<char, std::string> registers;
     registers.push('"');
     CommandOperation op = CommandOperation::None;
     Register tempReg("", false);
@@ -341,7 +789,7 @@ bool ZepMode_Vim::GetCommand(std::string command, uint32_t lastKey, uint32_t mod
         // Null register
         if (command[1] == '_')
         {
-            std::stack<char> temp;
+            std::stack<char, std::string> temp;
             registers.swap(temp);
         }
         else
@@ -411,7 +859,13 @@ bool ZepMode_Vim::GetCommand(std::string command, uint32_t lastKey, uint32_t mod
     }
     else if (command == "G")
     {
-        if (count != 1)
+        if (pBuffer->IsPaged() || pBuffer->IsBinary())
+        {
+            // Lines of the file, not of the window onto it that the buffer holds
+            m_pCurrentWindow->MoveCursorToFileLine(count != 1 ? count : pBuffer->GetFileLineCount() - 1);
+            commandResult.flags |= CommandResultFlags::HandledCount;
+        }
+        else if (count != 1)
         {
             // Goto line
             m_pCurrentWindow->MoveCursorTo(pBuffer->GetLinePos(count, LineLocation::LineBegin));
@@ -424,6 +878,144 @@ bool ZepMode_Vim::GetCommand(std::string command, uint32_t lastKey, uint32_t mod
         }
         return true;
     }
+    else if (command == "%" && count != 1)
+    {
+        // N% goes N percent of the way through the file's lines, rounding up as Vim does; past 100 is refused
+        if (count <= 100)
+        {
+            auto lines = pBuffer->GetFileLineCount();
+            if (pBuffer->IsPaged() || pBuffer->IsBinary())
+            {
+                m_pCurrentWindow->MoveCursorToFileLine((long(count) * lines + 99) / 100 - 1);
+            }
+            else
+            {
+                // Not the empty line after a final line end
+                if (lines > 1 && pBuffer->GetLinePos(lines - 1, LineLocation::LineBegin) == pBuffer->EndLocation())
+                {
+                    lines--;
+                }
+                auto line = (long(count) * lines + 99) / 100 - 1;
+                m_pCurrentWindow->MoveCursorTo(pBuffer->GetLinePos(line, LineLocation::LineFirstGraphChar));
+            }
+        }
+        commandResult.flags |= CommandResultFlags::HandledCount;
+        return true;
+    }
+    else if (command == "%")
+    {
+        // The bracket under the cursor, or the next one on the line, to its partner
+        auto& brackets = pBuffer->GetBrackets();
+        auto bracket = brackets.FindNext(bufferCursor, pBuffer->GetLinePos(pLineInfo->lineNumber, LineLocation::LineCRBegin));
+        auto match = bracket == -1 ? -1 : brackets.FindMatch(bracket);
+        if (match != -1)
+        {
+            m_pCurrentWindow->MoveCursorTo(match);
+        }
+        commandResult.flags |= CommandResultFlags::HandledCount;
+        return true;
+    }
+    else if (command[0] == '[' || command[0] == ']')
+    {
+        // Out to the count'th unmatched bracket around the cursor: [( and [{ to the open one, ]) and ]} to the close
+        if (command.size() == 1)
+        {
+            return false;
+        }
+        auto open = command == "[(" || command == "])" ? '(' : (command == "[{" || command == "]}" ? '{' : 0);
+        if (open == 0)
+        {
+            ResetCommand();
+            return true;
+        }
+
+        // On a close bracket, ]) and ]} look from just past it; the pair it closes is inside the one they go to
+        auto& brackets = pBuffer->GetBrackets();
+        auto start = bufferCursor;
+        auto close = open == '(' ? ')' : '}';
+        if (command[0] == ']' && pBuffer->GetText()[start] == utf8(close))
+        {
+            start++;
+        }
+        auto location = start;
+        for (int i = 0; i < count; i++)
+        {
+            auto enclosing = brackets.FindEnclosing(location, utf8(open));
+            if (enclosing == -1)
+            {
+                break;
+            }
+            location = enclosing;
+        }
+        if (location == start)
+        {
+            location = -1;
+        }
+        else if (command[0] == ']')
+        {
+            location = brackets.FindMatch(location);
+        }
+        if (location != -1)
+        {
+            m_pCurrentWindow->MoveCursorTo(location);
+        }
+        commandResult.flags |= CommandResultFlags::HandledCount;
+        return true;
+    }
+    else if (IsFind(command[0]) || command == ";" || command == ",")
+    {
+        // To the count'th character on the line; ; repeats the last find, and , repeats it the other way
+        if (command.size() == 1 && IsFind(command[0]))
+        {
+            return false;
+        }
+
+        auto find = command;
+        if (command == ";" || command == ",")
+        {
+            find = m_lastFind;
+            if (command == "," && !find.empty())
+            {
+                find[0] = char(std::isupper(find[0]) ? std::tolower(find[0]) : std::toupper(find[0]));
+            }
+        }
+        else
+        {
+            m_lastFind = command;
+        }
+
+        auto location = find.empty() ? InvalidOffset : FindChar(find, bufferCursor, count, find != command);
+        if (location != InvalidOffset)
+        {
+            m_pCurrentWindow->MoveCursorTo(location);
+        }
+        commandResult.flags |= CommandResultFlags::HandledCount;
+        return true;
+    }
+    else if (command == "n" || command == "N")
+    {
+        // Search again, the same way as the last search or the other way
+        if (m_lastSearch.empty())
+        {
+            m_pCurrentWindow->GetDisplay().SetCommandText("No previous pattern");
+            return true;
+        }
+
+        auto forward = (command == "n") == (m_lastSearchDirection == SearchDirection::Forward);
+        auto location = bufferCursor;
+        for (int i = 0; i < count; i++)
+        {
+            if (!SearchNext(m_lastSearch, location, forward ? SearchDirection::Forward : SearchDirection::Backward, location))
+            {
+                m_pCurrentWindow->GetDisplay().SetCommandText("Pattern not found: " + m_lastSearch);
+                return true;
+            }
+        }
+        m_pCurrentWindow->GetDisplay().SetCommandText((forward ? "/" : "?") + m_lastSearch);
+        m_pCurrentWindow->MoveCursorTo(location);
+        commandResult.flags |= CommandResultFlags::HandledCount;
+        return true;
+    }
     else if (lastKey == ExtKeys::BACKSPACE)
     {
         auto loc = bufferCursor;
@@ -446,55 +1038,55 @@ bool ZepMode_Vim::GetCommand(std::string command, uint32_t lastKey, uint32_t mod
     }
     else if (command == "w")
     {
-        auto block = pBuffer->GetBlock(SearchType::AlphaNumeric | SearchType::Word, bufferCursor, SearchDirection::Forward);
-        m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(WordMotion(block)));
+        m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(CountedMotion(*pBuffer, SearchType::AlphaNumeric | SearchType::Word, SearchDirection::Forward, bufferCursor, count, WordMotion)));
+        commandResult.flags |= CommandResultFlags::HandledCount;
         return true;
     }
     else if (command == "W")
     {
-        auto block = pBuffer->GetBlock(SearchType::Word, bufferCursor, SearchDirection::Forward);
-        m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(WordMotion(block)));
+        m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(CountedMotion(*pBuffer, SearchType::Word, SearchDirection::Forward, bufferCursor, count, WordMotion)));
+        commandResult.flags |= CommandResultFlags::HandledCount;
         return true;
     }
     else if (command == "b")
     {
-        auto block = pBuffer->GetBlock(SearchType::AlphaNumeric | SearchType::Word, bufferCursor, SearchDirection::Backward);
-        m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(WordMotion(block)));
+        m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(CountedMotion(*pBuffer, SearchType::AlphaNumeric | SearchType::Word, SearchDirection::Backward, bufferCursor, count, WordMotion)));
+        commandResult.flags |= CommandResultFlags::HandledCount;
         return true;
     }
     else if (command == "B")
     {
-        auto block = pBuffer->GetBlock(SearchType::Word, bufferCursor, SearchDirection::Backward);
-        m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(WordMotion(block)));
+        m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(CountedMotion(*pBuffer, SearchType::Word, SearchDirection::Backward, bufferCursor, count, WordMotion)));
+        commandResult.flags |= CommandResultFlags::HandledCount;
         return true;
     }
     else if (command == "e")
     {
-        auto block = pBuffer->GetBlock(SearchType::AlphaNumeric | SearchType::Word, bufferCursor, SearchDirection::Forward);
-        m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(WordEndMotion(block)));
+        m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(CountedMotion(*pBuffer, SearchType::AlphaNumeric | SearchType::Word, SearchDirection::Forward, bufferCursor, count, WordEndMotion)));
+        commandResult.flags |= CommandResultFlags::HandledCount;
         return true;
     }
     else if (command == "E")
     {
-        auto block = pBuffer->GetBlock(SearchType::Word, bufferCursor, SearchDirection::Forward);
-        m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(WordEndMotion(block)));
+        m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(CountedMotion(*pBuffer, SearchType::Word, SearchDirection::Forward, bufferCursor, count, WordEndMotion)));
+        commandResult.flags |= CommandResultFlags::HandledCount;
         return true;
     }
     else if (command[0] == 'g')
     {
         if (command == "ge")
         {
-            auto block = pBuffer->GetBlock(SearchType::AlphaNumeric | SearchType::Word, bufferCursor, SearchDirection::Backward);
-            m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(WordEndMotion(block)));
+            m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(CountedMotion(*pBuffer, SearchType::AlphaNumeric | SearchType::Word, SearchDirection::Backward, bufferCursor, count, WordEndMotion)));
+            commandResult.flags |= CommandResultFlags::HandledCount;
         }
         else if (command == "gE")
         {
-            auto block = pBuffer->GetBlock(SearchType::Word, bufferCursor, SearchDirection::Backward);
-            m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(WordEndMotion(block)));
+            m_pCurrentWindow->SetCursor(m_pCurrentWindow->BufferToDisplay(CountedMotion(*pBuffer, SearchType::Word, SearchDirection::Backward, bufferCursor, count, WordEndMotion)));
+            commandResult.flags |= CommandResultFlags::HandledCount;
         }
         else if (command == "gg")
         {
-            m_pCurrentWindow->MoveCursorTo(BufferLocation{ 0 });
+            m_pCurrentWindow->MoveCursorToFileLine(0);
         }
         else
         {
@@ -612,16 +1204,18 @@ bool ZepMode_Vim::GetCommand(std::string command, uint32_t lastKey, uint32_t mod
         }
         else if (command == "dw")
         {
-            if (GetBlockOpRange("w", mode, beginRange, endRange, cursorAfter))
+            if (GetBlockOpRange("w", mode, beginRange, endRange, cursorAfter, count))
             {
                 op = CommandOperation::Delete;
+                commandResult.flags |= CommandResultFlags::HandledCount;
             }
         }
         else if (command == "dW")
         {
-            if (GetBlockOpRange("W", mode, beginRange, endRange, cursorAfter))
+            if (GetBlockOpRange("W", mode, beginRange, endRange, cursorAfter, count))
             {
                 op = CommandOperation::Delete;
+                commandResult.flags |= CommandResultFlags::HandledCount;
             }
         }
         else if (command == "daw")
@@ -652,6 +1246,41 @@ bool ZepMode_Vim::GetCommand(std::string command, uint32_t lastKey, uint32_t mod
                 op = CommandOperation::Delete;
             }
         }
+        else if (command == "d%")
+        {
+            if (GetBlockOpRange("%", mode, beginRange, endRange, cursorAfter))
+            {
+                op = CommandOperation::Delete;
+            }
+            else
+            {
+                ResetCommand();
+            }
+        }
+        else if (command.size() == 3 && (command[1] == 'i' || command[1] == 'a'))
+        {
+            if (GetBlockOpRange(command.substr(1), mode, beginRange, endRange, cursorAfter))
+            {
+                op = CommandOperation::Delete;
+            }
+            else
+            {
+                ResetCommand();
+            }
+        }
+        else if (command.size() == 3 && IsFind(command[1]))
+        {
+            m_lastFind = command.substr(1);
+            if (GetBlockOpRange(m_lastFind, mode, beginRange, endRange, cursorAfter, count))
+            {
+                op = CommandOperation::Delete;
+                commandResult.flags |= CommandResultFlags::HandledCount;
+            }
+            else
+            {
+                ResetCommand();
+            }
+        }
     }
     // Substitute
     else if ((command[0] == 's') ||
@@ -715,16 +1344,18 @@ bool ZepMode_Vim::GetCommand(std::string command, uint32_t lastKey, uint32_t mod
         }
         else if (command == "cw")
         {
-            if (GetBlockOpRange("cw", mode, beginRange, endRange, cursorAfter))
+            if (GetBlockOpRange("cw", mode, beginRange, endRange, cursorAfter, count))
             {
                 op = CommandOperation::Delete;
+                commandResult.flags |= CommandResultFlags::HandledCount;
             }
         }
         else if (command == "cW")
         {
-            if (GetBlockOpRange("cW", mode, beginRange, endRange, cursorAfter))
+            if (GetBlockOpRange("cW", mode, beginRange, endRange, cursorAfter, count))
             {
                 op = CommandOperation::Delete;
+                commandResult.flags |= CommandResultFlags::HandledCount;
             }
         }
         else if (command == "caw")
@@ -755,6 +1386,41 @@ bool ZepMode_Vim::GetCommand(std::string command, uint32_t lastKey, uint32_t mod
                 op = CommandOperation::Delete;
             }
         }
+        else if (command == "c%")
+        {
+            if (GetBlockOpRange("%", mode, beginRange, endRange, cursorAfter))
+            {
+                op = CommandOperation::Delete;
+            }
+            else
+            {
+                ResetCommand();
+            }
+        }
+        else if (command.size() == 3 && (command[1] == 'i' || command[1] == 'a'))
+        {
+            if (GetBlockOpRange(command.substr(1), mode, beginRange, endRange, cursorAfter))
+            {
+                op = CommandOperation::Delete;
+            }
+            else
+            {
+                ResetCommand();
+            }
+        }
+        else if (command.size() == 3 && IsFind(command[1]))
+        {
+            m_lastFind = command.substr(1);
+            if (GetBlockOpRange(m_lastFind, mode, beginRange, endRange, cursorAfter, count))
+            {
+                op = CommandOperation::Delete;
+                commandResult.flags |= CommandResultFlags::HandledCount;
+            }
+            else
+            {
+                ResetCommand();
+            }
+        }
 
         if (op != CommandOperation::None)
         {
@@ -848,6 +1514,12 @@ bool ZepMode_Vim::GetCommand(std::string command, uint32_t lastKey, uint32_t mod
         Redo();
         return true;
     }
+    else if (command.size() == 2 && command[0] == 'r' && pBuffer->IsBinary())
+    {
+        // Overwrite the digit (or character) under the cursor
+        pBuffer->OverwriteBinary(bufferCursor, command[1]);
+        return true;
+    }
     else if (command == "i")
     {
         commandResult.modeSwitch = EditorMode::Insert;
@@ -880,43 +1552,262 @@ bool ZepMode_Vim::GetCommand(std::string command, uint32_t lastKey, uint32_t mod
         {
             if (command == ":reg")
             {
-                std::ostringstream str;
-                str << "--- Registers ---" << '\n';
-                for (auto& reg : GetEditor().GetRegisters())
+                std::ostringstream str;
+                str << "--- Registers ---" << '\n';
+                for (auto& reg : GetEditor().GetRegisters())
+                {
+                    if (!reg.second.text.empty())
+                    {
+                        std::string displayText = reg.second.text;
+                        displayText = StringUtils::ReplaceString(displayText, "\n", "^J");
+                        str << "\"" << reg.first << "   " << displayText << '\n';
+                    }
+                }
+                m_pCurrentWindow->GetDisplay().SetCommandText(str.str());
+                return true;
+            }
+            else if (command == ":ls")
+            {
+                std::ostringstream str;
+                str << "--- Buffers ---" << '\n';
+                int index = 0;
+                for (auto& buffer : GetEditor().GetBuffers())
+                {
+                    if (!buffer->GetName().empty())
+                    {
+                        std::string displayText = buffer->GetName();
+                        displayText = StringUtils::ReplaceString(displayText, "\n", "^J");
+                        if (pBuffer == buffer.get())
+                        {
+                            str << "*";
+                        }
+                        else
+                        {
+                            str << " ";
+                        }
+                        str << index++ << " : " << displayText << '\n';
+                    }
+                }
+                m_pCurrentWindow->GetDisplay().SetCommandText(str.str());
+                return true;
+            }
+            else if (command == ":mem")
+            {
+                auto toKb = [](size_t bytes) { return std::to_string((bytes + 1023) / 1024) + "K"; };
+
+                std::ostringstream str;
+                str << "--- Memory ---" << '\n';
+                size_t total = 0;
+                for (auto& buffer : GetEditor().GetBuffers())
+                {
+                    auto mem = GetEditor().GetMemoryUsage(*buffer);
+                    total += mem.Total();
+                    str << (pBuffer == buffer.get() ? "*" : " ") << buffer->GetName()
+                        << " : text " << toKb(mem.text)
+                        << ", gap " << toKb(mem.gap)
+                        << ", lines " << toKb(mem.lineEnds)
+                        << ", syntax " << toKb(mem.syntax)
+                        << ", undo " << toKb(mem.undo)
+                        << (mem.pages ? ", pages " + toKb(mem.pages) : std::string())
+                        << (mem.index ? ", index " + toKb(mem.index) : std::string())
+                        << (mem.brackets ? ", brackets " + toKb(mem.brackets) : std::string())
+                        << ", total " << toKb(mem.Total()) << '\n';
+                }
+                auto registerSize = GetEditor().GetRegisterMemoryUsage();
+                total += registerSize;
+                str << "Registers : " << toKb(registerSize) << '\n';
+                str << "Total : " << toKb(total) << '\n';
+                m_pCurrentWindow->GetDisplay().SetCommandText(str.str());
+                return true;
+            }
+            else if (command == ":w")
+            {
+                if (!pBuffer->SaveAsync())
+                {
+                    m_pCurrentWindow->GetDisplay().SetCommandText(pBuffer->IsReadOnly() ? "Buffer is read only" : "No file name");
+                }
+                return true;
+            }
+            else if (command == ":e!")
+            {
+                if (!pBuffer->ReloadChanges())
+                {
+                    m_pCurrentWindow->GetDisplay().SetCommandText("Can't reload \"" + pBuffer->GetFilePath() + "\"");
+                }
+                return true;
+            }
+            else if (command == ":rec" || command == ":recover")
+            {
+                if (!pBuffer->RecoverJournal())
+                {
+                    m_pCurrentWindow->GetDisplay().SetCommandText("No journal to recover for \"" + pBuffer->GetFilePath() + "\"");
+                }
+                return true;
+            }
+            else if (command.find(":diffs") == 0)
+            {
+                // Against the named file, or against this buffer's file as it is on disk
+                auto strTok = StringUtils::Split(command, " ");
+                auto path = strTok.size() > 1 ? strTok[1] : pBuffer->GetFilePath();
+                if (path.empty() || !FileUtils::Exists(path))
+                {
+                    m_pCurrentWindow->GetDisplay().SetCommandText("Can't read \"" + path + "\"");
+                    return true;
+                }
+
+                // The file is read into a temporary buffer of its own, which goes when the diff does
+                auto pOther = GetEditor().AddBuffer(strTok.size() > 1 ? path : pBuffer->GetName());
+                if (!pOther->Load(path))
+                {
+                    GetEditor().RemoveBuffer(pOther);
+                    m_pCurrentWindow->GetDisplay().SetCommandText("Can't read \"" + path + "\"");
+                    return true;
+                }
+                pOther->SetTemporary();
+
+                if (strTok.size() > 1)
+                {
+                    m_pCurrentWindow->GetDisplay().ShowDiff(pBuffer, pOther, pOther);
+                }
+                else
+                {
+                    m_pCurrentWindow->GetDisplay().ShowDiff(pOther, pBuffer, pOther);
+                }
+                return true;
+            }
+            else if (command == ":hex" || command == ":hex!")
+            {
+                // The hex view replaces the text, so unsaved changes need a !
+                if (command == ":hex" && pBuffer->IsDirty())
                 {
-                    if (!reg.second.text.empty())
+                    m_pCurrentWindow->GetDisplay().SetCommandText("No write since last change (add ! to override)");
+                }
+                else if (pBuffer->GetFilePath().empty() || !pBuffer->OpenBinary(pBuffer->GetFilePath(), ZepBinaryFile::DefaultMemoryBudget))
+                {
+                    m_pCurrentWindow->GetDisplay().SetCommandText("Can't read \"" + pBuffer->GetFilePath() + "\"");
+                }
+                return true;
+            }
+            else if (command.find(":hexfind ") == 0 || command.find(":hexfind! ") == 0)
+            {
+                // Hex digits, spaces ignored; ! searches backwards
+                std::vector<uint8_t> bytes;
+                std::string digits;
+                for (auto ch : command.substr(command.find(' ')))
+                {
+                    if (std::isxdigit(uint8_t(ch)))
                     {
-                        std::string displayText = reg.second.text;
-                        displayText = StringUtils::ReplaceString(displayText, "\n", "^J");
-                        str << "\"" << reg.first << "   " << displayText << '\n';
+                        digits.push_back(ch);
                     }
                 }
-                m_pCurrentWindow->GetDisplay().SetCommandText(str.str());
+                for (size_t i = 0; i + 1 < digits.size(); i += 2)
+                {
+                    bytes.push_back(uint8_t(std::stoi(digits.substr(i, 2), nullptr, 16)));
+                }
+
+                auto dir = command[8] == '!' ? SearchDirection::Backward : SearchDirection::Forward;
+                auto found = pBuffer->FindBinary(bytes, bufferCursor, dir);
+                if (found == -1)
+                {
+                    m_pCurrentWindow->GetDisplay().SetCommandText("Not found");
+                }
+                else
+                {
+                    m_pCurrentWindow->ScrollToLine(pBuffer->LineFromOffset(found));
+                    m_pCurrentWindow->MoveCursorTo(found);
+                }
                 return true;
             }
-            else if (command == ":ls")
+            else if (command == ":diffoff")
             {
-                std::ostringstream str;
-                str << "--- Buffers ---" << '\n';
-                int index = 0;
-                for (auto& buffer : GetEditor().GetBuffers())
+                m_pCurrentWindow->GetDisplay().CloseDiff();
+                return true;
+            }
+            else if (command.size() > 1 && command.find_first_not_of("0123456789", 1) == std::string::npos)
+            {
+                // :N goes to line N of the file
+                m_pCurrentWindow->MoveCursorToFileLine(std::strtol(command.c_str() + 1, nullptr, 10) - 1);
+                return true;
+            }
+            else if (command == ":noh" || command == ":nohlsearch")
+            {
+                GetEditor().SetHighlightPattern("");
+                return true;
+            }
+            else if (command.find(":set ") == 0)
+            {
+                // The search options, by their long or short names: [no]ignorecase, [no]smartcase
+                auto flags = GetEditor().GetSearchFlags();
+                for (auto& option : StringUtils::Split(command.substr(5), " "))
                 {
-                    if (!buffer->GetName().empty())
+                    if (option == "ignorecase" || option == "ic")
                     {
-                        std::string displayText = buffer->GetName();
-                        displayText = StringUtils::ReplaceString(displayText, "\n", "^J");
-                        if (pBuffer == buffer.get())
-                        {
-                            str << "*";
-                        }
-                        else
-                        {
-                            str << " ";
-                        }
-                        str << index++ << " : " << displayText << '\n';
+                        flags |= RegexFlags::IgnoreCase;
+                    }
+                    else if (option == "noignorecase" || option == "noic")
+                    {
+                        flags &= ~RegexFlags::IgnoreCase;
+                    }
+                    else if (option == "smartcase" || option == "scs")
+                    {
+                        flags |= RegexFlags::SmartCase;
+                    }
+                    else if (option == "nosmartcase" || option == "noscs")
+                    {
+                        flags &= ~RegexFlags::SmartCase;
+                    }
+                    else if (!option.empty())
+                    {
+                        m_pCurrentWindow->GetDisplay().SetCommandText("Unknown option: " + option);
+                        return true;
                     }
                 }
-                m_pCurrentWindow->GetDisplay().SetCommandText(str.str());
+                GetEditor().SetSearchFlags(flags);
+                return true;
+            }
+            else if (Substitute(command))
+            {
+                return true;
+            }
+            else if (command.find(":vimgrep ") == 0 || command.find(":vim ") == 0)
+            {
+                StartGrep(command.substr(command.find(' ') + 1));
+                return true;
+            }
+            else if (command == ":cn" || command == ":cnext" || command == ":cp" || command == ":cprevious")
+            {
+                auto& grep = GetEditor().GetGrep();
+                grep.Update();
+                ShowGrepResult(grep.Step(command[2] == 'n' ? 1 : -1));
+                return true;
+            }
+            else if (command == ":cc" || command.find(":cc ") == 0)
+            {
+                // From 1, as the results buffer shows them; the current one again if there's no number
+                auto& grep = GetEditor().GetGrep();
+                grep.Update();
+                auto index = std::max(grep.GetCurrent(), 0l);
+                auto strTok = StringUtils::Split(command, " ");
+                if (strTok.size() > 1)
+                {
+                    try
+                    {
+                        index = std::stol(strTok[1]) - 1;
+                    }
+                    catch (std::exception&)
+                    {
+                    }
+                }
+                ShowGrepResult(grep.Select(index));
+                return true;
+            }
+            else if (command == ":copen")
+            {
+                auto pResults = GetEditor().GetGrep().GetResultsBuffer();
+                if (pResults)
+                {
+                    m_pCurrentWindow->SetCurrentBuffer(pResults);
+                }
                 return true;
             }
             else if (command.find(":bu") == 0)
@@ -1150,6 +2041,8 @@ void ZepMode_Vim::Enable()
 
 void ZepMode_Vim::AddKeyPress(uint32_t key, uint32_t modifierKeys)
 {
+    RecordKey(key, modifierKeys);
+
     if (!m_pCurrentWindow)
         return;
 
@@ -1159,6 +2052,14 @@ void ZepMode_Vim::AddKeyPress(uint32_t key, uint32_t modifierKeys)
     if (m_currentMode == EditorMode::Normal ||
         m_currentMode == EditorMode::Visual)
     {
+        // A search takes the keys until it is done
+        if (IsSearching() || (m_currentCommand.empty() && (key == '/' || key == '?')))
+        {
+            HandleSearchKey(key);
+            m_pCurrentWindow->GetDisplay().ResetCursorTimer();
+            return;
+        }
+
         // Escape wins all
         if (key == ExtKeys::ESCAPE)
         {
@@ -1167,7 +2068,7 @@ void ZepMode_Vim::AddKeyPress(uint32_t key, uint32_t modifierKeys)
         }
 
         // Update the typed command
-        m_currentCommand += char(key);
+        EncodingUtils::AppendUtf8(key, m_currentCommand);
 
         // ... and show it in the command bar
         m_pCurrentWindow->GetDisplay().SetCommandText(m_currentCommand);
@@ -1175,6 +2076,7 @@ void ZepMode_Vim::AddKeyPress(uint32_t key, uint32_t modifierKeys)
         // Retrieve the vim command
         int count;
         std::string command = GetCommandAndCount(m_currentCommand, count);
+        PreviewSubstitute(command);
 
         CommandResult commandResult;
         if (GetCommand(command, key, modifierKeys, m_currentMode, count, commandResult))
@@ -1266,6 +2168,287 @@ void ZepMode_Vim::AddKeyPress(uint32_t key, uint32_t modifierKeys)
     }
 }
 
+bool ZepMode_Vim::IsSearching() const
+{
+    return !m_currentCommand.empty() && (m_currentCommand[0] == '/' || m_currentCommand[0] == '?');
+}
+
+// The pattern is typed on the command line.  Each key searches again from where the search started, and the windows
+// highlight the matches of what has been typed so far
+void ZepMode_Vim::HandleSearchKey(uint32_t key)
+{
+    auto& display = m_pCurrentWindow->GetDisplay();
+    if (!IsSearching())
+    {
+        m_searchOrigin = m_pCurrentWindow->DisplayToBuffer();
+        m_highlightBefore = GetEditor().GetHighlightPattern();
+        m_currentCommand.clear();
+        EncodingUtils::AppendUtf8(key, m_currentCommand);
+        display.SetCommandText(m_currentCommand);
+        return;
+    }
+
+    if (key == ExtKeys::ESCAPE)
+    {
+        CancelSearch();
+        return;
+    }
+    else if (key == ExtKeys::RETURN)
+    {
+        // An empty pattern searches for the last one again
+        auto dir = m_currentCommand[0] == '/' ? SearchDirection::Forward : SearchDirection::Backward;
+        auto pattern = m_currentCommand.size() > 1 ? m_currentCommand.substr(1) : m_lastSearch;
+        ZepRegex regex;
+        BufferLocation location;
+        if (pattern.empty())
+        {
+            CancelSearch();
+            display.SetCommandText("No previous pattern");
+        }
+        else if (!regex.Compile(pattern, GetEditor().GetSearchFlags()))
+        {
+            CancelSearch();
+            display.SetCommandText(regex.GetError());
+        }
+        else if (!SearchNext(pattern, m_searchOrigin, dir, location))
+        {
+            CancelSearch();
+            display.SetCommandText("Pattern not found: " + pattern);
+        }
+        else
+        {
+            m_lastSearch = pattern;
+            m_lastSearchDirection = dir;
+            GetEditor().SetHighlightPattern(pattern);
+            display.SetCommandText(m_currentCommand.substr(0, 1) + pattern);
+            m_pCurrentWindow->MoveCursorTo(location);
+            ResetCommand();
+            UpdateVisualSelection();
+        }
+        return;
+    }
+    else if (key == ExtKeys::BACKSPACE)
+    {
+        // Back over a whole UTF-8 character; and out of the search from its start
+        if (m_currentCommand.size() == 1)
+        {
+            CancelSearch();
+            return;
+        }
+        do
+        {
+            m_currentCommand.pop_back();
+        } while (m_currentCommand.size() > 1 && (uint8_t(m_currentCommand.back()) & 0xC0) == 0x80);
+    }
+    else if (key == ExtKeys::TAB)
+    {
+        m_currentCommand += '\t';
+    }
+    else if (key >= ' ')
+    {
+        EncodingUtils::AppendUtf8(key, m_currentCommand);
+    }
+
+    display.SetCommandText(m_currentCommand);
+    UpdateSearch();
+}
+
+// Move to the first match of what has been typed so far, and highlight them all.  The buffer's index of the matches
+// has them; until it is complete it only has those on screen, and the cursor only moves to one of those
+void ZepMode_Vim::UpdateSearch()
+{
+    auto dir = m_currentCommand[0] == '/' ? SearchDirection::Forward : SearchDirection::Backward;
+    auto location = m_searchOrigin;
+    ZepRegex regex;
+    if (m_currentCommand.size() == 1)
+    {
+        GetEditor().SetHighlightPattern(m_highlightBefore);
+    }
+    else if (regex.Compile(m_currentCommand.substr(1), GetEditor().GetSearchFlags()))
+    {
+        auto& search = UpdateBufferSearch(regex.GetPattern());
+        SearchMatch match;
+        if (search.FindNext(m_searchOrigin, dir, match) &&
+            (search.IsComplete() || (dir == SearchDirection::Forward ? match.start > m_searchOrigin : match.start < m_searchOrigin)))
+        {
+            location = match.start;
+        }
+    }
+    else
+    {
+        GetEditor().SetHighlightPattern("");
+    }
+    m_pCurrentWindow->MoveCursorTo(location);
+    UpdateVisualSelection();
+}
+
+void ZepMode_Vim::CancelSearch()
+{
+    GetEditor().SetHighlightPattern(m_highlightBefore);
+    m_pCurrentWindow->MoveCursorTo(m_searchOrigin);
+    ResetCommand();
+    UpdateVisualSelection();
+}
+
+// Highlight the pattern, and bring the buffer's index of its matches up to date; the lines on screen are searched
+// first, and the rest in the background
+ZepBufferSearch& ZepMode_Vim::UpdateBufferSearch(const std::string& pattern)
+{
+    GetEditor().SetHighlightPattern(pattern);
+
+    auto& search = m_pCurrentWindow->GetCurrentBuffer()->GetSearch();
+    const auto& lines = m_pCurrentWindow->visibleLines;
+    if (lines.empty())
+    {
+        search.SetPattern(pattern);
+    }
+    else
+    {
+        search.SetPattern(pattern, lines.front().columnOffsets.x, lines.back().columnOffsets.y);
+    }
+    search.Update();
+    return search;
+}
+
+// n and N step through the index of matches the buffer keeps for the highlighted pattern, with a binary search.  While
+// the index is being built in the background, the buffer is searched instead.  A paged buffer only holds a window of
+// its file, so the pager searches the rest, and the window slides to the match with the view following it
+bool ZepMode_Vim::SearchNext(const std::string& pattern, BufferLocation from, SearchDirection dir, BufferLocation& location)
+{
+    auto pBuffer = m_pCurrentWindow->GetCurrentBuffer();
+    if (pBuffer->IsPaged())
+    {
+        GetEditor().SetHighlightPattern(pattern);
+        auto firstLine = pBuffer->GetPagedFirstLine();
+        if (!pBuffer->FindPaged(ZepRegex(pattern, GetEditor().GetSearchFlags()), from, dir, location))
+        {
+            return false;
+        }
+        if (pBuffer->GetPagedFirstLine() != firstLine)
+        {
+            m_pCurrentWindow->ScrollToLine(std::max(0l, pBuffer->LineFromOffset(location) - long(m_pCurrentWindow->visibleLines.size()) / 2));
+        }
+        return true;
+    }
+
+    auto& search = UpdateBufferSearch(pattern);
+    if (search.IsComplete())
+    {
+        SearchMatch match;
+        if (!search.FindNext(from, dir, match))
+        {
+            return false;
+        }
+        location = match.start;
+        return true;
+    }
+    return FindNext(ZepRegex(pattern, GetEditor().GetSearchFlags()), from, dir, location);
+}
+
+// Where the next match starts, after from going forwards or before it going back; wrapping around the buffer
+bool ZepMode_Vim::FindNext(const ZepRegex& regex, BufferLocation from, SearchDirection dir, BufferLocation& location) const
+{
+    auto pBuffer = m_pCurrentWindow->GetCurrentBuffer();
+    RegexMatch match;
+    if (dir == SearchDirection::Forward)
+    {
+        if (!pBuffer->FindMatch(regex, from + 1, dir, match) &&
+            !pBuffer->FindMatch(regex, 0, dir, match))
+        {
+            return false;
+        }
+    }
+    else if (!pBuffer->FindMatch(regex, from, dir, match) &&
+        !pBuffer->FindMatch(regex, long(pBuffer->GetText().size()), dir, match))
+    {
+        return false;
+    }
+    location = match.start;
+    return true;
+}
+
+// A pattern between delimiters, as Vim has it, or up to the first space; then the directory to search, if any
+void ZepMode_Vim::StartGrep(const std::string& args)
+{
+    std::string pattern;
+    size_t pos = 0;
+    if (!args.empty() && !std::isalnum(utf8(args[0])) && args[0] != '\\')
+    {
+        auto delimiter = args[0];
+        for (pos = 1; pos < args.size() && args[pos] != delimiter; pos++)
+        {
+            if (args[pos] == '\\' && pos + 1 < args.size() && args[pos + 1] == delimiter)
+            {
+                pos++;
+            }
+            else if (args[pos] == '\\' && pos + 1 < args.size())
+            {
+                pattern.push_back(args[pos++]);
+            }
+            pattern.push_back(args[pos]);
+        }
+        pos++;
+    }
+    else
+    {
+        pos = std::min(args.find(' '), args.size());
+        pattern = args.substr(0, pos);
+    }
+    auto directory = pos < args.size() ? args.substr(pos) : std::string();
+    StringUtils::Trim(directory);
+
+    auto& grep = GetEditor().GetGrep();
+    if (pattern.empty() || !grep.Start(pattern, directory))
+    {
+        m_pCurrentWindow->GetDisplay().SetCommandText(pattern.empty() ? "No previous pattern" : ZepRegex(pattern).GetError());
+        return;
+    }
+
+    grep.Update();
+    m_pCurrentWindow->SetCurrentBuffer(grep.GetResultsBuffer());
+}
+
+// Open the result's file, or go to the buffer it was found in, and put the cursor on the match
+void ZepMode_Vim::ShowGrepResult(const GrepResult* pResult)
+{
+    if (!pResult)
+    {
+        m_pCurrentWindow->GetDisplay().SetCommandText("No Errors");
+        return;
+    }
+
+    ZepBuffer* pBuffer = nullptr;
+    for (auto& spBuffer : GetEditor().GetBuffers())
+    {
+        if (spBuffer->GetFilePath() == pResult->path ||
+            (spBuffer->GetFilePath().empty() && spBuffer->GetName() == pResult->path))
+        {
+            pBuffer = spBuffer.get();
+            break;
+        }
+    }
+
+    if (!pBuffer)
+    {
+        pBuffer = GetEditor().OpenFile(pResult->path);
+        if (!pBuffer)
+        {
+            m_pCurrentWindow->GetDisplay().SetCommandText("Can't read \"" + pResult->path + "\"");
+            return;
+        }
+        pBuffer->WaitForLoad();
+    }
+
+    m_pCurrentWindow->SetCurrentBuffer(pBuffer);
+    m_pCurrentWindow->ScrollToLine(pResult->line);
+    m_pCurrentWindow->MoveCursorTo(pBuffer->GetLinePos(pResult->line, LineLocation::LineBegin) + pResult->column);
+
+    auto& grep = GetEditor().GetGrep();
+    std::ostringstream str;
+    str << "(" << grep.GetCurrent() + 1 << " of " << grep.GetResults().size() << "): " << pResult->text;
+    m_pCurrentWindow->GetDisplay().SetCommandText(str.str());
+}
+
 void ZepMode_Vim::HandleInsert(uint32_t key)
 {
     auto cursor = m_pCurrentWindow->GetCursor();
@@ -1303,12 +2486,24 @@ void ZepMode_Vim::HandleInsert(uint32_t key)
     const auto bufferCursor = m_pCurrentWindow->DisplayToBuffer(cursor);
     auto pBuffer = m_pCurrentWindow->GetCurrentBuffer();
 
+    // The hex view has nothing to insert into; typing overwrites bytes in place
+    if (pBuffer->IsBinary() && !packCommand && key != ExtKeys::RETURN && key != ExtKeys::TAB)
+    {
+        m_pendingEscape = false;
+        auto next = pBuffer->OverwriteBinary(bufferCursor, char(key));
+        if (next != -1)
+        {
+            m_pCurrentWindow->MoveCursorTo(next, LineLocation::LineCRBegin);
+        }
+        return;
+    }
+
     // Escape back to normal mode
     if (packCommand)
     {
         // End location is where we just finished typing
         auto insertEnd = bufferCursor;
-        if (insertEnd > m_insertBegin)
+        if (insertEnd > m_insertBegin && !pBuffer->IsBinary())
         {
             // Get the string we inserted
             auto strInserted = std::string(pBuffer->GetText().begin() + m_insertBegin, pBuffer->GetText().begin() + insertEnd);
@@ -1355,7 +2550,9 @@ void ZepMode_Vim::HandleInsert(uint32_t key)
     }
 
     auto buf = bufferCursor;
-    std::string ch((char*)&key);
+    // The key is a code point; the buffer holds UTF-8
+    std::string ch;
+    EncodingUtils::AppendUtf8(key, ch);
     if (key == ExtKeys::RETURN)
     {
         ch = "\n";
@@ -1403,4 +2600,33 @@ void ZepMode_Vim::SetCurrentWindow(ZepWindow* pWindow)
         pWindow->MoveCursor(NVec2i(1, 0), LineLocation::LineCRBegin);
     }
 }
+
+// Report background saves of the buffer we are editing
+void ZepMode_Vim::Notify(std::shared_ptr<ZepMessage> message)
+{
+    if (message->messageId != Msg_Buffer || !m_pCurrentWindow)
+    {
+        return;
+    }
+
+    auto pMsg = std::static_pointer_cast<BufferMessage>(message);
+    if (pMsg->pBuffer != m_pCurrentWindow->GetCurrentBuffer())
+    {
+        return;
+    }
+
+    if (pMsg->type == BufferMessageType::Saved)
+    {
+        m_pCurrentWindow->GetDisplay().SetCommandText("\"" + pMsg->pBuffer->GetFilePath() + "\" written");
+    }
+    else if (pMsg->type == BufferMessageType::SaveFailed)
+    {
+        m_pCurrentWindow->GetDisplay().SetCommandText("Failed to write \"" + pMsg->pBuffer->GetFilePath() + "\"");
+    }
+    else if (pMsg->type == BufferMessageType::SaveConversionFailed)
+    {
+        m_pCurrentWindow->GetDisplay().SetCommandText("\"" + pMsg->pBuffer->GetFilePath() + "\" not written: can't convert to " +
+            EncodingUtils::Name(pMsg->pBuffer->GetEncoding()));
+    }
+}
 } // Zep
@@ -7,6 +7,9 @@ class Timer;
 namespace Zep
 {
 
+struct GrepResult;
+class ZepBufferSearch;
+
 enum class VimMotion
 {
     LineBegin,
@@ -40,17 +43,35 @@ public:
     virtual void AddKeyPress(uint32_t key, uint32_t modifiers = 0) override;
     virtual void Enable() override;
     virtual void SetCurrentWindow(ZepWindow* pWindow) override;
+    virtual void Notify(std::shared_ptr<ZepMessage> message) override;
 
     virtual const char* Name() const override { return "Vim"; }
 private:
     void HandleInsert(uint32_t key);
     std::string GetCommandAndCount(std::string strCommand, int& count);
-    bool GetBlockOpRange(const std::string& op, EditorMode mode, BufferLocation& beginRange, BufferLocation& endRange, BufferLocation& cursorAfter) const;
+    bool GetBlockOpRange(const std::string& op, EditorMode mode, BufferLocation& beginRange, BufferLocation& endRange, BufferLocation& cursorAfter, int count = 1) const;
+    BufferLocation FindChar(const std::string& find, BufferLocation from, int count, bool repeat) const;
     void SwitchMode(EditorMode mode);
     void ResetCommand();
     bool GetCommand(std::string strCommand, uint32_t lastKey, uint32_t modifiers, EditorMode mode, int count, CommandResult& commandResult);
     void Init();
 
+    // / and ? take the keys until RETURN or ESCAPE, moving to the first match as the pattern is typed
+    bool IsSearching() const;
+    void HandleSearchKey(uint32_t key);
+    void UpdateSearch();
+    void CancelSearch();
+    ZepBufferSearch& UpdateBufferSearch(const std::string& pattern);
+    bool SearchNext(const std::string& pattern, BufferLocation from, SearchDirection dir, BufferLocation& location);
+    bool FindNext(const ZepRegex& regex, BufferLocation from, SearchDirection dir, BufferLocation& location) const;
+    void PreviewSubstitute(const std::string& command);
+    bool Substitute(const std::string& command);
+    bool GetLineRange(const std::string& range, long& firstLine, long& lastLine) const;
+
+    // :vimgrep and the quickfix commands
+    void StartGrep(const std::string& args);
+    void ShowGrepResult(const GrepResult* pResult);
+
     std::string m_currentCommand;
     std::string m_lastCommand;
     int m_lastCount;
@@ -58,6 +79,14 @@ private:
 
     bool m_pendingEscape = false;
     std::shared_ptr<Timer> m_spInsertEscapeTimer;
+
+    BufferLocation m_searchOrigin = 0;     // Cursor when the search started; ESCAPE goes back to it
+    std::string m_highlightBefore;         // Pattern that was highlighted then, or before a :s preview
+    bool m_previewing = false;             // Highlighting the pattern of the :s command being typed
+    std::string m_lastSearch;              // Last pattern searched for, and which way
+    SearchDirection m_lastSearchDirection = SearchDirection::Forward;
+    std::string m_lastReplacement;         // For ~ in the next :s
+    std::string m_lastFind;                // Last f, F, t or T and its character, for ; and ,
 };
 
 } // Zep
@@ -1,5 +1,6 @@
 #include "syntax.h"
 #include "editor.h"
+#include "utils/trace.h"
 
 namespace Zep
 {
@@ -28,8 +29,19 @@ uint32_t ZepSyntax::GetSyntaxAt(long offset) const
     return m_syntax[offset];
 }
 
+size_t ZepSyntax::GetMemoryUsage() const
+{
+    size_t size = m_syntax.capacity() * sizeof(uint32_t);
+    size += m_commentEntries.capacity() * sizeof(CommentEntry);
+    size += m_multiCommentStarts.capacity() * sizeof(uint32_t);
+    size += m_multiCommentEnds.capacity() * sizeof(uint32_t);
+    return size;
+}
+
 void ZepSyntax::Interrupt()
 {
+    ZEP_TRACE_SCOPE("ZepSyntax::Interrupt");
+
     // Stop the thread, wait for it
     m_stop = true;
     if (m_syntaxResult.valid())
@@ -105,9 +117,24 @@ void ZepSyntax::Notify(std::shared_ptr<ZepMessage> spMsg)
     }
 }
 
+// The syntax before this can be read on the editor's thread while an update runs.  An update walks back from where
+// it was asked to start to the line end before it, and writes from there on
+long ZepSyntax::GetSettledChar() const
+{
+    // Finishing clears the target after its last write, so everything below the processed char is written once it's clear
+    if (m_targetChar == 0)
+    {
+        return m_processedChar;
+    }
+    auto lineStart = m_buffer.GetLinePos(m_buffer.LineFromOffset(m_processedChar), LineLocation::LineBegin);
+    return std::max(0l, long(lineStart) - 1);
+}
+
 // TODO: Multiline comments
 void ZepSyntax::UpdateSyntax()
 {
+    ZEP_TRACE_SCOPE("ZepSyntax::UpdateSyntax");
+
     auto& buffer = m_buffer.GetText();
     auto itrCurrent = buffer.begin() + m_processedChar;
     auto itrEnd = buffer.begin() + m_targetChar;
@@ -162,16 +189,37 @@ void ZepSyntax::UpdateSyntax()
 
         // Find a token, skipping delim <itrFirst, itrLast>
         auto itrFirst = buffer.find_first_not_of(itrCurrent, buffer.end(), delim.begin(), delim.end());
+
+        // The delimiters (brackets among them) were left marked as they were, even once out of a comment
+        mark(itrCurrent, itrFirst, SyntaxType::Normal);
         if (itrFirst == buffer.end())
             break;
 
+        // A quoted string runs to its closing quote, or the end of the line
+        if (*itrFirst == '"' || *itrFirst == '\'')
+        {
+            auto itrLast = itrFirst + 1;
+            while (itrLast < buffer.end() && *itrLast != *itrFirst && *itrLast != '\n' && *itrLast != 0)
+            {
+                itrLast += (*itrLast == '\\' && itrLast + 1 < buffer.end() && *(itrLast + 1) != '\n') ? 2 : 1;
+            }
+            if (itrLast < buffer.end() && *itrLast == *itrFirst)
+            {
+                itrLast++;
+            }
+            mark(itrFirst, itrLast, SyntaxType::String);
+            itrCurrent = itrLast;
+            continue;
+        }
+
         auto itrLast = buffer.find_first_of(itrFirst, buffer.end(), delim.begin(), delim.end());
 
         // Ensure we found a token
         assert(itrLast >= itrFirst);
 
-        // Do I need to make a string here?
-        auto token = std::string(itrFirst, itrLast);
+        // Reuse the token storage; this runs on every edit
+        auto& token = m_token;
+        token.assign(itrFirst, itrLast);
         if (keywords.find(token) != keywords.end())
         {
             mark(itrFirst, itrLast, SyntaxType::Keyword);
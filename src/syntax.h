@@ -13,7 +13,8 @@ enum
     Keyword = (1 << 1),
     Integer = (1 << 2),
     Comment = (1 << 3),
-    Whitespace = (1 << 4)
+    Whitespace = (1 << 4),
+    String = (1 << 5)
 };
 }
 
@@ -36,7 +37,9 @@ public:
     virtual void Interrupt();
 
     virtual long GetProcessedChar() const { return m_processedChar; }
+    virtual long GetSettledChar() const;
     virtual const std::vector<uint32_t>& GetText() const { return m_syntax; }
+    virtual size_t GetMemoryUsage() const;
     virtual void Notify(std::shared_ptr<ZepMessage> payload) override;
 
 private:
@@ -52,6 +55,7 @@ protected:
     std::vector<uint32_t> m_multiCommentStarts;
     std::vector<uint32_t> m_multiCommentEnds;
     std::set<std::string> keywords;
+    std::string m_token;                  // Scratch for UpdateSyntax; only one update runs at a time
     std::atomic<bool> m_stop;
 };
 } // Zep
@@ -0,0 +1,101 @@
+#include "m3rdparty.h"
+#include <gtest/gtest.h>
+#include "src/editor.h"
+#include "src/mode_vim.h"
+#include "src/buffer.h"
+#include "src/display.h"
+#include "src/syntax_glsl.h"
+#include "tests/alloc_counter.h"
+
+using namespace Zep;
+
+// Steady state editing should not touch the heap; allocation per keystroke is the main source of latency jitter
+class AllocationTest : public testing::Test
+{
+public:
+    AllocationTest()
+    {
+        spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+        spMode = std::make_shared<ZepMode_Vim>(*spEditor);
+        spBuffer = spEditor->AddBuffer("Test Buffer");
+
+        auto spSyntax = std::make_shared<ZepSyntaxGlsl>(*spBuffer);
+        spBuffer->SetSyntax(std::static_pointer_cast<ZepSyntax>(spSyntax));
+
+        spDisplay = std::make_shared<ZepDisplayNull>(*spEditor);
+        spDisplay->SetDisplaySize(NVec2f(0.0f, 0.0f), NVec2f(1024.0f, 1024.0f));
+
+        pWindow = spDisplay->AddWindow();
+        pWindow->AddBuffer(spBuffer);
+        spMode->SetCurrentWindow(pWindow);
+        pWindow->SetCursor(NVec2i(0, 0));
+
+        std::string text;
+        for (int i = 0; i < 50; i++)
+        {
+            text += "uniform vec4 value; // A comment\n    float x = pow(sin(y), 2.0);\n";
+        }
+        spBuffer->SetText(text);
+    }
+
+    ~AllocationTest()
+    {
+        pWindow->RemoveBuffer(spBuffer);
+        spDisplay->RemoveWindow(pWindow);
+    }
+
+    // Run a key sequence once to warm up any caches, then count the allocations of a second run
+    uint64_t CountAllocations(const std::string& keys)
+    {
+        for (int pass = 0; pass < 2; pass++)
+        {
+            ScopedAllocationCounter counter;
+            for (auto& ch : keys)
+            {
+                spMode->AddKeyPress(uint32_t(ch));
+                spDisplay->Display();
+            }
+            if (pass == 1)
+            {
+                return counter.GetCount();
+            }
+        }
+        return 0;
+    }
+
+public:
+    std::shared_ptr<ZepEditor> spEditor;
+    std::shared_ptr<ZepDisplayNull> spDisplay;
+    ZepBuffer* spBuffer;
+    ZepWindow* pWindow;
+    std::shared_ptr<ZepMode_Vim> spMode;
+};
+
+TEST(AllocationCounter, CountsThisThread)
+{
+    ScopedAllocationCounter counter;
+    auto p = new int(1);
+    delete p;
+    ASSERT_EQ(counter.GetCount(), 1);
+}
+
+TEST_F(AllocationTest, IdleFrame)
+{
+    spDisplay->Display();
+    spDisplay->Display();
+
+    ScopedAllocationCounter counter;
+    spDisplay->Display();
+    ASSERT_EQ(counter.GetCount(), 0);
+}
+
+TEST_F(AllocationTest, CursorMotion)
+{
+    ASSERT_EQ(CountAllocations("jjjlllwwwbbbkkkhhh"), 0);
+}
+
+TEST_F(AllocationTest, InsertModeTyping)
+{
+    spMode->AddCommandText("jjA");
+    ASSERT_EQ(CountAllocations("float value = 42.0;"), 0);
+}
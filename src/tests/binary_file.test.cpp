@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include "src/binary_file.h"
+#include "tests/temp_dir.h"
+
+using namespace Zep;
+
+namespace
+{
+std::string ReadBinaryFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    std::ostringstream str;
+    str << file.rdbuf();
+    return str.str();
+}
+}
+
+TEST(BinaryFile, FormatsRows)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.Write("rows.bin", std::string("Hello\0world\x01\xFF" "0123456789", 23));
+
+    ZepBinaryFile file;
+    ASSERT_TRUE(file.Open(path));
+    ASSERT_EQ(file.GetSize(), 23u);
+    ASSERT_EQ(file.GetRowCount(), 2);
+    ASSERT_TRUE(ZepBinaryFile::IsBinaryFile(path));
+
+    std::string text;
+    ASSERT_EQ(file.FormatRows(0, 10, text), 2);
+    ASSERT_EQ(text,
+        "00000000  48 65 6c 6c 6f 00 77 6f  72 6c 64 01 ff 30 31 32  Hello.world..012\n"
+        "00000010  33 34 35 36 37 38 39                              3456789");
+
+    // Columns, both ways
+    bool ascii;
+    bool high;
+    ASSERT_EQ(file.ByteAtColumn(file.HexColumn(9), ascii, high), 9);
+    ASSERT_TRUE(high && !ascii);
+    ASSERT_EQ(file.ByteAtColumn(file.HexColumn(9) + 1, ascii, high), 9);
+    ASSERT_FALSE(high);
+    ASSERT_EQ(file.ByteAtColumn(file.AsciiColumn(15), ascii, high), 15);
+    ASSERT_TRUE(ascii);
+    ASSERT_EQ(file.ByteAtColumn(3, ascii, high), -1);
+    ASSERT_EQ(file.ByteAtColumn(file.HexColumn(8) - 1, ascii, high), -1);
+
+    file.Close();
+    tempDir.Write("rows.bin", "plain text");
+    ASSERT_FALSE(ZepBinaryFile::IsBinaryFile(path));
+}
+
+TEST(BinaryFile, OverwritesInPlace)
+{
+    std::string contents(10000, '\0');
+    ScopedTempDir tempDir;
+    auto path = tempDir.Write("overwrite.bin", contents);
+
+    {
+        // Small pages, so edits land in pages that get evicted and read again
+        ZepBinaryFile file(8192, 4096);
+        ASSERT_TRUE(file.Open(path));
+        ASSERT_TRUE(file.Overwrite(1, 0xAB));
+        ASSERT_TRUE(file.Overwrite(2, 0xCD));
+        ASSERT_TRUE(file.Overwrite(9999, 0x7F));
+        ASSERT_FALSE(file.Overwrite(10000, 0x01));
+        ASSERT_TRUE(file.IsDirty());
+        ASSERT_TRUE(file.IsModified(2));
+
+        uint8_t bytes[4];
+        ASSERT_EQ(file.Read(0, bytes, 4), 4u);
+        ASSERT_EQ(bytes[1], 0xAB);
+        ASSERT_EQ(bytes[2], 0xCD);
+
+        // The file is untouched until a save
+        ASSERT_EQ(ReadBinaryFile(path), contents);
+        ASSERT_TRUE(file.Save());
+        ASSERT_FALSE(file.IsDirty());
+        ASSERT_EQ(file.Read(9998, bytes, 4), 2u);
+        ASSERT_EQ(bytes[1], 0x7F);
+    }
+
+    contents[1] = char(0xAB);
+    contents[2] = char(0xCD);
+    contents[9999] = char(0x7F);
+    ASSERT_EQ(ReadBinaryFile(path), contents);
+}
+
+TEST(BinaryFile, FindsAcrossPages)
+{
+    // Matches straddling each page boundary, and one at the very end
+    std::string contents(4096 * 3, 'x');
+    const std::string pattern("\x00\x01\x02", 3);
+    for (size_t offset : { size_t(4095), size_t(8190), contents.size() - 3 })
+    {
+        contents.replace(offset, 3, pattern);
+    }
+    ScopedTempDir tempDir;
+    auto path = tempDir.Write("find.bin", contents);
+
+    ZepBinaryFile file(8192, 4096);
+    ASSERT_TRUE(file.Open(path));
+    std::vector<uint8_t> bytes(pattern.begin(), pattern.end());
+    ASSERT_EQ(file.Find(bytes, 0), 4095);
+    ASSERT_EQ(file.Find(bytes, 4096), 8190);
+    ASSERT_EQ(file.Find(bytes, 8191), int64_t(contents.size() - 3));
+    ASSERT_EQ(file.Find(bytes, contents.size() - 2), -1);
+
+    ASSERT_EQ(file.Find(bytes, contents.size(), SearchDirection::Backward), int64_t(contents.size() - 3));
+    ASSERT_EQ(file.Find(bytes, 8189, SearchDirection::Backward), 4095);
+    ASSERT_EQ(file.Find(bytes, 4094, SearchDirection::Backward), -1);
+
+    // Finds what has been overwritten, not what is on disk
+    ASSERT_TRUE(file.Overwrite(100, 0));
+    ASSERT_TRUE(file.Overwrite(101, 1));
+    ASSERT_TRUE(file.Overwrite(102, 2));
+    ASSERT_EQ(file.Find(bytes, 0), 100);
+
+    file.Close();
+}
@@ -1,6 +1,23 @@
 #include "m3rdparty.h"
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include "src/binary_file.h"
 #include "src/buffer.h"
+#include "src/buffer_regex.h"
+#include "src/commands.h"
+#include "src/file_pager.h"
+#include "src/journal.h"
+#include "src/mode.h"
+#include "src/syntax_glsl.h"
+#include "src/utils/fileutils.h"
+#include "tests/temp_dir.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace Zep;
 
@@ -34,3 +51,774 @@ TEST(BufferTest, GetBlock)
     ASSERT_EQ(block.secondNonBlock, 9);
 };
 
+TEST(BufferTest, GetBlockAcrossTheGap)
+{
+    auto spEditor = std::make_shared<ZepEditor>();
+    auto spBuffer = spEditor->AddBuffer("MyBuffer");
+    spBuffer->SetText("one" + std::string(10000, ' ') + "two" + std::string(10000, '.') + " three");
+
+    // The edit leaves the gap in the middle of the runs
+    spBuffer->Insert(5000, " ");
+    auto block = spBuffer->GetBlock(SearchType::Word | SearchType::AlphaNumeric, 0, SearchDirection::Forward);
+    ASSERT_TRUE(block.spaceBetween);
+    ASSERT_EQ(block.firstNonBlock, 3);
+    ASSERT_EQ(block.secondBlock, 10004);
+    ASSERT_EQ(block.secondNonBlock, 10007);
+
+    spBuffer->Insert(15000, ".");
+    block = spBuffer->GetBlock(SearchType::Word | SearchType::AlphaNumeric, 12000, SearchDirection::Backward);
+    ASSERT_FALSE(block.startOnBlock);
+    ASSERT_EQ(block.firstBlock, 20007);
+    ASSERT_EQ(block.firstNonBlock, 10006);
+    ASSERT_EQ(block.secondNonBlock, 10003);
+
+    // Characters past ASCII aren't part of words
+    spBuffer->SetText("caf\xc3\xa9s");
+    block = spBuffer->GetBlock(SearchType::Word | SearchType::AlphaNumeric, 0, SearchDirection::Forward);
+    ASSERT_EQ(block.firstNonBlock, 3);
+    ASSERT_EQ(block.secondBlock, 3);
+    block = spBuffer->GetBlock(SearchType::Word, 0, SearchDirection::Forward);
+    ASSERT_EQ(block.firstNonBlock, 3);
+}
+
+TEST(BufferTest, FindOnLineAcrossTheGap)
+{
+    auto spEditor = std::make_shared<ZepEditor>();
+    auto spBuffer = spEditor->AddBuffer("MyBuffer");
+    spBuffer->SetText("x" + std::string(10000, 'a') + "x" + std::string(10000, 'a') + "x\nx");
+
+    // The edit leaves the gap between the matches
+    spBuffer->Insert(5000, "a");
+    ASSERT_EQ(spBuffer->FindOnLine('x', 0, SearchDirection::Forward), 10002);
+    ASSERT_EQ(spBuffer->FindOnLine('x', 0, SearchDirection::Forward, 2), 20003);
+    ASSERT_EQ(spBuffer->FindOnLine('x', 0, SearchDirection::Forward, 3), InvalidOffset);
+    ASSERT_EQ(spBuffer->FindOnLine('x', 20003, SearchDirection::Backward, 2), 0);
+    ASSERT_EQ(spBuffer->FindOnLine('x', 20003, SearchDirection::Backward, 3), InvalidOffset);
+    ASSERT_EQ(spBuffer->FindOnLine('x', 20005, SearchDirection::Backward), InvalidOffset);
+    ASSERT_EQ(spBuffer->FindOnLine('x', 20005, SearchDirection::Forward), InvalidOffset);
+}
+
+
+TEST(BufferTest, MemoryUsage)
+{
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto spBuffer = spEditor->AddBuffer("MyBuffer");
+    spBuffer->SetText("one\ntwo\nthree");
+
+    auto mem = spBuffer->GetMemoryUsage();
+    ASSERT_EQ(mem.text, spBuffer->GetText().size());
+    ASSERT_GE(mem.lineEnds, spBuffer->GetLineEnds().size() * sizeof(long));
+    ASSERT_EQ(mem.undo, 0);
+    ASSERT_EQ(mem.Total(), mem.text + mem.gap + mem.lineEnds + mem.syntax);
+
+    spEditor->SetRegister('a', "some register text");
+    ASSERT_GE(spEditor->GetRegisterMemoryUsage(), std::string("some register text").size());
+}
+
+TEST(BufferTest, ReplaceKeepsTheLineIndex)
+{
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->AddBuffer("Replace");
+    auto pCheck = spEditor->AddBuffer("Check");
+    pBuffer->SetText("one\ntwo\nthree\nfour");
+
+    // More line breaks than the range had, then fewer
+    ZepCommand_ReplaceRange replace(*pBuffer, 2, 10, "X\nY\nZ\n");
+    replace.Redo();
+    ASSERT_STREQ(pBuffer->GetText().string().c_str(), "onX\nY\nZ\nree\nfour");
+    pCheck->SetText(pBuffer->GetText().string().c_str());
+    ASSERT_TRUE(pBuffer->GetLineEnds() == pCheck->GetLineEnds());
+
+    replace.Undo();
+    ASSERT_STREQ(pBuffer->GetText().string().c_str(), "one\ntwo\nthree\nfour");
+    pCheck->SetText(pBuffer->GetText().string().c_str());
+    ASSERT_TRUE(pBuffer->GetLineEnds() == pCheck->GetLineEnds());
+    ASSERT_EQ(replace.GetMemoryUsage(), sizeof(ZepCommand_ReplaceRange) + replace.m_text.capacity());
+
+    ASSERT_TRUE(pBuffer->Replace(0, 8, ""));
+    ASSERT_EQ(pBuffer->GetLineCount(), 2);
+    ASSERT_FALSE(pBuffer->Replace(4, 100, "x"));
+}
+
+namespace
+{
+std::string ReadTempFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    std::ostringstream str;
+    str << file.rdbuf();
+    return str.str();
+}
+}
+
+TEST(BufferTest, LoadBuildsLineIndex)
+{
+    ScopedTempDir tempDir;
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto path = tempDir.Write("load.txt", "one\r\ntwo\r\nthree");
+
+    auto pBuffer = spEditor->OpenFile(path);
+    ASSERT_TRUE(pBuffer != nullptr);
+    ASSERT_STREQ(pBuffer->GetText().string().c_str(), "one\ntwo\nthree");
+    ASSERT_EQ(pBuffer->GetLineCount(), 3);
+    ASSERT_EQ(pBuffer->GetLineEnds()[0], 4);
+    ASSERT_EQ(pBuffer->GetLineEnds()[1], 8);
+    ASSERT_EQ(spEditor->OpenFile(path), pBuffer);
+}
+
+TEST(BufferTest, SaveRoundTripsLineEndings)
+{
+    ScopedTempDir tempDir;
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    for (auto& contents : { std::string("one\r\ntwo\r\n"), std::string("one\ntwo"), std::string("") })
+    {
+        auto path = tempDir.Write("save.txt", contents);
+        auto pBuffer = spEditor->AddBuffer("save.txt");
+        ASSERT_TRUE(pBuffer->Load(path));
+        ASSERT_TRUE(pBuffer->Save());
+        ASSERT_EQ(ReadTempFile(path), contents);
+    }
+
+    // Edit in the middle, so the gap is inside the text when we write
+    auto path = tempDir.Write("save.txt", "one\r\ntwo\r\n");
+    auto pBuffer = spEditor->AddBuffer("save.txt");
+    ASSERT_TRUE(pBuffer->Load(path));
+    pBuffer->Insert(4, "new\n");
+    ASSERT_TRUE(pBuffer->IsDirty());
+    ASSERT_TRUE(pBuffer->Save());
+    ASSERT_FALSE(pBuffer->IsDirty());
+    ASSERT_EQ(ReadTempFile(path), "one\r\nnew\r\ntwo\r\n");
+}
+
+// Only a file with \r\n on every line has its \r stripped; anything else is kept as it is
+TEST(BufferTest, SaveRoundTripsMixedLineEndings)
+{
+    ScopedTempDir tempDir;
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto path = tempDir.Write("mixed.txt", "one\r\ntwo\nthree\r\n");
+    auto pBuffer = spEditor->AddBuffer("mixed.txt");
+    ASSERT_TRUE(pBuffer->Load(path));
+    ASSERT_EQ(pBuffer->GetText().string(), std::string("one\r\ntwo\nthree\r\n") + '\0');
+    pBuffer->Insert(0, "new\n");
+    ASSERT_TRUE(pBuffer->Save());
+    ASSERT_EQ(ReadTempFile(path), "new\none\r\ntwo\nthree\r\n");
+
+    // A \r on its own stays, in a DOS file too
+    path = tempDir.Write("mixed.txt", "a\rb\r\nc\r\r\n");
+    ASSERT_TRUE(pBuffer->Load(path));
+    ASSERT_EQ(pBuffer->GetText().string(), std::string("a\rb\nc\r\n") + '\0');
+    pBuffer->Insert(0, "new\n");
+    ASSERT_TRUE(pBuffer->Save());
+    ASSERT_EQ(ReadTempFile(path), "new\r\na\rb\r\nc\r\r\n");
+
+    // Loading a piece at a time: every \r\n is split across two pieces, and the last line of the second file has no \r
+    std::string contents = "y";
+    for (int i = 0; i < 40000; i++)
+    {
+        contents += std::string(62, 'x') + "\r\n";
+    }
+    for (auto& fileContents : { contents, contents + "z\n" })
+    {
+        path = tempDir.Write("async.txt", fileContents);
+        auto spAsyncEditor = std::make_shared<ZepEditor>();
+        auto pAsync = spAsyncEditor->AddBuffer("async.txt");
+        ASSERT_TRUE(pAsync->LoadAsync(path));
+        pAsync->WaitForLoad();
+
+        auto expected = fileContents;
+        if (fileContents == contents)
+        {
+            expected.erase(std::remove(expected.begin(), expected.end(), '\r'), expected.end());
+        }
+        ASSERT_EQ(pAsync->GetText().string(), expected + '\0');
+        ASSERT_EQ(pAsync->GetLineCount(), 40001 + (fileContents == contents ? 0 : 1));
+        ASSERT_FALSE(pAsync->IsDirty());
+        ASSERT_TRUE(pAsync->Save());
+        ASSERT_EQ(ReadTempFile(path), fileContents);
+    }
+}
+
+TEST(BufferTest, OpenMissingFile)
+{
+    ScopedTempDir tempDir;
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto path = tempDir.GetFile("missing_file.txt");
+
+    auto pBuffer = spEditor->OpenFile(path);
+    ASSERT_TRUE(pBuffer != nullptr);
+    ASSERT_EQ(pBuffer->GetText().size(), 1);
+    pBuffer->Insert(0, "new");
+    ASSERT_TRUE(pBuffer->Save());
+    ASSERT_EQ(ReadTempFile(path), "new");
+}
+
+TEST(BufferTest, LoadAsyncStreamsWholeFile)
+{
+    ScopedTempDir tempDir;
+    std::string contents;
+    for (int i = 0; i < 100000; i++)
+    {
+        contents += "A line of text for the progressive loader " + std::to_string(i) + "\r\n";
+    }
+    auto path = tempDir.Write("load_async.txt", contents);
+
+    // With threads
+    auto spEditor = std::make_shared<ZepEditor>();
+    auto pBuffer = spEditor->AddBuffer("async.txt");
+    ASSERT_TRUE(pBuffer->LoadAsync(path));
+    ASSERT_GT(pBuffer->GetLineCount(), 1);
+
+    // Edits to the loaded part are fine while the rest streams in
+    pBuffer->Insert(0, "First\n");
+    pBuffer->WaitForLoad();
+    ASSERT_FALSE(pBuffer->IsLoading());
+    ASSERT_EQ(pBuffer->GetLoadProgress(), 1.0f);
+
+    auto pExpected = spEditor->AddBuffer("expected.txt");
+    ASSERT_TRUE(pExpected->Load(path));
+    pExpected->Insert(0, "First\n");
+    ASSERT_EQ(pBuffer->GetText().string(), pExpected->GetText().string());
+    ASSERT_EQ(pBuffer->GetLineEnds(), pExpected->GetLineEnds());
+
+    // Saving puts the carriage returns back
+    pBuffer->Delete(0, 6);
+    ASSERT_TRUE(pBuffer->Save());
+    ASSERT_EQ(ReadTempFile(path), contents);
+
+    // Replacing the text part way through a load stops it
+    ASSERT_TRUE(pBuffer->LoadAsync(path));
+    pBuffer->SetText("Replaced");
+    ASSERT_FALSE(pBuffer->IsLoading());
+    ASSERT_STREQ(pBuffer->GetText().string().c_str(), "Replaced");
+}
+
+namespace
+{
+std::string PagedFileContents(long lines)
+{
+    std::string contents;
+    for (long i = 0; i < lines; i++)
+    {
+        contents += "Paged line " + std::to_string(i) + "\n";
+    }
+    return contents + "Last";
+}
+}
+
+TEST(FilePagerTest, ReadsLinesWithinBudget)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.Write("pager.txt", PagedFileContents(50000));
+
+    // Small pages and budget, so the cache has to evict
+    ZepFilePager pager(16 * 1024, 4096);
+    ASSERT_TRUE(pager.Open(path));
+    ASSERT_EQ(pager.GetLineCount(), 50001);
+
+    std::string str;
+    ASSERT_EQ(pager.ReadLines(0, 2, str), 2);
+    ASSERT_EQ(str, "Paged line 0\nPaged line 1\n");
+
+    for (long line : { 40000l, 1023l, 1024l, 20000l })
+    {
+        str.clear();
+        ASSERT_EQ(pager.ReadLines(line, 1, str), 1);
+        ASSERT_EQ(str, "Paged line " + std::to_string(line) + "\n");
+        ASSERT_LE(pager.GetResidentBytes(), size_t(16 * 1024) + 1024);
+    }
+
+    str.clear();
+    ASSERT_EQ(pager.ReadLines(49999, 10, str), 2);
+    ASSERT_EQ(str, "Paged line 49999\nLast");
+
+    // At least one line, even when it doesn't fit
+    str.clear();
+    ASSERT_EQ(pager.ReadLines(100, 10, str, 4), 1);
+
+    ASSERT_EQ(pager.Find(ZepRegex("line 30000$"), 0), 30000);
+    ASSERT_EQ(pager.Find(ZepRegex("line 12$"), 40000, SearchDirection::Backward), 12);
+    ASSERT_EQ(pager.Find(ZepRegex("Last"), 100), 50000);
+    ASSERT_EQ(pager.Find(ZepRegex("not in the file"), 0), -1);
+    ASSERT_EQ(pager.Find(ZepRegex("^Paged line 4\\d\\{3}9$"), 45000), 45009);
+
+    // A block of indexed lines is bigger than a page here, so it is searched a page at a time
+    ASSERT_EQ(pager.Find(ZepRegex("line 1900$"), 1024), 1900);
+    ASSERT_EQ(pager.Find(ZepRegex("line 1100$"), 2000, SearchDirection::Backward), 1100);
+    ASSERT_EQ(pager.Find(ZepRegex("line 1"), 1999, SearchDirection::Backward), 1999);
+
+    pager.Close();
+}
+
+TEST(BufferTest, PagedBufferIsReadOnlyWindow)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.Write("paged.txt", PagedFileContents(20000));
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->AddBuffer("paged.txt");
+
+    // The window's text, syntax and line ends get a quarter of the budget; too small for a whole window here
+    ASSERT_TRUE(pBuffer->OpenPaged(path, 256 * 1024));
+    auto mem = pBuffer->GetMemoryUsage();
+    ASSERT_LT(pBuffer->GetLineCount(), ZepBuffer::PagedWindowLines);
+    ASSERT_LE(mem.text * (sizeof(utf8) + sizeof(uint32_t)) + mem.lineEnds, size_t(64 * 1024));
+    ASSERT_EQ(pBuffer->GetFileLineCount(), 20001);
+
+    ASSERT_TRUE(pBuffer->OpenPaged(path, 4 * 1024 * 1024));
+    ASSERT_TRUE(pBuffer->IsPaged());
+    ASSERT_TRUE(pBuffer->IsReadOnly());
+    ASSERT_EQ(pBuffer->GetLineCount(), ZepBuffer::PagedWindowLines);
+    ASSERT_EQ(pBuffer->GetText().string().substr(0, 13), "Paged line 0\n");
+    ASSERT_GT(pBuffer->GetMemoryUsage().pages, 0u);
+
+    ASSERT_FALSE(pBuffer->Insert(0, "x"));
+    ASSERT_FALSE(pBuffer->Delete(0, 1));
+    ASSERT_FALSE(pBuffer->Save());
+
+    ASSERT_TRUE(pBuffer->SetPagedWindow(10000));
+    ASSERT_EQ(pBuffer->GetPagedFirstLine(), 10000);
+    ASSERT_EQ(pBuffer->GetText().string().substr(0, 17), "Paged line 10000\n");
+
+    // The window stops at the end of the file
+    ASSERT_TRUE(pBuffer->SetPagedWindow(100000));
+    ASSERT_EQ(pBuffer->GetPagedFirstLine(), 20001 - ZepBuffer::PagedWindowLines);
+    ASSERT_NE(pBuffer->GetText().string().find("Paged line 19999\nLast"), std::string::npos);
+
+    // Setting text ends paging
+    pBuffer->SetText("Editable");
+    ASSERT_FALSE(pBuffer->IsPaged());
+    ASSERT_TRUE(pBuffer->Insert(0, "x"));
+}
+
+TEST(BufferTest, FollowAppendsNewText)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.Write("follow.txt", "one\ntwo");
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->AddBuffer("follow.vert");
+    pBuffer->SetSyntax(std::make_shared<ZepSyntaxGlsl>(*pBuffer));
+
+    ASSERT_TRUE(pBuffer->Follow(path));
+    ASSERT_TRUE(pBuffer->IsFollowing());
+    pBuffer->UpdateFollow();
+    ASSERT_STREQ(pBuffer->GetText().string().c_str(), "one\ntwo");
+
+    // Line ends and carriage returns are handled as they are on load, even across appends; not every line here ends
+    // with \r\n, so the \r stays
+    tempDir.Append("follow.txt", " more\r\nfloat x;\n");
+    pBuffer->UpdateFollow();
+    ASSERT_STREQ(pBuffer->GetText().string().c_str(), "one\ntwo more\r\nfloat x;\n");
+    ASSERT_EQ(pBuffer->GetLineCount(), 4);
+
+    auto pExpected = spEditor->AddBuffer("expected.txt");
+    ASSERT_TRUE(pExpected->Load(path));
+    ASSERT_EQ(pBuffer->GetLineEnds(), pExpected->GetLineEnds());
+
+    // Only the appended range is highlighted again, and it is highlighted
+    ASSERT_EQ(pBuffer->GetSyntax()->GetSyntaxAt(14), SyntaxType::Keyword);
+
+    // Nothing new, nothing changes
+    pBuffer->UpdateFollow();
+    ASSERT_EQ(pBuffer->GetLineCount(), 4);
+
+    // Truncated files are read again
+    tempDir.Write("follow.txt", "new");
+    pBuffer->UpdateFollow();
+    ASSERT_STREQ(pBuffer->GetText().string().c_str(), "new");
+    ASSERT_TRUE(pBuffer->IsFollowing());
+
+    pBuffer->SetText("Replaced");
+    ASSERT_FALSE(pBuffer->IsFollowing());
+}
+
+namespace
+{
+class SaveListener : public ZepComponent
+{
+public:
+    SaveListener(ZepEditor& editor) : ZepComponent(editor) {}
+
+    void Notify(std::shared_ptr<ZepMessage> message) override
+    {
+        if (message->messageId != Msg_Buffer)
+        {
+            return;
+        }
+        auto type = std::static_pointer_cast<BufferMessage>(message)->type;
+        if (type == BufferMessageType::Saved)
+        {
+            saved++;
+        }
+        else if (type == BufferMessageType::SaveConversionFailed)
+        {
+            conversionFailed++;
+        }
+    }
+
+    int saved = 0;
+    int conversionFailed = 0;
+};
+}
+
+TEST(BufferTest, SaveAsyncWritesSnapshot)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.Write("save_async.txt", "one\r\ntwo\r\n");
+    auto spEditor = std::make_shared<ZepEditor>();
+    SaveListener listener(*spEditor);
+    auto pBuffer = spEditor->AddBuffer("save_async.txt");
+    ASSERT_TRUE(pBuffer->Load(path));
+
+    // Edited after the text is copied; the file gets the copy, and the buffer stays dirty
+    pBuffer->Insert(0, "zero\n");
+    ASSERT_TRUE(pBuffer->SaveAsync());
+    pBuffer->Insert(0, "minus\n");
+    pBuffer->WaitForSave();
+    ASSERT_EQ(listener.saved, 1);
+    ASSERT_TRUE(pBuffer->IsDirty());
+    ASSERT_EQ(ReadTempFile(path), "zero\r\none\r\ntwo\r\n");
+
+    // Saving while a save is in flight saves again afterwards, with the latest text
+    ASSERT_TRUE(pBuffer->SaveAsync());
+    pBuffer->Insert(0, "again\n");
+    ASSERT_TRUE(pBuffer->SaveAsync());
+    pBuffer->WaitForSave();
+    ASSERT_EQ(listener.saved, 3);
+    ASSERT_FALSE(pBuffer->IsDirty());
+    ASSERT_EQ(ReadTempFile(path), "again\r\nminus\r\nzero\r\none\r\ntwo\r\n");
+    ASSERT_FALSE(FileUtils::Exists(path + ".zepsave"));
+}
+
+#ifndef _WIN32
+TEST(BufferTest, SaveAsyncKeepsLinks)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.Write("linked.txt", "one\n");
+    auto symlinkPath = tempDir.GetFile("symlink.txt");
+    auto hardlinkPath = tempDir.GetFile("hardlink.txt");
+    ASSERT_EQ(symlink(path.c_str(), symlinkPath.c_str()), 0);
+    ASSERT_EQ(link(path.c_str(), hardlinkPath.c_str()), 0);
+
+    // Saved through the symlink; the file it points at gets the text, and the link is still a link
+    auto spEditor = std::make_shared<ZepEditor>();
+    auto pBuffer = spEditor->AddBuffer("symlink.txt");
+    ASSERT_TRUE(pBuffer->Load(symlinkPath));
+    pBuffer->Insert(0, "zero\n");
+    ASSERT_TRUE(pBuffer->SaveAsync());
+    pBuffer->WaitForSave();
+    struct stat info;
+    ASSERT_EQ(lstat(symlinkPath.c_str(), &info), 0);
+    ASSERT_TRUE(S_ISLNK(info.st_mode));
+    ASSERT_EQ(ReadTempFile(path), "zero\none\n");
+    ASSERT_FALSE(FileUtils::Exists(path + ".zepsave"));
+
+    // And through a hard link; every name for the file sees the new text
+    auto pHard = spEditor->AddBuffer("hardlink.txt");
+    ASSERT_TRUE(pHard->Load(hardlinkPath));
+    pHard->Insert(0, "minus\n");
+    ASSERT_TRUE(pHard->SaveAsync());
+    pHard->WaitForSave();
+    ASSERT_EQ(ReadTempFile(path), "minus\nzero\none\n");
+    ASSERT_EQ(ReadTempFile(hardlinkPath), "minus\nzero\none\n");
+    ASSERT_EQ(stat(path.c_str(), &info), 0);
+    ASSERT_EQ(info.st_nlink, 2u);
+}
+#endif
+
+TEST(BufferTest, ExternalChangeAppliesHunks)
+{
+    ScopedTempDir tempDir;
+    std::string contents;
+    for (int i = 0; i < 100; i++)
+    {
+        contents += "Line " + std::to_string(i) + "\n";
+    }
+    auto path = tempDir.Write("external.txt", contents);
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->AddBuffer("external.txt");
+    ASSERT_TRUE(pBuffer->Load(path));
+
+    // Change two lines far apart; only they are touched
+    auto changed = contents;
+    changed.replace(changed.find("Line 10\n"), 8, "Changed ten\nAnd more\n");
+    changed.replace(changed.find("Line 90\n"), 8, "");
+    tempDir.Write("external.txt", changed);
+
+    auto revision = pBuffer->GetRevision();
+    pBuffer->UpdateExternalChange();
+    ASSERT_FALSE(pBuffer->IsChangedOnDisk());
+    ASSERT_FALSE(pBuffer->IsDirty());
+    ASSERT_EQ(pBuffer->GetText().string().substr(0, changed.size()), changed);
+    ASSERT_EQ(pBuffer->GetRevision(), revision + 3);
+
+    // The reload is one undo step
+    spEditor->GetCurrentMode()->Undo();
+    ASSERT_EQ(pBuffer->GetText().string().substr(0, contents.size()), contents);
+    spEditor->GetCurrentMode()->Redo();
+
+    // Our own saves aren't external changes
+    pBuffer->Insert(0, "Mine\n");
+    ASSERT_TRUE(pBuffer->Save());
+    revision = pBuffer->GetRevision();
+    pBuffer->UpdateExternalChange();
+    ASSERT_EQ(pBuffer->GetRevision(), revision);
+
+    // Unsaved edits are not overwritten
+    pBuffer->Insert(0, "Unsaved\n");
+    tempDir.Write("external.txt", "Replaced\n");
+    pBuffer->UpdateExternalChange();
+    ASSERT_TRUE(pBuffer->IsChangedOnDisk());
+    ASSERT_EQ(pBuffer->GetText().string().substr(0, 8), "Unsaved\n");
+
+    ASSERT_TRUE(pBuffer->ReloadChanges());
+    ASSERT_FALSE(pBuffer->IsChangedOnDisk());
+    ASSERT_STREQ(pBuffer->GetText().string().c_str(), "Replaced\n");
+}
+
+// More buffers than a user gets inotify instances (128 by default); they share the editor's
+TEST(BufferTest, ManyBuffersWatchTheirFiles)
+{
+    ScopedTempDir tempDir;
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    std::vector<ZepBuffer*> buffers;
+    for (int i = 0; i < 200; i++)
+    {
+        auto name = "watched" + std::to_string(i) + ".txt";
+        auto path = tempDir.Write(name, "Before\n");
+        buffers.push_back(spEditor->AddBuffer(name));
+        ASSERT_TRUE(buffers.back()->Load(path));
+    }
+
+    for (auto i : { 0, 150, 199 })
+    {
+        tempDir.Write("watched" + std::to_string(i) + ".txt", "After, and longer\n");
+    }
+    for (int i = 0; i < 200; i++)
+    {
+        buffers[i]->UpdateExternalChange();
+        auto changed = i == 0 || i == 150 || i == 199;
+        ASSERT_EQ(buffers[i]->GetText().string().substr(0, 6), changed ? "After," : "Before");
+    }
+}
+
+TEST(FileWatcherTest, WatchersOfOneFileShareAWatch)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.Write("shared.txt", "Text\n");
+    auto spNotifier = std::make_shared<FileUtils::FileNotifier>();
+    FileUtils::FileWatcher first;
+    FileUtils::FileWatcher second;
+    ASSERT_TRUE(first.Watch(path, spNotifier));
+    ASSERT_TRUE(second.Watch(path, spNotifier));
+    ASSERT_FALSE(first.Poll());
+    ASSERT_FALSE(second.Poll());
+
+    // Each sees the change once
+    tempDir.Write("shared.txt", "More text\n");
+    ASSERT_TRUE(first.Poll());
+    ASSERT_TRUE(second.Poll());
+    ASSERT_FALSE(first.Poll());
+    ASSERT_FALSE(second.Poll());
+
+    // The other keeps the watch when one stops
+    first.Stop();
+    tempDir.Append("shared.txt", "And more\n");
+    ASSERT_TRUE(second.Poll());
+    ASSERT_FALSE(first.Poll());
+
+    // Without a notifier, the file is polled
+    FileUtils::FileWatcher polled;
+    ASSERT_TRUE(polled.Watch(path, nullptr));
+    ASSERT_FALSE(polled.Poll());
+    tempDir.Append("shared.txt", "Longer\n");
+    ASSERT_TRUE(polled.Poll());
+}
+
+TEST(BufferTest, JournalRecoversEditsAfterCrash)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.Write("journal.txt", "one\r\ntwo\r\nthree\r\n");
+    auto journalPath = ZepJournal::PathFor(path);
+    std::string crashed;
+    {
+        auto spEditor = std::make_shared<ZepEditor>();
+        auto pBuffer = spEditor->AddBuffer("journal.txt");
+        ASSERT_TRUE(pBuffer->Load(path));
+        ASSERT_FALSE(pBuffer->HasRecoveryJournal());
+
+        pBuffer->Insert(4, "inserted\n");
+        pBuffer->Delete(0, 4);
+        pBuffer->Insert(pBuffer->GetLinePos(2, LineLocation::LineCRBegin), "!");
+        pBuffer->FlushJournal();
+
+        // What a crash would leave behind; a clean close removes it
+        crashed = ReadTempFile(journalPath);
+        ASSERT_FALSE(crashed.empty());
+    }
+    ASSERT_FALSE(FileUtils::Exists(journalPath));
+    tempDir.Write("journal.txt.zepjournal", crashed);
+
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->AddBuffer("journal.txt");
+    ASSERT_TRUE(pBuffer->Load(path));
+    ASSERT_TRUE(pBuffer->HasRecoveryJournal());
+    ASSERT_TRUE(pBuffer->RecoverJournal());
+    ASSERT_FALSE(pBuffer->HasRecoveryJournal());
+    ASSERT_TRUE(pBuffer->IsDirty());
+    ASSERT_STREQ(pBuffer->GetText().string().c_str(), "inserted\ntwo\nthree!\n");
+
+    // Saving puts the edits in the file, and the journal goes
+    pBuffer->Insert(0, "more ");
+    pBuffer->FlushJournal();
+    ASSERT_TRUE(FileUtils::Exists(journalPath));
+    ASSERT_TRUE(pBuffer->Save());
+    ASSERT_FALSE(FileUtils::Exists(journalPath));
+    ASSERT_EQ(ReadTempFile(path), "more inserted\r\ntwo\r\nthree!\r\n");
+}
+
+TEST(BufferTest, JournalIsAgainstTheFileAsLoaded)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.Write("journal.txt", "one\ntwo\n");
+    std::string journal;
+    {
+        auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+        auto pBuffer = spEditor->AddBuffer("journal.txt");
+        ASSERT_TRUE(pBuffer->Load(path));
+
+        // Changed outside before the first edit, and before the buffer noticed
+        tempDir.Write("journal.txt", "something else\n");
+        pBuffer->Insert(0, "zero\n");
+        pBuffer->FlushJournal();
+        journal = ReadTempFile(ZepJournal::PathFor(path));
+    }
+    tempDir.Write("journal.txt.zepjournal", journal);
+
+    // The edits were to the text as it was loaded, so they aren't replayed over what replaced it
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->AddBuffer("journal.txt");
+    ASSERT_TRUE(pBuffer->Load(path));
+    ASSERT_TRUE(pBuffer->HasRecoveryJournal());
+    ASSERT_FALSE(pBuffer->RecoverJournal());
+    ASSERT_STREQ(pBuffer->GetText().string().c_str(), "something else\n");
+}
+
+TEST(BufferTest, SaveKeepsFileEncoding)
+{
+    ScopedTempDir tempDir;
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+
+    // UTF-16 with a byte order mark and Windows line ends
+    const std::string utf16(
+        "\xFF\xFE"
+        "o\0n\0e\0\r\0\n\0"
+        "\xE9\0\r\0\n\0", 18);
+    auto path = tempDir.Write("encoding.txt", utf16);
+    auto pBuffer = spEditor->AddBuffer("encoding.txt");
+    ASSERT_TRUE(pBuffer->Load(path));
+    ASSERT_EQ(pBuffer->GetText().string(), std::string("one\n\xC3\xA9\n") + '\0');
+    ASSERT_TRUE(pBuffer->GetEncoding().type == TextEncoding::Utf16LE && pBuffer->GetEncoding().bom);
+    ASSERT_TRUE(pBuffer->Save());
+    ASSERT_EQ(ReadTempFile(path), utf16);
+
+    // A NUL, and a surrogate cut off by the end of the file
+    path = tempDir.Write("encoding.txt", std::string("\xFF\xFE" "a\0\0\0b\0\x3D\xD8", 10));
+    ASSERT_TRUE(pBuffer->Load(path));
+    ASSERT_EQ(pBuffer->GetText().string(), std::string("a\xEF\xBF\xBD" "b\xEF\xBF\xBD") + '\0');
+
+    // Latin-1, through the background save
+    path = tempDir.Write("encoding.txt", "caf\xE9\n");
+    ASSERT_TRUE(pBuffer->Load(path));
+    ASSERT_TRUE(pBuffer->GetEncoding().type == TextEncoding::Latin1);
+    pBuffer->Insert(0, "\xC3\xBC");
+    ASSERT_TRUE(pBuffer->SaveAsync());
+    pBuffer->WaitForSave();
+    ASSERT_EQ(ReadTempFile(path), "\xFC" "caf\xE9\n");
+
+    // Latin-1 can't hold the euro; the file is left alone rather than written with a '?', and the buffer stays dirty
+    SaveListener listener(*spEditor);
+    pBuffer->Insert(0, "\xE2\x82\xAC");
+    ASSERT_FALSE(pBuffer->Save());
+    ASSERT_TRUE(pBuffer->SaveAsync());
+    pBuffer->WaitForSave();
+    ASSERT_EQ(listener.conversionFailed, 1);
+    ASSERT_EQ(listener.saved, 0);
+    ASSERT_TRUE(pBuffer->IsDirty());
+    ASSERT_EQ(ReadTempFile(path), "\xFC" "caf\xE9\n");
+    ASSERT_FALSE(FileUtils::Exists(path + ".zepsave"));
+
+    // Streamed in pieces by the load thread; the first piece decides the encoding
+    std::string contents;
+    std::string expected;
+    for (int i = 0; i < 50000; i++)
+    {
+        auto line = "Wide line " + std::to_string(i) + "\n";
+        expected += line;
+        for (auto ch : line)
+        {
+            contents.push_back('\0');
+            contents.push_back(ch);
+        }
+    }
+    path = tempDir.Write("encoding.txt", contents);
+    auto spThreaded = std::make_shared<ZepEditor>();
+    auto pAsync = spThreaded->AddBuffer("encoding_async.txt");
+    ASSERT_TRUE(pAsync->LoadAsync(path));
+    pAsync->WaitForLoad();
+    ASSERT_TRUE(pAsync->GetEncoding().type == TextEncoding::Utf16BE && !pAsync->GetEncoding().bom);
+    ASSERT_EQ(pAsync->GetText().string(), expected + '\0');
+    ASSERT_EQ(pAsync->GetLineCount(), 50001);
+    ASSERT_TRUE(pAsync->Save());
+    ASSERT_EQ(ReadTempFile(path), contents);
+}
+
+TEST(BufferTest, BinaryFileOpensAsHexView)
+{
+    ScopedTempDir tempDir;
+    std::string contents;
+    for (int i = 0; i < 100000; i++)
+    {
+        contents.push_back(char(i & 0xFF));
+    }
+    auto path = tempDir.Write("binary.bin", contents);
+
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->OpenFile(path);
+    ASSERT_TRUE(pBuffer != nullptr);
+    ASSERT_TRUE(pBuffer->IsBinary());
+    ASSERT_TRUE(pBuffer->IsReadOnly());
+    ASSERT_EQ(pBuffer->GetLineCount(), ZepBuffer::BinaryWindowRows);
+    auto pBinary = pBuffer->GetBinaryFile();
+
+    // Overwrite the second byte: two hex digits, then a character on the ASCII side
+    auto row = pBuffer->GetLinePos(0, LineLocation::LineBegin);
+    auto next = pBuffer->OverwriteBinary(row + pBinary->HexColumn(1), 'a');
+    ASSERT_EQ(next, row + pBinary->HexColumn(1) + 1);
+    next = pBuffer->OverwriteBinary(next, 'B');
+    ASSERT_EQ(next, row + pBinary->HexColumn(2));
+    ASSERT_EQ(pBuffer->OverwriteBinary(next, 'g'), -1);
+    ASSERT_EQ(pBuffer->OverwriteBinary(row + pBinary->AsciiColumn(2), 'Z'), row + pBinary->AsciiColumn(3));
+    ASSERT_EQ(pBuffer->BinaryOffsetAt(row + pBinary->AsciiColumn(2)), 2);
+    ASSERT_EQ(pBuffer->BinaryOffsetAt(row), -1);
+    ASSERT_TRUE(pBuffer->IsDirty());
+
+    auto rowText = pBuffer->GetText().string().substr(0, pBinary->AsciiColumn(3));
+    ASSERT_EQ(rowText, "00000000  00 ab 5a 03 04 05 06 07  08 09 0a 0b 0c 0d 0e 0f  ..Z");
+
+    // A match far outside the window slides it along
+    auto found = pBuffer->FindBinary({ 0xFD, 0xFE, 0xFF }, row, SearchDirection::Forward);
+    ASSERT_EQ(pBuffer->GetBinaryFirstRow(), 0);
+    ASSERT_EQ(pBuffer->BinaryOffsetAt(found), 253);
+    found = pBuffer->FindBinary({ 0xFD, 0xFE, 0xFF }, pBuffer->GetLinePos(ZepBuffer::BinaryWindowRows - 1, LineLocation::LineBegin));
+    ASSERT_EQ(pBuffer->BinaryOffsetAt(found), 65280 + 253);
+    found = pBuffer->FindBinary({ 0xFD, 0xFE, 0xFF }, found);
+    ASSERT_GT(pBuffer->GetBinaryFirstRow(), 0);
+    ASSERT_EQ(pBuffer->BinaryOffsetAt(found), 65536 + 253);
+    found = pBuffer->FindBinary({ 0xFD, 0xFE, 0xFF }, found, SearchDirection::Backward);
+    ASSERT_EQ(pBuffer->BinaryOffsetAt(found), 65280 + 253);
+
+    ASSERT_TRUE(pBuffer->Save());
+    ASSERT_FALSE(pBuffer->IsDirty());
+    contents[1] = char(0xAB);
+    contents[2] = 'Z';
+    ASSERT_EQ(ReadTempFile(path), contents);
+}
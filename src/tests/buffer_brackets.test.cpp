@@ -0,0 +1,177 @@
+#include "m3rdparty.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include "src/buffer.h"
+#include "src/buffer_brackets.h"
+#include "src/syntax_glsl.h"
+
+using namespace Zep;
+
+namespace
+{
+// About 1.5MB of nested brackets, in a block of braces
+std::string MakeText()
+{
+    std::ostringstream str;
+    str << "{\n";
+    for (int i = 0; i < 100000; i++)
+    {
+        str << "  f(x[" << i << "]) { }\n";
+    }
+    str << "}\n";
+    return str.str();
+}
+
+// The partner of the bracket at location, found the slow way
+long MatchBySearch(const GapBuffer<utf8>& text, long location)
+{
+    const std::string brackets = "()[]{}";
+    auto kind = brackets.find(char(text[location]));
+    if (kind == std::string::npos)
+    {
+        return -1;
+    }
+
+    auto open = brackets[kind & ~1];
+    auto close = brackets[kind | 1];
+    auto step = (kind & 1) ? -1 : 1;
+    long depth = 0;
+    for (auto pos = location; pos >= 0 && pos < long(text.size()); pos += step)
+    {
+        if (text[pos] == open || text[pos] == close)
+        {
+            depth += (text[pos] == (step == 1 ? open : close)) ? 1 : -1;
+            if (depth == 0)
+            {
+                return pos;
+            }
+        }
+    }
+    return -1;
+}
+}
+
+TEST(BracketIndex, PairsBrackets)
+{
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->AddBuffer("Brackets");
+    pBuffer->SetText("f(a[1], {b(c)})\na)(");
+
+    auto& brackets = pBuffer->GetBrackets();
+    brackets.Wait();
+    ASSERT_TRUE(brackets.IsComplete());
+    ASSERT_EQ(pBuffer->GetMemoryUsage().brackets, brackets.GetMemoryUsage());
+
+    ASSERT_EQ(brackets.FindMatch(1), 14);
+    ASSERT_EQ(brackets.FindMatch(14), 1);
+    ASSERT_EQ(brackets.FindMatch(3), 5);
+    ASSERT_EQ(brackets.FindMatch(8), 13);
+    ASSERT_EQ(brackets.FindMatch(12), 10);
+    ASSERT_EQ(brackets.FindMatch(0), -1);
+    ASSERT_EQ(brackets.FindMatch(17), -1);
+    ASSERT_EQ(brackets.FindMatch(18), -1);
+
+    // Depth counts the pairs of the same kind around a bracket
+    ASSERT_EQ(brackets.GetDepth(1), 0);
+    ASSERT_EQ(brackets.GetDepth(10), 1);
+    ASSERT_EQ(brackets.GetDepth(12), 1);
+    ASSERT_EQ(brackets.GetDepth(8), 0);
+    ASSERT_EQ(brackets.GetDepth(2), -1);
+
+    ASSERT_EQ(brackets.FindEnclosing(11, '('), 10);
+    ASSERT_EQ(brackets.FindEnclosing(9, '('), 1);
+    ASSERT_EQ(brackets.FindEnclosing(9, '{'), 8);
+    ASSERT_EQ(brackets.FindEnclosing(10, '('), 1);
+    ASSERT_EQ(brackets.FindEnclosing(0, '('), -1);
+    ASSERT_EQ(brackets.FindEnclosing(9, ')'), -1);
+
+    ASSERT_EQ(brackets.FindNext(2, 15), 3);
+    ASSERT_EQ(brackets.FindNext(15, 17), -1);
+}
+
+TEST(BracketIndex, SkipsCommentsAndStrings)
+{
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->AddBuffer("Brackets.vert");
+    pBuffer->SetSyntax(std::make_shared<ZepSyntaxGlsl>(*pBuffer));
+    pBuffer->SetText("f(\"(\\\"\", ')') // )\n{ }");
+
+    auto& brackets = pBuffer->GetBrackets();
+    ASSERT_EQ(brackets.FindMatch(1), 12);
+    ASSERT_EQ(brackets.FindMatch(3), -1);
+    ASSERT_EQ(brackets.FindMatch(10), -1);
+    ASSERT_EQ(brackets.FindMatch(17), -1);
+    ASSERT_EQ(brackets.FindMatch(19), 21);
+
+    // Edits change what is in a comment
+    pBuffer->Insert(12, "//");
+    ASSERT_EQ(brackets.FindMatch(1), -1);
+    pBuffer->Delete(12, 14);
+    ASSERT_EQ(brackets.FindMatch(1), 12);
+    pBuffer->Insert(0, "(");
+    ASSERT_EQ(brackets.FindMatch(0), -1);
+    ASSERT_EQ(brackets.FindMatch(13), 2);
+}
+
+TEST(BracketIndex, PairsAcrossBlocks)
+{
+    auto spEditor = std::make_shared<ZepEditor>();
+    auto pBuffer = spEditor->AddBuffer("Brackets");
+    pBuffer->SetText(MakeText());
+
+    auto& brackets = pBuffer->GetBrackets();
+    auto& text = pBuffer->GetText();
+    auto last = long(text.size()) - 3;
+    ASSERT_EQ(brackets.FindMatch(0), last);
+    ASSERT_EQ(brackets.FindMatch(last), 0);
+    ASSERT_EQ(brackets.FindEnclosing(long(text.size()) / 2, '{'), 0);
+    ASSERT_EQ(brackets.GetDepth(last - 2), 1);
+
+    // Edits land while the blocks are being scanned, and some run across them
+    std::mt19937 rng(7);
+    const char* pieces[] = { "(", ")", "{\n", "}\n", "[x]", "\n" };
+    for (int edit = 0; edit < 200; edit++)
+    {
+        auto size = long(text.size()) - 1;
+        auto at = long(rng() % (size + 1));
+        auto choice = rng() % 10;
+        if (choice < 4 && at < size)
+        {
+            pBuffer->Delete(at, std::min(size, at + long(rng() % (choice == 0 ? 400000 : 8)) + 1));
+        }
+        else
+        {
+            pBuffer->Insert(at, pieces[rng() % 6]);
+        }
+
+        if (rng() % 4 == 0)
+        {
+            brackets.Update();
+        }
+        if (rng() % 20 == 0)
+        {
+            auto location = long(rng() % text.size());
+            auto bracket = brackets.FindNext(location, long(text.size()));
+            if (bracket != -1)
+            {
+                ASSERT_EQ(brackets.FindMatch(bracket), MatchBySearch(text, bracket));
+            }
+        }
+    }
+
+    brackets.Wait();
+    ASSERT_TRUE(brackets.IsComplete());
+    for (int check = 0; check < 20; check++)
+    {
+        auto bracket = brackets.FindNext(long(rng() % text.size()), long(text.size()));
+        if (bracket != -1)
+        {
+            ASSERT_EQ(brackets.FindMatch(bracket), MatchBySearch(text, bracket));
+        }
+    }
+
+    // Replacing the text starts again
+    pBuffer->SetText(MakeText());
+    ASSERT_EQ(brackets.FindMatch(0), long(text.size()) - 3);
+}
@@ -0,0 +1,170 @@
+#include "m3rdparty.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include "src/buffer.h"
+#include "src/buffer_diff.h"
+#include "src/display.h"
+
+using namespace Zep;
+
+namespace
+{
+std::string MakeLines(long count, long seed)
+{
+    std::ostringstream str;
+    for (long i = 0; i < count; i++)
+    {
+        str << "line " << (i * seed) % 97 << " of " << i << "\n";
+    }
+    return str.str();
+}
+
+// Without the terminating 0
+std::string BufferText(ZepBuffer* pBuffer)
+{
+    auto& text = pBuffer->GetText();
+    return std::string(text.begin(), text.end() - 1);
+}
+
+void ExpectSameHunks(const std::vector<DiffHunk>& a, const std::vector<DiffHunk>& b)
+{
+    ASSERT_EQ(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        ASSERT_EQ(a[i].oldStart, b[i].oldStart);
+        ASSERT_EQ(a[i].oldCount, b[i].oldCount);
+        ASSERT_EQ(a[i].newStart, b[i].newStart);
+        ASSERT_EQ(a[i].newCount, b[i].newCount);
+    }
+}
+}
+
+TEST(BufferDiff, LineTypesAndMapping)
+{
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pOld = spEditor->AddBuffer("Old");
+    auto pNew = spEditor->AddBuffer("New");
+    pOld->SetText("a\nb\nc\nd\ne\n");
+    pNew->SetText("a\nx\nc\ne\nf\ng\n");
+
+    ZepBufferDiff diff(*spEditor, pOld, pNew);
+    ASSERT_EQ(diff.GetHunks().size(), 3u);
+
+    ASSERT_EQ(diff.GetLineType(DiffSide::Old, 0), DiffLineType::Same);
+    ASSERT_EQ(diff.GetLineType(DiffSide::Old, 1), DiffLineType::Changed);
+    ASSERT_EQ(diff.GetLineType(DiffSide::New, 1), DiffLineType::Changed);
+    ASSERT_EQ(diff.GetLineType(DiffSide::Old, 3), DiffLineType::Removed);
+    ASSERT_EQ(diff.GetLineType(DiffSide::New, 4), DiffLineType::Added);
+    ASSERT_EQ(diff.GetLineType(DiffSide::New, 5), DiffLineType::Added);
+
+    ASSERT_TRUE(diff.IsGapBefore(DiffSide::New, 3));
+    ASSERT_FALSE(diff.IsGapBefore(DiffSide::New, 2));
+    ASSERT_TRUE(diff.IsGapBefore(DiffSide::Old, 5));
+
+    ASSERT_EQ(diff.MapLine(DiffSide::Old, 2), 2);
+    ASSERT_EQ(diff.MapLine(DiffSide::Old, 4), 3);
+    ASSERT_EQ(diff.MapLine(DiffSide::New, 3), 4);
+    ASSERT_EQ(diff.MapLine(DiffSide::New, 5), 5);
+}
+
+// Edits only rehash the lines they touch; the hunks must come out as if both buffers were diffed from scratch
+TEST(BufferDiff, IncrementalMatchesFullDiff)
+{
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pOld = spEditor->AddBuffer("Old");
+    auto pNew = spEditor->AddBuffer("New");
+    pOld->SetText(MakeLines(400, 3));
+    pNew->SetText(MakeLines(400, 3));
+
+    ZepBufferDiff diff(*spEditor, pOld, pNew);
+    ASSERT_TRUE(diff.GetHunks().empty());
+
+    std::mt19937 rng(7);
+    const char* inserts[] = { "x", "\n", "new line\n", "a\nb\nc" };
+    for (int i = 0; i < 200; i++)
+    {
+        auto pBuffer = (i % 3) == 0 ? pOld : pNew;
+        auto size = long(pBuffer->GetText().size()) - 1;
+        auto pos = long(rng() % (size + 1));
+        if ((rng() % 2) == 0 && size > 0)
+        {
+            auto end = std::min(size, pos + long(rng() % 20) + 1);
+            pos = std::min(pos, size - 1);
+            pBuffer->Delete(pos, end);
+        }
+        else
+        {
+            pBuffer->Insert(pos, inserts[rng() % 4]);
+        }
+
+        if ((i % 5) == 0)
+        {
+            diff.Update();
+            ZepBufferDiff fresh(*spEditor, pOld, pNew);
+            ExpectSameHunks(diff.GetHunks(), fresh.GetHunks());
+        }
+    }
+
+    pNew->SetText(BufferText(pOld));
+    diff.Update();
+    ASSERT_TRUE(diff.GetHunks().empty());
+}
+
+// Enough lines that the hashing is split across the pool
+TEST(BufferDiff, ParallelHashMatchesText)
+{
+    auto spEditor = std::make_shared<ZepEditor>();
+    auto pOld = spEditor->AddBuffer("Old");
+    auto pNew = spEditor->AddBuffer("New");
+    auto text = MakeLines(200000, 5);
+    pOld->SetText(text);
+    pNew->SetText(text);
+
+    // Move the gap into the middle of the new buffer, so some lines are read from either side of it
+    pNew->Insert(long(text.size() / 2), "changed\n");
+
+    ZepBufferDiff diff(*spEditor, pOld, pNew);
+    ASSERT_EQ(diff.GetHunks().size(), 1u);
+    ASSERT_EQ(diff.GetHunks()[0].oldCount, 1);
+    ASSERT_EQ(diff.GetHunks()[0].newCount, 2);
+
+    std::vector<uint64_t> oldLines;
+    std::vector<uint64_t> newLines;
+    auto newText = BufferText(pNew);
+    DiffUtils::HashLines(text.data(), text.data() + text.size(), oldLines);
+    DiffUtils::HashLines(newText.data(), newText.data() + newText.size(), newLines);
+    ExpectSameHunks(diff.GetHunks(), DiffUtils::DiffLines(oldLines, newLines));
+}
+
+TEST(BufferDiff, WindowsScrollTogether)
+{
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pOld = spEditor->AddBuffer("Old");
+    auto pNew = spEditor->AddBuffer("New");
+    pOld->SetText(MakeLines(1000, 1));
+    pNew->SetText(std::string(10, '\n') + MakeLines(1000, 1));
+
+    ZepDisplayNull display(*spEditor);
+    display.SetDisplaySize(NVec2f(0.0f, 0.0f), NVec2f(1024.0f, 768.0f));
+    display.ShowDiff(pOld, pNew);
+    ASSERT_EQ(display.GetWindows().size(), 2u);
+
+    auto pLeft = display.GetWindows()[0].get();
+    auto pRight = display.GetWindows()[1].get();
+    ASSERT_EQ(pLeft->GetCurrentBuffer(), pOld);
+    ASSERT_EQ(pRight->GetCurrentBuffer(), pNew);
+
+    display.SetCurrentWindow(pLeft);
+    pLeft->ScrollToLine(100);
+    display.Display();
+    ASSERT_EQ(pRight->bufferCL.y, 110);
+
+    display.SetCurrentWindow(pRight);
+    pRight->ScrollToLine(500);
+    display.Display();
+    ASSERT_EQ(pLeft->bufferCL.y, 490);
+
+    display.CloseDiff();
+    ASSERT_TRUE(pLeft->GetDiff() == nullptr);
+}
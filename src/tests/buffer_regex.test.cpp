@@ -0,0 +1,329 @@
+#include "m3rdparty.h"
+#include <gtest/gtest.h>
+#include <regex>
+#include "src/buffer.h"
+#include "src/buffer_regex.h"
+
+using namespace Zep;
+
+namespace
+{
+// With the gap at gapAt, and the 0 the buffer ends with
+void FillText(GapBuffer<utf8>& text, const std::string& str, long gapAt = -1)
+{
+    std::string withGap = str;
+    withGap.push_back(0);
+    if (gapAt < 0)
+    {
+        text.assign(withGap.begin(), withGap.end());
+        return;
+    }
+
+    // Put the last part in first, then the start in front of it, which leaves the gap between them
+    text.assign(withGap.begin() + gapAt, withGap.end());
+    text.insert(text.begin(), withGap.begin(), withGap.begin() + gapAt);
+}
+
+std::vector<long> LineEnds(const std::string& str)
+{
+    std::vector<long> lineEnds;
+    for (long i = 0; i < long(str.size()); i++)
+    {
+        if (str[i] == '\n')
+        {
+            lineEnds.push_back(i + 1);
+        }
+    }
+    lineEnds.push_back(long(str.size()) + 1);
+    return lineEnds;
+}
+
+// The first match at or after start, as text; "<none>" if there isn't one
+std::string FindText(const std::string& pattern, const std::string& str, long start = 0, uint32_t flags = RegexFlags::None)
+{
+    ZepRegex regex(pattern, flags);
+    EXPECT_TRUE(regex.IsValid()) << pattern << ": " << regex.GetError();
+    GapBuffer<utf8> text;
+    FillText(text, str);
+    RegexMatch match;
+    if (!regex.Find(text, LineEnds(str), start, -1, match))
+    {
+        return "<none>";
+    }
+    return str.substr(size_t(match.start), size_t(match.end - match.start));
+}
+} // namespace
+
+TEST(Regex, MatchesVimPatterns)
+{
+    ASSERT_EQ(FindText("needle", "hay needle hay"), "needle");
+    ASSERT_EQ(FindText("a.c", "abd a-c"), "a-c");
+    ASSERT_EQ(FindText("ab*c", "xac abbbc"), "ac");
+    ASSERT_EQ(FindText("ab\\+c", "xac abbbc"), "abbbc");
+    ASSERT_EQ(FindText("colou\\=r", "color"), "color");
+    ASSERT_EQ(FindText("colou\\?r", "colour"), "colour");
+    ASSERT_EQ(FindText("a\\{2,3}", "a aa aaaa"), "aa");
+    ASSERT_EQ(FindText("x\\{2}", "xxxx"), "xx");
+    ASSERT_EQ(FindText("x\\{-1,}", "xxxx"), "x");
+    ASSERT_EQ(FindText("a.\\{-}b", "a12b3b"), "a12b");
+    ASSERT_EQ(FindText("a.*b", "a12b3b"), "a12b3b");
+    ASSERT_EQ(FindText("[0-9]\\+", "abc 1234 x"), "1234");
+    ASSERT_EQ(FindText("[^ ]\\+", "   word  "), "word");
+    ASSERT_EQ(FindText("[]x]\\+", "a]x]b"), "]x]");
+    ASSERT_EQ(FindText("[[:upper:]][[:lower:]]*", "abc Hello"), "Hello");
+    ASSERT_EQ(FindText("\\d\\+\\s\\w\\+", "x 42 apples"), "42 apples");
+    ASSERT_EQ(FindText("\\u\\l\\+", "abc Word"), "Word");
+    ASSERT_EQ(FindText("0x\\x\\+", "val 0xBEEF;"), "0xBEEF");
+    ASSERT_EQ(FindText("cat\\|dog", "hotdog cat"), "dog");
+    ASSERT_EQ(FindText("\\(ab\\)\\+", "xababab"), "ababab");
+    ASSERT_EQ(FindText("\\%(ab\\|cd\\)x", "cdx"), "cdx");
+    ASSERT_EQ(FindText("a\\.b", "axb a.b"), "a.b");
+    ASSERT_EQ(FindText("1*2", "*2 12"), "2");
+    ASSERT_EQ(FindText("*x", "a*x"), "*x");
+    ASSERT_EQ(FindText("a$b", "a$b"), "a$b");
+    ASSERT_EQ(FindText("a^b", "a^b"), "a^b");
+}
+
+TEST(Regex, AnchorsAndBoundaries)
+{
+    ASSERT_EQ(FindText("^foo", "a foo\nfoo bar"), "foo");
+    ASSERT_EQ(FindText("^foo.*", "a foo\nfoo bar"), "foo bar");
+    ASSERT_EQ(FindText("bar$", "bar x\nthe bar"), "bar");
+    ASSERT_EQ(FindText("^$", "a\n\nb"), "");
+    ASSERT_EQ(FindText("\\<is\\>", "this is"), "is");
+    ASSERT_EQ(FindText("\\<th", "with this"), "th");
+    ASSERT_EQ(FindText("a\\nb", "xa\nb"), "a\nb");
+    ASSERT_EQ(FindText("a.b", "a\nb"), "<none>");
+    ASSERT_EQ(FindText("a\\_.b", "a\nb"), "a\nb");
+    ASSERT_EQ(FindText("a\\_s*b", "a \n b"), "a \n b");
+    ASSERT_EQ(FindText("[^x]\\+", "ab\ncd"), "ab");
+    ASSERT_EQ(FindText("foo\\zsbar", "foobar"), "bar");
+    ASSERT_EQ(FindText("foo\\zebar", "foo foobar"), "foo");
+
+    // The line index finds the line starts; the match is on the last line
+    std::string lines;
+    for (int i = 0; i < 1000; i++)
+    {
+        lines += "line " + std::to_string(i) + "\n";
+    }
+    lines += "target";
+    ASSERT_EQ(FindText("^tar", lines), "tar");
+    ASSERT_EQ(FindText("^line 999$", lines), "line 999");
+}
+
+TEST(Regex, MagicAndCase)
+{
+    ASSERT_EQ(FindText("\\v(ab)+c", "ababc"), "ababc");
+    ASSERT_EQ(FindText("\\va{2}", "aaa"), "aa");
+    ASSERT_EQ(FindText("\\v<is>", "this is"), "is");
+    ASSERT_EQ(FindText("\\va\\+", "aa+"), "a+");
+    ASSERT_EQ(FindText("\\Va.b", "axb a.b"), "a.b");
+    ASSERT_EQ(FindText("\\Ma*", "aa a*"), "a*");
+    ASSERT_EQ(FindText("\\Ma\\*", "aa"), "aa");
+    ASSERT_EQ(FindText("hello", "HeLLo hello"), "hello");
+    ASSERT_EQ(FindText("hello\\c", "HeLLo hello"), "HeLLo");
+    ASSERT_EQ(FindText("hello", "HeLLo hello", 0, RegexFlags::IgnoreCase), "HeLLo");
+    ASSERT_EQ(FindText("\\Chello", "HeLLo hello", 0, RegexFlags::IgnoreCase), "hello");
+    ASSERT_EQ(FindText("[a-c]\\+", "xABC", 0, RegexFlags::IgnoreCase), "ABC");
+}
+
+TEST(Regex, IgnoresCase)
+{
+    const auto ignoreCase = RegexFlags::IgnoreCase;
+    const auto smartCase = RegexFlags::IgnoreCase | RegexFlags::SmartCase;
+    ASSERT_EQ(FindText("caf\xC3\xA9", "CAF\xC3\x89", 0, ignoreCase), "CAF\xC3\x89");
+    ASSERT_EQ(FindText("\xD0\xBC\xD0\xB8\xD1\x80\\c", "\xD0\x9C\xD0\x98\xD0\xA0"), "\xD0\x9C\xD0\x98\xD0\xA0");
+    ASSERT_EQ(FindText("\xC4\x81\xC3\xBF", "\xC4\x80\xC5\xB8", 0, ignoreCase), "\xC4\x80\xC5\xB8");
+    ASSERT_EQ(FindText("\xCE\xB1\\+", "\xCE\x91\xCE\xB1", 0, ignoreCase), "\xCE\x91\xCE\xB1");
+    ASSERT_EQ(FindText("[\xC3\xA0-\xC3\xA9]\\+", "x\xC3\x89\xC3\xA8", 0, ignoreCase), "\xC3\x89\xC3\xA8");
+    ASSERT_EQ(FindText("[^\xC3\xA9]", "\xC3\x89x", 0, ignoreCase), "x");
+    ASSERT_EQ(FindText("\xC3\x97", "\xC3\xB7\xC3\x97", 0, ignoreCase), "\xC3\x97");
+
+    // Smartcase ignores case until there is an upper case letter; not one after a backslash
+    ASSERT_EQ(FindText("hello", "HeLLo hello", 0, smartCase), "HeLLo");
+    ASSERT_EQ(FindText("Hello", "HELLO Hello", 0, smartCase), "Hello");
+    ASSERT_EQ(FindText("\\Shello", "xHELLO", 0, smartCase), "xHELLO");
+    ASSERT_EQ(FindText("\xC3\x89t\xC3\xA9", "\xC3\x89T\xC3\x89 \xC3\x89t\xC3\xA9", 0, smartCase), "\xC3\x89t\xC3\xA9");
+    ASSERT_EQ(FindText("hello\\C", "HeLLo hello", 0, smartCase), "hello");
+    ASSERT_EQ(FindText("Hello\\c", "HELLO Hello", 0, smartCase), "HELLO");
+    ASSERT_EQ(FindText("Hello", "HeLLo hello", 0, RegexFlags::SmartCase), "<none>");
+
+    // The prefix goes on through the letters, folded; the literal one stops at the first of them
+    ZepRegex regex("12Ab\\c");
+    ASSERT_EQ(regex.GetLiteralPrefix(), "12");
+    ASSERT_EQ(regex.GetFoldedPrefix(), "12ab");
+    ASSERT_EQ(ZepRegex("12Ab").GetFoldedPrefix(), "");
+    ASSERT_EQ(ZepRegex("\\<x\xC3\xA9y\\c").GetFoldedPrefix(), "x");
+}
+
+TEST(Regex, FoldsAWordAtATime)
+{
+    // Near misses all the way along, so every word has a candidate in it; and the match at every place in a word
+    for (long at = 0; at < 24; at++)
+    {
+        std::string str = std::string(size_t(at), 'n') + "nEEdLe @[ neEDLE";
+        for (long gapAt = 0; gapAt <= long(str.size()); gapAt += 3)
+        {
+            GapBuffer<utf8> text;
+            FillText(text, str, gapAt);
+            RegexMatch match;
+            ZepRegex regex("needle \\c");
+            ASSERT_EQ(regex.GetFoldedPrefix(), "needle ");
+            ASSERT_TRUE(regex.Find(text, LineEnds(str), 0, -1, match)) << at << " " << gapAt;
+            ASSERT_EQ(match.start, at);
+            ASSERT_TRUE(ZepRegex("needLE", RegexFlags::IgnoreCase).Find(text, LineEnds(str), at + 2, -1, match));
+            ASSERT_EQ(match.start, at + 10);
+
+            // Only the letters fold; not the characters either side of them
+            ASSERT_TRUE(ZepRegex("\\V@[ N\\c").Find(text, LineEnds(str), 0, -1, match));
+            ASSERT_FALSE(ZepRegex("\\V`{ n\\c").Find(text, LineEnds(str), 0, -1, match));
+        }
+    }
+}
+
+TEST(Regex, Utf8)
+{
+    ASSERT_EQ(FindText("caf.", "caf\xC3\xA9!"), "caf\xC3\xA9");
+    ASSERT_EQ(FindText("[\xC3\xA0-\xC3\xBF]\\+", "x\xC3\xA9\xC3\xA8y"), "\xC3\xA9\xC3\xA8");
+    ASSERT_EQ(FindText("[^a]b", "\xE2\x82\xAC" "b"), "\xE2\x82\xAC" "b");
+    ASSERT_EQ(FindText("\xE2\x82\xAC\\d", "\xE2\x82\xAC" "x \xE2\x82\xAC" "5"), "\xE2\x82\xAC" "5");
+}
+
+TEST(Regex, Groups)
+{
+    ZepRegex regex("\\(\\w\\+\\)=\\(\\d*\\)\\|\\(none\\)");
+    ASSERT_EQ(regex.GetGroupCount(), 3);
+
+    std::string str = "x: key=42";
+    GapBuffer<utf8> text;
+    FillText(text, str);
+    RegexMatch match;
+    ASSERT_TRUE(regex.Find(text, LineEnds(str), 0, -1, match));
+    long start, end;
+    ASSERT_TRUE(match.GetGroup(1, start, end));
+    ASSERT_EQ(str.substr(start, end - start), "key");
+    ASSERT_TRUE(match.GetGroup(2, start, end));
+    ASSERT_EQ(str.substr(start, end - start), "42");
+    ASSERT_FALSE(match.GetGroup(3, start, end));
+}
+
+TEST(Regex, SearchesAcrossTheGap)
+{
+    std::string str = "first line\nsecond needle here\nthird";
+    auto lineEnds = LineEnds(str);
+    ZepRegex regex("ne\\+dle h");
+    ZepRegex anchored("^second");
+    ASSERT_EQ(regex.GetLiteralPrefix(), "ne");
+
+    // Every place the gap can be, including the middle of the match and of the prefix
+    for (long gapAt = 0; gapAt <= long(str.size()); gapAt++)
+    {
+        GapBuffer<utf8> text;
+        FillText(text, str, gapAt);
+        RegexMatch match;
+        ASSERT_TRUE(regex.Find(text, lineEnds, 0, -1, match)) << gapAt;
+        ASSERT_EQ(match.start, 18);
+        ASSERT_EQ(match.end, 26);
+
+        ASSERT_TRUE(anchored.Find(text, lineEnds, 0, -1, match)) << gapAt;
+        ASSERT_EQ(match.start, 11);
+    }
+}
+
+TEST(Regex, FindsLastAndRanges)
+{
+    std::string str = "one two one\nthree one\nfour";
+    GapBuffer<utf8> text;
+    FillText(text, str);
+    auto lineEnds = LineEnds(str);
+    ZepRegex regex("one");
+
+    RegexMatch match;
+    ASSERT_TRUE(regex.FindLast(text, lineEnds, 0, long(str.size()), match));
+    ASSERT_EQ(match.start, 18);
+    ASSERT_TRUE(regex.FindLast(text, lineEnds, 0, 17, match));
+    ASSERT_EQ(match.start, 8);
+    ASSERT_FALSE(regex.FindLast(text, lineEnds, 1, 7, match));
+
+    // Starts in range; the match can run past the end of it
+    ASSERT_TRUE(regex.Find(text, lineEnds, 1, 8, match));
+    ASSERT_EQ(match.start, 8);
+    ASSERT_FALSE(regex.Find(text, lineEnds, 1, 7, match));
+}
+
+TEST(Regex, ReportsErrors)
+{
+    for (auto pattern : { "\\(abc", "abc\\)", "\\+a", "a**", "a\\{2", "[z-a]", "\\(a\\)\\1", "a\\@=b", "\\%d12" })
+    {
+        ZepRegex regex(pattern);
+        ASSERT_FALSE(regex.IsValid()) << pattern;
+        ASSERT_FALSE(regex.GetError().empty()) << pattern;
+    }
+
+    // An unclosed [ is a literal, as in Vim
+    ASSERT_EQ(FindText("a[b", "xa[b"), "a[b");
+}
+
+// The same answers as std::regex, on patterns both can read
+TEST(Regex, AgreesWithStdRegex)
+{
+    std::string str;
+    for (int i = 0; i < 200; i++)
+    {
+        str += "item_" + std::to_string(i * 7919 % 1000) + " = value(" + std::to_string(i) + ");\n";
+    }
+
+    std::vector<std::pair<std::string, std::string>> patterns = {
+        { "value(1[0-9])", "value\\(1[0-9]\\)" },
+        { "item_[0-9]+ = v", "item_[0-9]\\+ = v" },
+        { "[0-9]{3}\\)", "[0-9]\\{3})" },
+        { "(item|value)_?[0-9]*[2-4]", "\\(item\\|value\\)_\\=[0-9]*[2-4]" },
+        { "= [a-z]+\\(19", "= [a-z]\\+(19" },
+    };
+
+    GapBuffer<utf8> text;
+    FillText(text, str, long(str.size() / 2));
+    auto lineEnds = LineEnds(str);
+    for (auto& pattern : patterns)
+    {
+        std::regex stdRegex(pattern.first);
+        ZepRegex regex(pattern.second);
+        ASSERT_TRUE(regex.IsValid()) << pattern.second;
+
+        long start = 0;
+        auto itr = std::sregex_iterator(str.begin(), str.end(), stdRegex);
+        for (; itr != std::sregex_iterator(); itr++)
+        {
+            RegexMatch match;
+            ASSERT_TRUE(regex.Find(text, lineEnds, start, -1, match)) << pattern.second;
+            ASSERT_EQ(match.start, long(itr->position())) << pattern.second;
+            ASSERT_EQ(match.end - match.start, long(itr->length())) << pattern.second;
+            start = std::max(match.end, match.start + 1);
+        }
+        RegexMatch match;
+        ASSERT_FALSE(regex.Find(text, lineEnds, start, -1, match)) << pattern.second;
+    }
+}
+
+TEST(Regex, BufferSearch)
+{
+    auto spEditor = std::make_shared<ZepEditor>();
+    auto pBuffer = spEditor->AddBuffer("search.txt");
+    pBuffer->SetText("alpha beta\ngamma beta\ndelta");
+
+    ASSERT_EQ(pBuffer->Search("beta", 0), 6);
+    ASSERT_EQ(pBuffer->Search("beta", 7), 17);
+    ASSERT_EQ(pBuffer->Search("beta", 17, SearchDirection::Backward), 6);
+    ASSERT_EQ(pBuffer->Search("^d", 0), 22);
+    ASSERT_EQ(pBuffer->Search("zeta", 0), InvalidOffset);
+    ASSERT_EQ(pBuffer->Search("\\(bad", 0), InvalidOffset);
+
+    // After an edit moves the gap into the middle
+    pBuffer->Insert(13, "XX");
+    ZepRegex regex("gaXXmma \\zsbeta");
+    RegexMatch match;
+    ASSERT_TRUE(pBuffer->FindMatch(regex, 0, SearchDirection::Forward, match));
+    ASSERT_EQ(match.start, 19);
+    ASSERT_TRUE(pBuffer->FindMatch(regex, 30, SearchDirection::Backward, match));
+    ASSERT_EQ(match.start, 19);
+}
@@ -0,0 +1,194 @@
+#include "m3rdparty.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include "src/buffer.h"
+#include "src/buffer_search.h"
+
+using namespace Zep;
+
+namespace
+{
+// The matches of a search from scratch
+std::vector<SearchMatch> FindAll(ZepBuffer* pBuffer, const std::string& pattern)
+{
+    std::vector<SearchMatch> matches;
+    ZepRegex regex(pattern);
+    regex.ForEachMatch(pBuffer->GetText(), pBuffer->GetLineEnds(), 0, -1, [&](const RegexMatch& match)
+    {
+        matches.push_back(SearchMatch{ match.start, match.end });
+        return true;
+    });
+    return matches;
+}
+
+BufferLocation NextStart(const ZepBufferSearch& search, BufferLocation location, SearchDirection dir)
+{
+    SearchMatch match = { -1, -1 };
+    search.FindNext(location, dir, match);
+    return match.start;
+}
+
+void ExpectSameMatches(const std::vector<SearchMatch>& a, const std::vector<SearchMatch>& b)
+{
+    ASSERT_EQ(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        ASSERT_EQ(a[i].start, b[i].start);
+        ASSERT_EQ(a[i].end, b[i].end);
+    }
+}
+
+// Through the matches one at a time, as the display reads them; so the shift from edits is added, not applied to them
+void ExpectSameMatches(const ZepBufferSearch& search, const std::vector<SearchMatch>& b)
+{
+    ASSERT_EQ(search.GetMatchCount(), b.size());
+    for (size_t i = 0; i < b.size(); i++)
+    {
+        ASSERT_EQ(search.GetMatch(i).start, b[i].start);
+        ASSERT_EQ(search.GetMatch(i).end, b[i].end);
+    }
+}
+}
+
+TEST(BufferSearch, RefinesAsThePatternGrows)
+{
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->AddBuffer("Search");
+    pBuffer->SetText("foo food fool\nfor the fox; foo.bar fo\nafoot aaaab aaab\n");
+
+    auto& search = pBuffer->GetSearch();
+    for (auto pattern : { "f", "fo", "foo", "food", "foo\\>", "fo\\+", "a", "aa", "aaa", "aaab" })
+    {
+        search.SetPattern(pattern);
+        ExpectSameMatches(search.GetMatches(), FindAll(pBuffer, pattern));
+    }
+
+    search.SetPattern("foo");
+    ASSERT_EQ(search.GetMatches().size(), 5u);
+    ASSERT_EQ(search.GetMatch(search.MatchesFrom(5)).start, 4);
+    ASSERT_EQ(search.GetMatch(search.MatchesFrom(7)).start, 9);
+
+    // A bad pattern matches nothing, until it is fixed
+    search.SetPattern("foo\\(");
+    ASSERT_TRUE(search.GetMatches().empty());
+    search.SetPattern("foo\\(d\\)");
+    ExpectSameMatches(search.GetMatches(), FindAll(pBuffer, "foo\\(d\\)"));
+
+    search.Clear();
+    ASSERT_TRUE(search.GetMatches().empty());
+}
+
+TEST(BufferSearch, StepsThroughTheIndex)
+{
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->AddBuffer("Search");
+    pBuffer->SetText("ab ab\nxx ab\n");
+
+    auto& search = pBuffer->GetSearch();
+    search.SetPattern("ab");
+    ASSERT_EQ(NextStart(search, 0, SearchDirection::Forward), 3);
+    ASSERT_EQ(NextStart(search, 2, SearchDirection::Forward), 3);
+    ASSERT_EQ(NextStart(search, 9, SearchDirection::Forward), 0);
+    ASSERT_EQ(NextStart(search, 3, SearchDirection::Backward), 0);
+    ASSERT_EQ(NextStart(search, 4, SearchDirection::Backward), 3);
+    ASSERT_EQ(NextStart(search, 0, SearchDirection::Backward), 9);
+    ASSERT_EQ(search.CountTo(0), 1);
+    ASSERT_EQ(search.CountTo(8), 2);
+    ASSERT_EQ(search.CountTo(20), 3);
+
+    // Edits move the index with them
+    pBuffer->Insert(0, "ab\n");
+    search.Update();
+    ASSERT_EQ(search.GetMatches().size(), 4u);
+    ASSERT_EQ(NextStart(search, 0, SearchDirection::Forward), 3);
+
+    search.SetPattern("zz");
+    SearchMatch match;
+    ASSERT_FALSE(search.FindNext(0, SearchDirection::Forward, match));
+    ASSERT_EQ(search.CountTo(5), 0);
+}
+
+TEST(BufferSearch, FollowsEdits)
+{
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->AddBuffer("Search");
+
+    std::mt19937 rng(7);
+    std::ostringstream str;
+    for (int i = 0; i < 200; i++)
+    {
+        str << "ab ba " << (rng() % 2 ? "abba" : "a\nb") << "\n";
+    }
+
+    for (auto pattern : { "ab", "a\\nb", "^b", "b\\+a$" })
+    {
+        pBuffer->SetText(str.str());
+        auto& search = pBuffer->GetSearch();
+        search.SetPattern(pattern);
+
+        const char* pieces[] = { "a", "b", "ab", "\n", "ba\nab", " " };
+        for (int edit = 0; edit < 300; edit++)
+        {
+            auto size = long(pBuffer->GetText().size()) - 1;
+            auto at = long(rng() % (size + 1));
+            if (rng() % 2 && at < size)
+            {
+                pBuffer->Delete(at, std::min(size, at + long(rng() % 4) + 1));
+            }
+            else
+            {
+                pBuffer->Insert(at, pieces[rng() % 6]);
+            }
+
+            // Several edits between updates, sometimes
+            if (rng() % 3 == 0)
+            {
+                search.Update();
+                ExpectSameMatches(search, FindAll(pBuffer, pattern));
+            }
+        }
+        search.Update();
+        ExpectSameMatches(search.GetMatches(), FindAll(pBuffer, pattern));
+    }
+}
+
+TEST(BufferSearch, SearchesTheRestInTheBackground)
+{
+    auto spEditor = std::make_shared<ZepEditor>();
+    auto pBuffer = spEditor->AddBuffer("Search");
+
+    std::ostringstream str;
+    for (int i = 0; i < 50000; i++)
+    {
+        str << "line " << i << " has " << (i % 7 == 0 ? "a needle" : "hay") << "\n";
+    }
+    pBuffer->SetText(str.str());
+
+    // The visible lines are searched before it returns
+    auto& search = pBuffer->GetSearch();
+    auto visibleStart = pBuffer->GetLinePos(700, LineLocation::LineBegin);
+    auto visibleEnd = pBuffer->GetLinePos(740, LineLocation::LineBegin);
+    search.SetPattern("needle", visibleStart, visibleEnd);
+    if (!search.IsComplete())
+    {
+        ASSERT_EQ(search.GetMatches().size(), 6u);
+        ASSERT_TRUE(search.GetMatch(search.MatchesFrom(visibleStart)).start > visibleStart);
+    }
+    search.Wait();
+    ASSERT_TRUE(search.IsComplete());
+    ExpectSameMatches(search.GetMatches(), FindAll(pBuffer, "needle"));
+
+    // An edit while searching starts it again
+    search.SetPattern("a needle", visibleStart, visibleEnd);
+    pBuffer->Insert(0, "a needle\n");
+    pBuffer->Delete(pBuffer->GetLinePos(1000, LineLocation::LineBegin), pBuffer->GetLinePos(1010, LineLocation::LineBegin));
+    search.Wait();
+    ExpectSameMatches(search.GetMatches(), FindAll(pBuffer, "a needle"));
+
+    // So does replacing the text
+    pBuffer->SetText(str.str() + str.str());
+    search.Update();
+    search.Wait();
+    ExpectSameMatches(search.GetMatches(), FindAll(pBuffer, "a needle"));
+}
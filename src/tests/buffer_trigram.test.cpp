@@ -0,0 +1,195 @@
+#include "m3rdparty.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include "src/buffer.h"
+#include "src/buffer_search.h"
+#include "src/buffer_trigram.h"
+
+using namespace Zep;
+
+namespace
+{
+// About 4MB of lines, with a needle every so often
+std::string MakeText(int needleEvery)
+{
+    std::ostringstream str;
+    for (int i = 0; i < 100000; i++)
+    {
+        str << "line " << i << " of the haystack" << (i % needleEvery == 0 ? " Needle" : "") << " ends here\n";
+    }
+    return str.str();
+}
+
+// Every match of the literal starts in one of the ranges; there are none while no block is indexed
+void ExpectCandidates(ZepBuffer* pBuffer, const std::string& literal)
+{
+    SearchRanges ranges;
+    if (!pBuffer->GetTrigramIndex().FindCandidates(literal, ranges))
+    {
+        ASSERT_FALSE(pBuffer->GetTrigramIndex().IsComplete());
+        return;
+    }
+    ASSERT_TRUE(ranges.empty() || ranges.back().second <= long(pBuffer->GetText().size()));
+
+    auto& text = pBuffer->GetText();
+    ZepRegex regex(literal, RegexFlags::IgnoreCase);
+    regex.ForEachMatch(text, pBuffer->GetLineEnds(), 0, -1, [&](const RegexMatch& match)
+    {
+        auto itr = std::find_if(ranges.begin(), ranges.end(), [&](const std::pair<long, long>& range)
+        {
+            return match.start >= range.first && match.start < range.second;
+        });
+        EXPECT_TRUE(itr != ranges.end());
+        return true;
+    });
+}
+
+long RangesSize(const SearchRanges& ranges)
+{
+    long size = 0;
+    for (auto& range : ranges)
+    {
+        size += range.second - range.first;
+    }
+    return size;
+}
+}
+
+TEST(TrigramIndex, NarrowsTheSearch)
+{
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->AddBuffer("Index");
+    pBuffer->SetText(MakeText(40000));
+
+    // Too small to index, until the minimum comes down
+    auto& index = pBuffer->GetTrigramIndex();
+    SearchRanges ranges;
+    index.Update();
+    ASSERT_FALSE(index.IsActive());
+    index.SetMinimumSize(0);
+    index.Wait();
+    ASSERT_TRUE(index.IsComplete());
+    ASSERT_TRUE(index.GetMemoryUsage() > 0);
+    ASSERT_EQ(pBuffer->GetMemoryUsage().index, index.GetMemoryUsage());
+
+    // Three needles, in a block each; letters match either case
+    ASSERT_TRUE(index.FindCandidates("needle", ranges));
+    ASSERT_EQ(ranges.size(), 3u);
+    ASSERT_TRUE(RangesSize(ranges) <= ZepTrigramIndex::BlockSize * 6);
+    ExpectCandidates(pBuffer, "needle");
+    ExpectCandidates(pBuffer, "NEEDLE ends");
+    ASSERT_TRUE(index.FindCandidates("needles", ranges));
+    ASSERT_TRUE(ranges.empty());
+
+    // Too short, or only its first line counts
+    ASSERT_FALSE(index.FindCandidates("ne", ranges));
+    ASSERT_FALSE(index.FindCandidates("ne\nedle", ranges));
+    ASSERT_TRUE(index.FindCandidates("here\nzzz", ranges));
+    ASSERT_EQ(RangesSize(ranges), long(pBuffer->GetText().size()));
+
+    // The search only looks where the index says
+    auto& search = pBuffer->GetSearch();
+    search.SetPattern("Needle");
+    ASSERT_EQ(search.GetMatches().size(), 3u);
+    ASSERT_EQ(pBuffer->GetText()[search.GetMatches()[1].start], 'N');
+
+    // Edited blocks are searched until they are indexed again
+    pBuffer->Insert(10, "needle");
+    ASSERT_FALSE(index.IsComplete());
+    ExpectCandidates(pBuffer, "needle");
+    index.Update();
+    ASSERT_TRUE(index.IsComplete());
+    ExpectCandidates(pBuffer, "needle");
+
+    index.SetEnabled(false);
+    ASSERT_FALSE(index.IsActive());
+    ASSERT_FALSE(index.FindCandidates("needle", ranges));
+    index.Update();
+    ASSERT_FALSE(index.IsActive());
+}
+
+TEST(TrigramIndex, DroppedOverBudget)
+{
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->AddBuffer("Index");
+    pBuffer->SetText(MakeText(10));
+
+    auto& index = pBuffer->GetTrigramIndex();
+    index.SetMinimumSize(0);
+    index.SetMemoryBudget(16 * 1024);
+    index.Wait();
+    ASSERT_TRUE(index.IsOverBudget());
+    ASSERT_FALSE(index.IsActive());
+    ASSERT_EQ(index.GetMemoryUsage(), 0u);
+
+    index.SetMemoryBudget(ZepTrigramIndex::DefaultMemoryBudget);
+    index.Wait();
+    ASSERT_TRUE(index.IsComplete());
+    ExpectCandidates(pBuffer, "needle");
+}
+
+TEST(TrigramIndex, FollowsEdits)
+{
+    auto spEditor = std::make_shared<ZepEditor>();
+    auto pBuffer = spEditor->AddBuffer("Index");
+    pBuffer->SetText(MakeText(5000));
+
+    auto& index = pBuffer->GetTrigramIndex();
+    index.SetMinimumSize(0);
+    index.Wait();
+
+    // Edits land while the blocks are being indexed, and some run across them
+    std::mt19937 rng(11);
+    const char* pieces[] = { "nee", "dle", "needle\n", "\n", "x", "line\nneedle" };
+    for (int edit = 0; edit < 200; edit++)
+    {
+        auto size = long(pBuffer->GetText().size()) - 1;
+        auto at = long(rng() % (size + 1));
+        auto choice = rng() % 10;
+        if (choice < 4 && at < size)
+        {
+            pBuffer->Delete(at, std::min(size, at + long(rng() % (choice == 0 ? 600000 : 8)) + 1));
+        }
+        else
+        {
+            pBuffer->Insert(at, pieces[rng() % 6]);
+        }
+
+        if (rng() % 4 == 0)
+        {
+            index.Update();
+        }
+        if (rng() % 10 == 0)
+        {
+            ExpectCandidates(pBuffer, "needle");
+        }
+    }
+
+    index.Wait();
+    ASSERT_TRUE(index.IsComplete());
+    ExpectCandidates(pBuffer, "needle");
+    ExpectCandidates(pBuffer, "line 4");
+
+    auto& search = pBuffer->GetSearch();
+    search.SetPattern("needle");
+    search.Wait();
+    std::vector<SearchMatch> matches;
+    ZepRegex("needle").ForEachMatch(pBuffer->GetText(), pBuffer->GetLineEnds(), 0, -1, [&](const RegexMatch& match)
+    {
+        matches.push_back(SearchMatch{ match.start, match.end });
+        return true;
+    });
+    ASSERT_EQ(search.GetMatches().size(), matches.size());
+    for (size_t i = 0; i < matches.size(); i++)
+    {
+        ASSERT_EQ(search.GetMatches()[i].start, matches[i].start);
+    }
+
+    // Replacing the text starts again
+    pBuffer->SetText(MakeText(30000));
+    index.Wait();
+    SearchRanges ranges;
+    ASSERT_TRUE(index.FindCandidates("needle", ranges));
+    ASSERT_EQ(ranges.size(), 4u);
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include <random>
+#include "src/utils/diff.h"
+
+using namespace Zep;
+
+namespace
+{
+// Apply the hunks to the old lines; the result should be the new lines
+std::vector<uint64_t> Apply(const std::vector<uint64_t>& oldLines, const std::vector<uint64_t>& newLines, const std::vector<DiffHunk>& hunks)
+{
+    std::vector<uint64_t> result;
+    long oldLine = 0;
+    for (auto& hunk : hunks)
+    {
+        result.insert(result.end(), oldLines.begin() + oldLine, oldLines.begin() + hunk.oldStart);
+        result.insert(result.end(), newLines.begin() + hunk.newStart, newLines.begin() + hunk.newStart + hunk.newCount);
+        oldLine = hunk.oldStart + hunk.oldCount;
+    }
+    result.insert(result.end(), oldLines.begin() + oldLine, oldLines.end());
+    return result;
+}
+}
+
+TEST(Diff, SimpleEdits)
+{
+    ASSERT_TRUE(DiffUtils::DiffLines({ 1, 2, 3 }, { 1, 2, 3 }).empty());
+
+    auto hunks = DiffUtils::DiffLines({ 1, 2, 3 }, { 1, 4, 3 });
+    ASSERT_EQ(hunks.size(), 1u);
+    ASSERT_EQ(hunks[0].oldStart, 1);
+    ASSERT_EQ(hunks[0].oldCount, 1);
+    ASSERT_EQ(hunks[0].newStart, 1);
+    ASSERT_EQ(hunks[0].newCount, 1);
+
+    hunks = DiffUtils::DiffLines({ 1, 2, 3, 4, 5 }, { 2, 3, 9, 4, 5, 6 });
+    ASSERT_EQ(hunks.size(), 3u);
+    ASSERT_EQ(hunks[0].oldCount, 1);
+    ASSERT_EQ(hunks[0].newCount, 0);
+    ASSERT_EQ(hunks[1].oldStart, 3);
+    ASSERT_EQ(hunks[1].newCount, 1);
+    ASSERT_EQ(hunks[2].oldStart, 5);
+    ASSERT_EQ(hunks[2].newStart, 5);
+
+    hunks = DiffUtils::DiffLines({}, { 1, 2 });
+    ASSERT_EQ(hunks.size(), 1u);
+    ASSERT_EQ(hunks[0].newCount, 2);
+}
+
+TEST(Diff, RandomEditsRoundTrip)
+{
+    std::mt19937 rng(7);
+    for (int test = 0; test < 200; test++)
+    {
+        // A small alphabet, so there are plenty of equal lines in the wrong places
+        std::uniform_int_distribution<int> line(0, 5);
+        std::uniform_int_distribution<int> length(0, 40);
+        std::vector<uint64_t> oldLines(length(rng));
+        for (auto& l : oldLines)
+        {
+            l = line(rng);
+        }
+
+        auto newLines = oldLines;
+        std::uniform_int_distribution<int> edits(0, 6);
+        for (int i = edits(rng); i > 0; i--)
+        {
+            auto pos = newLines.empty() ? 0 : rng() % (newLines.size() + 1);
+            if ((rng() & 1) && pos < newLines.size())
+            {
+                newLines.erase(newLines.begin() + pos);
+            }
+            else
+            {
+                newLines.insert(newLines.begin() + pos, line(rng));
+            }
+        }
+
+        auto hunks = DiffUtils::DiffLines(oldLines, newLines);
+        ASSERT_EQ(Apply(oldLines, newLines, hunks), newLines);
+    }
+}
+
+TEST(Diff, HashLines)
+{
+    std::vector<uint64_t> hashes;
+    std::string text = "one\ntwo\none\n";
+    DiffUtils::HashLines(text.data(), text.data() + text.size(), hashes);
+    ASSERT_EQ(hashes.size(), 4u);
+    ASSERT_EQ(hashes[0], hashes[2]);
+    ASSERT_NE(hashes[0], hashes[1]);
+
+    // The last line is there even when empty, like the buffer's
+    text = "one";
+    DiffUtils::HashLines(text.data(), text.data() + text.size(), hashes);
+    ASSERT_EQ(hashes.size(), 1u);
+}
@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+#include "src/utils/encoding.h"
+
+using namespace Zep;
+
+namespace
+{
+FileEncoding DetectString(const std::string& text, size_t& bomSize)
+{
+    auto p = (const uint8_t*)text.data();
+    return EncodingUtils::Detect(p, p + text.size(), bomSize);
+}
+
+std::string Utf16(const std::string& ascii, bool littleEndian)
+{
+    std::string out;
+    for (auto ch : ascii)
+    {
+        out.push_back(littleEndian ? ch : '\0');
+        out.push_back(littleEndian ? '\0' : ch);
+    }
+    return out;
+}
+
+// A byte at a time and all at once must agree; the pieces split characters every way there is
+std::string DecodeInPieces(TextEncoding type, const std::string& text, size_t pieceSize)
+{
+    EncodingUtils::Utf8Decoder decoder(type);
+    std::vector<uint8_t> out;
+    auto p = (const uint8_t*)text.data();
+    for (size_t i = 0; i < text.size(); i += pieceSize)
+    {
+        decoder.Decode(p + i, p + std::min(text.size(), i + pieceSize), out);
+    }
+    return std::string(out.begin(), out.end());
+}
+
+std::string EncodeString(const FileEncoding& encoding, const std::string& text)
+{
+    std::string out;
+    auto p = (const uint8_t*)text.data();
+    EncodingUtils::Encode(encoding, p, p + text.size(), out);
+    return out;
+}
+}
+
+TEST(Encoding, DetectsMarksAndGuesses)
+{
+    size_t bomSize = 0;
+    auto encoding = DetectString("\xEF\xBB\xBFhello", bomSize);
+    ASSERT_TRUE(encoding.type == TextEncoding::Utf8 && encoding.bom);
+    ASSERT_EQ(bomSize, 3u);
+
+    encoding = DetectString(std::string("\xFF\xFEh\0i\0", 6), bomSize);
+    ASSERT_TRUE(encoding.type == TextEncoding::Utf16LE && encoding.bom);
+    ASSERT_EQ(bomSize, 2u);
+
+    encoding = DetectString(Utf16("No mark on this one", false), bomSize);
+    ASSERT_TRUE(encoding.type == TextEncoding::Utf16BE && !encoding.bom);
+    ASSERT_EQ(bomSize, 0u);
+
+    encoding = DetectString(Utf16("Nor this", true), bomSize);
+    ASSERT_TRUE(encoding.type == TextEncoding::Utf16LE);
+
+    ASSERT_TRUE(DetectString("caf\xC3\xA9 na\xC3\xAFve", bomSize).IsUtf8());
+    ASSERT_TRUE(DetectString("", bomSize).IsUtf8());
+    ASSERT_TRUE(DetectString("caf\xE9 na\xEFve", bomSize).type == TextEncoding::Latin1);
+
+    // Overlong, and an encoded surrogate
+    ASSERT_TRUE(DetectString("\xC0\xAF", bomSize).type == TextEncoding::Latin1);
+    ASSERT_TRUE(DetectString("\xED\xA0\x80", bomSize).type == TextEncoding::Latin1);
+}
+
+TEST(Encoding, DecodesAcrossPieces)
+{
+    // ASCII long enough for the word at a time path, then a 2, 3 and 4 byte character
+    const std::string expected = "Plenty of plain ASCII here caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80 end";
+
+    std::string le;
+    std::string be;
+    auto pushUnit = [&](uint16_t unit)
+    {
+        le.push_back(char(unit & 0xFF));
+        le.push_back(char(unit >> 8));
+        be.push_back(char(unit >> 8));
+        be.push_back(char(unit & 0xFF));
+    };
+    for (auto ch : std::string("Plenty of plain ASCII here caf"))
+    {
+        pushUnit(uint16_t(ch));
+    }
+    for (auto unit : { 0xE9, 0x20, 0x20AC, 0x20, 0xD83D, 0xDE00, 0x20, 0x65, 0x6E, 0x64 })
+    {
+        pushUnit(uint16_t(unit));
+    }
+
+    for (size_t pieceSize : { 1, 3, 7, 1000 })
+    {
+        ASSERT_EQ(DecodeInPieces(TextEncoding::Utf16LE, le, pieceSize), expected);
+        ASSERT_EQ(DecodeInPieces(TextEncoding::Utf16BE, be, pieceSize), expected);
+    }
+
+    ASSERT_EQ(DecodeInPieces(TextEncoding::Latin1, "Plain ASCII then caf\xE9", 5), "Plain ASCII then caf\xC3\xA9");
+
+    // A lone surrogate becomes U+FFFD
+    ASSERT_EQ(DecodeInPieces(TextEncoding::Utf16LE, std::string("\x3D\xD8" "a\0", 4), 2), "\xEF\xBF\xBD" "a");
+
+    // So does a NUL, on the word at a time path or not
+    auto withNul = Utf16("Sixteen units, then", true);
+    withNul[6] = '\0';
+    ASSERT_EQ(DecodeInPieces(TextEncoding::Utf16LE, withNul, 1000), "Six\xEF\xBF\xBD" "een units, then");
+    ASSERT_EQ(DecodeInPieces(TextEncoding::Utf16LE, withNul, 1), "Six\xEF\xBF\xBD" "een units, then");
+    ASSERT_EQ(DecodeInPieces(TextEncoding::Latin1, std::string("Eight by\0tes caf\xE9", 17), 1000), "Eight by\xEF\xBF\xBDtes caf\xC3\xA9");
+}
+
+TEST(Encoding, FinishEndsCutOffCharacter)
+{
+    EncodingUtils::Utf8Decoder decoder(TextEncoding::Utf16LE);
+    std::vector<uint8_t> out;
+    auto text = std::string("a\0\x3D\xD8", 4);
+    decoder.Decode((const uint8_t*)text.data(), (const uint8_t*)text.data() + text.size(), out);
+    ASSERT_EQ(std::string(out.begin(), out.end()), "a");
+    decoder.Finish(out);
+    ASSERT_EQ(std::string(out.begin(), out.end()), "a\xEF\xBF\xBD");
+
+    // An odd byte at the end is half a unit
+    out.clear();
+    decoder.Decode((const uint8_t*)text.data(), (const uint8_t*)text.data() + 3, out);
+    decoder.Finish(out);
+    ASSERT_EQ(std::string(out.begin(), out.end()), "a\xEF\xBF\xBD");
+
+    // Nothing held over, nothing added
+    out.clear();
+    decoder.Finish(out);
+    ASSERT_TRUE(out.empty());
+}
+
+TEST(Encoding, EncodesBack)
+{
+    const std::string text = "Plenty of plain ASCII here caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80";
+
+    FileEncoding utf16;
+    utf16.type = TextEncoding::Utf16BE;
+    ASSERT_EQ(DecodeInPieces(TextEncoding::Utf16BE, EncodeString(utf16, text), 4), text);
+    utf16.type = TextEncoding::Utf16LE;
+    ASSERT_EQ(DecodeInPieces(TextEncoding::Utf16LE, EncodeString(utf16, text), 4), text);
+    utf16.bom = true;
+    ASSERT_STREQ(EncodingUtils::ByteOrderMark(utf16), "\xFF\xFE");
+
+    // Latin-1 can't hold the euro or the emoji
+    FileEncoding latin1;
+    latin1.type = TextEncoding::Latin1;
+    ASSERT_EQ(EncodeString(latin1, text), "Plenty of plain ASCII here caf\xE9 ? ?");
+    ASSERT_STREQ(EncodingUtils::ByteOrderMark(latin1), "");
+
+    // And says so; as does UTF-16 for bytes that aren't UTF-8, which Latin-1 takes as they are
+    std::string out;
+    auto p = (const uint8_t*)text.data();
+    ASSERT_FALSE(EncodingUtils::Encode(latin1, p, p + text.size(), out));
+    ASSERT_TRUE(EncodingUtils::Encode(utf16, p, p + text.size(), out));
+    const std::string invalid("caf\xE9");
+    p = (const uint8_t*)invalid.data();
+    ASSERT_TRUE(EncodingUtils::Encode(latin1, p, p + invalid.size(), out));
+    ASSERT_FALSE(EncodingUtils::Encode(utf16, p, p + invalid.size(), out));
+}
@@ -0,0 +1,168 @@
+#include "m3rdparty.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include "src/buffer.h"
+#include "src/grep.h"
+#include "tests/temp_dir.h"
+
+using namespace Zep;
+
+namespace
+{
+// "path:line:column" for each result, sorted; the tasks finish in any order
+std::vector<std::string> GetLocations(const ZepGrep& grep)
+{
+    std::vector<std::string> locations;
+    for (auto& result : grep.GetResults())
+    {
+        locations.push_back(result.path + ":" + std::to_string(result.line + 1) + ":" + std::to_string(result.column + 1));
+    }
+    std::sort(locations.begin(), locations.end());
+    return locations;
+}
+}
+
+TEST(GrepTest, SearchesEveryBuffer)
+{
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    spEditor->AddBuffer("One")->SetText("one two\nthree\n  two twice\n");
+    spEditor->AddBuffer("Two")->SetText("twelve");
+
+    auto& grep = spEditor->GetGrep();
+    ASSERT_TRUE(grep.Start("tw\\(o\\|elve\\)"));
+    ASSERT_TRUE(grep.Update());
+    ASSERT_FALSE(grep.IsRunning());
+
+    // A line for each line with a match on it, in the results buffer
+    auto locations = GetLocations(grep);
+    ASSERT_EQ(locations.size(), 3u);
+    ASSERT_STREQ(locations[0].c_str(), "One:1:5");
+    ASSERT_STREQ(locations[1].c_str(), "One:3:3");
+    ASSERT_STREQ(locations[2].c_str(), "Two:1:1");
+    auto text = grep.GetResultsBuffer()->GetText().string();
+    ASSERT_NE(text.find("One:3:3:   two twice\n"), std::string::npos);
+    ASSERT_NE(text.find("Two:1:1: twelve\n"), std::string::npos);
+
+    ASSERT_EQ(grep.Step(1), &grep.GetResults()[0]);
+    ASSERT_EQ(grep.Step(5), &grep.GetResults()[2]);
+    ASSERT_EQ(grep.Step(-1), &grep.GetResults()[1]);
+    ASSERT_EQ(grep.Select(-3), &grep.GetResults()[0]);
+
+    // The results buffer isn't searched itself; and a bad pattern starts nothing
+    ASSERT_TRUE(grep.Start("twice"));
+    grep.Update();
+    ASSERT_EQ(grep.GetResults().size(), 1u);
+    ASSERT_FALSE(grep.Start("tw\\("));
+    ASSERT_EQ(grep.GetResults().size(), 1u);
+
+    ASSERT_TRUE(grep.Start("nothing"));
+    ASSERT_FALSE(grep.Update());
+    ASSERT_TRUE(grep.Step(1) == nullptr);
+}
+
+TEST(GrepTest, CopiesBigBuffersOverFrames)
+{
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto pSmall = spEditor->AddBuffer("Small");
+    pSmall->SetText("hay\n");
+    auto pBig = spEditor->AddBuffer("Big");
+    pBig->SetText(std::string(5 * 1024 * 1024, 'x') + "needle\n");
+
+    // The newest buffer is first, and the first frame only gets part of it copied
+    auto& grep = spEditor->GetGrep();
+    ASSERT_TRUE(grep.Start("needle"));
+    ASSERT_FALSE(grep.Update());
+    ASSERT_TRUE(grep.IsRunning());
+
+    // An edit to it finishes its copy first, so the search sees it as it was; the buffer not copied yet is searched as
+    // it is now
+    pBig->Insert(0, "needle\n");
+    pSmall->Insert(0, "needle\n");
+    ASSERT_TRUE(grep.Update());
+    ASSERT_FALSE(grep.IsRunning());
+
+    auto locations = GetLocations(grep);
+    ASSERT_EQ(locations.size(), 2u);
+    ASSERT_STREQ(locations[0].c_str(), "Big:1:5242881");
+    ASSERT_STREQ(locations[1].c_str(), "Small:1:1");
+}
+
+TEST(GrepTest, SearchesFilesOnThePool)
+{
+    ScopedTempDir tempDir;
+    tempDir.MakeDirectory("sub");
+    tempDir.MakeDirectory(".git");
+    tempDir.Write("a.txt", "needle\r\nhay\r\nhay needle\r\n");
+    tempDir.Write("sub/b.txt", "hay\nneedle");
+    tempDir.Write(".git/c.txt", "needle");
+    tempDir.Write("d.bin", std::string("needle\0needle", 13));
+    tempDir.Write("open.txt", "needle\n");
+    auto directory = tempDir.GetPath();
+
+    auto spEditor = std::make_shared<ZepEditor>();
+    for (int i = 0; i < 20; i++)
+    {
+        spEditor->AddBuffer("Buffer" + std::to_string(i))->SetText(std::string(size_t(i) * 1000, 'x') + "needle\n");
+    }
+
+    // An open file is searched as it is in its buffer, however its path was written
+    auto pOpen = spEditor->OpenFile(tempDir.GetFile("sub/../open.txt"));
+    pOpen->WaitForLoad();
+    pOpen->Insert(0, "hay\n");
+
+    auto& grep = spEditor->GetGrep();
+    ASSERT_TRUE(grep.Start("needle", directory));
+    grep.Wait();
+    ASSERT_FALSE(grep.IsRunning());
+
+    auto locations = GetLocations(grep);
+    ASSERT_EQ(locations.size(), 24u);
+    ASSERT_EQ(locations[0], directory + "/a.txt:1:1");
+    ASSERT_EQ(locations[1], directory + "/a.txt:3:5");
+    ASSERT_EQ(locations[2], directory + "/sub/../open.txt:2:1");
+    ASSERT_EQ(locations[3], directory + "/sub/b.txt:2:1");
+    ASSERT_STREQ(locations[4].c_str(), "Buffer0:1:1");
+    ASSERT_STREQ(locations[5].c_str(), "Buffer10:1:10001");
+    ASSERT_EQ(long(std::count(grep.GetResultsBuffer()->GetText().begin(), grep.GetResultsBuffer()->GetText().end(), '\n')), 24);
+
+    // Starting again stops the search that is running
+    ASSERT_TRUE(grep.Start("hay", directory));
+    ASSERT_TRUE(grep.Start("needle", directory));
+    grep.Wait();
+    ASSERT_EQ(grep.GetResults().size(), 24u);
+
+    // Stopping doesn't wait for the tasks
+    ASSERT_TRUE(grep.Start("needle", directory));
+    grep.Stop();
+    ASSERT_FALSE(grep.IsRunning());
+    ASSERT_FALSE(grep.Update());
+}
+
+// Files are read as a buffer loads them, so the columns and text are the ones the user sees on opening the file
+TEST(GrepTest, ReadsFilesLikeABuffer)
+{
+    ScopedTempDir tempDir;
+    tempDir.Write("dos.txt", "hay\r\nx\rneedle\r\n");
+    tempDir.Write("mixed.txt", "hay\nx\rneedle\r\n");
+    auto directory = tempDir.GetPath();
+
+    auto spEditor = std::make_shared<ZepEditor>(ZepEditorFlags::DisableThreads);
+    auto& grep = spEditor->GetGrep();
+    ASSERT_TRUE(grep.Start("needle", directory));
+    grep.Wait();
+
+    auto locations = GetLocations(grep);
+    ASSERT_EQ(locations.size(), 2u);
+    ASSERT_EQ(locations[0], directory + "/dos.txt:2:3");
+    ASSERT_EQ(locations[1], directory + "/mixed.txt:2:3");
+
+    for (auto& result : grep.GetResults())
+    {
+        auto pBuffer = spEditor->AddBuffer(result.path);
+        ASSERT_TRUE(pBuffer->Load(result.path));
+        long lineStart, lineEnd;
+        ASSERT_TRUE(pBuffer->GetLineOffsets(result.line, lineStart, lineEnd));
+        ASSERT_EQ(pBuffer->GetText().string().substr(size_t(lineStart + result.column), 6), "needle");
+        ASSERT_EQ(result.text, result.path == directory + "/dos.txt" ? "x\rneedle" : "x\rneedle\r");
+    }
+}
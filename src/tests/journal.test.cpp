@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "src/journal.h"
+#include "tests/temp_dir.h"
+
+using namespace Zep;
+
+namespace
+{
+std::string ReadJournal(const std::string& path)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    std::ostringstream str;
+    str << file.rdbuf();
+    return str.str();
+}
+
+FileUtils::FileStamp MakeStamp(uint64_t size, int64_t modified)
+{
+    FileUtils::FileStamp stamp;
+    stamp.size = size;
+    stamp.modified = modified;
+    return stamp;
+}
+}
+
+TEST(Journal, ReplaysEdits)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.GetFile("replay.zepjournal");
+    auto base = MakeStamp(12, 1234);
+    {
+        ZepJournal journal(path, base, true);
+        std::string hello = "Hello ";
+        journal.Insert(0, hello.data(), hello.data() + hello.size());
+        journal.Delete(6, 4);
+        std::string world = "world ";
+        journal.Insert(6, world.data(), world.data() + world.size());
+        journal.Flush();
+    }
+
+    std::string text = "one two\nend";
+    ASSERT_TRUE(ZepJournal::Replay(path, base, text));
+    ASSERT_EQ(text, "Hello world two\nend");
+
+    // Not against a file that has changed since
+    text = "one two\nend";
+    ASSERT_FALSE(ZepJournal::Replay(path, MakeStamp(12, 1235), text));
+
+    std::remove(path.c_str());
+    ASSERT_FALSE(ZepJournal::Replay(path, base, text));
+}
+
+TEST(Journal, SnapshotReplacesText)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.GetFile("snapshot.zepjournal");
+    auto base = MakeStamp(3, 1);
+    {
+        ZepJournal journal(path, base, false);
+        std::string snapshot = "abc\ndef";
+        journal.Snapshot(snapshot.data(), snapshot.data() + snapshot.size());
+        journal.Delete(0, 4);
+    }
+
+    std::string text = "xyz";
+    ASSERT_TRUE(ZepJournal::Replay(path, base, text));
+    ASSERT_EQ(text, "def");
+}
+
+// A crash can leave the last record half written, or garbage after it; the records before it still count
+TEST(Journal, StopsAtDamagedRecord)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.GetFile("torn.zepjournal");
+    auto base = MakeStamp(0, 0);
+    {
+        ZepJournal journal(path, base, true);
+        for (char ch = 'a'; ch <= 'e'; ch++)
+        {
+            journal.Insert(long(ch - 'a'), &ch, &ch + 1);
+        }
+    }
+
+    auto contents = ReadJournal(path);
+    std::string text;
+    ASSERT_TRUE(ZepJournal::Replay(path, base, text));
+    ASSERT_EQ(text, "abcde");
+
+    tempDir.Write("torn.zepjournal", contents.substr(0, contents.size() - 3));
+    text.clear();
+    ASSERT_TRUE(ZepJournal::Replay(path, base, text));
+    ASSERT_EQ(text, "abcd");
+
+    auto corrupt = contents;
+    corrupt[corrupt.size() - 30] ^= 0x20;
+    tempDir.Write("torn.zepjournal", corrupt);
+    text.clear();
+    ASSERT_TRUE(ZepJournal::Replay(path, base, text));
+    ASSERT_LT(text.size(), 5u);
+    ASSERT_EQ(text, std::string("abcde").substr(0, text.size()));
+
+    ZepJournal discarded(path, base, true);
+    discarded.Flush();
+    discarded.Discard();
+    std::ifstream gone(path);
+    ASSERT_FALSE(gone.good());
+}
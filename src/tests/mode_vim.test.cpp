@@ -3,8 +3,15 @@
 #include "src/editor.h"
 #include "src/mode_vim.h"
 #include "src/buffer.h"
+#include "src/buffer_search.h"
+#include "src/grep.h"
 #include "src/display.h"
 #include "src/syntax_glsl.h"
+#include "src/keytrace.h"
+#include "src/journal.h"
+#include "src/utils/fileutils.h"
+#include "tests/temp_dir.h"
+#include <fstream>
 
 using namespace Zep;
 class VimTest : public testing::Test
@@ -222,13 +229,33 @@ COMMAND_TEST(delete_ciw_space_start, " one two three", "ciwabc", "abcone two thr
 // ciW
 COMMAND_TEST(delete_ciW_first, "one! two three", "ciWabc", "abc two three");
 
+// Bracket blocks; brackets in strings and comments don't count
+COMMAND_TEST(delete_di_paren, "f(a, (b)) x", "lldi(", "f() x");
+COMMAND_TEST(delete_dib_on_close, "f(a, (b)) x", "lllllllldib", "f() x");
+COMMAND_TEST(delete_da_brace_on_open, "x {a {b}} y", "lllllda{", "x {a } y");
+COMMAND_TEST(delete_di_brace_lines, "f {\n    a;\n}", "jdi{", "f {\n}");
+COMMAND_TEST(delete_di_paren_string, "f(\")\", a) x", "lldi)", "f() x");
+COMMAND_TEST(delete_di_paren_none, "one (two", "di(x", "ne (two");
+COMMAND_TEST(delete_ci_bracket, "a[12] b", "llci]xjk", "a[x] b");
+COMMAND_TEST(delete_d_percent, "a (b) c", "d%", " c");
+COMMAND_TEST(delete_c_percent, "a (b) c", "llllc%xjk", "a x c");
+COMMAND_TEST(delete_dfx, "one, two, three", "df,", " two, three");
+COMMAND_TEST(delete_d2fx, "one, two, three", "d2f,", " three");
+COMMAND_TEST(delete_dtx, "one, two, three", "dt,", ", two, three");
+COMMAND_TEST(delete_dFx, "one, two, three", "$dF,", "one, twoe");
+COMMAND_TEST(delete_dTx, "one, two, three", "$dT,", "one, two,e");
+COMMAND_TEST(delete_dfx_missing, "one, two", "dfxx", "ne, two");
+COMMAND_TEST(change_ctx, "a(b, c)", "llct)xjk", "a(x)");
+
 // cw
 COMMAND_TEST(delete_cw, "one two three", "cwabc", "abc two three");
 COMMAND_TEST(delete_cw_inside, "one two three", "lcwabc", "oabc two three");
 COMMAND_TEST(delete_cw_inside_2, "one two three", "llllllllcwabc", "one two abc");
 
-// TODO:
-//COMMAND_TEST(delete_c2w, "one two three", "c2w", " three");
+COMMAND_TEST(delete_c2w, "one two three", "c2w", " three");
+COMMAND_TEST(delete_2cw, "one two three", "2cwx", "x three");
+COMMAND_TEST(delete_d3w, "one two three four", "d3w", "four");
+COMMAND_TEST(delete_3dW, "one! two, three four", "3dW", "four");
 
 // cW
 COMMAND_TEST(delete_cW, "one two! three", "llllcWabc", "one abc three");
@@ -287,6 +314,7 @@ COMMAND_TEST(unfinished_y, "one two", "y", "one two")
 COMMAND_TEST_RET(registers, "one\ntwo", "2Y:reg", "one\ntwo")
 COMMAND_TEST_RET(bufferset, "one", ":buf 1", "one")
 COMMAND_TEST_RET(buffers, "one", ":ls", "one")
+COMMAND_TEST_RET(memory, "one", ":mem", "one")
 COMMAND_TEST_RET(invalid_command, "one", ":invalid", "one")
 
 // Visual
@@ -323,6 +351,27 @@ CURSOR_TEST(motion_goto_beginline, "one two", "lllll0", 0, 0);
 CURSOR_TEST(motion_goto_firstlinechar, "   one two", "^", 3, 0);
 
 CURSOR_TEST(motion_2w, "one two three", "2w", 8, 0);
+CURSOR_TEST(motion_3b, "one two three four", "$3b", 4, 0);
+CURSOR_TEST(motion_2e, "one two three", "2e", 6, 0);
+CURSOR_TEST(motion_2ge, "one two three", "$2ge", 2, 0);
+CURSOR_TEST(motion_count_past_end, "one two", "50w", 7, 0);
+CURSOR_TEST(motion_count_past_start, "one two", "$50B", 0, 0);
+CURSOR_TEST(motion_fx, "one two three", "fe", 2, 0);
+CURSOR_TEST(motion_3fx, "one two three", "3fe", 12, 0);
+CURSOR_TEST(motion_2fx, "a.b.c.d", "2f.", 3, 0);
+CURSOR_TEST(motion_tx, "a.b.c.d", "t.", 0, 0);
+CURSOR_TEST(motion_Fx, "a.b.c.d", "$F.", 5, 0);
+CURSOR_TEST(motion_Tx, "a.b.c.d", "$2T.", 4, 0);
+CURSOR_TEST(motion_fx_stays_on_line, "abc\nx", "fx", 0, 0);
+CURSOR_TEST(motion_fx_too_many, "a.b.c", "3f.", 0, 0);
+CURSOR_TEST(motion_fx_large_count, "a.b.c", "1000f.", 0, 0);
+CURSOR_TEST(motion_fx_repeat, "a.b.c.d", "f.;", 3, 0);
+CURSOR_TEST(motion_fx_reverse, "a.b.c.d", "2f.;,", 3, 0);
+CURSOR_TEST(motion_tx_repeat, "a.b.c.d", "t.;", 2, 0);
+CURSOR_TEST(motion_Tx_repeat, "a.b.c.d", "$T.;", 4, 0);
+CURSOR_TEST(motion_repeat_count, "a.b.c.d", "f.2;", 5, 0);
+CURSOR_TEST(motion_repeat_nothing, "a.b.c.d", ";", 0, 0);
+CURSOR_TEST(motion_repeat_after_delete, "a.b.c.d", "dt.;", 1, 0);
 CURSOR_TEST(motion_w, "one! two three", "w", 3, 0);
 CURSOR_TEST(motion_w_space, "one two three", "lllw", 4, 0);
 CURSOR_TEST(motion_W, "one! two three", "W", 5, 0);
@@ -346,3 +395,518 @@ CURSOR_TEST(motion_G, "one\ntwo\nthree\nfour", "3G", 0, 3);
 CURSOR_TEST(motion_0, "one two", "llll0", 0, 0);
 CURSOR_TEST(motion_gg, "one two", "llllgg", 0, 0);
 CURSOR_TEST(motion_dollar, "one two", "ll$", 6, 0);
+
+CURSOR_TEST(motion_percent, "if (a(b)) x", "%", 8, 0);
+CURSOR_TEST(motion_percent_back, "if (a(b)) x", "%%", 3, 0);
+CURSOR_TEST(motion_percent_none, "ab (", "%", 0, 0);
+CURSOR_TEST(motion_percent_lines, "f {\n // }\n}", "%", 0, 2);
+CURSOR_TEST(motion_enclosing_brace, "{\n  f(a, {b});\n}", "jllll[{", 0, 0);
+CURSOR_TEST(motion_enclosing_brace_close, "{\n  f(a, {b});\n}", "jllll]}", 0, 2);
+CURSOR_TEST(motion_enclosing_paren, "{\n  f(a, {b});\n}", "jllll[(", 3, 1);
+CURSOR_TEST(motion_enclosing_paren_close, "{\n  f(a, {b});\n}", "jllll])", 10, 1);
+CURSOR_TEST(motion_enclosing_count, "{ {a} }", "lll2[{", 0, 0);
+CURSOR_TEST(motion_enclosing_none, "a (b", "]}", 0, 0);
+CURSOR_TEST(motion_enclosing_paren_on_close, "f(a(b), c)", "llllll])", 9, 0);
+CURSOR_TEST(motion_enclosing_brace_on_close, "{\n  f(a, {b});\n}", "jlllllllll]}", 0, 2);
+CURSOR_TEST(motion_enclosing_on_close_none, "f(a)", "lll])", 3, 0);
+CURSOR_TEST(motion_enclosing_open_on_open, "f(a(b))", "lll[(", 1, 0);
+CURSOR_TEST(motion_percent_count, "one\ntwo\n  three\nfour\n", "50%", 0, 1);
+CURSOR_TEST(motion_percent_count_round_up, "one\ntwo\n  three\nfour\n", "51%", 2, 2);
+CURSOR_TEST(motion_percent_count_all, "one\ntwo\nthree\nfour", "100%", 0, 3);
+CURSOR_TEST(motion_percent_count_too_big, "one\ntwo (x)\nthree", "j101%", 0, 1);
+
+TEST_F(VimTest, CountedDeleteIsOneUndo)
+{
+    spBuffer->SetText("one two three four");
+    spMode->AddCommandText("d3w");
+    ASSERT_STREQ(spBuffer->GetText().string().c_str(), "four");
+    ASSERT_STREQ(spEditor->GetRegister('"').text.c_str(), "one two three ");
+
+    spMode->AddCommandText("u");
+    ASSERT_STREQ(spBuffer->GetText().string().c_str(), "one two three four");
+    spMode->AddCommandText("u");
+    ASSERT_STREQ(spBuffer->GetText().string().c_str(), "one two three four");
+}
+
+TEST_F(VimTest, KeyTraceRecordsAndReplays)
+{
+    ZepKeyTrace trace;
+    spEditor->SetKeyTrace(&trace);
+    spBuffer->SetText("one two");
+    spMode->AddCommandText("ciwabc");
+    spMode->AddKeyPress(ExtKeys::ESCAPE);
+    spEditor->SetKeyTrace(nullptr);
+    ASSERT_EQ(trace.GetKeys().size(), 7);
+    ASSERT_EQ(trace.GetKeys()[6].key, uint32_t(ExtKeys::ESCAPE));
+
+    ZepKeyTrace loaded;
+    ASSERT_TRUE(loaded.FromString(trace.ToString()));
+    ASSERT_EQ(loaded.GetKeys().size(), trace.GetKeys().size());
+    ASSERT_FALSE(loaded.FromString("12 0\n13"));
+
+    spBuffer->SetText("one two");
+    for (auto& entry : loaded.GetKeys())
+    {
+        spMode->AddKeyPress(entry.key, entry.modifiers);
+    }
+    ASSERT_STREQ(spBuffer->GetText().string().c_str(), "abc two");
+}
+
+TEST_F(VimTest, KeyTraceReplaysCharactersBeyondLatin1)
+{
+    // Keys are code points; typing them inserts their UTF-8, and a replay inserts the same text
+    ZepKeyTrace trace;
+    spEditor->SetKeyTrace(&trace);
+    spBuffer->SetText("");
+    spMode->AddCommandText("i\xc3\xa9\xe2\x82\xac");
+    spMode->AddKeyPress(0x4E2D);
+    spMode->AddKeyPress(ExtKeys::ESCAPE);
+    spEditor->SetKeyTrace(nullptr);
+    ASSERT_STREQ(spBuffer->GetText().string().c_str(), "\xc3\xa9\xe2\x82\xac\xe4\xb8\xad");
+    ASSERT_EQ(trace.GetKeys().size(), 5);
+    ASSERT_EQ(trace.GetKeys()[2].key, 0x20ACu);
+
+    ZepKeyTrace loaded;
+    ASSERT_TRUE(loaded.FromString(trace.ToString()));
+    spBuffer->SetText("");
+    for (auto& entry : loaded.GetKeys())
+    {
+        spMode->AddKeyPress(entry.key, entry.modifiers);
+    }
+    ASSERT_STREQ(spBuffer->GetText().string().c_str(), "\xc3\xa9\xe2\x82\xac\xe4\xb8\xad");
+}
+
+TEST_F(VimTest, UndoMemoryFollowsEdits)
+{
+    spBuffer->SetText("one two");
+    ASSERT_EQ(spMode->GetUndoMemoryUsage(*spBuffer), 0);
+
+    spMode->AddCommandText("ciwabc");
+    spMode->AddKeyPress(ExtKeys::ESCAPE);
+    auto undoSize = spMode->GetUndoMemoryUsage(*spBuffer);
+    ASSERT_GT(undoSize, 0);
+
+    // Undo moves the commands to the redo stack, which still holds them
+    spMode->AddCommandText("u");
+    ASSERT_EQ(spMode->GetUndoMemoryUsage(*spBuffer), undoSize);
+}
+
+TEST_F(VimTest, PagedBufferSlidesWindow)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.GetFile("paged.txt");
+    {
+        std::ofstream file(path, std::ios::out | std::ios::binary);
+        for (long i = 0; i < 10000; i++)
+        {
+            file << "Line " << i << "\n";
+        }
+    }
+    ASSERT_TRUE(spBuffer->OpenPaged(path, 1024 * 1024));
+    spDisplay->Display();
+
+    // Walk off the end of the first window
+    for (long i = 0; i < ZepBuffer::PagedWindowLines; i++)
+    {
+        spMode->AddKeyPress('j');
+        spDisplay->Display();
+    }
+    ASSERT_GT(spBuffer->GetPagedFirstLine(), 0);
+
+    // The cursor is still on the file line we walked to
+    auto cursor = pWindow->DisplayToBuffer();
+    auto line = spBuffer->LineFromOffset(cursor) + spBuffer->GetPagedFirstLine();
+    ASSERT_EQ(line, ZepBuffer::PagedWindowLines);
+
+    // Line numbers are the file's
+    spMode->AddCommandText(":9000");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(spBuffer->LineFromOffset(pWindow->DisplayToBuffer()) + spBuffer->GetPagedFirstLine(), 8999);
+    spMode->AddCommandText("G");
+    ASSERT_EQ(spBuffer->LineFromOffset(pWindow->DisplayToBuffer()) + spBuffer->GetPagedFirstLine(), 10000);
+    spMode->AddCommandText("gg");
+    ASSERT_EQ(spBuffer->GetPagedFirstLine(), 0);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 0);
+    spMode->AddCommandText("5000G");
+    ASSERT_EQ(spBuffer->LineFromOffset(pWindow->DisplayToBuffer()) + spBuffer->GetPagedFirstLine(), 5000);
+
+    // Edits are refused
+    spMode->AddCommandText("iabc");
+    ASSERT_TRUE(spBuffer->IsReadOnly());
+    ASSERT_EQ(spBuffer->GetText().string().find("abc"), std::string::npos);
+
+    spBuffer->SetText("");
+}
+
+TEST_F(VimTest, PagedSearchGoesPastTheWindow)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.GetFile("paged.txt");
+    {
+        std::ofstream file(path, std::ios::out | std::ios::binary);
+        for (long i = 0; i < 20000; i++)
+        {
+            file << "Line " << i << "\n";
+        }
+    }
+    ASSERT_TRUE(spBuffer->OpenPaged(path, 1024 * 1024));
+    spDisplay->Display();
+
+    auto fileLine = [&]() { return spBuffer->LineFromOffset(pWindow->DisplayToBuffer()) + spBuffer->GetPagedFirstLine(); };
+
+    // Far past the lines loaded
+    spMode->AddCommandText("/Line 15000$");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(fileLine(), 15000);
+    ASSERT_GT(spBuffer->GetPagedFirstLine(), 0);
+
+    // On through the file, and back
+    spMode->AddCommandText("/^Line 1999.$");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(fileLine(), 19990);
+    spMode->AddCommandText("n");
+    ASSERT_EQ(fileLine(), 19991);
+    spMode->AddCommandText("N");
+    ASSERT_EQ(fileLine(), 19990);
+
+    // Around the end of the file to the start, and back before the window
+    spMode->AddCommandText("/Line 12$");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(fileLine(), 12);
+    ASSERT_EQ(spBuffer->GetPagedFirstLine(), 0);
+    spMode->AddCommandText("?Line 17000$");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(fileLine(), 17000);
+
+    spMode->AddCommandText("/not in the file");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(fileLine(), 17000);
+
+    spBuffer->SetText("");
+}
+
+TEST_F(VimTest, FollowScrollsWhenCursorAtEnd)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.Write("follow.txt", "one\ntwo\nthree");
+    ASSERT_TRUE(spBuffer->Follow(path));
+    spDisplay->Display();
+
+    // Not at the end; the cursor stays where it is
+    tempDir.Append("follow.txt", "\nfour");
+    spDisplay->Display();
+    ASSERT_EQ(spBuffer->GetLineCount(), 4);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 0);
+
+    spMode->AddCommandText("G");
+    spDisplay->Display();
+    {
+        std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::app);
+        for (int i = 0; i < 500; i++)
+        {
+            file << "\nLine " << i;
+        }
+    }
+    spDisplay->Display();
+    ASSERT_EQ(spBuffer->GetLineCount(), 504);
+    ASSERT_EQ(spBuffer->LineFromOffset(pWindow->DisplayToBuffer()), 503);
+
+    spBuffer->SetText("");
+}
+
+TEST_F(VimTest, HexRefusesDirtyBuffer)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.Write("hex.txt", "one\ntwo\n");
+    auto journalPath = ZepJournal::PathFor(path);
+    ASSERT_TRUE(spBuffer->Load(path));
+    spMode->AddCommandText("iabc");
+    spMode->AddKeyPress(ExtKeys::ESCAPE);
+    spBuffer->FlushJournal();
+    ASSERT_TRUE(FileUtils::Exists(journalPath));
+
+    // The edits, and the journal of them, are kept
+    spMode->AddCommandText(":hex");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_FALSE(spBuffer->IsBinary());
+    ASSERT_STREQ(spBuffer->GetText().string().c_str(), "abcone\ntwo\n");
+    ASSERT_TRUE(FileUtils::Exists(journalPath));
+
+    // Unless they are thrown away
+    spMode->AddCommandText(":hex!");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_TRUE(spBuffer->IsBinary());
+
+    spBuffer->SetText("");
+}
+
+TEST_F(VimTest, DiffSplitRemovesItsBuffer)
+{
+    ScopedTempDir tempDir;
+    auto path = tempDir.Write("diffsplit.txt", "one\ntwo\n");
+    spBuffer->SetText("one\nthree\n");
+    auto buffers = spEditor->GetBuffers().size();
+
+    // A file that can't be read leaves nothing behind
+    spMode->AddCommandText(":diffsplit " + tempDir.GetFile("missing.txt"));
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(spEditor->GetBuffers().size(), buffers);
+    ASSERT_EQ(spDisplay->GetDiff(), nullptr);
+
+    spMode->AddCommandText(":diffsplit " + path);
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_NE(spDisplay->GetDiff(), nullptr);
+    ASSERT_EQ(spEditor->GetBuffers().size(), buffers + 1);
+    spMode->AddCommandText(":diffoff");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(spEditor->GetBuffers().size(), buffers);
+
+    // Against the buffer's own file: opening the file, however its path is written, finds the buffer and not the
+    // copy the diff holds; and :vimgrep searches it once
+    ASSERT_TRUE(spBuffer->Load(path));
+    spBuffer->Insert(0, "needle\n");
+    spMode->AddCommandText(":diffsplit");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_NE(spDisplay->GetDiff(), nullptr);
+    ASSERT_EQ(spEditor->GetBuffers().size(), buffers + 1);
+    ASSERT_EQ(spEditor->OpenFile(path), spBuffer);
+    ASSERT_EQ(spEditor->OpenFile(tempDir.GetPath() + "/./diffsplit.txt"), spBuffer);
+    ASSERT_EQ(spEditor->GetBuffers().size(), buffers + 1);
+
+    auto& grep = spEditor->GetGrep();
+    ASSERT_TRUE(grep.Start("two", tempDir.GetPath()));
+    grep.Wait();
+    ASSERT_EQ(grep.GetResults().size(), 1u);
+    ASSERT_EQ(grep.GetResults()[0].path, path);
+    ASSERT_EQ(grep.GetResults()[0].line, 2);
+
+    // The results have a buffer of their own
+    spMode->AddCommandText(":diffoff");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(spDisplay->GetDiff(), nullptr);
+    ASSERT_EQ(spEditor->GetBuffers().size(), buffers + 1);
+    for (auto& spWindow : spDisplay->GetWindows())
+    {
+        ASSERT_EQ(spWindow->GetCurrentBuffer(), spBuffer);
+    }
+
+    spBuffer->SetText("");
+}
+
+TEST_F(VimTest, SearchMovesAsThePatternIsTyped)
+{
+    spBuffer->SetText("one two\nthree two\ntwenty");
+    spMode->AddCommandText("/t");
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 4);
+    spMode->AddCommandText("h");
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 8);
+    ASSERT_STREQ(spEditor->GetHighlightPattern().c_str(), "th");
+
+    // Backspace searches for less again; the display highlights the matches
+    spMode->AddKeyPress(ExtKeys::BACKSPACE);
+    spMode->AddCommandText("wo");
+    spDisplay->Display();
+    ASSERT_EQ(spBuffer->GetSearch().GetMatches().size(), 2u);
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 4);
+
+    // ? searches back, wrapping around the start
+    spMode->AddCommandText("?tw");
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 18);
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 18);
+    ASSERT_STREQ(spEditor->GetHighlightPattern().c_str(), "tw");
+
+    // Escape goes back to the start, and the highlight to the last search
+    spMode->AddCommandText("/thr");
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 8);
+    spMode->AddKeyPress(ExtKeys::ESCAPE);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 18);
+    ASSERT_STREQ(spEditor->GetHighlightPattern().c_str(), "tw");
+
+    // Not found stays put
+    spMode->AddCommandText("/four");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 18);
+
+    // Keys go back to being commands
+    spMode->AddCommandText("x:noh");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_STREQ(spBuffer->GetText().string().c_str(), "one two\nthree two\nwenty");
+    ASSERT_TRUE(spEditor->GetHighlightPattern().empty());
+    spDisplay->Display();
+    ASSERT_TRUE(spBuffer->GetSearch().GetMatches().empty());
+}
+
+TEST_F(VimTest, SearchNextAndPrevious)
+{
+    spBuffer->SetText("one two\nthree two\ntwenty two");
+    spMode->AddCommandText("n");
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 0);
+
+    spMode->AddCommandText("/two");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 4);
+    spMode->AddCommandText("n");
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 14);
+    spMode->AddCommandText("2n");
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 4);
+    spMode->AddCommandText("N");
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 25);
+
+    // The status bar counts the matches
+    spDisplay->Display();
+    ASSERT_NE(pWindow->statusLines[0].find("(Match 3 of 3)"), std::string::npos);
+
+    // ? turns n around; and n after :noh highlights again
+    spMode->AddCommandText("?two");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 14);
+    spMode->AddCommandText(":noh");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    spMode->AddCommandText("n");
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 4);
+    ASSERT_STREQ(spEditor->GetHighlightPattern().c_str(), "two");
+
+    // Edits keep the index up to date
+    spMode->AddCommandText("ggx");
+    spMode->AddCommandText("n");
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 24);
+}
+
+TEST_F(VimTest, SearchIgnoringCase)
+{
+    spBuffer->SetText("Two two TWO");
+    spMode->AddCommandText("/two");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 4);
+
+    // ignorecase finds them all, and highlights them all
+    spMode->AddCommandText(":set ic");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    spMode->AddCommandText("n");
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 8);
+    spDisplay->Display();
+    ASSERT_EQ(spBuffer->GetSearch().GetMatches().size(), 3u);
+
+    // smartcase doesn't, for a pattern with an upper case letter; \c still does
+    spMode->AddCommandText(":set smartcase");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    spMode->AddCommandText("/TWO");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 8);
+    spMode->AddCommandText("n");
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 8);
+    spMode->AddCommandText("/TWO\\c");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 0);
+
+    // :s follows the options, unless its flags say otherwise
+    spMode->AddCommandText(":s/two/x/g");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_STREQ(spBuffer->GetText().string().c_str(), "x x x");
+    spMode->AddCommandText(":set noic noscs");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    spMode->AddCommandText(":s/X/y/gi");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_STREQ(spBuffer->GetText().string().c_str(), "y y y");
+    ASSERT_EQ(spEditor->GetSearchFlags(), RegexFlags::None);
+
+    spMode->AddCommandText(":set ic nosuch");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(spEditor->GetSearchFlags(), RegexFlags::None);
+}
+
+TEST_F(VimTest, SubstitutePreviewHighlights)
+{
+    spBuffer->SetText("one two\nthree two");
+    spMode->AddCommandText(":%s/t\\/o");
+    ASSERT_STREQ(spEditor->GetHighlightPattern().c_str(), "t/o");
+    spMode->AddCommandText("/");
+    ASSERT_STREQ(spEditor->GetHighlightPattern().c_str(), "t/o");
+    spMode->AddKeyPress(ExtKeys::ESCAPE);
+    ASSERT_TRUE(spEditor->GetHighlightPattern().empty());
+
+    spMode->AddCommandText(":s#tw");
+    spDisplay->Display();
+    ASSERT_EQ(spBuffer->GetSearch().GetMatches().size(), 2u);
+    spMode->AddKeyPress(ExtKeys::ESCAPE);
+    ASSERT_TRUE(spEditor->GetHighlightPattern().empty());
+}
+
+TEST_F(VimTest, GrepStepsThroughTheResults)
+{
+    spBuffer->SetText("one two\nthree two");
+    auto pOther = spEditor->AddBuffer("Other");
+    pOther->SetText("xx\n a/two");
+
+    spMode->AddCommandText(":vimgrep /a\\/two/");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pWindow->GetCurrentBuffer(), spEditor->GetGrep().GetResultsBuffer());
+    ASSERT_EQ(spEditor->GetGrep().GetResults().size(), 1u);
+
+    spMode->AddCommandText(":vim two");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(spEditor->GetGrep().GetResults().size(), 3u);
+
+    // Buffers are searched newest first
+    spMode->AddCommandText(":cn");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pWindow->GetCurrentBuffer(), pOther);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 6);
+    spMode->AddCommandText(":cn");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pWindow->GetCurrentBuffer(), spBuffer);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 4);
+    spMode->AddCommandText(":cc 3");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 14);
+    spMode->AddCommandText(":cp");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 4);
+
+    spMode->AddCommandText(":copen");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_EQ(pWindow->GetCurrentBuffer(), spEditor->GetGrep().GetResultsBuffer());
+}
+
+COMMAND_TEST_RET(substitute_cursor_line, "a a\na a\na", "j:s/a/b", "a a\nb a\na");
+COMMAND_TEST_RET(substitute_global, "one two two\ntwo", ":%s/two/2/g", "one 2 2\n2");
+COMMAND_TEST_RET(substitute_first_on_each_line, "one two two\ntwo", ":%s/two/2", "one 2 two\n2");
+COMMAND_TEST_RET(substitute_line_range, "a\na\na\na", ":2,3s/a/b", "a\nb\nb\na");
+COMMAND_TEST_RET(substitute_relative_range, "a\na\na\na", "j:.,+1s/a/b", "a\nb\nb\na");
+COMMAND_TEST_RET(substitute_last_line, "a\na\n", ":$s/a/b", "a\nb\n");
+COMMAND_TEST_RET(substitute_bad_range, "a\na", ":1,5s/a/b", "a\na");
+COMMAND_TEST_RET(substitute_groups, "john smith", ":s/\\(\\w\\+\\) \\(\\w\\+\\)/\\u\\2, \\1", "Smith, john");
+COMMAND_TEST_RET(substitute_match, "ab", ":s/b/[&]\\&", "a[b]&");
+COMMAND_TEST_RET(substitute_case, "one two", ":s/\\w\\+/\\U&\\E!/g", "ONE! TWO!");
+COMMAND_TEST_RET(substitute_line_break, "a,b,c", ":s#,#\\r#g", "a\nb\nc");
+COMMAND_TEST_RET(substitute_join_lines, "a\nb\nc", ":%s/\\n//", "abc");
+COMMAND_TEST_RET(substitute_empty_matches, "axc", ":s/x*/-/g", "-a-c-");
+COMMAND_TEST_RET(substitute_ignore_case, "One one", ":s/one/1/gi", "1 1");
+COMMAND_TEST_RET(substitute_count_only, "a a\na", ":%s/a/b/gn", "a a\na");
+COMMAND_TEST_RET(substitute_trailing_flags, "a", ":s/a/b/x", "a");
+
+TEST_F(VimTest, SubstituteIsOneUndo)
+{
+    spBuffer->SetText("one\ntwo one\none one\n");
+    spMode->AddCommandText(":%s/one/1/g");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_STREQ(spBuffer->GetText().string().c_str(), "1\ntwo 1\n1 1\n");
+    ASSERT_EQ(spBuffer->GetLineCount(), 4);
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 8);
+    ASSERT_STREQ(spEditor->GetHighlightPattern().c_str(), "one");
+
+    spMode->Undo();
+    ASSERT_STREQ(spBuffer->GetText().string().c_str(), "one\ntwo one\none one\n");
+    ASSERT_EQ(spBuffer->GetLineEnds()[2], 20);
+    spMode->Redo();
+    ASSERT_STREQ(spBuffer->GetText().string().c_str(), "1\ntwo 1\n1 1\n");
+    ASSERT_EQ(pWindow->DisplayToBuffer(), 8);
+
+    // An empty pattern is the last one; ~ the last replacement
+    spMode->Undo();
+    spMode->AddCommandText(":2s//~~");
+    spMode->AddKeyPress(ExtKeys::RETURN);
+    ASSERT_STREQ(spBuffer->GetText().string().c_str(), "one\ntwo 11\none one\n");
+}
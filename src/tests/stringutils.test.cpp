@@ -43,6 +43,18 @@ TEST(StringUtils, SplitLines)
 
 }
 
+TEST(StringUtils, SplitLinesReusesVector)
+{
+    std::vector<std::string> lines{ "old", "lines", "here" };
+    StringUtils::SplitLines("one\ntwo", lines);
+    ASSERT_EQ(lines.size(), 2);
+    ASSERT_STREQ(lines[0].c_str(), "one");
+    ASSERT_STREQ(lines[1].c_str(), "two");
+
+    StringUtils::SplitLines("", lines);
+    ASSERT_TRUE(lines.empty());
+}
+
 TEST(StringUtils, Trim)
 {
     std::string strStart("  foo  ");
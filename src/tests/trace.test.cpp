@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "src/utils/trace.h"
+
+using namespace Zep;
+
+TEST(Trace, NotRecordingWhenStopped)
+{
+    auto& recorder = TraceRecorder::Instance();
+    recorder.Stop();
+    recorder.Clear();
+    {
+        TraceScope scope("Ignored");
+    }
+    ASSERT_EQ(recorder.GetChromeTrace().find("Ignored"), std::string::npos);
+}
+
+TEST(Trace, RecordsScopesAcrossThreads)
+{
+    auto& recorder = TraceRecorder::Instance();
+    recorder.Clear();
+    recorder.Start();
+    {
+        TraceScope scope("MainScope");
+    }
+    std::thread worker([]()
+    {
+        TraceScope scope("Worker\"Scope");
+    });
+    worker.join();
+    recorder.Stop();
+
+    auto trace = recorder.GetChromeTrace();
+    ASSERT_EQ(trace.find("{\"traceEvents\":["), 0);
+    ASSERT_NE(trace.find("\"name\":\"MainScope\",\"ph\":\"X\""), std::string::npos);
+    ASSERT_NE(trace.find("\"name\":\"Worker\\\"Scope\""), std::string::npos);
+    recorder.Clear();
+}
+
+TEST(Trace, RingKeepsNewestEvents)
+{
+    // Each event's begin time is its number, so the trace shows which survived the wrap
+    const int64_t extra = 10;
+    auto& recorder = TraceRecorder::Instance();
+    recorder.Clear();
+    recorder.Start();
+    for (int64_t i = 0; i < TraceRecorder::RingSize + extra; i++)
+    {
+        recorder.Record("Event", i, i + 1);
+    }
+    recorder.Stop();
+
+    std::vector<int64_t> ids;
+    auto trace = recorder.GetChromeTrace();
+    const std::string marker = "\"name\":\"Event\",\"ph\":\"X\",\"ts\":";
+    for (auto pos = trace.find(marker); pos != std::string::npos; pos = trace.find(marker, pos + 1))
+    {
+        ids.push_back(std::strtoll(trace.c_str() + pos + marker.size(), nullptr, 10));
+    }
+    ASSERT_EQ(ids.size(), size_t(TraceRecorder::RingSize));
+    ASSERT_EQ(ids.front(), extra);
+    ASSERT_EQ(ids.back(), TraceRecorder::RingSize + extra - 1);
+    recorder.Clear();
+}
@@ -27,6 +27,8 @@ uint32_t Theme::GetColor(uint32_t type) const
         return 0xFF11FFFF;
     case SyntaxType::Whitespace:
         return 0xFF223322;
+    case SyntaxType::String:
+        return 0xFFFF8811;
     }
 }
 
@@ -0,0 +1,263 @@
+#include "diff.h"
+#include "stringutils.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace Zep
+{
+namespace DiffUtils
+{
+
+namespace
+{
+
+const uint64_t LineHashSeed = 0x5a6e5a6e;
+
+class LineDiff
+{
+public:
+    LineDiff(const std::vector<uint64_t>& a, const std::vector<uint64_t>& b)
+        : m_a(a),
+        m_b(b),
+        m_aChanged(a.size(), false),
+        m_bChanged(b.size(), false)
+    {
+    }
+
+    std::vector<DiffHunk> Run()
+    {
+        Compare(0, long(m_a.size()), 0, long(m_b.size()));
+
+        // Walk both sides together, gathering the changed runs into hunks
+        std::vector<DiffHunk> hunks;
+        long x = 0;
+        long y = 0;
+        const auto n = long(m_a.size());
+        const auto m = long(m_b.size());
+        while (x < n || y < m)
+        {
+            if (x < n && y < m && !m_aChanged[x] && !m_bChanged[y])
+            {
+                x++;
+                y++;
+                continue;
+            }
+
+            DiffHunk hunk;
+            hunk.oldStart = x;
+            hunk.newStart = y;
+            while (x < n && m_aChanged[x])
+            {
+                x++;
+            }
+            while (y < m && m_bChanged[y])
+            {
+                y++;
+            }
+            hunk.oldCount = x - hunk.oldStart;
+            hunk.newCount = y - hunk.newStart;
+            hunks.push_back(hunk);
+        }
+        return hunks;
+    }
+
+private:
+    void Compare(long aLo, long aHi, long bLo, long bHi)
+    {
+        // Common prefix and suffix are never part of the edit
+        while (aLo < aHi && bLo < bHi && m_a[aLo] == m_b[bLo])
+        {
+            aLo++;
+            bLo++;
+        }
+        while (aLo < aHi && bLo < bHi && m_a[aHi - 1] == m_b[bHi - 1])
+        {
+            aHi--;
+            bHi--;
+        }
+
+        if (aLo == aHi)
+        {
+            std::fill(m_bChanged.begin() + bLo, m_bChanged.begin() + bHi, true);
+            return;
+        }
+        if (bLo == bHi)
+        {
+            std::fill(m_aChanged.begin() + aLo, m_aChanged.begin() + aHi, true);
+            return;
+        }
+
+        long x;
+        long y;
+        if (!Bisect(aLo, aHi, bLo, bHi, x, y))
+        {
+            std::fill(m_aChanged.begin() + aLo, m_aChanged.begin() + aHi, true);
+            std::fill(m_bChanged.begin() + bLo, m_bChanged.begin() + bHi, true);
+            return;
+        }
+
+        Compare(aLo, aLo + x, bLo, bLo + y);
+        Compare(aLo + x, aHi, bLo + y, bHi);
+    }
+
+    // Run the forward and reverse searches until they overlap; the overlap is on the middle snake of an
+    // optimal edit script, which splits the problem in two
+    bool Bisect(long aLo, long aHi, long bLo, long bHi, long& splitX, long& splitY)
+    {
+        const auto n = aHi - aLo;
+        const auto m = bHi - bLo;
+        const auto maxD = (n + m + 1) / 2;
+        const auto offset = maxD;
+        const auto length = 2 * maxD + 2;
+
+        m_forward.assign(size_t(length), -1);
+        m_reverse.assign(size_t(length), -1);
+        m_forward[offset + 1] = 0;
+        m_reverse[offset + 1] = 0;
+
+        const auto delta = n - m;
+        const bool front = (delta % 2) != 0;
+
+        // Diagonals that ran off the edge of the grid are skipped from then on
+        long k1Start = 0;
+        long k1End = 0;
+        long k2Start = 0;
+        long k2End = 0;
+
+        for (long d = 0; d < maxD; d++)
+        {
+            for (long k1 = -d + k1Start; k1 <= d - k1End; k1 += 2)
+            {
+                auto k1Offset = offset + k1;
+                long x1;
+                if (k1 == -d || (k1 != d && m_forward[k1Offset - 1] < m_forward[k1Offset + 1]))
+                {
+                    x1 = m_forward[k1Offset + 1];
+                }
+                else
+                {
+                    x1 = m_forward[k1Offset - 1] + 1;
+                }
+                auto y1 = x1 - k1;
+                while (x1 < n && y1 < m && m_a[aLo + x1] == m_b[bLo + y1])
+                {
+                    x1++;
+                    y1++;
+                }
+                m_forward[k1Offset] = x1;
+
+                if (x1 > n)
+                {
+                    k1End += 2;
+                }
+                else if (y1 > m)
+                {
+                    k1Start += 2;
+                }
+                else if (front)
+                {
+                    auto k2Offset = offset + delta - k1;
+                    if (k2Offset >= 0 && k2Offset < length && m_reverse[k2Offset] != -1)
+                    {
+                        if (x1 >= n - m_reverse[k2Offset])
+                        {
+                            splitX = x1;
+                            splitY = y1;
+                            return true;
+                        }
+                    }
+                }
+            }
+
+            for (long k2 = -d + k2Start; k2 <= d - k2End; k2 += 2)
+            {
+                auto k2Offset = offset + k2;
+                long x2;
+                if (k2 == -d || (k2 != d && m_reverse[k2Offset - 1] < m_reverse[k2Offset + 1]))
+                {
+                    x2 = m_reverse[k2Offset + 1];
+                }
+                else
+                {
+                    x2 = m_reverse[k2Offset - 1] + 1;
+                }
+                auto y2 = x2 - k2;
+                while (x2 < n && y2 < m && m_a[aHi - x2 - 1] == m_b[bHi - y2 - 1])
+                {
+                    x2++;
+                    y2++;
+                }
+                m_reverse[k2Offset] = x2;
+
+                if (x2 > n)
+                {
+                    k2End += 2;
+                }
+                else if (y2 > m)
+                {
+                    k2Start += 2;
+                }
+                else if (!front)
+                {
+                    auto k1Offset = offset + delta - k2;
+                    if (k1Offset >= 0 && k1Offset < length && m_forward[k1Offset] != -1)
+                    {
+                        auto x1 = m_forward[k1Offset];
+                        auto y1 = offset + x1 - k1Offset;
+                        if (x1 >= n - x2)
+                        {
+                            splitX = x1;
+                            splitY = y1;
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    const std::vector<uint64_t>& m_a;
+    const std::vector<uint64_t>& m_b;
+    std::vector<bool> m_aChanged;
+    std::vector<bool> m_bChanged;
+
+    // Furthest x reached on each diagonal; reused by every bisection
+    std::vector<long> m_forward;
+    std::vector<long> m_reverse;
+};
+
+} // namespace
+
+std::vector<DiffHunk> DiffLines(const std::vector<uint64_t>& oldLines, const std::vector<uint64_t>& newLines)
+{
+    LineDiff diff(oldLines, newLines);
+    return diff.Run();
+}
+
+uint64_t HashLine(const char* pBegin, const char* pEnd)
+{
+    return StringUtils::murmur_hash_64(pBegin, uint32_t(pEnd - pBegin), LineHashSeed);
+}
+
+void HashLines(const char* pBegin, const char* pEnd, std::vector<uint64_t>& hashes)
+{
+    hashes.clear();
+    auto pLine = pBegin;
+    for (;;)
+    {
+        auto pLineEnd = (const char*)memchr(pLine, '\n', size_t(pEnd - pLine));
+        if (!pLineEnd)
+        {
+            hashes.push_back(HashLine(pLine, pEnd));
+            break;
+        }
+        pLineEnd++;
+        hashes.push_back(HashLine(pLine, pLineEnd));
+        pLine = pLineEnd;
+    }
+}
+
+} // DiffUtils
+} // Zep
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Zep
+{
+
+// A run of lines in the old text replaced by a run in the new; either count can be 0
+struct DiffHunk
+{
+    long oldStart = 0;
+    long oldCount = 0;
+    long newStart = 0;
+    long newCount = 0;
+};
+
+namespace DiffUtils
+{
+
+// Myers' O(ND) difference, in linear space (bisecting on the middle snake).  Lines are compared by hash, so the
+// caller hashes each line once and the diff never touches the text.  Hunks come back in order.
+std::vector<DiffHunk> DiffLines(const std::vector<uint64_t>& oldLines, const std::vector<uint64_t>& newLines);
+
+// The hash of one line; every line hash used for diffing comes from here, so buffers and files compare equal
+uint64_t HashLine(const char* pBegin, const char* pEnd);
+
+// A hash per line; a line includes its \n, and the last line is whatever follows the last \n
+void HashLines(const char* pBegin, const char* pEnd, std::vector<uint64_t>& hashes);
+
+} // DiffUtils
+} // Zep
@@ -0,0 +1,487 @@
+#include "encoding.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace Zep
+{
+namespace EncodingUtils
+{
+
+namespace
+{
+const size_t DetectSampleSize = 64 * 1024;
+const uint64_t HighBits = 0x8080808080808080ull;
+const uint32_t ReplacementChar = 0xFFFD;
+
+uint64_t Load64(const uint8_t* p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+bool HasZeroByte(uint64_t value)
+{
+    return ((value - 0x0101010101010101ull) & ~value & HighBits) != 0;
+}
+
+// Non zero bits in a UTF-16 code unit that isn't ASCII, for 4 units in stream order; copied into a word so that
+// it matches however the host lays out a load
+uint64_t Utf16NonAsciiMask(TextEncoding type)
+{
+    static const uint8_t le[8] = { 0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF };
+    static const uint8_t be[8] = { 0xFF, 0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF, 0x80 };
+    return Load64(type == TextEncoding::Utf16LE ? le : be);
+}
+
+uint8_t* WriteUtf8(uint32_t cp, uint8_t* pOut)
+{
+    if (cp < 0x80)
+    {
+        *pOut++ = uint8_t(cp);
+    }
+    else if (cp < 0x800)
+    {
+        *pOut++ = uint8_t(0xC0 | (cp >> 6));
+        *pOut++ = uint8_t(0x80 | (cp & 0x3F));
+    }
+    else if (cp < 0x10000)
+    {
+        *pOut++ = uint8_t(0xE0 | (cp >> 12));
+        *pOut++ = uint8_t(0x80 | ((cp >> 6) & 0x3F));
+        *pOut++ = uint8_t(0x80 | (cp & 0x3F));
+    }
+    else
+    {
+        *pOut++ = uint8_t(0xF0 | (cp >> 18));
+        *pOut++ = uint8_t(0x80 | ((cp >> 12) & 0x3F));
+        *pOut++ = uint8_t(0x80 | ((cp >> 6) & 0x3F));
+        *pOut++ = uint8_t(0x80 | (cp & 0x3F));
+    }
+    return pOut;
+}
+
+// The length of the UTF-8 sequence at p, and its code point; 0 if it isn't a valid one (or is cut off by pEnd)
+size_t ReadUtf8(const uint8_t* p, const uint8_t* pEnd, uint32_t& cp)
+{
+    auto c = p[0];
+    if (c < 0x80)
+    {
+        cp = c;
+        return 1;
+    }
+
+    size_t length;
+    uint8_t low = 0x80;
+    uint8_t high = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF)
+    {
+        length = 2;
+        cp = c & 0x1F;
+    }
+    else if (c >= 0xE0 && c <= 0xEF)
+    {
+        length = 3;
+        cp = c & 0x0F;
+        low = c == 0xE0 ? 0xA0 : 0x80;      // Overlong
+        high = c == 0xED ? 0x9F : 0xBF;     // Surrogates
+    }
+    else if (c >= 0xF0 && c <= 0xF4)
+    {
+        length = 4;
+        cp = c & 0x07;
+        low = c == 0xF0 ? 0x90 : 0x80;
+        high = c == 0xF4 ? 0x8F : 0xBF;     // Beyond U+10FFFF
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (size_t(pEnd - p) < length || p[1] < low || p[1] > high)
+    {
+        return 0;
+    }
+    for (size_t i = 1; i < length; i++)
+    {
+        if ((p[i] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+        cp = (cp << 6) | (p[i] & 0x3F);
+    }
+    return length;
+}
+
+// A sequence cut off by the end of a sample doesn't count against it
+bool IsValidUtf8(const uint8_t* p, const uint8_t* pEnd, bool sampled)
+{
+    while (p < pEnd)
+    {
+        if (pEnd - p >= 8 && (Load64(p) & HighBits) == 0)
+        {
+            p += 8;
+            continue;
+        }
+
+        uint32_t cp;
+        auto length = ReadUtf8(p, pEnd, cp);
+        if (length == 0)
+        {
+            return sampled && pEnd - p < 4;
+        }
+        p += length;
+    }
+    return true;
+}
+}
+
+FileEncoding Detect(const uint8_t* pBegin, const uint8_t* pEnd, size_t& bomSize)
+{
+    FileEncoding encoding;
+    bomSize = 0;
+
+    auto size = size_t(pEnd - pBegin);
+    if (size >= 3 && pBegin[0] == 0xEF && pBegin[1] == 0xBB && pBegin[2] == 0xBF)
+    {
+        encoding.bom = true;
+        bomSize = 3;
+        return encoding;
+    }
+    if (size >= 2 && ((pBegin[0] == 0xFF && pBegin[1] == 0xFE) || (pBegin[0] == 0xFE && pBegin[1] == 0xFF)))
+    {
+        encoding.type = pBegin[0] == 0xFF ? TextEncoding::Utf16LE : TextEncoding::Utf16BE;
+        encoding.bom = true;
+        bomSize = 2;
+        return encoding;
+    }
+
+    auto pSampleEnd = pBegin + std::min(size, DetectSampleSize);
+
+    // Mostly Latin script UTF-16 has a zero in the high byte of nearly every unit, and almost never in the low one
+    size_t evenZeros = 0;
+    size_t oddZeros = 0;
+    for (auto p = pBegin; p + 1 < pSampleEnd; p += 2)
+    {
+        evenZeros += p[0] == 0 ? 1 : 0;
+        oddZeros += p[1] == 0 ? 1 : 0;
+    }
+    auto units = size_t(pSampleEnd - pBegin) / 2;
+    if (oddZeros * 3 >= units && oddZeros > 0 && evenZeros * 16 <= oddZeros)
+    {
+        encoding.type = TextEncoding::Utf16LE;
+        return encoding;
+    }
+    if (evenZeros * 3 >= units && evenZeros > 0 && oddZeros * 16 <= evenZeros)
+    {
+        encoding.type = TextEncoding::Utf16BE;
+        return encoding;
+    }
+
+    if (!IsValidUtf8(pBegin, pSampleEnd, pSampleEnd != pEnd))
+    {
+        encoding.type = TextEncoding::Latin1;
+    }
+    return encoding;
+}
+
+const char* Name(const FileEncoding& encoding)
+{
+    switch (encoding.type)
+    {
+    case TextEncoding::Utf16LE:
+        return "utf-16le";
+    case TextEncoding::Utf16BE:
+        return "utf-16be";
+    case TextEncoding::Latin1:
+        return "latin1";
+    default:
+        return encoding.bom ? "utf-8 bom" : "utf-8";
+    }
+}
+
+const char* ByteOrderMark(const FileEncoding& encoding)
+{
+    if (!encoding.bom)
+    {
+        return "";
+    }
+
+    switch (encoding.type)
+    {
+    case TextEncoding::Utf8:
+        return "\xEF\xBB\xBF";
+    case TextEncoding::Utf16LE:
+        return "\xFF\xFE";
+    case TextEncoding::Utf16BE:
+        return "\xFE\xFF";
+    default:
+        return "";
+    }
+}
+
+void Utf8Decoder::Decode(const uint8_t* pBegin, const uint8_t* pEnd, std::vector<uint8_t>& out)
+{
+    switch (m_type)
+    {
+    case TextEncoding::Utf8:
+        out.insert(out.end(), pBegin, pEnd);
+        break;
+    case TextEncoding::Latin1:
+    {
+        // Each byte is its own code point; at most 3 bytes of UTF-8, for a NUL
+        auto start = out.size();
+        out.resize(start + size_t(pEnd - pBegin) * 3);
+        auto pOut = out.data() + start;
+        auto p = pBegin;
+        while (p < pEnd)
+        {
+            if (pEnd - p >= 8 && (Load64(p) & HighBits) == 0 && !HasZeroByte(Load64(p)))
+            {
+                memcpy(pOut, p, 8);
+                pOut += 8;
+                p += 8;
+                continue;
+            }
+            pOut = WriteUtf8(*p ? *p : ReplacementChar, pOut);
+            p++;
+        }
+        out.resize(size_t(pOut - out.data()));
+        break;
+    }
+    default:
+        DecodeUtf16(pBegin, pEnd, out);
+        break;
+    }
+}
+
+void Utf8Decoder::DecodeUtf16(const uint8_t* pBegin, const uint8_t* pEnd, std::vector<uint8_t>& out)
+{
+    const bool littleEndian = m_type == TextEncoding::Utf16LE;
+    const auto nonAscii = Utf16NonAsciiMask(m_type);
+    const int lowByte = littleEndian ? 0 : 1;
+
+    // At most 3 bytes of UTF-8 per unit, counting the one held over
+    auto start = out.size();
+    out.resize(start + (size_t(pEnd - pBegin) / 2 + 2) * 3);
+    auto pOut = out.data() + start;
+
+    auto unit = [&](uint32_t u)
+    {
+        if (m_highSurrogate)
+        {
+            if (u >= 0xDC00 && u <= 0xDFFF)
+            {
+                pOut = WriteUtf8(0x10000 + ((m_highSurrogate - 0xD800) << 10) + (u - 0xDC00), pOut);
+                m_highSurrogate = 0;
+                return;
+            }
+            pOut = WriteUtf8(ReplacementChar, pOut);
+            m_highSurrogate = 0;
+        }
+
+        if (u >= 0xD800 && u <= 0xDBFF)
+        {
+            m_highSurrogate = u;
+        }
+        else if ((u >= 0xDC00 && u <= 0xDFFF) || u == 0)
+        {
+            pOut = WriteUtf8(ReplacementChar, pOut);
+        }
+        else
+        {
+            pOut = WriteUtf8(u, pOut);
+        }
+    };
+
+    auto p = pBegin;
+    if (m_hasCarry && p < pEnd)
+    {
+        uint8_t bytes[2] = { m_carry, *p++ };
+        unit(littleEndian ? (bytes[0] | (bytes[1] << 8)) : ((bytes[0] << 8) | bytes[1]));
+        m_hasCarry = false;
+    }
+
+    while (pEnd - p >= 2)
+    {
+        // 8 ASCII units at a time; written out before we know there's no NUL among them, which has room to go back
+        // over one at a time
+        if (pEnd - p >= 16 && !m_highSurrogate && ((Load64(p) | Load64(p + 8)) & nonAscii) == 0)
+        {
+            for (int i = 0; i < 8; i++)
+            {
+                pOut[i] = p[i * 2 + lowByte];
+            }
+            if (!HasZeroByte(Load64(pOut)))
+            {
+                pOut += 8;
+                p += 16;
+                continue;
+            }
+        }
+
+        unit(littleEndian ? (p[0] | (p[1] << 8)) : ((p[0] << 8) | p[1]));
+        p += 2;
+    }
+
+    if (p < pEnd)
+    {
+        m_carry = *p;
+        m_hasCarry = true;
+    }
+    out.resize(size_t(pOut - out.data()));
+}
+
+void Utf8Decoder::Finish(std::vector<uint8_t>& out)
+{
+    if (m_highSurrogate || m_hasCarry)
+    {
+        uint8_t bytes[4];
+        out.insert(out.end(), bytes, WriteUtf8(ReplacementChar, bytes));
+    }
+    m_highSurrogate = 0;
+    m_hasCarry = false;
+}
+
+bool Encode(const FileEncoding& encoding, const uint8_t* pBegin, const uint8_t* pEnd, std::string& out)
+{
+    if (encoding.type == TextEncoding::Utf8)
+    {
+        out.append((const char*)pBegin, (const char*)pEnd);
+        return true;
+    }
+
+    const bool latin1 = encoding.type == TextEncoding::Latin1;
+    const bool littleEndian = encoding.type == TextEncoding::Utf16LE;
+    out.reserve(out.size() + size_t(pEnd - pBegin) * (latin1 ? 1 : 2));
+    bool converted = true;
+
+    auto writeUnit = [&](uint32_t u)
+    {
+        if (littleEndian)
+        {
+            out.push_back(char(u & 0xFF));
+            out.push_back(char(u >> 8));
+        }
+        else
+        {
+            out.push_back(char(u >> 8));
+            out.push_back(char(u & 0xFF));
+        }
+    };
+
+    auto p = pBegin;
+    while (p < pEnd)
+    {
+        if (pEnd - p >= 8 && (Load64(p) & HighBits) == 0)
+        {
+            if (latin1)
+            {
+                out.append((const char*)p, 8);
+            }
+            else
+            {
+                for (int i = 0; i < 8; i++)
+                {
+                    writeUnit(p[i]);
+                }
+            }
+            p += 8;
+            continue;
+        }
+
+        uint32_t cp;
+        auto length = ReadUtf8(p, pEnd, cp);
+        if (length == 0)
+        {
+            cp = latin1 ? *p : ReplacementChar;
+            converted = converted && latin1;
+            length = 1;
+        }
+        p += length;
+
+        if (latin1)
+        {
+            converted = converted && cp <= 0xFF;
+            out.push_back(cp <= 0xFF ? char(cp) : '?');
+        }
+        else if (cp >= 0x10000)
+        {
+            cp -= 0x10000;
+            writeUnit(0xD800 + (cp >> 10));
+            writeUnit(0xDC00 + (cp & 0x3FF));
+        }
+        else
+        {
+            writeUnit(cp);
+        }
+    }
+    return converted;
+}
+
+// One pass to see whether every \n here has its \r, and a second to take them off if so
+size_t ReadLineEnds(uint8_t* pText, size_t size, LineEndState& state, std::vector<long>& lineEnds)
+{
+    auto pEnd = pText + size;
+    if (state.format != LineEndFormat::Unix)
+    {
+        for (auto p = pText; (p = (uint8_t*)memchr(p, '\n', size_t(pEnd - p))) != nullptr; p++)
+        {
+            if (p == pText ? !state.afterCR : p[-1] != '\r')
+            {
+                state.format = LineEndFormat::Unix;
+                break;
+            }
+            state.format = LineEndFormat::Dos;
+        }
+    }
+    state.afterCR = size > 0 && pEnd[-1] == '\r';
+
+    if (state.format != LineEndFormat::Dos)
+    {
+        for (auto p = pText; (p = (uint8_t*)memchr(p, '\n', size_t(pEnd - p))) != nullptr;)
+        {
+            p++;
+            lineEnds.push_back(long(p - pText));
+        }
+        return size;
+    }
+
+    // Only the \r before a \n; one on its own stays
+    auto pWrite = pText;
+    for (auto pRead = pText; pRead < pEnd; pRead++)
+    {
+        if (*pRead == '\r' && pRead + 1 < pEnd && pRead[1] == '\n')
+        {
+            continue;
+        }
+        *pWrite++ = *pRead;
+        if (*pRead == '\n')
+        {
+            lineEnds.push_back(long(pWrite - pText));
+        }
+    }
+    return size_t(pWrite - pText);
+}
+
+void AppendUtf8(uint32_t cp, std::string& str)
+{
+    uint8_t bytes[4];
+    auto pEnd = WriteUtf8(cp, bytes);
+    str.append((const char*)bytes, pEnd - bytes);
+}
+
+size_t NextChar(const char* p, const char* pEnd, uint32_t& cp)
+{
+    auto length = ReadUtf8((const uint8_t*)p, (const uint8_t*)pEnd, cp);
+    if (length == 0)
+    {
+        cp = uint8_t(*p);
+        length = 1;
+    }
+    return length;
+}
+
+} // EncodingUtils
+} // Zep
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Zep
+{
+
+// The buffer always holds UTF-8; files can be in any of these
+enum class TextEncoding
+{
+    Utf8,
+    Utf16LE,
+    Utf16BE,
+    Latin1
+};
+
+struct FileEncoding
+{
+    TextEncoding type = TextEncoding::Utf8;
+    bool bom = false;       // The file started with a byte order mark, so it gets one when saved
+
+    // Plain UTF-8 files are read and written as they are
+    bool IsUtf8() const { return type == TextEncoding::Utf8 && !bom; }
+    bool operator==(const FileEncoding& rhs) const { return type == rhs.type && bom == rhs.bom; }
+    bool operator!=(const FileEncoding& rhs) const { return !(*this == rhs); }
+};
+
+// How a file's lines end.  A file is DOS when every line ends with \r\n: the \r come off as it is read, and go back on
+// as it is written.  Anything else is read as it is, \r and all, so it is written back unchanged
+enum class LineEndFormat
+{
+    Unknown,    // No line ends yet
+    Unix,
+    Dos
+};
+
+// How far reading a file's text, a piece at a time, has got
+struct LineEndState
+{
+    LineEndFormat format = LineEndFormat::Unknown;
+    bool afterCR = false;   // The last piece ended with a \r
+};
+
+namespace EncodingUtils
+{
+
+// Looks for a byte order mark, then guesses from the first 64KB: UTF-16 without a mark has a zero in most of its high
+// bytes; otherwise text that isn't valid UTF-8 is taken to be Latin-1.  bomSize is the number of bytes to skip.
+FileEncoding Detect(const uint8_t* pBegin, const uint8_t* pEnd, size_t& bomSize);
+
+const char* Name(const FileEncoding& encoding);
+// Empty if the file doesn't have one; a literal, so it can be handed straight to a FileWriter
+const char* ByteOrderMark(const FileEncoding& encoding);
+
+// Converts a file's text to UTF-8 a piece at a time, as it is read; a character split across two pieces is held
+// over to the next.  ASCII, the bulk of most text, is converted 8 bytes at a time.  The gap buffer's text ends at a
+// 0, so a NUL in the file becomes U+FFFD.
+class Utf8Decoder
+{
+public:
+    explicit Utf8Decoder(TextEncoding type = TextEncoding::Utf8) : m_type(type) {}
+
+    // Appends to out
+    void Decode(const uint8_t* pBegin, const uint8_t* pEnd, std::vector<uint8_t>& out);
+
+    // At the end of the file; a character still held over was cut off, and is appended as U+FFFD
+    void Finish(std::vector<uint8_t>& out);
+
+    TextEncoding GetType() const { return m_type; }
+
+private:
+    void DecodeUtf16(const uint8_t* pBegin, const uint8_t* pEnd, std::vector<uint8_t>& out);
+
+private:
+    TextEncoding m_type;
+    uint8_t m_carry = 0;            // The first byte of a UTF-16 code unit split across pieces
+    bool m_hasCarry = false;
+    uint32_t m_highSurrogate = 0;   // The first half of a surrogate pair
+};
+
+// Finds the line ends in the next piece of a file's text, appending the offset just past each \n to lineEnds, and takes
+// the \r off them in place while the file is still DOS; returns the size left.  A \r\n split between two pieces leaves
+// its \r at the end of the first, for the caller to take off.  The first \n that isn't part of a \r\n makes the file
+// Unix, and from then on nothing is taken off; any \r the caller took off earlier pieces need to go back.
+size_t ReadLineEnds(uint8_t* pText, size_t size, LineEndState& state, std::vector<long>& lineEnds);
+
+// A key's code point as UTF-8, appended to str
+void AppendUtf8(uint32_t cp, std::string& str);
+
+// The code point of the UTF-8 sequence at p, and its length; a byte that doesn't start a valid sequence is returned
+// as the code point of the same value, so Latin-1 text still reads a character at a time
+size_t NextChar(const char* p, const char* pEnd, uint32_t& cp);
+
+// UTF-8 to the file's encoding, appended to out; without the byte order mark.  Characters Latin-1 can't hold
+// become '?', and bytes that aren't valid UTF-8 become U+FFFD in UTF-16 (and are taken as Latin-1 in Latin-1);
+// either way we return false, as the text has been lost
+bool Encode(const FileEncoding& encoding, const uint8_t* pBegin, const uint8_t* pEnd, std::string& out);
+
+} // EncodingUtils
+} // Zep
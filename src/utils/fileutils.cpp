@@ -0,0 +1,587 @@
+#include "fileutils.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace Zep
+{
+namespace FileUtils
+{
+
+bool Exists(const std::string& path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0;
+}
+
+size_t Size(const std::string& path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+    {
+        return 0;
+    }
+    return size_t(info.st_size);
+}
+
+FileStamp GetStamp(const std::string& path)
+{
+    FileStamp stamp;
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+    {
+        return stamp;
+    }
+    stamp.size = uint64_t(info.st_size);
+#if defined(__linux__)
+    stamp.modified = int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+    stamp.modified = int64_t(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    stamp.modified = int64_t(info.st_mtime);
+#endif
+    return stamp;
+}
+
+bool HasOtherLinks(const std::string& path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && info.st_nlink > 1;
+}
+
+std::string Canonical(const std::string& path)
+{
+#ifdef _WIN32
+    char full[MAX_PATH];
+    auto length = GetFullPathNameA(path.c_str(), MAX_PATH, full, nullptr);
+    if (length == 0 || length >= MAX_PATH)
+    {
+        return path;
+    }
+    return std::string(full, length);
+#else
+    auto pReal = realpath(path.c_str(), nullptr);
+    if (!pReal)
+    {
+        return path;
+    }
+    std::string real(pReal);
+    free(pReal);
+    return real;
+#endif
+}
+
+#ifdef _WIN32
+
+void ListFiles(const std::string& directory, std::vector<std::string>& files)
+{
+    WIN32_FIND_DATAA data;
+    auto hFind = FindFirstFileA((directory + "\\*").c_str(), &data);
+    if (hFind == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    do
+    {
+        if (data.cFileName[0] == '.')
+        {
+            continue;
+        }
+        auto path = directory + "\\" + data.cFileName;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            ListFiles(path, files);
+        }
+        else
+        {
+            files.push_back(path);
+        }
+    } while (FindNextFileA(hFind, &data));
+    FindClose(hFind);
+}
+
+#else
+
+void ListFiles(const std::string& directory, std::vector<std::string>& files)
+{
+    auto pDir = opendir(directory.c_str());
+    if (!pDir)
+    {
+        return;
+    }
+
+    while (auto pEntry = readdir(pDir))
+    {
+        if (pEntry->d_name[0] == '.')
+        {
+            continue;
+        }
+        auto path = directory + "/" + pEntry->d_name;
+
+        // Not every file system fills in the type
+        bool isDirectory = pEntry->d_type == DT_DIR;
+        bool isFile = pEntry->d_type == DT_REG;
+        if (pEntry->d_type == DT_UNKNOWN || pEntry->d_type == DT_LNK)
+        {
+            struct stat info;
+            if (stat(path.c_str(), &info) == 0)
+            {
+                isDirectory = S_ISDIR(info.st_mode) && pEntry->d_type != DT_LNK;
+                isFile = S_ISREG(info.st_mode);
+            }
+        }
+
+        if (isDirectory)
+        {
+            ListFiles(path, files);
+        }
+        else if (isFile)
+        {
+            files.push_back(path);
+        }
+    }
+    closedir(pDir);
+}
+
+#endif
+
+bool Seek(FILE* pFile, uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(pFile, int64_t(offset), SEEK_SET) == 0;
+#else
+    return fseeko(pFile, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+#ifdef _WIN32
+
+bool ReadFile(const std::string& path, const std::function<uint8_t*(size_t)>& fnStorage, size_t& bytesRead)
+{
+    bytesRead = 0;
+    auto pFile = fopen(path.c_str(), "rb");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    struct _stat64 info;
+    if (_fstat64(_fileno(pFile), &info) != 0)
+    {
+        fclose(pFile);
+        return false;
+    }
+
+    auto size = size_t(info.st_size);
+    auto pData = fnStorage(size);
+    bytesRead = fread(pData, 1, size, pFile);
+    bool success = !ferror(pFile);
+    fclose(pFile);
+    return success;
+}
+
+FileWriter::~FileWriter()
+{
+    Close();
+}
+
+bool FileWriter::Open(const std::string& path)
+{
+    Close();
+    m_failed = false;
+    m_pFile = fopen(path.c_str(), "wb");
+    return m_pFile != nullptr;
+}
+
+bool FileWriter::Flush()
+{
+    for (int i = 0; i < m_spanCount && !m_failed; i++)
+    {
+        if (fwrite(m_spans[i].pData, 1, m_spans[i].size, m_pFile) != m_spans[i].size)
+        {
+            m_failed = true;
+        }
+    }
+    m_spanCount = 0;
+    return !m_failed;
+}
+
+bool FileWriter::Sync()
+{
+    if (!m_pFile || !Flush() || fflush(m_pFile) != 0 || _commit(_fileno(m_pFile)) != 0)
+    {
+        m_failed = true;
+    }
+    return !m_failed;
+}
+
+bool ReplaceFileAtomic(const std::string& from, const std::string& to)
+{
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
+bool FileWriter::Close()
+{
+    if (!m_pFile)
+    {
+        return false;
+    }
+    Flush();
+    if (fclose(m_pFile) != 0)
+    {
+        m_failed = true;
+    }
+    m_pFile = nullptr;
+    return !m_failed;
+}
+
+bool FileWriter::Write(const void* pData, size_t size)
+{
+    if (size == 0)
+    {
+        return !m_failed;
+    }
+    if (m_spanCount == MaxSpans)
+    {
+        Flush();
+    }
+    m_spans[m_spanCount++] = Span{ pData, size };
+    return !m_failed;
+}
+
+#else
+
+bool ReadFile(const std::string& path, const std::function<uint8_t*(size_t)>& fnStorage, size_t& bytesRead)
+{
+    bytesRead = 0;
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(file, &info) != 0)
+    {
+        close(file);
+        return false;
+    }
+
+    auto size = size_t(info.st_size);
+    auto pData = fnStorage(size);
+
+    // One read, unless the kernel hands it back in pieces (Linux caps a single read at 2GB)
+    bool success = true;
+    while (bytesRead < size)
+    {
+        auto count = read(file, pData + bytesRead, size - bytesRead);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            success = count == 0;
+            break;
+        }
+        bytesRead += size_t(count);
+    }
+    close(file);
+    return success;
+}
+
+FileWriter::~FileWriter()
+{
+    Close();
+}
+
+bool FileWriter::Open(const std::string& path)
+{
+    Close();
+    m_failed = false;
+    m_file = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    return m_file >= 0;
+}
+
+bool FileWriter::Flush()
+{
+    int first = 0;
+    while (first < m_spanCount && !m_failed)
+    {
+        auto written = writev(m_file, &m_spans[first], m_spanCount - first);
+        if (written < 0)
+        {
+            if (errno != EINTR)
+            {
+                m_failed = true;
+            }
+            continue;
+        }
+
+        // Partial writes: skip the spans that made it, and trim the one we stopped in
+        auto remaining = size_t(written);
+        while (first < m_spanCount && remaining >= m_spans[first].iov_len)
+        {
+            remaining -= m_spans[first].iov_len;
+            first++;
+        }
+        if (first < m_spanCount)
+        {
+            m_spans[first].iov_base = (uint8_t*)m_spans[first].iov_base + remaining;
+            m_spans[first].iov_len -= remaining;
+        }
+    }
+    m_spanCount = 0;
+    return !m_failed;
+}
+
+bool FileWriter::Sync()
+{
+    if (m_file < 0 || !Flush() || fsync(m_file) != 0)
+    {
+        m_failed = true;
+    }
+    return !m_failed;
+}
+
+bool ReplaceFileAtomic(const std::string& from, const std::string& to)
+{
+    struct stat info;
+    if (stat(to.c_str(), &info) == 0)
+    {
+        chmod(from.c_str(), info.st_mode & 07777);
+    }
+    if (rename(from.c_str(), to.c_str()) != 0)
+    {
+        return false;
+    }
+
+    // The rename is only durable once the directory holding it is
+    auto slash = to.find_last_of('/');
+    auto directory = slash == std::string::npos ? std::string(".") : (slash == 0 ? std::string("/") : to.substr(0, slash));
+    auto dir = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir < 0)
+    {
+        return false;
+    }
+    bool synced = fsync(dir) == 0;
+    close(dir);
+    return synced;
+}
+
+bool FileWriter::Close()
+{
+    if (m_file < 0)
+    {
+        return false;
+    }
+    Flush();
+    if (close(m_file) != 0)
+    {
+        m_failed = true;
+    }
+    m_file = -1;
+    return !m_failed;
+}
+
+bool FileWriter::Write(const void* pData, size_t size)
+{
+    if (size == 0)
+    {
+        return !m_failed;
+    }
+    if (m_spanCount == MaxSpans)
+    {
+        Flush();
+    }
+    m_spans[m_spanCount].iov_base = const_cast<void*>(pData);
+    m_spans[m_spanCount].iov_len = size;
+    m_spanCount++;
+    return !m_failed;
+}
+
+#endif
+
+FileNotifier::~FileNotifier()
+{
+#ifdef __linux__
+    if (m_file >= 0)
+    {
+        close(m_file);
+    }
+#endif
+}
+
+#ifdef __linux__
+
+// The instance is made with the first watch; if it can't be, it isn't tried again
+int FileNotifier::AddWatch(const std::string& path)
+{
+    if (m_file < 0 && !m_failed)
+    {
+        m_file = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        m_failed = m_file < 0;
+    }
+    if (m_file < 0)
+    {
+        return -1;
+    }
+
+    // A file already watched gets the same watch back
+    auto watch = inotify_add_watch(m_file, path.c_str(), IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF);
+    if (watch < 0)
+    {
+        return -1;
+    }
+    m_watches[watch].watchers++;
+    return watch;
+}
+
+void FileNotifier::RemoveWatch(int watch)
+{
+    auto itr = m_watches.find(watch);
+    if (itr == m_watches.end())
+    {
+        return;
+    }
+    if (--itr->second.watchers == 0)
+    {
+        // Fails harmlessly if the file has gone, and the watch with it
+        inotify_rm_watch(m_file, watch);
+        m_watches.erase(itr);
+    }
+}
+
+uint64_t FileNotifier::GetEventCount(int watch)
+{
+    ReadEvents();
+    auto itr = m_watches.find(watch);
+    return itr == m_watches.end() ? 0 : itr->second.events;
+}
+
+// One non blocking read when nothing has happened
+void FileNotifier::ReadEvents()
+{
+    if (m_file < 0)
+    {
+        return;
+    }
+
+    alignas(inotify_event) char events[4096];
+    ssize_t size;
+    while ((size = read(m_file, events, sizeof(events))) > 0)
+    {
+        for (auto p = events; p < events + size;)
+        {
+            auto pEvent = (const inotify_event*)p;
+            auto itr = m_watches.find(pEvent->wd);
+            if (itr != m_watches.end())
+            {
+                itr->second.events++;
+            }
+            p += sizeof(inotify_event) + pEvent->len;
+        }
+    }
+}
+
+#else
+
+int FileNotifier::AddWatch(const std::string&)
+{
+    return -1;
+}
+
+void FileNotifier::RemoveWatch(int)
+{
+}
+
+uint64_t FileNotifier::GetEventCount(int)
+{
+    return 0;
+}
+
+#endif
+
+FileWatcher::~FileWatcher()
+{
+    Stop();
+}
+
+bool FileWatcher::Watch(const std::string& path, std::shared_ptr<FileNotifier> spNotifier)
+{
+    Stop();
+    m_path = path;
+    m_stamp = GetStamp(path);
+    m_watching = Exists(path);
+    if (m_watching && spNotifier)
+    {
+        m_watch = spNotifier->AddWatch(path);
+        if (m_watch >= 0)
+        {
+            m_spNotifier = spNotifier;
+            m_events = m_spNotifier->GetEventCount(m_watch);
+        }
+    }
+    return m_watching;
+}
+
+void FileWatcher::Stop()
+{
+    if (m_spNotifier)
+    {
+        m_spNotifier->RemoveWatch(m_watch);
+        m_spNotifier.reset();
+    }
+    m_watch = -1;
+    m_watching = false;
+}
+
+// The events on our watch; without one, a stat of the file against the one from the last poll
+bool FileWatcher::Poll()
+{
+    if (!m_watching)
+    {
+        return false;
+    }
+
+    if (m_spNotifier)
+    {
+        auto events = m_spNotifier->GetEventCount(m_watch);
+        if (events == m_events)
+        {
+            return false;
+        }
+        m_events = events;
+        return true;
+    }
+
+    auto stamp = GetStamp(m_path);
+    if (stamp == m_stamp)
+    {
+        return false;
+    }
+    m_stamp = stamp;
+    return true;
+}
+
+} // FileUtils
+} // Zep
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+namespace Zep
+{
+namespace FileUtils
+{
+
+bool Exists(const std::string& path);
+size_t Size(const std::string& path);
+
+// Enough to tell whether a file has been changed: its size, and its modification time as precisely as we have it
+struct FileStamp
+{
+    uint64_t size = 0;
+    int64_t modified = 0;
+
+    bool operator==(const FileStamp& rhs) const { return size == rhs.size && modified == rhs.modified; }
+    bool operator!=(const FileStamp& rhs) const { return !(*this == rhs); }
+};
+FileStamp GetStamp(const std::string& path);
+
+// The absolute path, with links resolved where the platform can; so two paths to the same file compare the same.
+// The path as it is if that fails
+std::string Canonical(const std::string& path);
+
+// Every file under the directory, recursively; hidden files and directories (starting with a '.') are left out
+void ListFiles(const std::string& directory, std::vector<std::string>& files);
+
+// fseek that works past 2GB
+bool Seek(FILE* pFile, uint64_t offset);
+
+// True if the file has more than one hard link; replacing it would split it from the others
+bool HasOtherLinks(const std::string& path);
+
+// Renames from over to, atomically where the platform can, and syncs the directory so the rename survives a crash.
+// to keeps its permissions; it should be the real file, not a link to it, which the rename would replace
+bool ReplaceFileAtomic(const std::string& from, const std::string& to);
+
+// Reads the whole file with a single sized read.  fnStorage is called once with the file size, and returns
+// the memory to read into; so the caller can read straight into its own storage without another copy.
+// bytesRead can be less than the size passed to fnStorage if the file shrinks while we read it.
+bool ReadFile(const std::string& path, const std::function<uint8_t*(size_t)>& fnStorage, size_t& bytesRead);
+
+// Gathers spans of memory and writes them out in as few calls as possible (writev where we have it).
+// The spans are not copied; they must stay valid until the next Flush() or Close().
+class FileWriter
+{
+public:
+    FileWriter() = default;
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+    ~FileWriter();
+
+    bool Open(const std::string& path);
+    bool Write(const void* pData, size_t size);
+    bool Flush();
+    bool Sync();    // Flush, and wait for the data to reach the disk
+    bool Close();
+
+private:
+    static const int MaxSpans = 256;
+
+#ifdef _WIN32
+    FILE* m_pFile = nullptr;
+    struct Span
+    {
+        const void* pData;
+        size_t size;
+    };
+    Span m_spans[MaxSpans];
+#else
+    int m_file = -1;
+    iovec m_spans[MaxSpans];
+#endif
+    int m_spanCount = 0;
+    bool m_failed = false;
+};
+
+// One inotify instance for all of an editor's watchers, with a watch on each file; there are only a few instances to
+// go round (fs.inotify.max_user_instances is 128 by default).  Events are read for all the watches at once, and
+// counted for each.  Where there's no inotify, or it can't be had, there's nothing here and the watchers poll
+class FileNotifier
+{
+public:
+    FileNotifier() = default;
+    FileNotifier(const FileNotifier&) = delete;
+    FileNotifier& operator=(const FileNotifier&) = delete;
+    ~FileNotifier();
+
+    // The watch for the file, shared with any other watcher of it; -1 if it can't be watched
+    int AddWatch(const std::string& path);
+    void RemoveWatch(int watch);
+
+    // Events on the watch since it was added; they only ever go up
+    uint64_t GetEventCount(int watch);
+
+private:
+#ifdef __linux__
+    struct Watch
+    {
+        long watchers = 0;
+        uint64_t events = 0;
+    };
+
+    void ReadEvents();
+
+    int m_file = -1;
+    bool m_failed = false;
+    std::map<int, Watch> m_watches;
+#endif
+};
+
+// Tells us when a file has been written to.  Uses the notifier's watch where it can have one; otherwise each poll
+// compares the file's size and modification time with what they were at the last one
+class FileWatcher
+{
+public:
+    FileWatcher() = default;
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+    ~FileWatcher();
+
+    bool Watch(const std::string& path, std::shared_ptr<FileNotifier> spNotifier);
+    void Stop();
+
+    // True if the file may have changed since the last poll
+    bool Poll();
+
+private:
+    std::shared_ptr<FileNotifier> m_spNotifier;
+    int m_watch = -1;
+    uint64_t m_events = 0;
+
+    bool m_watching = false;
+    std::string m_path;
+    FileStamp m_stamp;
+};
+
+} // FileUtils
+} // Zep
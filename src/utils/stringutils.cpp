@@ -52,6 +52,39 @@ std::vector<std::string> SplitLines(const std::string& text)
     return Split(text, "\r\n");
 }
 
+void Split(const std::string& text, const std::string& delims, std::vector<std::string>& tokens)
+{
+    size_t count = 0;
+    auto addToken = [&](size_t start, size_t length)
+    {
+        if (count < tokens.size())
+        {
+            tokens[count].assign(text, start, length);
+        }
+        else
+        {
+            tokens.push_back(text.substr(start, length));
+        }
+        count++;
+    };
+
+    std::size_t start = text.find_first_not_of(delims), end = 0;
+    while ((end = text.find_first_of(delims, start)) != std::string::npos)
+    {
+        addToken(start, end - start);
+        start = text.find_first_not_of(delims, end);
+    }
+    if (start != std::string::npos)
+        addToken(start, std::string::npos);
+
+    tokens.resize(count);
+}
+
+void SplitLines(const std::string& text, std::vector<std::string>& lines)
+{
+    Split(text, "\r\n", lines);
+}
+
 // CM: I can't remember where this came from; please let me know if you do!
 // I know it is open source, but not sure who wrote it.
 uint32_t murmur_hash(const void * key, int len, uint32_t seed)
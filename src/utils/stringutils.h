@@ -34,6 +34,10 @@ std::string ReplaceString(std::string subject, const std::string& search, const
 std::vector<std::string> Split(const std::string& text, const std::string& delims);
 std::vector<std::string> SplitLines(const std::string& text);
 
+// As above, but filling an existing vector and reusing the storage of the strings already in it
+void Split(const std::string& text, const std::string& delims, std::vector<std::string>& tokens);
+void SplitLines(const std::string& text, std::vector<std::string>& lines);
+
 // trim from beginning of string (left)
 inline std::string& LTrim(std::string& s, const char* t = " \t\n\r\f\v")
 {
@@ -0,0 +1,119 @@
+#include "trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+namespace Zep
+{
+
+TraceRecorder& TraceRecorder::Instance()
+{
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+int64_t TraceRecorder::Now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TraceRecorder::Start()
+{
+    m_recording = true;
+}
+
+void TraceRecorder::Stop()
+{
+    m_recording = false;
+}
+
+void TraceRecorder::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_ringMutex);
+    for (auto& spRing : m_rings)
+    {
+        spRing->writeIndex = 0;
+    }
+}
+
+// The ring is created the first time a thread records, which is the only time we lock
+TraceRecorder::ThreadRing& TraceRecorder::GetThreadRing()
+{
+    thread_local ThreadRing* pRing = nullptr;
+    if (pRing == nullptr)
+    {
+        auto spRing = std::make_shared<ThreadRing>();
+        spRing->events.resize(RingSize);
+
+        std::lock_guard<std::mutex> lock(m_ringMutex);
+        spRing->threadId = uint32_t(m_rings.size() + 1);
+        m_rings.push_back(spRing);
+        pRing = spRing.get();
+    }
+    return *pRing;
+}
+
+void TraceRecorder::Record(const char* pszName, int64_t beginUs, int64_t endUs)
+{
+    auto& ring = GetThreadRing();
+    auto index = ring.writeIndex.load(std::memory_order_relaxed);
+
+    auto& ev = ring.events[index & (RingSize - 1)];
+    ev.pszName = pszName;
+    ev.beginUs = beginUs;
+    ev.durationUs = endUs - beginUs;
+
+    ring.writeIndex.store(index + 1, std::memory_order_release);
+}
+
+std::string TraceRecorder::GetChromeTrace() const
+{
+    std::ostringstream str;
+    str << "{\"traceEvents\":[";
+
+    bool first = true;
+    std::lock_guard<std::mutex> lock(m_ringMutex);
+    for (auto& spRing : m_rings)
+    {
+        auto count = spRing->writeIndex.load(std::memory_order_acquire);
+        auto start = count > RingSize ? count - RingSize : 0;
+        for (auto index = start; index < count; index++)
+        {
+            const auto& ev = spRing->events[index & (RingSize - 1)];
+            if (!first)
+            {
+                str << ",";
+            }
+            first = false;
+
+            str << "\n{\"name\":\"";
+            for (auto pCh = ev.pszName; *pCh; pCh++)
+            {
+                if (*pCh == '"' || *pCh == '\\')
+                {
+                    str << '\\';
+                }
+                str << *pCh;
+            }
+            str << "\",\"ph\":\"X\",\"ts\":" << ev.beginUs
+                << ",\"dur\":" << ev.durationUs
+                << ",\"pid\":1,\"tid\":" << spRing->threadId << "}";
+        }
+    }
+    str << "\n]}\n";
+    return str.str();
+}
+
+bool TraceRecorder::WriteChromeTrace(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::out | std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    file << GetChromeTrace();
+    return bool(file);
+}
+
+} // Zep
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Lightweight scoped trace events, written out in the Chrome trace format (load the file in chrome://tracing)
+// Each thread records into its own fixed size ring buffer, so the hot path takes no locks and never allocates.
+// The ZEP_TRACE_SCOPE markers only exist when the library is built with ZEP_TRACE=1; otherwise they compile away.
+namespace Zep
+{
+
+struct TraceEvent
+{
+    const char* pszName = nullptr;  // Must be a string literal; we only store the pointer
+    int64_t beginUs = 0;
+    int64_t durationUs = 0;
+};
+
+class TraceRecorder
+{
+public:
+    // Events per thread before the ring wraps and the oldest are overwritten
+    static const uint32_t RingSize = 1 << 16;
+
+    static TraceRecorder& Instance();
+    static int64_t Now();
+
+    void Start();
+    void Stop();
+    bool IsRecording() const { return m_recording.load(std::memory_order_relaxed); }
+    void Clear();
+
+    void Record(const char* pszName, int64_t beginUs, int64_t endUs);
+
+    // Stop() before writing to get a consistent snapshot
+    std::string GetChromeTrace() const;
+    bool WriteChromeTrace(const std::string& path) const;
+
+private:
+    struct ThreadRing
+    {
+        uint32_t threadId = 0;
+        std::atomic<uint64_t> writeIndex = { 0 };
+        std::vector<TraceEvent> events;
+    };
+
+    ThreadRing& GetThreadRing();
+
+    std::atomic<bool> m_recording = { false };
+    mutable std::mutex m_ringMutex;
+    std::vector<std::shared_ptr<ThreadRing>> m_rings;  // Kept alive after the owning thread exits
+};
+
+class TraceScope
+{
+public:
+    TraceScope(const char* pszName)
+        : m_pszName(pszName),
+        m_beginUs(TraceRecorder::Instance().IsRecording() ? TraceRecorder::Now() : -1)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (m_beginUs >= 0)
+        {
+            TraceRecorder::Instance().Record(m_pszName, m_beginUs, TraceRecorder::Now());
+        }
+    }
+
+private:
+    const char* m_pszName;
+    int64_t m_beginUs;
+};
+
+} // Zep
+
+#define ZEP_TRACE_CONCAT_INNER(a, b) a##b
+#define ZEP_TRACE_CONCAT(a, b) ZEP_TRACE_CONCAT_INNER(a, b)
+
+#if ZEP_TRACE
+#define ZEP_TRACE_SCOPE(name) Zep::TraceScope ZEP_TRACE_CONCAT(zepTraceScope_, __LINE__)(name)
+#else
+#define ZEP_TRACE_SCOPE(name)
+#endif
@@ -4,11 +4,15 @@
 #include "display.h"
 #include "window.h"
 #include "syntax.h"
+#include "binary_file.h"
 #include "buffer.h"
+#include "buffer_search.h"
+#include "file_pager.h"
 #include "mode.h"
 #include "theme.h"
 
 #include "utils/stringutils.h"
+#include "utils/trace.h"
 
 namespace Zep
 {
@@ -18,6 +22,20 @@ namespace
 const uint32_t Color_CursorNormal = 0xEEF35FBC;
 const uint32_t Color_CursorInsert = 0xFFFFFFFF;
 const float TabSize = 20.0f;
+
+// Diff gutter, a strip down the left of the line numbers
+const float DiffGutterWidth = 4.0f;
+const uint32_t Color_DiffAdded = 0xFF33AA33;
+const uint32_t Color_DiffRemoved = 0xFF3333CC;
+const uint32_t Color_DiffChanged = 0xFF22AACC;
+
+// Hex view
+const uint32_t Color_HexOffset = 0xFF888888;
+const uint32_t Color_HexZero = 0xFF666666;
+const uint32_t Color_HexModified = 0xFF33CCFF;
+
+// Behind matches of the search pattern
+const uint32_t Color_SearchMatch = 0xFF2E6E8E;
 }
 
 ZepWindow::ZepWindow(ZepDisplay& display)
@@ -92,7 +110,15 @@ void ZepWindow::Notify(std::shared_ptr<ZepMessage> payload)
             return;
         }
 
-        if (pMsg->type != BufferMessageType::PreBufferChange)
+        // A followed file keeps the view at the end, as long as the cursor is on the last line when text arrives
+        if (pMsg->type == BufferMessageType::PreBufferChange)
+        {
+            m_followTail = m_pCurrentBuffer->IsFollowing() &&
+                !visibleLines.empty() &&
+                pMsg->startLocation == long(m_pCurrentBuffer->GetText().size() - 1) &&
+                m_pCurrentBuffer->LineFromOffset(DisplayToBuffer()) == m_pCurrentBuffer->GetLineCount() - 1;
+        }
+        else
         {
             // Put the cursor where the replaced text was added
             if (pMsg->type == BufferMessageType::TextDeleted ||
@@ -106,6 +132,15 @@ void ZepWindow::Notify(std::shared_ptr<ZepMessage> payload)
                 {
                     cursorCL = BufferToDisplay(pMsg->cursorAfter);
                 }
+
+                if (pMsg->type == BufferMessageType::TextAdded && m_followTail)
+                {
+                    auto lastLine = m_pCurrentBuffer->GetLineCount() - 1;
+                    bufferCL.y = std::max(0l, m_pCurrentBuffer->GetLineCount() - long(visibleLines.size()));
+                    PreDisplay(m_windowRegion);
+                    cursorCL = BufferToDisplay(m_pCurrentBuffer->GetLinePos(lastLine, LineLocation::LineBegin));
+                    m_followTail = false;
+                }
                 m_display.ResetCursorTimer();
             }
         }
@@ -257,8 +292,52 @@ void ZepWindow::MoveCursorTo(const BufferLocation& location, LineLocation clampL
     MoveCursor(BufferToDisplay(location) - cursorCL, clampLocation);
 }
 
+// A paged buffer (or a hex view) only holds a window of the file's lines; when the cursor gets near either end
+// of it, slide the window so the cursor line is back in the middle
+void ZepWindow::UpdatePagedWindow(const NVec2i& target)
+{
+    auto fileLines = m_pCurrentBuffer->GetFileLineCount();
+    auto firstLine = m_pCurrentBuffer->GetFileFirstLine();
+    auto bufferLines = m_pCurrentBuffer->GetLineCount();
+    auto targetLine = bufferCL.y + target.y;
+    auto margin = long(visibleLines.size()) * 2;
+
+    bool nearTop = targetLine < margin && firstLine > 0;
+    bool nearBottom = targetLine > bufferLines - margin && firstLine + bufferLines < fileLines;
+    if (!nearTop && !nearBottom)
+    {
+        return;
+    }
+
+    // The window can hold fewer lines than it might, when they are long
+    m_pCurrentBuffer->SetFileWindow(firstLine + targetLine - bufferLines / 2);
+
+    // Keep the same file lines on screen
+    bufferCL.y -= m_pCurrentBuffer->GetFileFirstLine() - firstLine;
+    bufferCL.y = std::max(0l, bufferCL.y);
+    PreDisplay(m_windowRegion);
+}
+
+// For a paged buffer or a hex view, the window slides to the line first, and the line ends up mid screen
+void ZepWindow::MoveCursorToFileLine(long line)
+{
+    line = std::max(0l, std::min(line, m_pCurrentBuffer->GetFileLineCount() - 1));
+    if (m_pCurrentBuffer->IsPaged() || m_pCurrentBuffer->IsBinary())
+    {
+        m_pCurrentBuffer->SetFileWindow(line - m_pCurrentBuffer->GetLineCount() / 2);
+        line = std::min(line - m_pCurrentBuffer->GetFileFirstLine(), m_pCurrentBuffer->GetLineCount() - 1);
+        ScrollToLine(std::max(0l, line - long(visibleLines.size()) / 2));
+    }
+    MoveCursorTo(m_pCurrentBuffer->GetLinePos(line, LineLocation::LineBegin));
+}
+
 void ZepWindow::MoveCursor(const NVec2i& distance, LineLocation clampLocation)
 {
+    if (m_pCurrentBuffer->IsPaged() || m_pCurrentBuffer->IsBinary())
+    {
+        UpdatePagedWindow(cursorCL + distance);
+    }
+
     auto target = cursorCL + distance;
 
     // TODO: Add helpers for these conditions
@@ -301,6 +380,23 @@ void ZepWindow::MoveCursor(const NVec2i& distance, LineLocation clampLocation)
     m_display.ResetCursorTimer();
 }
 
+void ZepWindow::ScrollToLine(long line)
+{
+    if (!m_pCurrentBuffer)
+    {
+        return;
+    }
+    bufferCL.y = std::max(0l, std::min(line, m_pCurrentBuffer->GetLineCount() - 1));
+    PreDisplay(m_windowRegion);
+    ClampCursorToDisplay();
+}
+
+void ZepWindow::SetDiff(std::shared_ptr<ZepBufferDiff> spDiff, DiffSide side)
+{
+    m_spDiff = spDiff;
+    m_diffSide = side;
+}
+
 void ZepWindow::SetSelectionRange(const NVec2i& start, const NVec2i& end)
 {
     selection.startCL = start;
@@ -314,7 +410,7 @@ void ZepWindow::SetSelectionRange(const NVec2i& start, const NVec2i& end)
 
 void ZepWindow::SetStatusText(const std::string& strText)
 {
-    statusLines = StringUtils::SplitLines(strText);
+    StringUtils::SplitLines(strText, statusLines);
 }
 
 void ZepWindow::ClampCursorToDisplay()
@@ -326,14 +422,59 @@ void ZepWindow::ClampCursorToDisplay()
 
 void ZepWindow::PreDisplay(const DisplayRegion& region)
 {
+    ZEP_TRACE_SCOPE("ZepWindow::PreDisplay");
+
     m_windowRegion = region;
 
     // ** Temporary, status
     if (m_pCurrentBuffer)
     {
-        std::ostringstream str;
-        str << "(" << GetEditor().GetCurrentMode()->Name() << ") NORMAL" << " : " << int(m_pCurrentBuffer->GetLineEnds().size()) << " Lines";
-        SetStatusText(str.str());
+        // Built every frame; reuse the string rather than going through a stream
+        m_strStatus.assign("(");
+        m_strStatus.append(GetEditor().GetCurrentMode()->Name());
+        m_strStatus.append(") NORMAL : ");
+        m_strStatus.append(std::to_string(m_pCurrentBuffer->GetFileLineCount()));
+        m_strStatus.append(" Lines");
+        if (m_pCurrentBuffer->IsLoading())
+        {
+            m_strStatus.append(" (Loading ");
+            m_strStatus.append(std::to_string(int(m_pCurrentBuffer->GetLoadProgress() * 100.0f)));
+            m_strStatus.append("%)");
+        }
+        if (m_pCurrentBuffer->IsChangedOnDisk())
+        {
+            m_strStatus.append(" (Changed on disk)");
+        }
+        if (m_pCurrentBuffer->HasRecoveryJournal())
+        {
+            m_strStatus.append(" (Journal found)");
+        }
+        if (m_pCurrentBuffer->IsBinary())
+        {
+            m_strStatus.append(m_pCurrentBuffer->GetBinaryFile()->IsReadOnly() ? " (Binary, read only)" : " (Binary)");
+        }
+        if (!m_pCurrentBuffer->GetEncoding().IsUtf8())
+        {
+            m_strStatus.append(" [");
+            m_strStatus.append(EncodingUtils::Name(m_pCurrentBuffer->GetEncoding()));
+            m_strStatus.append("]");
+        }
+
+        // Which match the cursor is on, or after
+        const auto& search = m_pCurrentBuffer->GetSearch();
+        if (!search.IsComplete())
+        {
+            m_strStatus.append(" (Searching)");
+        }
+        else if (search.GetMatchCount() != 0)
+        {
+            m_strStatus.append(" (Match ");
+            m_strStatus.append(std::to_string(search.CountTo(DisplayToBuffer())));
+            m_strStatus.append(" of ");
+            m_strStatus.append(std::to_string(search.GetMatchCount()));
+            m_strStatus.append(")");
+        }
+        SetStatusText(m_strStatus);
     }
 
     auto statusCount = statusLines.size();
@@ -518,6 +659,33 @@ bool ZepWindow::DisplayLine(const LineInfo& lineInfo, const DisplayRegion& regio
 
     auto activeWindow = (m_display.GetCurrentWindow() == this);
 
+    // Mark lines that differ from the other side of the diff; a bar over a line shows where the other side has lines this one doesn't
+    auto showDiffGutter = [&]()
+    {
+        auto left = m_leftRegion.topLeftPx.x;
+        switch (m_spDiff->GetLineType(m_diffSide, lineInfo.lineNumber))
+        {
+        case DiffLineType::Added:
+            m_display.DrawRectFilled(NVec2f(left, lineInfo.screenPosYPx), NVec2f(left + DiffGutterWidth, lineInfo.screenPosYPx + m_display.GetFontSize()), Color_DiffAdded);
+            break;
+        case DiffLineType::Removed:
+            m_display.DrawRectFilled(NVec2f(left, lineInfo.screenPosYPx), NVec2f(left + DiffGutterWidth, lineInfo.screenPosYPx + m_display.GetFontSize()), Color_DiffRemoved);
+            break;
+        case DiffLineType::Changed:
+            m_display.DrawRectFilled(NVec2f(left, lineInfo.screenPosYPx), NVec2f(left + DiffGutterWidth, lineInfo.screenPosYPx + m_display.GetFontSize()), Color_DiffChanged);
+            break;
+        default:
+            break;
+        }
+
+        if (lineInfo.columnOffsets.x == m_pCurrentBuffer->GetLinePos(lineInfo.lineNumber, LineLocation::LineBegin) &&
+            m_spDiff->IsGapBefore(m_diffSide, lineInfo.lineNumber))
+        {
+            m_display.DrawRectFilled(NVec2f(left, lineInfo.screenPosYPx), NVec2f(m_leftRegion.bottomRightPx.x, lineInfo.screenPosYPx + 2.0f),
+                m_diffSide == DiffSide::Old ? Color_DiffAdded : Color_DiffRemoved);
+        }
+    };
+
     // Draw line numbers
     auto showLineNumber = [&]()
     {
@@ -538,6 +706,11 @@ bool ZepWindow::DisplayLine(const LineInfo& lineInfo, const DisplayRegion& regio
             NVec2f(m_leftRegion.bottomRightPx.x, lineInfo.screenPosYPx + m_display.GetFontSize()),
             0xFF222222);
 
+        if (m_spDiff)
+        {
+            showDiffGutter();
+        }
+
         auto digitCol = 0xFF11FF11;
         if (cursorCL.y == lineInfo.screenLineNumber)
         {
@@ -562,11 +735,52 @@ bool ZepWindow::DisplayLine(const LineInfo& lineInfo, const DisplayRegion& regio
 
     bool foundCursor = false;
 
+    // The hex view colours by column: dim offsets and zero bytes, and bright bytes that have been overwritten
+    auto pBinary = m_pCurrentBuffer->GetBinaryFile();
+    auto lineBegin = pBinary ? m_pCurrentBuffer->GetLinePos(lineInfo.lineNumber, LineLocation::LineBegin) : 0;
+    auto binaryColor = [&](long ch) -> uint32_t
+    {
+        if (ch - lineBegin < pBinary->GetOffsetDigits())
+        {
+            return Color_HexOffset;
+        }
+        auto offset = m_pCurrentBuffer->BinaryOffsetAt(ch);
+        if (offset >= 0 && pBinary->IsModified(uint64_t(offset)))
+        {
+            return Color_HexModified;
+        }
+        bool ascii;
+        bool high;
+        auto byte = pBinary->ByteAtColumn(int(ch - lineBegin), ascii, high);
+        if (offset >= 0 && !ascii)
+        {
+            auto hex = lineBegin + pBinary->HexColumn(byte);
+            if (m_pCurrentBuffer->GetText()[hex] == '0' && m_pCurrentBuffer->GetText()[hex + 1] == '0')
+            {
+                return Color_HexZero;
+            }
+        }
+        return 0xFFFFFFFF;
+    };
+
+    // Search matches are sorted, so walk along them with the line
+    const auto& search = m_pCurrentBuffer->GetSearch();
+    auto matchIndex = search.MatchesFrom(lineInfo.columnOffsets.x);
+    SearchMatch match = { -1, -1 };
+    if (matchIndex < search.GetMatchCount())
+    {
+        match = search.GetMatch(matchIndex);
+    }
+
     // Walk from the start of the line to the end of the line (in buffer chars)
     for (auto ch = lineInfo.columnOffsets.x; ch < lineInfo.columnOffsets.y; ch++)
     {
         auto pSyntax = m_pCurrentBuffer->GetSyntax();
         auto col = pSyntax != nullptr ? Theme::Instance().GetColor(pSyntax->GetSyntaxAt(ch)) : 0xFFFFFFFF;
+        if (pBinary && displayPass == WindowPass::Text)
+        {
+            col = binaryColor(ch);
+        }
         auto* pCh = &m_pCurrentBuffer->GetText()[ch];
         auto bufferLocation = DisplayToBuffer(NVec2i(ch - lineInfo.columnOffsets.x, lineInfo.screenLineNumber));
 
@@ -601,6 +815,15 @@ bool ZepWindow::DisplayLine(const LineInfo& lineInfo, const DisplayRegion& regio
 
         if (displayPass == 0)
         {
+            while (match.end >= 0 && match.end <= ch)
+            {
+                match = ++matchIndex < search.GetMatchCount() ? search.GetMatch(matchIndex) : SearchMatch{ -1, -1 };
+            }
+            if (match.end >= 0 && match.start <= ch)
+            {
+                m_display.DrawRectFilled(NVec2f(screenPosX, lineInfo.screenPosYPx), NVec2f(screenPosX + textSize.x, lineInfo.screenPosYPx + textSize.y), Color_SearchMatch);
+            }
+
             if (activeWindow)
             {
                 if (cursorMode == CursorMode::Visual)
@@ -667,6 +890,8 @@ bool ZepWindow::DisplayLine(const LineInfo& lineInfo, const DisplayRegion& regio
 
 void ZepWindow::Display()
 {
+    ZEP_TRACE_SCOPE("ZepWindow::Display");
+
     PreDisplay(m_windowRegion);
 
     auto activeWindow = (m_display.GetCurrentWindow() == this);
@@ -704,6 +929,18 @@ void ZepWindow::Display()
         }
     }
 
+    // Matches of the highlighted pattern: the visible lines are searched now, the rest of the buffer in the background
+    auto& search = m_pCurrentBuffer->GetSearch();
+    const auto& pattern = GetEditor().GetHighlightPattern();
+    if (pattern.empty())
+    {
+        search.Clear();
+    }
+    else if (!visibleLines.empty())
+    {
+        search.SetPattern(pattern, visibleLines.front().columnOffsets.x, visibleLines.back().columnOffsets.y);
+    }
+
     for (int displayPass = 0; displayPass < WindowPass::Max; displayPass++)
     {
         for (const auto& lineInfo : visibleLines)
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "buffer.h"
+#include "buffer_diff.h"
 
 namespace Zep
 {
@@ -91,6 +92,8 @@ public:
     BufferLocation DisplayToBuffer(const NVec2i& display) const;
 
     void MoveCursorTo(const BufferLocation& location, LineLocation clampLocation = LineLocation::LineLastNonCR);
+    // A line of the file, from 0, even when the buffer holds only a window of it; past the end is the last line
+    void MoveCursorToFileLine(long line);
 
     void MoveCursor(LineLocation location);
     void MoveCursor(const NVec2i& distance, LineLocation clampLocation = LineLocation::LineLastNonCR);
@@ -131,6 +134,14 @@ public:
     void SetWindowFlags(uint32_t windowFlags) { m_windowFlags = windowFlags; }
     uint32_t GetWindowFlags() const { return m_windowFlags;  }
 
+    // Show one side of a diff in the left region
+    void SetDiff(std::shared_ptr<ZepBufferDiff> spDiff, DiffSide side);
+    ZepBufferDiff* GetDiff() const { return m_spDiff.get(); }
+    DiffSide GetDiffSide() const { return m_diffSide; }
+
+    // Put the buffer line at the top of the view, keeping the cursor on screen
+    void ScrollToLine(long line);
+
     // TODO: Fix this; used to be a struct, now members
 public:
     ZepDisplay& m_display;                     // Display that owns this window
@@ -155,6 +166,7 @@ public:
 
     // Visual stuff
     std::vector<std::string> statusLines;         // Status information, shown under the buffer
+    std::string m_strStatus;                      // Scratch space for building the status text
     std::vector<LineInfo> visibleLines;           // Information about the currently displayed lines 
 
     static const int CursorMax = std::numeric_limits<int>::max();
@@ -166,7 +178,12 @@ public:
 
     uint32_t m_windowFlags = WindowFlags::None;
 private:
+    void UpdatePagedWindow(const NVec2i& target);
+
     NVec2i cursorCL;                              // Position of Cursor in line/column (display coords)
+    bool m_followTail = false;                    // Scroll to the end when text is appended to a followed file
+    std::shared_ptr<ZepBufferDiff> m_spDiff;      // Diff this window is showing a side of
+    DiffSide m_diffSide = DiffSide::Old;
 };
 
 } // Zep
@@ -0,0 +1,73 @@
+#include "alloc_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+// Plain old data, so it is usable before any constructors have run
+thread_local uint64_t t_allocationCount = 0;
+
+void* CountedAlloc(std::size_t size)
+{
+    t_allocationCount++;
+    if (size == 0)
+    {
+        size = 1;
+    }
+    return std::malloc(size);
+}
+}
+
+namespace Zep
+{
+uint64_t GetThreadAllocationCount()
+{
+    return t_allocationCount;
+}
+} // Zep
+
+void* operator new(std::size_t size)
+{
+    auto p = CountedAlloc(size);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return CountedAlloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return CountedAlloc(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+// Test only: the unittests target replaces the global operator new, so that tests can check
+// a code path does not touch the heap.  Counts are per thread; work done on the thread pool is not included.
+namespace Zep
+{
+
+uint64_t GetThreadAllocationCount();
+
+class ScopedAllocationCounter
+{
+public:
+    ScopedAllocationCounter()
+        : m_start(GetThreadAllocationCount())
+    {
+    }
+
+    // Allocations made on this thread since the counter was created
+    uint64_t GetCount() const { return GetThreadAllocationCount() - m_start; }
+
+private:
+    uint64_t m_start;
+};
+
+} // Zep
@@ -3,7 +3,9 @@ FILE(GLOB_RECURSE FOUND_TEST_SOURCES "*.test.cpp")
 
 LIST(APPEND TEST_SOURCES
     ${FOUND_TEST_SOURCES}
+    tests/alloc_counter.cpp
     tests/main.cpp
+    tests/temp_dir.cpp
 )
 
 
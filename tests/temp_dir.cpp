@@ -0,0 +1,160 @@
+#include "temp_dir.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Zep
+{
+
+namespace
+{
+#ifdef _WIN32
+
+std::string MakeUniqueDirectory()
+{
+    char temp[MAX_PATH];
+    auto length = GetTempPathA(MAX_PATH, temp);
+    auto base = std::string(temp, length) + "zep_test_" + std::to_string(GetCurrentProcessId()) + "_";
+    for (unsigned int attempt = GetTickCount();; attempt++)
+    {
+        auto path = base + std::to_string(attempt);
+        if (_mkdir(path.c_str()) == 0)
+        {
+            return path;
+        }
+    }
+}
+
+void RemoveAll(const std::string& path)
+{
+    WIN32_FIND_DATAA data;
+    auto hFind = FindFirstFileA((path + "\\*").c_str(), &data);
+    if (hFind != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            std::string name = data.cFileName;
+            if (name == "." || name == "..")
+            {
+                continue;
+            }
+            auto child = path + "\\" + name;
+            if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                RemoveAll(child);
+            }
+            else
+            {
+                DeleteFileA(child.c_str());
+            }
+        } while (FindNextFileA(hFind, &data));
+        FindClose(hFind);
+    }
+    RemoveDirectoryA(path.c_str());
+}
+
+#else
+
+std::string MakeUniqueDirectory()
+{
+    auto pTemp = getenv("TMPDIR");
+    std::string pattern = std::string(pTemp && *pTemp ? pTemp : "/tmp") + "/zep_test_XXXXXX";
+    std::vector<char> path(pattern.begin(), pattern.end());
+    path.push_back(0);
+    if (!mkdtemp(path.data()))
+    {
+        return std::string();
+    }
+    return path.data();
+}
+
+// Links are removed, not followed
+void RemoveAll(const std::string& path)
+{
+    if (auto pDir = opendir(path.c_str()))
+    {
+        while (auto pEntry = readdir(pDir))
+        {
+            std::string name = pEntry->d_name;
+            if (name == "." || name == "..")
+            {
+                continue;
+            }
+            auto child = path + "/" + name;
+            struct stat info;
+            if (lstat(child.c_str(), &info) == 0 && S_ISDIR(info.st_mode))
+            {
+                RemoveAll(child);
+            }
+            else
+            {
+                unlink(child.c_str());
+            }
+        }
+        closedir(pDir);
+    }
+    rmdir(path.c_str());
+}
+
+#endif
+}
+
+ScopedTempDir::ScopedTempDir()
+    : m_path(MakeUniqueDirectory())
+{
+}
+
+ScopedTempDir::~ScopedTempDir()
+{
+    if (!m_path.empty())
+    {
+        RemoveAll(m_path);
+    }
+}
+
+std::string ScopedTempDir::GetFile(const std::string& name) const
+{
+    return m_path + "/" + name;
+}
+
+std::string ScopedTempDir::Write(const std::string& name, const std::string& contents) const
+{
+    auto path = GetFile(name);
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    file << contents;
+    return path;
+}
+
+std::string ScopedTempDir::Append(const std::string& name, const std::string& contents) const
+{
+    auto path = GetFile(name);
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::app);
+    file << contents;
+    return path;
+}
+
+std::string ScopedTempDir::MakeDirectory(const std::string& name) const
+{
+    auto path = GetFile(name);
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0777);
+#endif
+    return path;
+}
+
+} // Zep
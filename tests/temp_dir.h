@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+// Test only: a directory of its own for a test's files, under the system's temp directory; so tests don't write into
+// the working directory, or trip over each other's files.  It is removed, with everything in it, when it goes.
+namespace Zep
+{
+
+class ScopedTempDir
+{
+public:
+    ScopedTempDir();
+    ~ScopedTempDir();
+    ScopedTempDir(const ScopedTempDir&) = delete;
+    ScopedTempDir& operator=(const ScopedTempDir&) = delete;
+
+    const std::string& GetPath() const { return m_path; }
+
+    // The path of a file or directory in it, which needn't exist
+    std::string GetFile(const std::string& name) const;
+
+    // Write the file, replacing what was there, or add to the end of it; they return its path
+    std::string Write(const std::string& name, const std::string& contents) const;
+    std::string Append(const std::string& name, const std::string& contents) const;
+    std::string MakeDirectory(const std::string& name) const;
+
+private:
+    std::string m_path;
+};
+
+} // Zep